@@ -0,0 +1,924 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Benchmark of the handlers without the kernel.
+ *
+ * Generates synthetic documents of several shapes and sizes, loads 
+ * them as at mounting and calls the handlers directly from several 
+ * threads, taking the lock as the FUSE callbacks do. Throughput and
+ * tail latency of every operation are printed as a JSON document,
+ * so the results of two builds can be compared by a script. 
+ * With the arena, the memory of every loaded tree is also reported 
+ * without and with -o intern.
+ *
+ * Usage: jsonfs_bench [-s sizes] [-t threads] [-n ops] [-d dir] [-m]
+ * - -s comma separated sizes of the documents (default 1000,10000,100000),
+ * - -t comma separated numbers of threads (default 1,2,4),
+ * - -n number of operations of each run (default 20000),
+ * - -d directory with ex_obj.json and ex_arr.json (default test),
+ * - -m allocate the tree with malloc() instead of the arena.
+ */
+
+#define FUSE_USE_VERSION 35
+
+#include <jansson.h>
+#include <fuse.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <limits.h>
+
+#include "common.h"
+#include "jsonfs.h"
+#include "handlers.h"
+#include "json_operations.h"
+#include "arena.h"
+
+/**
+ * @def MAX_LIST
+ * @brief Largest number of sizes or thread counts given with an option.
+ */
+#define MAX_LIST		16
+
+/**
+ * @def ROUNDS
+ * @brief Number of the repetitions of loading and saving.
+ */
+#define ROUNDS			3
+
+/**
+ * @def READ_SIZE
+ * @brief Size of the buffer of a read.
+ */
+#define READ_SIZE		(64 * 1024)
+
+/**
+ * @def DEEP_LEVELS
+ * @brief Depth of the deep document.
+ */
+#define DEEP_LEVELS		32
+
+/**
+ * @def RECORD_FIELDS
+ * @brief Number of the keys of every element of the array of records.
+ */
+#define RECORD_FIELDS	20
+
+/**
+ * @def COUNT_STRINGS
+ * @brief Number of the values of the document of large strings.
+ */
+#define COUNT_STRINGS	8
+
+/* ================================= */
+/*               Types               */
+/* ================================= */
+
+/**
+ * @enum bench_op
+ * @brief Operations run from several threads.
+ */
+enum bench_op {
+	OP_LOOKUP,
+	OP_GETATTR,
+	OP_READ,
+	OP_READDIR,
+	OP_WRITE,
+	OP_MKNOD,
+	OP_RENAME,
+	OP_RM,
+	COUNT_OPS
+};
+
+static const char *op_names[COUNT_OPS] = {
+	"lookup", "getattr", "read", "readdir", "write", "mknod", "rename", "rm"
+};
+
+/**
+ * @struct path_list
+ * @brief Paths of the files or directories of a document.
+ */
+struct path_list {
+	char **paths;
+	size_t count;
+	size_t cap;
+};
+
+/**
+ * @struct bench_run
+ * @brief Run of an operation, shared by its threads.
+ */
+struct bench_run {
+	struct jsonfs_private_data *pd;
+	enum bench_op op;
+	const struct path_list *files;
+	const struct path_list *dirs;
+	size_t ops_per_thread;
+};
+
+/**
+ * @struct bench_worker
+ * @brief Thread of a run and the latencies it measured.
+ */
+struct bench_worker {
+	pthread_t thread;
+	const struct bench_run *run;
+	int id;
+	uint64_t *samples;		/**< Latency of every operation in nanoseconds */
+	size_t errors;			/**< Number of the failed operations */
+};
+
+/**
+ * @struct bench_doc
+ * @brief Shape of the generated documents.
+ */
+struct bench_doc {
+	const char *name;
+	json_t *(*make)(size_t size, json_t *template);
+	const char *template_file;	/**< File the records are copied from, may be NULL */
+};
+
+/**
+ * @struct bench_result
+ * @brief Summary of the latencies of a run.
+ */
+struct bench_result {
+	size_t ops;
+	size_t errors;
+	double seconds;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t p999;
+	uint64_t max;
+};
+
+static int is_first_result = 1;
+
+/* ================================= */
+/*             Documents             */
+/* ================================= */
+
+/**
+ * @brief Makes an object with the given number of scalar keys.
+ */
+static json_t *make_wide(size_t size, json_t *template)
+{
+	char key[SHRT_SIZE];
+	json_t *doc = json_object();
+	(void) template;
+
+	CHECK_POINTER(doc, NULL);
+
+	for (size_t i = 0; i < size; i++) {
+		snprintf(key, sizeof(key), "k%zu", i);
+		json_object_set_new(doc, key, i % 2 ? json_integer((json_int_t) i)
+											: json_string("value"));
+	}
+
+	return doc;
+}
+
+/**
+ * @brief Makes a chain of DEEP_LEVELS objects with the scalars spread over them.
+ */
+static json_t *make_deep(size_t size, json_t *template)
+{
+	char key[SHRT_SIZE];
+	json_t *doc = NULL;
+	json_t *level = NULL;
+	size_t per_level = size / DEEP_LEVELS + 1;
+	(void) template;
+
+	for (int depth = DEEP_LEVELS - 1; depth >= 0; depth--) {
+		level = json_object();
+		if (!level) {
+			json_decref(doc);
+			return NULL;
+		}
+
+		for (size_t i = 0; i < per_level; i++) {
+			snprintf(key, sizeof(key), "v%zu", i);
+			json_object_set_new(level, key, json_integer((json_int_t) i));
+		}
+
+		if (doc) { json_object_set_new(level, "d", doc); }
+		doc = level;
+	}
+
+	return doc;
+}
+
+/**
+ * @brief Makes an object of records copied from an object template.
+ */
+static json_t *make_records(size_t size, json_t *template)
+{
+	char key[SHRT_SIZE];
+	json_t *doc = json_object();
+
+	CHECK_POINTER(doc, NULL);
+
+	for (size_t i = 0; i < size; i++) {
+		snprintf(key, sizeof(key), "r%zu", i);
+		json_object_set_new(doc, key, json_deep_copy(template));
+	}
+
+	return doc;
+}
+
+/**
+ * @brief Makes an array of the elements of an array template, repeated.
+ */
+static json_t *make_array(size_t size, json_t *template)
+{
+	json_t *doc = json_array();
+	size_t count = json_array_size(template);
+
+	CHECK_POINTER(doc, NULL);
+	if (!count) { return doc; }
+
+	for (size_t i = 0; i < size; i++) {
+		json_array_append_new(doc, 
+							  json_deep_copy(json_array_get(template, 
+															i % count)));
+	}
+
+	return doc;
+}
+
+/**
+ * @brief Makes an array of records with the same RECORD_FIELDS keys.
+ * 
+ * A record has a unique id and name, the other fields take a few values 
+ * each, as the columns of a table do.
+ */
+static json_t *make_record_array(size_t size, json_t *template)
+{
+	static const char *states[] = { "active", "blocked", "pending", "deleted" };
+	char key[SHRT_SIZE];
+	char name[SHRT_SIZE];
+	json_t *doc = json_array();
+	json_t *record = NULL;
+	(void) template;
+
+	CHECK_POINTER(doc, NULL);
+
+	for (size_t i = 0; i < size; i++) {
+		record = json_object();
+		if (!record) {
+			json_decref(doc);
+			return NULL;
+		}
+
+		snprintf(name, sizeof(name), "user%zu", i);
+		json_object_set_new(record, "id", json_integer((json_int_t) i));
+		json_object_set_new(record, "name", json_string(name));
+		json_object_set_new(record, "state", json_string(states[i % 4]));
+		json_object_set_new(record, "is_admin", json_boolean(i % 50 == 0));
+		json_object_set_new(record, "score", json_real((double) (i % 10) / 2));
+		for (int f = 5; f < RECORD_FIELDS; f++) {
+			snprintf(key, sizeof(key), "field%d", f);
+			json_object_set_new(record, key, 
+								json_integer((json_int_t) ((i + f) % 8)));
+		}
+
+		json_array_append_new(doc, record);
+	}
+
+	return doc;
+}
+
+/**
+ * @brief Makes an object of COUNT_STRINGS strings of 8 * size bytes each.
+ */
+static json_t *make_strings(size_t size, json_t *template)
+{
+	char key[SHRT_SIZE];
+	char *text = NULL;
+	json_t *doc = json_object();
+	(void) template;
+
+	CHECK_POINTER(doc, NULL);
+
+	text = malloc(size * 8 + 1);
+	if (!text) {
+		json_decref(doc);
+		return NULL;
+	}
+	memset(text, 'x', size * 8);
+	text[size * 8] = '\0';
+
+	for (int i = 0; i < COUNT_STRINGS; i++) {
+		snprintf(key, sizeof(key), "s%d", i);
+		json_object_set_new(doc, key, json_string(text));
+	}
+
+	free(text);
+	return doc;
+}
+
+static const struct bench_doc docs[] = {
+	{ "wide", make_wide, NULL },
+	{ "deep", make_deep, NULL },
+	{ "records", make_records, "ex_obj.json" },
+	{ "array", make_array, "ex_arr.json" },
+	{ "record_array", make_record_array, NULL },
+	{ "strings", make_strings, NULL }
+};
+
+#define COUNT_DOCS	(sizeof(docs) / sizeof(docs[0]))
+
+/* ================================= */
+/*               Paths               */
+/* ================================= */
+
+static int add_path(struct path_list *list, const char *path)
+{
+	char **res_realloc = NULL;
+	size_t new_cap;
+
+	if (list->count == list->cap) {
+		new_cap = list->cap ? list->cap * 2 : BIG_SIZE;
+		res_realloc = realloc(list->paths, new_cap * sizeof(char *));
+		CHECK_POINTER(res_realloc, -1);
+		list->paths = res_realloc;
+		list->cap = new_cap;
+	}
+
+	list->paths[list->count] = strdup(path);
+	CHECK_POINTER(list->paths[list->count], -1);
+	list->count++;
+
+	return 0;
+}
+
+static void free_paths(struct path_list *list)
+{
+	for (size_t i = 0; i < list->count; i++) {
+		free(list->paths[i]);
+	}
+	free(list->paths);
+	memset(list, 0, sizeof(struct path_list));
+}
+
+/**
+ * @brief Collects the paths of the files and directories of a normalized tree.
+ * 
+ * @param node Node of the path.
+ * @param path Path of the node, it is extended and restored.
+ * @param len Length of the path.
+ */
+static int collect_paths(json_t *node, char *path, size_t len,
+						 struct path_list *files, struct path_list *dirs)
+{
+	const char *key = NULL;
+	json_t *child = NULL;
+	size_t key_len;
+
+	if (!json_is_object(node)) {
+		return add_path(files, path);
+	}
+
+	if (add_path(dirs, len ? path : "/") < 0) { return -1; }
+
+	json_object_foreach(node, key, child) {
+		key_len = strlen(key);
+		if (len + key_len + 2 > PATH_MAX) { continue; }
+
+		path[len] = '/';
+		memcpy(path + len + 1, key, key_len + 1);
+		if (collect_paths(child, path, len + key_len + 1, files, dirs) < 0) {
+			return -1;
+		}
+		path[len] = '\0';
+	}
+
+	return 0;
+}
+
+/* ================================= */
+/*              Running              */
+/* ================================= */
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static int count_entry(void *buffer, const char *name, const struct stat *st,
+					   off_t offset, enum fuse_fill_dir_flags flags)
+{
+	(void) name;
+	(void) st;
+	(void) offset;
+	(void) flags;
+
+	(*(size_t *) buffer)++;
+	return 0;
+}
+
+/**
+ * @brief Picks a random path of the list.
+ */
+static const char *pick_path(const struct path_list *list, uint64_t *seed)
+{
+	/* xorshift64 */
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+
+	return list->paths[*seed % list->count];
+}
+
+/**
+ * @brief Runs one operation, the lock is taken as by the FUSE callbacks.
+ * @return Result of the handler.
+ */
+static int run_op(const struct bench_run *run, int id, size_t index,
+				  uint64_t *seed, char *buffer)
+{
+	struct jsonfs_private_data *pd = run->pd;
+	struct dir_cursor *cursor = NULL;
+	struct stat st;
+	char path[MID_SIZE];
+	char new_path[MID_SIZE];
+	const char *picked = NULL;
+	size_t count_entries = 0;
+	int res = 0;
+
+	snprintf(path, sizeof(path), "/bench_%d_%zu", id, index);
+	snprintf(new_path, sizeof(new_path), "/bench_%d_%zu_r", id, index);
+
+	pthread_mutex_lock(&pd->lock);
+	switch (run->op) {
+		case OP_LOOKUP:
+			/* Resolving the path alone, as every handler starts with */
+			res = find_json_node(pick_path(run->files, seed), pd->root) 
+				  ? 0 : -ENOENT;
+			break;
+		case OP_GETATTR:
+			res = getattr_json_file(pick_path(run->files, seed), &st, pd);
+			break;
+		case OP_READ:
+			res = read_json_file(pick_path(run->files, seed), buffer, 
+								 READ_SIZE, 0, pd);
+			break;
+		case OP_READDIR:
+			picked = pick_path(run->dirs, seed);
+			res = open_json_dir(picked, &cursor, pd);
+			if (!res) {
+				res = read_json_dir(picked, &count_entries, count_entry, 0, 
+									0, cursor, pd);
+				release_json_dir(cursor);
+			}
+			break;
+		case OP_WRITE:
+			/* As echo does: open with O_TRUNC and write */
+			picked = pick_path(run->files, seed);
+			res = trunc_json_file(picked, 0, pd);
+			if (!res) { res = write_json_file(picked, "12345", 5, 0, pd); }
+			break;
+		case OP_MKNOD:
+			res = make_file(path, S_IFREG | 0644, pd);
+			break;
+		case OP_RENAME:
+			res = rename_file(path, new_path, pd);
+			break;
+		case OP_RM:
+			res = rm_file(new_path, S_IFREG, pd);
+			break;
+		default:
+			res = -EINVAL;
+	}
+	pthread_mutex_unlock(&pd->lock);
+
+	return res;
+}
+
+static void *run_worker(void *arg)
+{
+	struct bench_worker *worker = arg;
+	const struct bench_run *run = worker->run;
+	uint64_t seed = 0x9E3779B97F4A7C15ULL * (uint64_t) (worker->id + 1);
+	uint64_t start;
+	char *buffer = malloc(READ_SIZE);
+
+	if (!buffer) {
+		worker->errors = run->ops_per_thread;
+		return NULL;
+	}
+
+	for (size_t i = 0; i < run->ops_per_thread; i++) {
+		start = get_time();
+		if (run_op(run, worker->id, i, &seed, buffer) < 0) { worker->errors++; }
+		worker->samples[i] = get_time() - start;
+	}
+
+	free(buffer);
+	return NULL;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * @brief Gives the total time of the operations in seconds.
+ */
+static double sum_samples(const uint64_t *samples, size_t count)
+{
+	uint64_t sum = 0;
+
+	for (size_t i = 0; i < count; i++) { sum += samples[i]; }
+
+	return sum / 1e9;
+}
+
+/**
+ * @brief Sorts the latencies and takes their percentiles.
+ */
+static void summarize(uint64_t *samples, size_t count, size_t errors, 
+					  double seconds, struct bench_result *result)
+{
+	qsort(samples, count, sizeof(uint64_t), compare_samples);
+
+	result->ops = count;
+	result->errors = errors;
+	result->seconds = seconds;
+	result->p50 = count ? samples[count / 2] : 0;
+	result->p99 = count ? samples[count * 99 / 100] : 0;
+	result->p999 = count ? samples[count * 999 / 1000] : 0;
+	result->max = count ? samples[count - 1] : 0;
+}
+
+static void print_result(const char *doc, size_t size, const char *op,
+						 int threads, const struct bench_result *result)
+{
+	printf("%s\n{\"doc\":\"%s\",\"size\":%zu,\"op\":\"%s\",\"threads\":%d,"
+		   "\"ops\":%zu,\"errors\":%zu,\"seconds\":%.6f,\"ops_per_sec\":%.1f,"
+		   "\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}",
+		   is_first_result ? "" : ",", doc, size, op, threads, result->ops, 
+		   result->errors, result->seconds, 
+		   result->seconds > 0 ? result->ops / result->seconds : 0.0,
+		   (unsigned long long) result->p50, (unsigned long long) result->p99,
+		   (unsigned long long) result->p999, (unsigned long long) result->max);
+	is_first_result = 0;
+}
+
+/**
+ * @brief Runs an operation from the given number of threads.
+ * @return 0 on success, -1 on failure.
+ */
+static int run_threads(const struct bench_run *run, int threads,
+					   struct bench_result *result)
+{
+	struct bench_worker *workers = NULL;
+	uint64_t *samples = NULL;
+	size_t errors = 0;
+	uint64_t start;
+	double seconds;
+	int started = 0;
+
+	workers = calloc(threads, sizeof(struct bench_worker));
+	samples = malloc(threads * run->ops_per_thread * sizeof(uint64_t) + 1);
+	if (!workers || !samples) { goto handle_error; }
+
+	start = get_time();
+	for (started = 0; started < threads; started++) {
+		workers[started].run = run;
+		workers[started].id = started;
+		workers[started].samples = samples + started * run->ops_per_thread;
+		if (pthread_create(&workers[started].thread, NULL, run_worker, 
+						   &workers[started])) {
+			break;
+		}
+	}
+	for (int i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		errors += workers[i].errors;
+	}
+	seconds = (get_time() - start) / 1e9;
+	if (started < threads) { goto handle_error; }
+
+	summarize(samples, threads * run->ops_per_thread, errors, seconds, result);
+
+	free(samples);
+	free(workers);
+	return 0;
+
+	handle_error:
+		free(samples);
+		free(workers);
+		return -1;
+}
+
+/**
+ * @brief Loads a document file as at mounting.
+ * @param pool Pool of the shared scalars, NULL without -o intern.
+ * @return Normalized tree or NULL on failure.
+ */
+static json_t *load_document(const char *file, struct json_pool *pool)
+{
+	json_t *root = NULL;
+	json_t *norm_root = NULL;
+
+	root = json_load_file(file, JSON_DECODE_ANY, NULL);
+	CHECK_POINTER(root, NULL);
+
+	norm_root = normalize_json(root, 1, pool);
+	json_decref(root);
+	return norm_root;
+}
+
+/**
+ * @brief Prints the memory of the loaded tree without and with -o intern.
+ * 
+ * The bytes in use of the arena are taken before loading and after 
+ * the pool is destroyed, as at mounting, so only the tree is counted.
+ * 
+ * @return 0 on success, -1 on failure.
+ */
+static int print_memory(const char *doc, size_t size, const char *file)
+{
+	struct arena_stats before;
+	struct arena_stats after;
+	struct json_pool *pool = NULL;
+	json_t *norm_root = NULL;
+	size_t bytes[2];
+	size_t count_shared = 0;
+	size_t count_objects = 0;
+
+	for (int is_intern = 0; is_intern < 2; is_intern++) {
+		if (is_intern) {
+			pool = create_json_pool();
+			CHECK_POINTER(pool, -1);
+		}
+
+		get_arena_stats(&before);
+		norm_root = load_document(file, pool);
+		if (pool) { 
+			count_shared = pool->count_shared; 
+			count_objects = pool->count_objects;
+		}
+		destroy_json_pool(pool);
+		pool = NULL;
+		get_arena_stats(&after);
+		CHECK_POINTER(norm_root, -1);
+
+		bytes[is_intern] = after.bytes_in_use - before.bytes_in_use;
+		json_decref(norm_root);
+	}
+
+	printf("%s\n{\"doc\":\"%s\",\"size\":%zu,\"op\":\"memory\","
+		   "\"bytes_in_use\":%zu,\"bytes_in_use_intern\":%zu,"
+		   "\"shared_scalars\":%zu,\"shared_objects\":%zu}",
+		   is_first_result ? "" : ",", doc, size, bytes[0], bytes[1], 
+		   count_shared, count_objects);
+	is_first_result = 0;
+
+	return 0;
+}
+
+/**
+ * @brief Benchmarks all operations on a document.
+ * @return 0 on success, -1 on failure.
+ */
+static int bench_document(const struct bench_doc *doc, size_t size, 
+						  json_t *template, const int *threads, 
+						  int count_threads, size_t ops)
+{
+	char file[] = "/tmp/jsonfs_bench_XXXXXX";
+	char *path = NULL;
+	json_t *source = NULL;
+	json_t *norm_root = NULL;
+	struct jsonfs_private_data *pd = NULL;
+	struct path_list files = { NULL, 0, 0 };
+	struct path_list dirs = { NULL, 0, 0 };
+	struct bench_run run;
+	struct bench_result result;
+	uint64_t samples[ROUNDS];
+	uint64_t start;
+	int fd;
+	int ret = -1;
+
+	fd = mkstemp(file);
+	if (fd < 0) { return -1; }
+	close(fd);
+
+	source = doc->make(size, template);
+	if (!source || json_dump_file(source, file, JSON_COMPACT) < 0) { 
+		goto handle_error; 
+	}
+	json_decref(source);
+	source = NULL;
+
+	/* Loading keeps the tree of the last round */
+	for (int i = 0; i < ROUNDS; i++) {
+		json_decref(norm_root);
+		start = get_time();
+		norm_root = load_document(file, NULL);
+		samples[i] = get_time() - start;
+		if (!norm_root) { goto handle_error; }
+	}
+	summarize(samples, ROUNDS, 0, sum_samples(samples, ROUNDS), &result);
+	print_result(doc->name, size, "load", 1, &result);
+
+	if (json_arena_is_used() && print_memory(doc->name, size, file) < 0) {
+		goto handle_error;
+	}
+
+	pd = init_private_data(norm_root, file);
+	if (!pd) { goto handle_error; }
+	norm_root = NULL;
+
+	path = calloc(1, PATH_MAX);
+	if (!path || collect_paths(pd->root, path, 0, &files, &dirs) < 0) {
+		goto handle_error;
+	}
+
+	for (int t = 0; t < count_threads; t++) {
+		run.pd = pd;
+		run.files = &files;
+		run.dirs = &dirs;
+		run.ops_per_thread = ops / threads[t] ? ops / threads[t] : 1;
+
+		for (int op = 0; op < COUNT_OPS; op++) {
+			if (!files.count && (op == OP_LOOKUP || op == OP_GETATTR 
+								 || op == OP_READ || op == OP_WRITE)) {
+				continue;
+			}
+
+			run.op = op;
+			if (run_threads(&run, threads[t], &result) < 0) { 
+				goto handle_error; 
+			}
+			print_result(doc->name, size, op_names[op], threads[t], &result);
+		}
+	}
+
+	for (int i = 0; i < ROUNDS; i++) {
+		start = get_time();
+		write_special_file("/.save", "1", 1, 0, pd);
+		samples[i] = get_time() - start;
+	}
+	summarize(samples, ROUNDS, 0, sum_samples(samples, ROUNDS), &result);
+	print_result(doc->name, size, "save", 1, &result);
+
+	ret = 0;
+
+	handle_error:
+		json_decref(source);
+		json_decref(norm_root);
+		destroy_private_data(pd);
+		free_paths(&files);
+		free_paths(&dirs);
+		free(path);
+		unlink(file);
+		return ret;
+}
+
+/* ================================= */
+/*                Main               */
+/* ================================= */
+
+/**
+ * @brief Parses a comma separated list of positive numbers.
+ * @return Number of the values, 0 on failure.
+ */
+static int parse_list(const char *text, size_t *values)
+{
+	char *end = NULL;
+	int count = 0;
+
+	while (*text && count < MAX_LIST) {
+		values[count] = strtoul(text, &end, 10);
+		if (end == text || !values[count]) { return 0; }
+		count++;
+
+		if (*end == ',') { end++; }
+		else if (*end) { return 0; }
+		text = end;
+	}
+
+	return count;
+}
+
+int main(int argc, char **argv)
+{
+	size_t sizes[MAX_LIST] = { 1000, 10000, 100000 };
+	size_t values[MAX_LIST];
+	int threads[MAX_LIST] = { 1, 2, 4 };
+	int count_sizes = 3;
+	int count_threads = 3;
+	size_t ops = 20000;
+	const char *dir = "test";
+	char file[PATH_MAX];
+	json_t *template = NULL;
+	int use_arena = 1;
+	int opt;
+	int ret = EXIT_SUCCESS;
+
+	while ((opt = getopt(argc, argv, "s:t:n:d:m")) != -1) {
+		switch (opt) {
+			case 's':
+				count_sizes = parse_list(optarg, sizes);
+				if (!count_sizes) { goto handle_usage; }
+				break;
+			case 't':
+				count_threads = parse_list(optarg, values);
+				if (!count_threads) { goto handle_usage; }
+				for (int i = 0; i < count_threads; i++) {
+					threads[i] = (int) values[i];
+				}
+				break;
+			case 'n':
+				ops = strtoul(optarg, NULL, 10);
+				if (!ops) { goto handle_usage; }
+				break;
+			case 'd':
+				dir = optarg;
+				break;
+			case 'm':
+				use_arena = 0;
+				break;
+			default:
+				goto handle_usage;
+		}
+	}
+
+	if (use_arena && init_json_arena() < 0) {
+		fputs("jsonfs_bench: failed to initialize the arena\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	printf("{\"config\":{\"ops\":%zu,\"arena\":%s},\n\"results\":[", 
+		   ops, use_arena ? "true" : "false");
+
+	for (size_t d = 0; d < COUNT_DOCS; d++) {
+		template = NULL;
+		if (docs[d].template_file) {
+			snprintf(file, sizeof(file), "%s/%s", dir, docs[d].template_file);
+			template = json_load_file(file, 0, NULL);
+			if (!template) {
+				fprintf(stderr, "jsonfs_bench: %s is skipped, "
+						"%s is not found\n", docs[d].name, file);
+				continue;
+			}
+		}
+
+		for (int s = 0; s < count_sizes; s++) {
+			fprintf(stderr, "jsonfs_bench: %s, size %zu\n", docs[d].name, 
+					sizes[s]);
+			if (bench_document(&docs[d], sizes[s], template, threads,
+							   count_threads, ops) < 0) {
+				fprintf(stderr, "jsonfs_bench: %s of size %zu failed\n",
+						docs[d].name, sizes[s]);
+				ret = EXIT_FAILURE;
+			}
+		}
+
+		json_decref(template);
+	}
+
+	printf("\n]}\n");
+
+	if (use_arena) { release_json_arena(); }
+	return ret;
+
+	handle_usage:
+		fprintf(stderr, "Usage: %s [-s sizes] [-t threads] [-n ops] "
+				"[-d dir] [-m]\n", argv[0]);
+		return EXIT_FAILURE;
+}
@@ -0,0 +1,755 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Replay of the requests recorded with -o record=FILE.
+ *
+ * Loads the document as at mounting and calls the handlers in the 
+ * order of the record, choosing them as the FUSE callbacks do. 
+ * The written data is not recorded, so a write gets a JSON value 
+ * of the recorded size. The document is saved to a temporary file,
+ * never to the original one. The latencies of the replay and of 
+ * the recording are printed as a JSON document.
+ *
+ * Usage: jsonfs_replay [-p] document.json record
+ * - -p keep the recorded pauses between the requests, 
+ *   by default the requests are replayed one after another.
+ */
+
+#define FUSE_USE_VERSION 35
+
+#include <jansson.h>
+#include <fuse.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "common.h"
+#include "jsonfs.h"
+#include "handlers.h"
+#include "json_operations.h"
+#include "arena.h"
+#include "stats.h"
+#include "record.h"
+
+/* ================================= */
+/*               Types               */
+/* ================================= */
+
+/**
+ * @struct sample_list
+ * @brief Latencies of an operation in nanoseconds.
+ */
+struct sample_list {
+	uint64_t *samples;
+	size_t count;
+	size_t cap;
+};
+
+/**
+ * @struct op_result
+ * @brief Summary of the replay of an operation.
+ */
+struct op_result {
+	struct sample_list replayed;
+	struct sample_list recorded;
+	size_t errors;			/**< Requests failed in the replay */
+	size_t mismatches;		/**< Requests with a result other than recorded */
+	size_t skipped;			/**< Requests that are not replayed */
+};
+
+/**
+ * @struct open_handle
+ * @brief File buffer or directory cursor opened for a recorded handle.
+ */
+struct open_handle {
+	uint64_t recorded_fh;
+	void *handle;
+	int is_dir;		/**< The handle is a struct dir_cursor */
+};
+
+/**
+ * @struct replay_state
+ * @brief Document and handles of the replay.
+ */
+struct replay_state {
+	struct jsonfs_private_data *pd;
+	struct open_handle *handles;
+	size_t count_handles;
+	size_t cap_handles;
+	char *buffer;			/**< Buffer of reads and synthetic writes */
+	size_t buffer_size;
+};
+
+/* ================================= */
+/*              Helpers              */
+/* ================================= */
+
+static int add_sample(struct sample_list *list, uint64_t sample)
+{
+	uint64_t *res_realloc = NULL;
+	size_t new_cap;
+
+	if (list->count == list->cap) {
+		new_cap = list->cap ? list->cap * 2 : BIG_SIZE;
+		res_realloc = realloc(list->samples, new_cap * sizeof(uint64_t));
+		CHECK_POINTER(res_realloc, -1);
+		list->samples = res_realloc;
+		list->cap = new_cap;
+	}
+
+	list->samples[list->count++] = sample;
+	return 0;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * @brief Sorts the latencies and takes a percentile.
+ */
+static uint64_t get_percentile(struct sample_list *list, int percent)
+{
+	if (!list->count) { return 0; }
+
+	qsort(list->samples, list->count, sizeof(uint64_t), compare_samples);
+	return list->samples[list->count * percent / 100];
+}
+
+/**
+ * @brief Gives a buffer of at least the given size.
+ */
+static char *get_buffer(struct replay_state *state, size_t size)
+{
+	char *res_realloc = NULL;
+
+	if (size > state->buffer_size) {
+		res_realloc = realloc(state->buffer, size);
+		CHECK_POINTER(res_realloc, NULL);
+		state->buffer = res_realloc;
+		state->buffer_size = size;
+	}
+
+	return state->buffer;
+}
+
+/**
+ * @brief Makes the data of a write: a number of one byte 
+ * or a string of the given size.
+ */
+static char *make_payload(struct replay_state *state, size_t size)
+{
+	char *data = get_buffer(state, size ? size : 1);
+
+	CHECK_POINTER(data, NULL);
+
+	if (size == 1) {
+		data[0] = '0';
+	}
+	else if (size > 1) {
+		memset(data, 'x', size);
+		data[0] = '"';
+		data[size - 1] = '"';
+	}
+
+	return data;
+}
+
+static int add_handle(struct replay_state *state, uint64_t recorded_fh, 
+					  void *handle, int is_dir)
+{
+	struct open_handle *res_realloc = NULL;
+	size_t new_cap;
+
+	if (state->count_handles == state->cap_handles) {
+		new_cap = state->cap_handles ? state->cap_handles * 2 : SHRT_SIZE;
+		res_realloc = realloc(state->handles, 
+							  new_cap * sizeof(struct open_handle));
+		CHECK_POINTER(res_realloc, -1);
+		state->handles = res_realloc;
+		state->cap_handles = new_cap;
+	}
+
+	state->handles[state->count_handles].recorded_fh = recorded_fh;
+	state->handles[state->count_handles].handle = handle;
+	state->handles[state->count_handles].is_dir = is_dir;
+	state->count_handles++;
+
+	return 0;
+}
+
+/**
+ * @brief Finds the handle opened for a recorded one.
+ * 
+ * @param remove Forget the handle, it is being released.
+ * 
+ * @return The handle, NULL if it is not opened.
+ */
+static void *find_handle(struct replay_state *state, uint64_t recorded_fh,
+						 int remove)
+{
+	void *handle = NULL;
+
+	if (!recorded_fh) { return NULL; }
+
+	/* Few files are open at once, the last opened are searched first */
+	for (size_t i = state->count_handles; i-- > 0; ) {
+		if (state->handles[i].recorded_fh != recorded_fh) { continue; }
+
+		handle = state->handles[i].handle;
+		if (remove) {
+			state->handles[i] = state->handles[--state->count_handles];
+		}
+		return handle;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Releases the handles left open by the record and the buffers.
+ */
+static void release_state(struct replay_state *state)
+{
+	for (size_t i = 0; i < state->count_handles; i++) {
+		if (state->handles[i].is_dir) {
+			release_json_dir(state->handles[i].handle);
+		}
+		else {
+			release_file_buffer(state->handles[i].handle);
+		}
+	}
+
+	free(state->handles);
+	free(state->buffer);
+	destroy_private_data(state->pd);
+	memset(state, 0, sizeof(struct replay_state));
+}
+
+static int count_entry(void *buffer, const char *name, const struct stat *st,
+					   off_t offset, enum fuse_fill_dir_flags flags)
+{
+	(void) name;
+	(void) st;
+	(void) offset;
+	(void) flags;
+
+	(*(size_t *) buffer)++;
+	return 0;
+}
+
+/* ================================= */
+/*              Replaying            */
+/* ================================= */
+
+static int replay_read(struct replay_state *state, 
+					   const struct record_entry *entry)
+{
+	struct jsonfs_private_data *pd = state->pd;
+	struct file_buffer *fb = find_handle(state, entry->args.fh, 0);
+	char *buffer = get_buffer(state, entry->args.size ? entry->args.size : 1);
+
+	CHECK_POINTER(buffer, -ENOMEM);
+
+	if (fb && !fb->is_raw) {
+		return read_file_buffer(fb, buffer, entry->args.size, 
+								entry->args.offset);
+	}
+	if (is_special_file(entry->path)) {
+		return read_special_file(entry->path, buffer, entry->args.size,
+								 entry->args.offset, pd);
+	}
+	return read_json_file(entry->path, buffer, entry->args.size, 
+						  entry->args.offset, pd);
+}
+
+static int replay_read_buf(struct replay_state *state, 
+						   const struct record_entry *entry)
+{
+	struct fuse_bufvec *bufv = NULL;
+	int res_read;
+
+	if (is_special_file(entry->path) || entry->args.fh) {
+		return replay_read(state, entry);
+	}
+
+	res_read = read_json_buf(entry->path, &bufv, entry->args.size, 
+							 entry->args.offset, state->pd);
+	if (res_read < 0) { return res_read; }
+
+	/* The callback gives 0 and FUSE sends the data of the vector */
+	free(bufv->buf[0].mem);
+	free(bufv);
+	return res_read;
+}
+
+static int replay_write(struct replay_state *state, 
+						const struct record_entry *entry)
+{
+	struct jsonfs_private_data *pd = state->pd;
+	struct file_buffer *fb = find_handle(state, entry->args.fh, 0);
+	char *data = make_payload(state, entry->args.size);
+	struct fuse_bufvec bufv = FUSE_BUFVEC_INIT(entry->args.size);
+	int is_changed = 0;
+	int res_write;
+
+	CHECK_POINTER(data, -ENOMEM);
+
+	if (fb && strcmp("/.ctl", entry->path) == 0) {
+		res_write = write_ctl_file(fb, data, entry->args.size,
+								   entry->args.offset, &is_changed, pd);
+		if (is_changed) { pd->is_saved = 0; }
+		return res_write;
+	}
+	if (fb && fb->is_raw) {
+		bufv.buf[0].mem = data;
+		res_write = write_raw_file(entry->path, fb, &bufv, entry->args.offset,
+								   pd);
+		if (res_write >= 0) { pd->is_saved = 0; }
+		return res_write;
+	}
+	if (fb) {
+		return write_file_buffer(fb, data, entry->args.size, 
+								 entry->args.offset);
+	}
+	if (strcmp("/.ctl", entry->path) == 0) {
+		res_write = write_ctl_commands(data, entry->args.size, &is_changed, pd);
+		if (is_changed) { pd->is_saved = 0; }
+		return res_write;
+	}
+	if (is_special_file(entry->path)) {
+		res_write = write_special_file(entry->path, data, entry->args.size,
+									   entry->args.offset, pd);
+		if (res_write >= 0) { pd->is_saved = 1; }
+		return res_write;
+	}
+
+	res_write = write_json_file(entry->path, data, entry->args.size, 
+								entry->args.offset, pd);
+	if (res_write >= 0) { pd->is_saved = 0; }
+	return res_write;
+}
+
+static int replay_write_buf(struct replay_state *state, 
+							const struct record_entry *entry)
+{
+	struct fuse_bufvec bufv;
+	char *data = NULL;
+	int res_write;
+
+	if (is_special_file(entry->path) || entry->args.fh) {
+		return replay_write(state, entry);
+	}
+
+	data = make_payload(state, entry->args.size);
+	CHECK_POINTER(data, -ENOMEM);
+
+	bufv = (struct fuse_bufvec) FUSE_BUFVEC_INIT(entry->args.size);
+	bufv.buf[0].mem = data;
+
+	res_write = write_json_buf(entry->path, &bufv, entry->args.offset, 
+							   state->pd);
+	if (res_write >= 0) { state->pd->is_saved = 0; }
+	return res_write;
+}
+
+static int replay_open(struct replay_state *state, 
+					   const struct record_entry *entry)
+{
+	struct jsonfs_private_data *pd = state->pd;
+	struct file_buffer *fb = NULL;
+	const char *path = entry->path;
+	int flags = (int) entry->args.flags;
+	int res_open;
+
+	if (strcmp("/.patch", path) == 0) {
+		res_open = open_patch_file(flags, &fb, pd);
+	}
+	else if (strcmp("/.ctl", path) == 0 && (flags & O_ACCMODE) != O_RDONLY) {
+		res_open = open_ctl_file(&fb);
+	}
+	else if (strcmp("/.stats", path) == 0 
+			 || strcmp("/.stats.prom", path) == 0
+			 || strcmp("/.trace", path) == 0
+			 || strcmp("/.hot", path) == 0) {
+		res_open = open_snapshot_file(path, flags, &fb, pd);
+	}
+	else if (find_subtree_dir(path, pd->root)) {
+		res_open = open_subtree_file(path, flags, &fb, pd);
+	}
+	else if (pd->opts.raw_strings && (flags & O_ACCMODE) != O_RDONLY
+			 && json_is_string(find_json_node(path, pd->root))) {
+		res_open = open_raw_file(path, flags, &fb, pd);
+	}
+	else {
+		if ((flags & O_TRUNC) == O_TRUNC) { trunc_json_file(path, 0, pd); }
+		res_open = 0;
+	}
+
+	if (!res_open && fb && add_handle(state, entry->args.fh, fb, 0) < 0) {
+		release_file_buffer(fb);
+		return -ENOMEM;
+	}
+
+	return res_open;
+}
+
+static int replay_flush(struct replay_state *state, 
+						const struct record_entry *entry)
+{
+	struct file_buffer *fb = find_handle(state, entry->args.fh, 0);
+	int res_flush;
+
+	if (!fb) { return 0; }
+
+	if (strcmp("/.patch", entry->path) == 0) {
+		res_flush = flush_patch_file(fb, state->pd);
+	}
+	else if (strcmp("/.ctl", entry->path) == 0) {
+		res_flush = flush_ctl_file(fb, state->pd);
+	}
+	else if (is_special_file(entry->path) 
+			 || find_subtree_dir(entry->path, state->pd->root)) {
+		res_flush = flush_subtree_file(entry->path, fb, state->pd);
+	}
+	else {
+		res_flush = flush_raw_file(entry->path, fb, state->pd);
+	}
+	if (res_flush > 0) { state->pd->is_saved = 0; }
+
+	return res_flush;
+}
+
+/**
+ * @brief Replays a request as the FUSE callback would handle it.
+ * 
+ * @param skipped[out] Set if the request is not replayed.
+ * 
+ * @return Result of the handler.
+ */
+static int replay_request(struct replay_state *state, 
+						  const struct record_entry *entry, int *skipped)
+{
+	struct jsonfs_private_data *pd = state->pd;
+	const char *path = entry->path;
+	struct dir_cursor *cursor = NULL;
+	struct file_buffer *fb = NULL;
+	struct stat st;
+	size_t count_entries = 0;
+	char *buffer = NULL;
+	int res;
+
+	memset(&st, 0, sizeof(struct stat));
+	*skipped = 0;
+
+	switch (entry->op) {
+		case STATS_GETATTR:
+			if (is_special_file(path)) { 
+				return getattr_special_file(path, &st, pd); 
+			}
+			if (find_subtree_dir(path, pd->root)) { 
+				return getattr_subtree_file(path, &st, pd); 
+			}
+			return getattr_json_file(path, &st, pd);
+		case STATS_MKNOD:
+		case STATS_MKDIR:
+			res = make_file(path, (mode_t) entry->args.flags, pd);
+			if (!res) { pd->is_saved = 0; }
+			return res;
+		case STATS_UNLINK:
+		case STATS_RMDIR:
+			res = rm_file(path, entry->op == STATS_UNLINK ? S_IFREG : S_IFDIR,
+						  pd);
+			if (!res) { pd->is_saved = 0; }
+			return res;
+		case STATS_RENAME:
+			if (!entry->args.path2) { break; }
+			res = rename_file(path, entry->args.path2, pd);
+			if (!res) { pd->is_saved = 0; }
+			return res;
+		case STATS_TRUNCATE:
+			fb = find_handle(state, entry->args.fh, 0);
+			if (fb && fb->is_raw) {
+				res = trunc_raw_file(path, fb, (off_t) entry->args.size, pd);
+				if (!res) { pd->is_saved = 0; }
+				return res;
+			}
+			if (entry->args.fh) {
+				return trunc_file_buffer(fb, (off_t) entry->args.size);
+			}
+			return trunc_json_file(path, (off_t) entry->args.size, pd);
+		case STATS_OPEN:
+			return replay_open(state, entry);
+		case STATS_READ:
+			return replay_read(state, entry);
+		case STATS_WRITE:
+			return replay_write(state, entry);
+		case STATS_READ_BUF:
+			return replay_read_buf(state, entry);
+		case STATS_WRITE_BUF:
+			return replay_write_buf(state, entry);
+		case STATS_FLUSH:
+			return replay_flush(state, entry);
+		case STATS_RELEASE:
+			release_file_buffer(find_handle(state, entry->args.fh, 1));
+			return 0;
+		case STATS_OPENDIR:
+			res = open_json_dir(path, &cursor, pd);
+			if (!res && add_handle(state, entry->args.fh, cursor, 1) < 0) {
+				release_json_dir(cursor);
+				return -ENOMEM;
+			}
+			return res;
+		case STATS_READDIR:
+			return read_json_dir(path, &count_entries, count_entry, 
+								 entry->args.offset, 
+								 (entry->args.flags & FUSE_READDIR_PLUS) ? 1 : 0,
+								 find_handle(state, entry->args.fh, 0), pd);
+		case STATS_RELEASEDIR:
+			release_json_dir(find_handle(state, entry->args.fh, 1));
+			return 0;
+		case STATS_GETXATTR:
+			if (!entry->args.path2) { break; }
+			buffer = get_buffer(state, entry->args.size ? entry->args.size : 1);
+			CHECK_POINTER(buffer, -ENOMEM);
+			return getxattr_json_file(path, entry->args.path2, 
+									  entry->args.size ? buffer : NULL, 
+									  entry->args.size, pd);
+		case STATS_LISTXATTR:
+			buffer = get_buffer(state, entry->args.size ? entry->args.size : 1);
+			CHECK_POINTER(buffer, -ENOMEM);
+			return listxattr_json_file(path, entry->args.size ? buffer : NULL,
+									   entry->args.size, pd);
+		default:
+			/* utimens only sets the times given by the kernel */
+			break;
+	}
+
+	*skipped = 1;
+	return 0;
+}
+
+/**
+ * @brief Waits until the recorded start of a request.
+ */
+static void wait_for(uint64_t replay_start, uint64_t recorded_start)
+{
+	struct timespec ts;
+	uint64_t elapsed = get_stats_time() - replay_start;
+	uint64_t delay;
+
+	if (elapsed >= recorded_start) { return; }
+
+	delay = recorded_start - elapsed;
+	ts.tv_sec = (time_t) (delay / 1000000000ULL);
+	ts.tv_nsec = (long) (delay % 1000000000ULL);
+	nanosleep(&ts, NULL);
+}
+
+/**
+ * @brief Replays all records of a file.
+ * @return Number of the replayed records, -1 if the file is corrupted.
+ */
+static long replay_file(FILE *in, struct replay_state *state, int paced,
+						struct op_result *results)
+{
+	struct record_entry *entry = NULL;
+	struct op_result *result = NULL;
+	uint64_t last_start = 0;
+	uint64_t replay_start = get_stats_time();
+	uint64_t start;
+	long count = 0;
+	int skipped;
+	int res_read;
+	int res;
+
+	/* The paths take 8 KB, too much for the stack of a loop */
+	entry = malloc(sizeof(struct record_entry));
+	CHECK_POINTER(entry, -1);
+
+	while ((res_read = read_record(in, &last_start, entry)) > 0) {
+		if (paced) { wait_for(replay_start, entry->start); }
+
+		pthread_mutex_lock(&state->pd->lock);
+		start = get_stats_time();
+		res = replay_request(state, entry, &skipped);
+		start = get_stats_time() - start;
+		pthread_mutex_unlock(&state->pd->lock);
+
+		result = &results[entry->op];
+		if (skipped) {
+			result->skipped++;
+			continue;
+		}
+
+		if (add_sample(&result->replayed, start) < 0
+			|| add_sample(&result->recorded, entry->duration) < 0) {
+			res_read = -1;
+			break;
+		}
+		if (res < 0) { result->errors++; }
+		if (res != entry->result) { result->mismatches++; }
+		count++;
+	}
+
+	free(entry);
+	return res_read < 0 ? -1 : count;
+}
+
+static void print_results(const char *record, int paced, long count,
+						  double seconds, struct op_result *results)
+{
+	struct op_result *result = NULL;
+	uint64_t p50, p99, max;
+	int is_first = 1;
+
+	printf("{\"record\":\"%s\",\"paced\":%s,\"ops\":%ld,\"seconds\":%.6f,"
+		   "\"ops_per_sec\":%.1f,\n\"results\":[", record, 
+		   paced ? "true" : "false", count, seconds, 
+		   seconds > 0 ? count / seconds : 0.0);
+
+	for (int op = 0; op < STATS_COUNT_OPS; op++) {
+		result = &results[op];
+		if (!result->replayed.count && !result->skipped) { continue; }
+
+		/* The percentiles sort the samples, so the maximum is the last one */
+		p50 = get_percentile(&result->replayed, 50);
+		p99 = get_percentile(&result->replayed, 99);
+		max = result->replayed.count 
+			  ? result->replayed.samples[result->replayed.count - 1] : 0;
+
+		printf("%s\n{\"op\":\"%s\",\"count\":%zu,\"errors\":%zu,"
+			   "\"mismatches\":%zu,\"skipped\":%zu,\"p50_ns\":%llu,"
+			   "\"p99_ns\":%llu,\"max_ns\":%llu,\"recorded_p50_ns\":%llu,"
+			   "\"recorded_p99_ns\":%llu}",
+			   is_first ? "" : ",", get_stats_op_name(op), 
+			   result->replayed.count, result->errors, result->mismatches,
+			   result->skipped, (unsigned long long) p50, 
+			   (unsigned long long) p99, (unsigned long long) max,
+			   (unsigned long long) get_percentile(&result->recorded, 50),
+			   (unsigned long long) get_percentile(&result->recorded, 99));
+		is_first = 0;
+	}
+
+	printf("\n]}\n");
+}
+
+/* ================================= */
+/*                Main               */
+/* ================================= */
+
+int main(int argc, char **argv)
+{
+	char save_file[] = "/tmp/jsonfs_replay_XXXXXX";
+	struct op_result results[STATS_COUNT_OPS];
+	struct replay_state state;
+	json_t *root = NULL;
+	json_t *norm_root = NULL;
+	FILE *in = NULL;
+	uint64_t start;
+	long count;
+	int paced = 0;
+	int opt;
+	int fd = -1;
+
+	memset(results, 0, sizeof(results));
+	memset(&state, 0, sizeof(state));
+
+	while ((opt = getopt(argc, argv, "p")) != -1) {
+		switch (opt) {
+			case 'p':
+				paced = 1;
+				break;
+			default:
+				goto handle_usage;
+		}
+	}
+	if (argc - optind != 2) { goto handle_usage; }
+
+	in = open_record_file(argv[optind + 1]);
+	if (!in) {
+		fprintf(stderr, "jsonfs_replay: %s is not a record\n", 
+				argv[optind + 1]);
+		return EXIT_FAILURE;
+	}
+
+	if (init_json_arena() < 0) { goto handle_error; }
+
+	root = json_load_file(argv[optind], JSON_DECODE_ANY, NULL);
+	if (!root) { goto handle_error; }
+
+	norm_root = normalize_json(root, 1, NULL);
+	json_decref(root);
+	if (!norm_root) { goto handle_error; }
+
+	/* Writes to /.save must not change the original document */
+	fd = mkstemp(save_file);
+	if (fd < 0) { goto handle_error; }
+	close(fd);
+
+	state.pd = init_private_data(norm_root, save_file);
+	if (!state.pd) { goto handle_error; }
+	norm_root = NULL;
+
+	start = get_stats_time();
+	count = replay_file(in, &state, paced, results);
+	start = get_stats_time() - start;
+	if (count >= 0) {
+		print_results(argv[optind + 1], paced, count, start / 1e9, results);
+	}
+	else {
+		fprintf(stderr, "jsonfs_replay: %s is corrupted\n", argv[optind + 1]);
+	}
+
+	for (int op = 0; op < STATS_COUNT_OPS; op++) {
+		free(results[op].replayed.samples);
+		free(results[op].recorded.samples);
+	}
+	release_state(&state);
+	unlink(save_file);
+	fclose(in);
+	release_json_arena();
+	return count < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+	handle_error:
+		json_decref(norm_root);
+		release_state(&state);
+		if (fd >= 0) { unlink(save_file); }
+		fclose(in);
+		release_json_arena();
+		fputs("jsonfs_replay: failed to load the document\n", stderr);
+		return EXIT_FAILURE;
+
+	handle_usage:
+		fprintf(stderr, "Usage: %s [-p] document.json record\n", argv[0]);
+		return EXIT_FAILURE;
+}
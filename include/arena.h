@@ -0,0 +1,90 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Pool allocator for the JSON tree.
+ * 
+ * Small blocks are cut from large chunks and reused through 
+ * free lists of their size class, so the tree does not consist
+ * of millions of separate malloc() blocks. At unmounting 
+ * the whole tree is released at once with the chunks.
+ * Every thread allocates from a cache of its own, the lock is taken 
+ * only to move a batch of blocks or to add a chunk.
+ */
+
+#ifndef ARENA_H_SENTRY
+#define ARENA_H_SENTRY
+
+#include <stddef.h>
+
+/* ================================= */
+/*               Types               */
+/* ================================= */
+
+/**
+ * @struct arena_stats
+ * @brief Allocation statistics of the arena.
+ * 
+ * @see get_arena_stats
+ */
+struct arena_stats {
+	size_t count_alloc;		/**< Number of allocations */
+	size_t count_free;		/**< Number of releases */
+	size_t bytes_in_use;	/**< Bytes of the blocks in use, headers included */
+	size_t bytes_reserved;	/**< Bytes taken from the system */
+	size_t count_chunks;	/**< Number of chunks for small blocks */
+	size_t count_large;		/**< Number of large blocks in use */
+};
+
+/* ================================= */
+/*            Declarations           */
+/* ================================= */
+
+/**
+ * @brief Makes jansson allocate from the arena.
+ * 
+ * @return 0 on success, -1 on failure.
+ * 
+ * @warning Must be called before any JSON value is created.
+ */
+int init_json_arena(void);
+
+/**
+ * @brief Checks if jansson allocates from the arena.
+ * @return 1 if the arena is in use, 0 otherwise.
+ */
+int json_arena_is_used(void);
+
+/**
+ * @brief Releases all memory of the arena at once.
+ * 
+ * @warning All JSON values become invalid, 
+ *          they must not be used or json_decref()'ed after that.
+ */
+void release_json_arena(void);
+
+/**
+ * @brief Gives the allocation statistics of the arena.
+ * @param stats[out] Structure to fill.
+ */
+void get_arena_stats(struct arena_stats *stats);
+
+#endif /* ARENA_H_SENTRY */
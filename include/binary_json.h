@@ -0,0 +1,107 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief MessagePack and CBOR documents.
+ *
+ * The binary formats are converted from and to the same JSON values 
+ * as the text, so a document is mounted the same way whatever its 
+ * format. Values that JSON cannot hold, such as binary strings, 
+ * extension types, map keys other than strings, NaN or integers 
+ * beyond 64-bit signed, are rejected at loading. Tags of CBOR 
+ * are skipped. Reals are saved as 64-bit floats.
+ */
+
+#ifndef BINARY_JSON_H_SENTRY
+#define BINARY_JSON_H_SENTRY
+
+#include <jansson.h>
+
+/**
+ * @def BINARY_MAX_DEPTH
+ * @brief Maximal nesting of arrays and maps, the same as of jansson.
+ */
+#define BINARY_MAX_DEPTH	2048
+
+/* ================================= */
+/*               Types               */
+/* ================================= */
+
+/**
+ * @enum binary_format
+ * @brief Formats of the documents besides JSON text.
+ */
+enum binary_format {
+	BINARY_NONE,		/**< JSON text */
+	BINARY_MSGPACK,		/**< MessagePack */
+	BINARY_CBOR			/**< CBOR, RFC 8949 */
+};
+
+/* ================================= */
+/*            Declarations           */
+/* ================================= */
+
+/**
+ * @brief Gives the format of a file by its extension: .msgpack 
+ * 		  or .mpk for MessagePack, .cbor for CBOR.
+ * 
+ * @return The format, BINARY_NONE for any other extension.
+ */
+enum binary_format get_binary_format(const char *path);
+
+/**
+ * @brief Gives the format by its name in -o format=NAME.
+ * 
+ * @param name "json", "msgpack" or "cbor".
+ * @param format[out] The format.
+ * 
+ * @return 0 on success, -1 if the name is unknown.
+ */
+int parse_binary_format(const char *name, enum binary_format *format);
+
+/**
+ * @brief Loads a MessagePack or CBOR document.
+ * 
+ * The whole file must be a single value.
+ * 
+ * @param path Path to the file.
+ * @param format Format of the file.
+ * @param error[out] Error with the offset of the bad value in position.
+ * 
+ * @return JSON value on success (not normalized), NULL on failure.
+ * 
+ * @note Caller must json_decref() the result.
+ */
+json_t *load_binary_file(const char *path, enum binary_format format,
+						 json_error_t *error);
+
+/**
+ * @brief Saves a JSON value as a MessagePack or CBOR document.
+ * 
+ * @param root JSON value (not normalized).
+ * @param path Path to the file, it is truncated.
+ * @param format Format of the file.
+ * 
+ * @return 0 on success, -1 on failure.
+ */
+int dump_binary_file(json_t *root, const char *path, enum binary_format format);
+
+#endif /* BINARY_JSON_H_SENTRY */
@@ -20,12 +20,15 @@
 
 /**
  * @file
- * @brief Common macros for JSONFS.
+ * @brief Common macros and helpers for JSONFS.
  */
 
 #ifndef COMMON_H_SENTRY
 #define COMMON_H_SENTRY
 
+#include <stddef.h>
+#include <stdint.h>
+
 /**
  * @def SHRT_SIZE
  * @brief Used as the size for buffers.
@@ -74,6 +77,42 @@
  */
 #define SPECIAL_SLASH	SPECIAL_PREFIX"2F"
 
+/**
+ * @def SUBTREE_NAME
+ * @brief Name of the virtual file of every directory 
+ * 		  that holds the whole subtree as JSON.
+ * 
+ * It is not listed in the directory. A key with this name
+ * in the document hides the virtual file.
+ */
+#define SUBTREE_NAME	".json"
+
+/**
+ * @def XATTR_TYPE
+ * @brief Extended attribute with the type of a node.
+ */
+#define XATTR_TYPE		"user.json.type"
+
+/**
+ * @def XATTR_SIZE
+ * @brief Extended attribute with the size of a node in compact JSON.
+ */
+#define XATTR_SIZE		"user.json.size"
+
+/**
+ * @def XATTR_CHILDREN
+ * @brief Extended attribute with the number of children of a directory.
+ */
+#define XATTR_CHILDREN	"user.json.children"
+
+/**
+ * @def XATTR_VERSION
+ * @brief Extended attribute with the version of the last change of a node.
+ * 
+ * The version grows with every change of the node or its descendants.
+ */
+#define XATTR_VERSION	"user.json.version"
+
 /**
  * @def CHECK_POINTER
  * @brief Checks if a pointer is NULL.
@@ -91,19 +130,32 @@
 	} while(0)
 
 /**
- * @def FILL_OR_RETURN 
- * @brief Adds a directory entry to readdir buffer. 
+ * @def FNV1A_BASIS
+ * @brief Initial value of a FNV-1a hash.
+ */
+#define FNV1A_BASIS		0xCBF29CE484222325ULL
+
+/**
+ * @def FNV1A_PRIME
+ * @brief Multiplier of a FNV-1a hash.
+ */
+#define FNV1A_PRIME		0x100000001B3ULL
+
+/**
+ * @brief Adds bytes to a FNV-1a hash.
  * 
- * @param BUFF The buffer passed to the readdir() operation.
- * @param NAME Name of the directory entry to add.
- *
- * @return Returns -ENOMEM if filler fails. 
+ * @param hash FNV1A_BASIS for a new hash, or the hash of 
+ * 		  the preceding bytes.
+ * 
+ * @return The new hash.
  */
-#define FILL_OR_RETURN(BUFF, NAME)								\
-	do {														\
-		if (filler(BUFF, NAME, NULL, 0, FUSE_FILL_DIR_PLUS)) {	\
-			return -ENOMEM;										\
-		}														\
-	} while(0)
+uint64_t hash_fnv1a(uint64_t hash, const void *data, size_t size);
+
+/**
+ * @brief Writes all the bytes to a file, repeating short writes.
+ * 
+ * @return 0 on success, -1 on failure.
+ */
+int write_all(int fd, const void *data, size_t len);
 
 #endif /* COMMON_H_SENTRY */
@@ -27,20 +27,37 @@
 #ifndef FILE_TIME_H_SENTRY
 #define FILE_TIME_H_SENTRY
 
+#include <stdint.h>
+#include <time.h>
+
 /* ================================= */
 /*               Types               */
 /* ================================= */
 
+struct file_time_index;
+
 /**
  * @struct file_time
  * @brief File time metadata structure.
+ * 
+ * The nodes form a list in the order of adding, the first node
+ * is the head and belongs to the root. The head also keeps a hash 
+ * index of the list by path, so a node is found without walking the list.
  */
 struct file_time {
     char *path;                 /**< File/directory path */
     time_t atime;               /**< Last access time */
     time_t mtime;               /**< Last modification time */
     time_t ctime;               /**< Last status change time */
-    struct file_time *next_node;/**< Next node in singly-linked list */
+    unsigned long long version; /**< Version of the last change in the subtree */
+    unsigned long long reset_version;/**< Version at which the subtree was replaced */
+    size_t json_size;           /**< Cached size of the node in compact JSON */
+    unsigned long long size_version;/**< Version of json_size, 0 if not cached */
+    uint64_t hash;              /**< Hash of the path in the index */
+    struct file_time *next_node;/**< Next node in the list */
+    struct file_time *prev_node;/**< Previous node in the list, NULL for the head */
+    struct file_time *next_hash;/**< Next node in the same bucket of the index */
+    struct file_time_index *index;/**< Index of the list, kept by the head only */
 };
 
 /**
@@ -84,10 +101,59 @@ struct file_time *add_node_to_list_ft(const char* path, struct file_time *root,
  */
 int remove_node_to_list_ft(const char* path, struct file_time *root);
 
+/**
+ * @brief Removes the node of a path and the nodes of all paths below it.
+ * 
+ * The list is walked once, whatever the size of the subtree.
+ * 
+ * @param path Path of the subtree root (must not be NULL).
+ * @param root Head of the file_time linked list (must not be NULL).
+ * 
+ * @return Number of removed nodes on success, -1 on failure.
+ * 
+ * @note The head of the list is never removed.
+ */
+int remove_subtree_to_list_ft(const char* path, struct file_time *root);
+
+/**
+ * @brief Sets the version of a changed path.
+ * 
+ * The version is set for the path and for all its parents, 
+ * their nodes are added if missing. If the whole subtree 
+ * of the path was replaced, the nodes below the path are removed,
+ * so that the paths below it get the new version.
+ * 
+ * @param path Path of the changed node (must not be NULL).
+ * @param root Head of the file_time linked list (must not be NULL).
+ * @param version New version, greater than all previous ones.
+ * @param is_reset 1 if the whole subtree of the path was replaced.
+ * 
+ * @return 0 on success, -1 on failure.
+ * 
+ * @see get_version_ft
+ */
+int set_version_ft(const char *path, struct file_time *root,
+				   unsigned long long version, int is_reset);
+
+/**
+ * @brief Gives the version of a path.
+ * 
+ * A path without its own node has the version at which 
+ * the last replaced subtree containing it was replaced.
+ * 
+ * @param path File path (must not be NULL).
+ * @param root Head of the file_time linked list (must not be NULL).
+ * 
+ * @return The version, 0 on failure.
+ * 
+ * @see set_version_ft
+ */
+unsigned long long get_version_ft(const char *path, struct file_time *root);
+
 /**
  * @brief Finds a file_time node by path in the linked list.
  *
- * Searches through the file_time linked list for a node with matching path.
+ * The node is looked up in the hash index of the head.
  *
  * @param path File path to search for (must not be NULL).
  * @param root Head of the file_time linked list to search (must not be NULL).
@@ -98,6 +164,9 @@ struct file_time *find_node_file_time(const char *path, struct file_time *root);
 
 /**
  * @brief Free the struct file_time node in the list. 
+ * 
+ * The node is not unlinked, the index of the head is freed with it.
+ * 
  * @param ft The node that will be free. 
  */
 void free_file_time(struct file_time *ft);
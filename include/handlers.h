@@ -28,6 +28,98 @@
 
 #include "jsonfs.h"
 
+/* ================================= */
+/*               Types               */
+/* ================================= */
+
+/**
+ * @struct dir_cursor
+ * @brief Position of an open directory stream.
+ * 
+ * Allocated in opendir() and kept in fi->fh until releasedir().
+ * Allows readdir() to continue from the entry at which the previous
+ * call stopped, instead of walking the directory from the beginning.
+ * 
+ * Entries are numbered from 0: ".", "..", the special files (root only),
+ * then the children. The offset passed to the filler is the number 
+ * of the next entry.
+ * 
+ * A directory that looks like a converted array is listed by index 
+ * up to its current size. If an index is missing, it is not an array
+ * (or no longer one): the rest is listed by the keys, skipping 
+ * the elements already listed.
+ * 
+ * @see open_json_dir
+ * @see read_json_dir
+ * @see release_json_dir
+ */
+struct dir_cursor {
+	off_t offset;		/**< Number of the entry to fill next */
+	char *next_key;		/**< Key of the child to fill next, NULL if unknown */
+	size_t count_indexed;	/**< Number of the elements listed by index */
+	int is_array;		/**< 1 while the directory is listed by index */
+};
+
+/**
+ * @struct file_buffer
+ * @brief Content of a virtual file for the time it is open.
+ * 
+ * Allocated in open() and kept in fi->fh until release().
+ * Reads and writes work with the buffer only, the content 
+ * is applied to the tree when the file is flushed. 
+ * The strings of raw_strings are written at once, see open_raw_file().
+ * 
+ * @see open_subtree_file
+ * @see flush_subtree_file
+ */
+struct file_buffer {
+	char *data;			/**< Content of the file */
+	size_t len;			/**< Length of the content */
+	size_t cap;			/**< Size of the allocated memory */
+	int is_changed;		/**< 1 if the content was written since the last flush */
+	off_t offset;		/**< Offset of the content in the file, see write_ctl_file */
+	int is_raw;			/**< 1 for a string of raw_strings, see open_raw_file */
+};
+
+/**
+ * @enum merge_state
+ * @brief What became of a change of the file in the tree.
+ */
+enum merge_state {
+	MERGE_APPLIED,		/**< The node got the new value */
+	MERGE_CONFLICT,		/**< The node was changed locally and kept */
+	MERGE_SAME			/**< The node was changed locally to the same value */
+};
+
+/**
+ * @struct merge_change
+ * @brief Node changed in the file by another program.
+ * 
+ * @see merge_json_document
+ */
+struct merge_change {
+	char *path;					/**< Absolute path to the node */
+	json_t *value;				/**< New value, borrowed from the newer document, NULL if removed */
+	enum merge_state state;		/**< Result of applying the change */
+};
+
+/**
+ * @struct merge_result
+ * @brief Changes found by merge_json_document().
+ * 
+ * @see free_merge_result
+ */
+struct merge_result {
+	struct merge_change *changes;	/**< Changes in the order of the tree */
+	size_t count;					/**< Number of the changes */
+	size_t cap;						/**< Number of the allocated changes */
+	size_t count_conflicts;			/**< Number of the changes in conflict */
+};
+
+/* ================================= */
+/*            Declarations           */
+/* ================================= */
+
 /**
  * @brief Sets attributes for JSON files and directories. 
  * 
@@ -88,6 +180,35 @@ int rm_file(const char *path, int file_type, struct jsonfs_private_data *pd);
 int rename_file(const char *old_path, const char *new_path, 
 				struct jsonfs_private_data *pd);
 
+/**
+ * @brief Deletes a file or a directory with all its content.
+ * 
+ * The subtree is detached from its parent at once, instead of 
+ * deleting its files one by one.
+ * 
+ * @param path The absolute path to the file/directory.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, negative error code on failure.
+ */
+int rm_tree(const char *path, struct jsonfs_private_data *pd);
+
+/**
+ * @brief Copies a file or a directory with all its content.
+ * 
+ * The copy shares the nodes of the source, so it costs O(1). 
+ * A shared directory is copied only when it is changed through 
+ * one of the paths, see unshare_json_node().
+ * 
+ * @param src_path The absolute path to the source file/directory.
+ * @param dst_path The absolute path to the copy, must not exist.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, negative error code on failure.
+ */
+int clone_tree(const char *src_path, const char *dst_path, 
+			   struct jsonfs_private_data *pd);
+
 /**
  * @brief Truncating the file size.
  * 
@@ -114,6 +235,25 @@ int trunc_json_file(const char *path, off_t offset,
 int read_json_file(const char *path, char *buffer, size_t size,
 				   off_t offset, struct jsonfs_private_data *pd);
 
+/**
+ * @brief Reads content from JSON file into a buffer vector.
+ * 
+ * The serialized node is given to FUSE as is, without copying 
+ * it to another buffer.
+ * 
+ * @param path The absolute path to the JSON file.
+ * @param bufp Set to a new buffer vector with the read data.
+ * @param size Maximum number of bytes to read.
+ * @param offset Byte offset from which to start reading.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, negative error code on failure.
+ * 
+ * @note The buffer vector and its memory are freed by FUSE.
+ */
+int read_json_buf(const char *path, struct fuse_bufvec **bufp, size_t size,
+				  off_t offset, struct jsonfs_private_data *pd);
+
 /**
  * @brief Reads content from special filesystem control files.
  * 
@@ -148,9 +288,28 @@ int read_special_file(const char *path, char *buffer, size_t size,
 int write_json_file(const char *path, const char *buffer, size_t size,
 					off_t offset, struct jsonfs_private_data *pd);
 
+/**
+ * @brief Writes data from a buffer vector to JSON file.
+ * 
+ * When splice is used, the data is copied from the pipe 
+ * right into the new content of the file.
+ * 
+ * @param path The absolute path to the JSON file.
+ * @param src Buffer vector containing data to write.
+ * @param offset Byte offset where to start writing.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return Number of bytes written on success, negative error code on failure.
+ */
+int write_json_buf(const char *path, struct fuse_bufvec *src, off_t offset,
+				   struct jsonfs_private_data *pd);
+
 /**
  * @brief Writes data to special filesystem control files.
  * 
+ * Writing to /.save saves the document. /.ctl is written 
+ * with write_ctl_file().
+ * 
  * @param path The absolute path to the special file.
  * @param buffer Buffer containing data to write.
  * @param size Number of bytes to write.
@@ -164,4 +323,415 @@ int write_json_file(const char *path, const char *buffer, size_t size,
 int write_special_file(const char *path, const char *buffer, size_t size,
 					   off_t offset, struct jsonfs_private_data *pd);
 
+/**
+ * @brief Runs the commands written to /.ctl without an open buffer.
+ * 
+ * The written lines are taken as complete, see write_ctl_file().
+ * 
+ * @param buffer Buffer containing the commands.
+ * @param size Number of bytes to write.
+ * @param is_changed[out] Set to 1 if a command changed the tree,
+ * 		  even when the write fails on a later one.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return Number of bytes written on success, error code of the first 
+ * 		   failed command otherwise. The commands before it stay applied.
+ */
+int write_ctl_commands(const char *buffer, size_t size, int *is_changed,
+					   struct jsonfs_private_data *pd);
+
+/**
+ * @brief Opens the /.ctl control file for writing.
+ * 
+ * @param fb Set to the new buffer of the file, it is empty.
+ * 
+ * @return 0 on success, negative error code on failure.
+ * 
+ * @note The buffer must be released with release_file_buffer().
+ */
+int open_ctl_file(struct file_buffer **fb);
+
+/**
+ * @brief Writes commands to an open /.ctl file.
+ * 
+ * The commands are "rmtree <path>", "clone <src> <dst>", 
+ * "cas <path> <version> <json>" and "trace on|off|clear", one per line.
+ * Every complete line is run at once, so the write fails with 
+ * the error of a failed command. An unfinished line is kept in 
+ * the buffer until the next write completes it or the file is flushed.
+ * The writes must follow each other: the content before the buffer 
+ * has already run and cannot be rewritten.
+ * 
+ * @param fb Buffer of the file.
+ * @param buffer Buffer containing data to write.
+ * @param size Number of bytes to write.
+ * @param offset Byte offset where to start writing.
+ * @param is_changed[out] Set to 1 if a command changed the tree,
+ * 		  even when the write fails on a later one.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return Number of bytes written on success, negative error code on failure.
+ */
+int write_ctl_file(struct file_buffer *fb, const char *buffer, size_t size,
+				   off_t offset, int *is_changed, 
+				   struct jsonfs_private_data *pd);
+
+/**
+ * @brief Runs the unfinished last line of an open /.ctl file.
+ * 
+ * @param fb Buffer of the file.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 1 if the command changed the tree, 0 if it did not 
+ * 		   or there was nothing to do, negative error code on failure.
+ */
+int flush_ctl_file(struct file_buffer *fb, struct jsonfs_private_data *pd);
+
+/**
+ * @brief Gets attributes of a SUBTREE_NAME virtual file.
+ * 
+ * The size is 0, the content is made when the file is opened.
+ * 
+ * @param path The absolute path to the file.
+ * @param st Structure to fill with file attributes.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, negative error code on failure.
+ * 
+ * @see SUBTREE_NAME
+ */
+int getattr_subtree_file(const char *path, struct stat *st,
+						 struct jsonfs_private_data *pd);
+
+/**
+ * @brief Opens a SUBTREE_NAME virtual file.
+ * 
+ * The subtree of the directory is written to the buffer as a JSON 
+ * document, unless the file is opened with O_TRUNC.
+ * 
+ * @param path The absolute path to the file.
+ * @param flags Flags of open().
+ * @param fb Set to the new buffer of the file.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, negative error code on failure.
+ * 
+ * @note The buffer must be released with release_file_buffer().
+ */
+int open_subtree_file(const char *path, int flags, struct file_buffer **fb,
+					  struct jsonfs_private_data *pd);
+
+/**
+ * @brief Replaces the subtree of the directory with the written document.
+ * 
+ * Does nothing if the buffer was not written since the last flush.
+ * 
+ * @param path The absolute path to the SUBTREE_NAME file.
+ * @param fb Buffer of the file.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 1 if the subtree was replaced, 0 if there was nothing to do,
+ * 		   negative error code on failure.
+ */
+int flush_subtree_file(const char *path, struct file_buffer *fb,
+					   struct jsonfs_private_data *pd);
+
+/**
+ * @brief Opens a string file for writing with raw_strings.
+ * 
+ * The writes go to the string at once, so they are seen by getattr 
+ * and by the reads of other handles. Since a multi-byte character 
+ * may be split between writes, their UTF-8 is checked when the file 
+ * is flushed. The buffer keeps a copy of the string as it was checked 
+ * last, it is not read or written.
+ * 
+ * @param path The absolute path to the string.
+ * @param flags Flags of open(), the string is emptied with O_TRUNC.
+ * @param fb Set to the new buffer of the file.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, -EINVAL if the node is not a raw string,
+ * 		   other negative error code on failure.
+ * 
+ * @note The buffer must be released with release_file_buffer().
+ * @see jsonfs_options
+ */
+int open_raw_file(const char *path, int flags, struct file_buffer **fb,
+				  struct jsonfs_private_data *pd);
+
+/**
+ * @brief Writes to a string opened with open_raw_file().
+ * 
+ * The bytes are placed in the string without checking UTF-8.
+ * If the node is no longer a string, the write is done by 
+ * write_json_buf().
+ * 
+ * @param path The absolute path to the string.
+ * @param fb Buffer of the file.
+ * @param src Data to write.
+ * @param offset Offset in the string.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return Number of bytes written on success, negative error code on failure.
+ */
+int write_raw_file(const char *path, struct file_buffer *fb, 
+				   struct fuse_bufvec *src, off_t offset, 
+				   struct jsonfs_private_data *pd);
+
+/**
+ * @brief Truncates a string opened with open_raw_file().
+ * 
+ * Like write_raw_file(), UTF-8 is not checked until the file is flushed.
+ * 
+ * @param path The absolute path to the string.
+ * @param fb Buffer of the file.
+ * @param offset New length of the string.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, negative error code on failure.
+ */
+int trunc_raw_file(const char *path, struct file_buffer *fb, off_t offset,
+				   struct jsonfs_private_data *pd);
+
+/**
+ * @brief Checks the UTF-8 of a string written through the file.
+ * 
+ * If the string is not valid UTF-8, it gets back the content it had 
+ * at the last flush, or at open() for the first one. 
+ * Does nothing if the file was not written since the last flush.
+ * 
+ * @param path The absolute path to the string.
+ * @param fb Buffer of the file.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, -EILSEQ if the content was not valid UTF-8,
+ * 		   other negative error code on failure.
+ */
+int flush_raw_file(const char *path, struct file_buffer *fb,
+				   struct jsonfs_private_data *pd);
+
+/**
+ * @brief Opens the /.patch control file.
+ * 
+ * The buffer holds the report of the last patch,
+ * unless the file is opened with O_TRUNC.
+ * 
+ * @param flags Flags of open().
+ * @param fb Set to the new buffer of the file.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, negative error code on failure.
+ * 
+ * @note The buffer must be released with release_file_buffer().
+ */
+int open_patch_file(int flags, struct file_buffer **fb,
+					struct jsonfs_private_data *pd);
+
+/**
+ * @brief Applies the JSON Patch written to /.patch.
+ * 
+ * The patch is applied as a whole or not at all. Its report replaces 
+ * the content of the buffer and is kept for the next readers.
+ * Does nothing if the buffer was not written since the last flush.
+ * 
+ * @param fb Buffer of the file.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return Number of applied operations on success,
+ * 		   negative error code on failure.
+ * 
+ * @see apply_json_patch
+ */
+int flush_patch_file(struct file_buffer *fb, struct jsonfs_private_data *pd);
+
+/**
+ * @brief Opens /.stats, /.stats.prom, /.trace or /.hot.
+ * 
+ * The buffer holds a snapshot of the metrics, the trace or the counters,
+ * so the file does not change while it is read.
+ * 
+ * @param path Path to the file.
+ * @param flags Flags of open(), only reading is allowed.
+ * @param fb Set to the new buffer of the file.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, negative error code on failure.
+ * 
+ * @note The buffer must be released with release_file_buffer().
+ */
+int open_snapshot_file(const char *path, int flags, struct file_buffer **fb,
+					struct jsonfs_private_data *pd);
+
+/**
+ * @brief Reads content from the buffer of an open virtual file.
+ * 
+ * @param fb Buffer of the file.
+ * @param buffer Buffer provided by FUSE for storing read data.
+ * @param size Maximum number of bytes to read.
+ * @param offset Byte offset from which to start reading.
+ * 
+ * @return Number of bytes read on success, negative error code on failure.
+ */
+int read_file_buffer(struct file_buffer *fb, char *buffer, size_t size,
+					 off_t offset);
+
+/**
+ * @brief Writes data to the buffer of an open virtual file.
+ * 
+ * @param fb Buffer of the file.
+ * @param buffer Buffer containing data to write.
+ * @param size Number of bytes to write.
+ * @param offset Byte offset where to start writing.
+ * 
+ * @return Number of bytes written on success, negative error code on failure.
+ */
+int write_file_buffer(struct file_buffer *fb, const char *buffer, size_t size,
+					  off_t offset);
+
+/**
+ * @brief Truncates the buffer of an open virtual file.
+ * 
+ * @param fb Buffer of the file.
+ * @param offset The number of bytes to which the truncation occurs.
+ * 
+ * @return 0 on success, negative error code on failure.
+ */
+int trunc_file_buffer(struct file_buffer *fb, off_t offset);
+
+/**
+ * @brief Frees the buffer of a virtual file.
+ * 
+ * @param fb Buffer to free, may be NULL.
+ */
+void release_file_buffer(struct file_buffer *fb);
+
+/**
+ * @brief Opens a directory stream.
+ * 
+ * @param path The absolute path to the directory.
+ * @param cursor[out] New cursor of the directory stream.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, negative error code on failure.
+ * 
+ * @note Caller must release the cursor with release_json_dir().
+ */
+int open_json_dir(const char *path, struct dir_cursor **cursor,
+				  struct jsonfs_private_data *pd);
+
+/**
+ * @brief Lists a directory starting from the given offset.
+ * 
+ * Fills entries until the filler reports that the buffer is full.
+ * For converted arrays the entry is found by its index directly,
+ * for objects the key of the next entry is kept in the cursor,
+ * so continuing the listing costs O(1) in both cases.
+ * 
+ * @param path The absolute path to the directory.
+ * @param buffer The buffer passed to the readdir() operation.
+ * @param filler Function to add an entry to the buffer.
+ * @param offset Number of the first entry to fill.
+ * @param plus 1 to fill in the attributes of each entry (readdirplus),
+ * 			   so that the kernel does not need getattr() for every child.
+ * @param cursor Cursor from open_json_dir(), can be NULL.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, negative error code on failure.
+ */
+int read_json_dir(const char *path, void *buffer, fuse_fill_dir_t filler,
+				  off_t offset, int plus, struct dir_cursor *cursor,
+				  struct jsonfs_private_data *pd);
+
+/**
+ * @brief Releases a directory stream.
+ * @param cursor Cursor from open_json_dir(), can be NULL.
+ */
+void release_json_dir(struct dir_cursor *cursor);
+
+/**
+ * @brief Gives an extended attribute of a JSON file or directory.
+ * 
+ * The attributes are XATTR_TYPE, XATTR_SIZE, XATTR_CHILDREN 
+ * (directories only) and XATTR_VERSION. They are taken from the tree 
+ * and the file_time list, the content of the node is not serialized.
+ * 
+ * @param path The absolute path to the file/directory.
+ * @param name Name of the attribute.
+ * @param value Buffer for the value, the value is not null-terminated.
+ * @param size Size of the buffer, 0 to get the size of the value.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return Size of the value on success, -ENODATA if there is no such
+ * 		   attribute, -ERANGE if the buffer is too small, 
+ * 		   other negative error code on failure.
+ */
+int getxattr_json_file(const char *path, const char *name, char *value,
+					   size_t size, struct jsonfs_private_data *pd);
+
+/**
+ * @brief Lists the extended attributes of a JSON file or directory.
+ * 
+ * Special and SUBTREE_NAME files have no attributes.
+ * 
+ * @param path The absolute path to the file/directory.
+ * @param list Buffer for the null-terminated names.
+ * @param size Size of the buffer, 0 to get the size of the list.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return Size of the list on success, -ERANGE if the buffer 
+ * 		   is too small, other negative error code on failure.
+ * 
+ * @see getxattr_json_file
+ */
+int listxattr_json_file(const char *path, char *list, size_t size,
+						struct jsonfs_private_data *pd);
+
+/**
+ * @brief Warms up a JSON file or directory before it is accessed.
+ * 
+ * The node is looked up and its subtree is walked to measure 
+ * its size, which is cached for the size attribute.
+ * 
+ * @param path The absolute path to the file/directory.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, negative error code on failure.
+ * 
+ * @see load_hot_paths
+ */
+int warm_json_file(const char *path, struct jsonfs_private_data *pd);
+
+/**
+ * @brief Applies a newer version of the document to the tree.
+ * 
+ * The newer document is compared with the snapshot of the file 
+ * (jsonfs_private_data::file_root), and only the nodes that differ
+ * are replaced, added or removed in the tree, the others keep their 
+ * times and versions. A node that was also changed locally and 
+ * differs from the snapshot is kept and counted as a conflict.
+ * The newer document becomes the snapshot.
+ * 
+ * @param new_root Normalized root of the newer document. Its nodes 
+ * 		  equal to the snapshot are replaced by the snapshot ones, 
+ * 		  so the documents share them.
+ * @param result[out] Found changes, the applied paths need 
+ * 		  their kernel cache invalidated.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return Number of the applied changes on success, 
+ * 		   negative error code on failure.
+ * 
+ * @note The result must be freed with free_merge_result().
+ * 
+ * @see jsonfs_private_data
+ */
+int merge_json_document(json_t *new_root, struct merge_result *result,
+						struct jsonfs_private_data *pd);
+
+/**
+ * @brief Frees the changes found by merge_json_document().
+ * @param result Changes to free.
+ */
+void free_merge_result(struct merge_result *result);
+
 #endif /* HANDLERS_H_SENTRY */
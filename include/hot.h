@@ -0,0 +1,137 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Access counters of the paths, shown in /.hot.
+ *
+ * Each thread counts one of every HOT_SAMPLE of its requests, 
+ * with the weight of all of them, in a count-min sketch of fixed size.
+ * The sketch is updated with atomic operations, without a lock.
+ * The hottest paths and top-level subtrees are kept in two small tables;
+ * the lock is taken only when a path may get into one of them.
+ * With -o persist_hot the tables are saved to <document>.hot 
+ * at unmounting and read back at mounting, where the listed paths 
+ * are warmed up.
+ */
+
+#ifndef HOT_H_SENTRY
+#define HOT_H_SENTRY
+
+#include <stddef.h>
+
+/**
+ * @def HOT_SUFFIX
+ * @brief Suffix of the file the counters are saved to, after the document name.
+ */
+#define HOT_SUFFIX	".hot"
+
+/**
+ * @def HOT_SAMPLE
+ * @brief By default, one of this many requests of a thread is counted,
+ * 		  see set_hot_sampling().
+ */
+#define HOT_SAMPLE	16
+
+/* ================================= */
+/*               Types               */
+/* ================================= */
+
+/**
+ * @enum hot_kind
+ * @brief Kinds of the counted accesses.
+ */
+enum hot_kind {
+	HOT_LOOKUPS,		/**< getattr, open, opendir and xattrs */
+	HOT_READS,			/**< read and readdir */
+	HOT_WRITES,			/**< Writes and changes of the tree */
+	HOT_COUNT_KINDS
+};
+
+/* ================================= */
+/*            Declarations           */
+/* ================================= */
+
+/**
+ * @brief Sets how many requests of a thread one counted access stands for.
+ * 
+ * @param every 1 to count every request, 0 to count none.
+ * 
+ * @warning Must be called before the requests are served.
+ */
+void set_hot_sampling(unsigned long every);
+
+/**
+ * @brief Counts an access to a path and to its top-level subtree.
+ * 
+ * @param path Path of the access.
+ * @param kind Kind of the access.
+ */
+void count_hot_access(const char *path, enum hot_kind kind);
+
+/**
+ * @brief Renders the hottest paths and subtrees as a JSON object.
+ *
+ * @param len[out] Length of the text, may be NULL.
+ *
+ * @return The text on success, NULL on failure.
+ *
+ * @note The returned text must be freed with free().
+ */
+char *format_hot_json(size_t *len);
+
+/**
+ * @brief Saves the hottest paths and subtrees next to the document.
+ * 
+ * @param json_file Path to the document, the counters are written 
+ * 		  to the file with HOT_SUFFIX added.
+ * 
+ * @return 0 on success, -1 on failure.
+ */
+int save_hot_paths(const char *json_file);
+
+/**
+ * @brief Reads the paths saved by save_hot_paths().
+ * 
+ * The saved counts are halved, so the paths of old mounts cool down.
+ * 
+ * @param json_file Path to the document.
+ * 
+ * @return 0 on success, -1 on failure, a missing file is a failure.
+ */
+int load_hot_paths(const char *json_file);
+
+/**
+ * @brief Gives the hottest paths, the hottest first.
+ * 
+ * @param count[out] Number of the paths.
+ * 
+ * @return Array of the paths, NULL if there are none or on failure.
+ * 
+ * @note The paths and the array must be freed with free().
+ */
+char **get_hot_paths(size_t *count);
+
+/**
+ * @brief Forgets all counters.
+ */
+void release_hot(void);
+
+#endif /* HOT_H_SENTRY */
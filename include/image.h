@@ -0,0 +1,167 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Binary images of normalized documents for fast mounting.
+ *
+ * With -o image the normalized tree is written to <file>.img beside 
+ * the JSON file after mounting and after every save. The next mount 
+ * builds the tree from the image without parsing and normalizing 
+ * the text, if the image belongs to the file as it is: its size, 
+ * modification time and hash are recorded in the image. The image 
+ * also keeps the hash of its own parts, so a corrupted one is not used.
+ *
+ * The image is mapped to memory and read in place. It consists of 
+ * the header, the array of nodes, the array of object entries and 
+ * the strings. Nodes refer to each other by index and to the strings
+ * by offset, so the image has no pointers. Nodes are numbered in 
+ * preorder, the root is the first one. A node shared by several 
+ * parents, such as an interned scalar, is stored once.
+ */
+
+#ifndef IMAGE_H_SENTRY
+#define IMAGE_H_SENTRY
+
+#include <jansson.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/**
+ * @def IMAGE_MAGIC
+ * @brief First bytes of an image, the last one is the format version.
+ */
+#define IMAGE_MAGIC			"JFSIMG\0\2"
+#define IMAGE_MAGIC_LEN		8
+
+/**
+ * @def IMAGE_BYTE_ORDER
+ * @brief Written in the native byte order, an image of another 
+ * 		  architecture is not used.
+ */
+#define IMAGE_BYTE_ORDER	0x01020304
+
+/**
+ * @def IMAGE_SUFFIX
+ * @brief Appended to the path of the JSON file to get the path of its image.
+ */
+#define IMAGE_SUFFIX		".img"
+
+/* ================================= */
+/*               Types               */
+/* ================================= */
+
+/**
+ * @enum image_type
+ * @brief Types of the nodes.
+ */
+enum image_type {
+	IMAGE_OBJECT,
+	IMAGE_STRING,
+	IMAGE_INTEGER,
+	IMAGE_REAL,
+	IMAGE_TRUE,
+	IMAGE_FALSE,
+	IMAGE_NULL
+};
+
+/**
+ * @def IMAGE_SHARED
+ * @brief Flag of a node referenced by several parents.
+ */
+#define IMAGE_SHARED		0x1
+
+/**
+ * @struct image_header
+ * @brief Beginning of an image.
+ */
+struct image_header {
+	char magic[IMAGE_MAGIC_LEN];
+	uint32_t byte_order;		/**< IMAGE_BYTE_ORDER */
+	uint32_t reserved;
+	uint64_t file_size;			/**< Size of the JSON file */
+	int64_t file_mtime_sec;		/**< Modification time of the JSON file */
+	int64_t file_mtime_nsec;
+	uint64_t file_hash;			/**< FNV-1a hash of the content of the JSON file */
+	uint64_t image_hash;		/**< FNV-1a hash of the image after the header */
+	uint64_t count_nodes;
+	uint64_t count_entries;
+	uint64_t strings_size;		/**< Size of the strings in bytes */
+};
+
+/**
+ * @struct image_node
+ * @brief Node of the tree.
+ * 
+ * value is the index of the first entry of an object, the offset 
+ * of a string, the bits of an integer or a real.
+ */
+struct image_node {
+	uint16_t type;		/**< One of image_type */
+	uint16_t flags;		/**< IMAGE_SHARED or 0 */
+	uint32_t reserved;
+	uint64_t value;		
+	uint64_t count;		/**< Number of the entries of an object, length of a string */
+};
+
+/**
+ * @struct image_entry
+ * @brief Member of an object.
+ * 
+ * The entries of an object follow each other.
+ */
+struct image_entry {
+	uint64_t key;		/**< Offset of the key, null-terminated, in the strings */
+	uint64_t node;		/**< Index of the value */
+};
+
+/* ================================= */
+/*            Declarations           */
+/* ================================= */
+
+/**
+ * @brief Builds a normalized tree from the image of a JSON file.
+ * 
+ * @param json_file Path to the JSON file.
+ * 
+ * @return Normalized root on success, NULL if there is no image,
+ * 		   it is corrupted or does not belong to the file as it is.
+ * 
+ * @note Caller must json_decref() the result.
+ */
+json_t *load_json_image(const char *json_file);
+
+/**
+ * @brief Writes the image of a normalized tree beside its JSON file.
+ * 
+ * The image is written to a temporary file and renamed, 
+ * so a mount never sees a half-written image.
+ * 
+ * @param root Normalized root.
+ * @param json_file Path to the JSON file.
+ * @param st Attributes of the JSON file the tree was loaded from 
+ * 		  or saved to. The image is not written if the file 
+ * 		  has changed since then.
+ * 
+ * @return 0 on success, -1 on failure.
+ */
+int save_json_image(json_t *root, const char *json_file, const struct stat *st);
+
+#endif /* IMAGE_H_SENTRY */
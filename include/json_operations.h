@@ -27,6 +27,85 @@
 #define JSON_OPERATIONS_H_SENTRY
 
 #include <jansson.h>
+#include <stdio.h>
+
+/* ================================= */
+/*               Types               */
+/* ================================= */
+
+/**
+ * @def REAL_PRECISION
+ * @brief Number of significant digits of reals in file content.
+ */
+#define REAL_PRECISION	10
+
+/**
+ * @def DUMP_FLAGS
+ * @brief Flags of jansson used to represent a node as file content.
+ */
+#define DUMP_FLAGS	(JSON_ENCODE_ANY | JSON_REAL_PRECISION(REAL_PRECISION))
+
+/**
+ * @def SAVE_FLAGS
+ * @brief Flags of jansson used to write the document and its subtrees.
+ */
+#define SAVE_FLAGS	(JSON_INDENT(2) | JSON_ENCODE_ANY | \
+					 JSON_REAL_PRECISION(REAL_PRECISION))
+
+/**
+ * @def LINE_FLAGS
+ * @brief Flags of jansson used to write a value on a single line.
+ */
+#define LINE_FLAGS	(JSON_COMPACT | JSON_ENCODE_ANY | \
+					 JSON_REAL_PRECISION(REAL_PRECISION))
+
+/**
+ * @def SCALAR_NODE_SIZE
+ * @brief Approximate size of a scalar node in jansson, without the payload.
+ * 
+ * Used only to estimate the memory saved by json_pool.
+ */
+#define SCALAR_NODE_SIZE	(sizeof(json_t) + 2 * sizeof(size_t))
+
+/**
+ * @struct json_pool
+ * @brief Pool of shared values.
+ * 
+ * Identical strings and numbers of the document are stored once
+ * and referenced from every place where they occur. So are identical
+ * objects below the root: their children are already shared, so two
+ * objects are equal if they have the same keys with the same nodes.
+ * A shared object is copied by unshare_json_node() before it is changed.
+ * 
+ * @see intern_json_scalar
+ * @see normalize_json
+ */
+struct json_pool {
+	json_t *strings;		/**< Shared strings by their value */
+	json_t *integers;		/**< Shared integers by their text */
+	json_t *reals;			/**< Shared reals by their text */
+	json_t *objects;		/**< Arrays of shared objects by the hash of their entries */
+	size_t count_scalars;	/**< Number of interned scalars */
+	size_t count_shared;	/**< Number of scalars that reused a shared node */
+	size_t count_objects;	/**< Number of objects that reused a shared node */
+	size_t saved_bytes;		/**< Estimate of the memory saved by the scalars, in bytes */
+};
+
+/**
+ * @struct json_scalar
+ * @brief Number or literal parsed without jansson.
+ * 
+ * @see parse_json_scalar
+ */
+struct json_scalar {
+	json_type type;			/**< JSON_INTEGER, JSON_REAL, JSON_TRUE, JSON_FALSE or JSON_NULL */
+	json_int_t integer;		/**< Value if the type is JSON_INTEGER */
+	double real;			/**< Value if the type is JSON_REAL */
+};
+
+/* ================================= */
+/*            Declarations           */
+/* ================================= */
 
 /**
  * @brief Converts JSON to object-only representation for filesystem.
@@ -34,6 +113,7 @@
  * @param root JSON value (can be obtained using json_load_file).
  * @param is_root Flag indicating if this is the root level (1) or nested (0).
  * 				  It is assumed that the caller will pass the value 1.
+ * @param pool Pool of shared scalars, NULL to copy every scalar.
  * 
  * @return New independent JSON object:
  * 		   - Arrays become {"SPECIAL_PREFIX0":..., "SPECIAL_PREFIX1":...}.
@@ -43,10 +123,13 @@
  * @note SPECIAL_PREFIX provide unambiguous identification of
  *       converted arrays and root scalars.
  *       Caller must json_decref() the result.
+ * @note With a pool, a scalar node can have several parents,
+ *       so it must be replaced rather than changed in place.
  * 
  * @see denormalize_json
+ * @see intern_json_scalar
  */
-json_t *normalize_json(json_t *root, int is_root);
+json_t *normalize_json(json_t *root, int is_root, struct json_pool *pool);
 
 /**
  * @brief Converts JSON from object-only representation to diverse.
@@ -81,6 +164,28 @@ json_t *denormalize_json(json_t *root);
  */
 json_t *find_json_node(const char *path, json_t *root);
 
+/**
+ * @brief Finds a JSON node to be changed.
+ * 
+ * Objects may be shared between several paths after a clone. 
+ * Every shared object on the path, including the node itself,
+ * is replaced by its shallow copy, so that a change of the node 
+ * is not seen through the other paths (copy-on-write). 
+ * Objects that are not shared are not copied, so this costs 
+ * the same as find_json_node() until a clone is changed.
+ * 
+ * @param path Absolute path, must not be NULL.
+ * @param root Root JSON object to start traversal from, must not be NULL.
+ * 
+ * @return Pointer to the found JSON node, or NULL on failure.
+ * 
+ * @note Used with normalized JSON.
+ * @note Scalars are not copied, a shared scalar must not be changed in place.
+ * 
+ * @see find_json_node
+ */
+json_t *unshare_json_node(const char *path, json_t *root);
+
 /**
  * @brief Find parent and key for given JSON value.
  * 
@@ -155,6 +260,22 @@ int find_array_in_normal_root(json_t *root, json_t **results, int max_results, i
  */
 int replace_json_nodes(json_t *old_node, json_t *new_node, json_t *root);
 
+/**
+ * @brief Replace the node at the given path with a new node.
+ * 
+ * Unlike replace_json_nodes(), the parent is found by the path,
+ * so the search costs O(depth) and works for shared nodes.
+ * 
+ * @param path Absolute path of the node to be replaced.
+ * @param new_node New node to insert (in case of an error, it requires json_decref()).
+ * @param root Root of deserialized JSON to search in.
+ * 
+ * @return 0 on success, negative error code on failure.
+ * 
+ * @note Used with normalized JSON.
+ */
+int replace_json_node_at(const char *path, json_t *new_node, json_t *root);
+
 /**
  * @brief Counts immediate subdirectories in a JSON directory.
  *        A subdirectory is a direct child JSON object.
@@ -173,6 +294,10 @@ int count_subdirs(json_t *obj);
  * Special files are virtual files used for filesystem control operations:
  * - /.status - shows filesystem status (SAVED or UNSAVED).
  * - /.save - triggers saving changes (writing to a file causes saving).
+ * - /.patch - applies a JSON Patch written to it.
+ * - /.ctl - runs the control commands written to it.
+ * - /.stats, /.stats.prom - show the operation metrics.
+ * - /.trace - shows the recorded spans of the requests.
  * 
  * @param path The absolute file path to check.
  * 
@@ -180,6 +305,122 @@ int count_subdirs(json_t *obj);
  */
 int is_special_file(const char *path);
 
+/**
+ * @brief Gives the special file with the given index.
+ * 
+ * Together with count_special_files() allows to enumerate 
+ * the special files, e.g. when listing the root directory.
+ * 
+ * @param index Index of the special file, starting from 0.
+ * 
+ * @return Absolute path of the special file, NULL if index is out of range.
+ * 
+ * @see is_special_file
+ */
+const char *get_special_file(int index);
+
+/**
+ * @brief Counts the special files.
+ * @return Number of the special files.
+ * @see get_special_file
+ */
+int count_special_files(void);
+
+/**
+ * @brief Checks if an object is a converted array.
+ * 
+ * An object of size N is a converted array if its keys are exactly
+ * SPECIAL_PREFIX0 ... SPECIAL_PREFIX(N-1).
+ * 
+ * @param obj JSON object representing a directory.
+ * 
+ * @return 1 if obj is a converted array, 0 otherwise.
+ * 
+ * @note Used with normalized JSON.
+ * @see normalize_json
+ */
+int is_normal_array(json_t *obj);
+
+/**
+ * @brief Checks if an object looks like a converted array.
+ * 
+ * Only the first and the last indexes are checked, 
+ * so that the check does not depend on the size of the array.
+ * 
+ * @param obj JSON object representing a directory.
+ * 
+ * @return 1 if obj has the keys SPECIAL_PREFIX0 and SPECIAL_PREFIX(N-1), 
+ * 		   0 otherwise (also for an empty object).
+ * 
+ * @see is_normal_array
+ */
+int is_array_like(json_t *obj);
+
+/**
+ * @brief Finds the directory of a SUBTREE_NAME virtual file.
+ * 
+ * @param path The absolute path to the file.
+ * @param root Root node of the normalized tree.
+ * 
+ * @return The directory node if the path is its SUBTREE_NAME file,
+ * 		   NULL otherwise (also if there is such a key in the directory).
+ * 
+ * @see SUBTREE_NAME
+ */
+json_t *find_subtree_dir(const char *path, json_t *root);
+
+/**
+ * @brief Represents a node as a readable JSON document.
+ * 
+ * @param node Node to represent.
+ * @param len Set to the length of the text, may be NULL.
+ * 
+ * @return Null-terminated text, NULL on failure.
+ * 
+ * @note Caller must free() the result.
+ * @see SAVE_FLAGS
+ */
+char *dump_json_document(json_t *node, size_t *len);
+
+/**
+ * @brief Represents a normalized subtree as a JSON document.
+ * 
+ * @param node Root of the subtree.
+ * @param len Set to the length of the text, may be NULL.
+ * 
+ * @return Null-terminated text, NULL on failure.
+ * 
+ * @note Caller must free() the result.
+ * @see SAVE_FLAGS
+ */
+char *export_json_subtree(json_t *node, size_t *len);
+
+/**
+ * @brief Represents a normalized node as JSON on a single line.
+ * 
+ * @param node Node, an element of an array or the root.
+ * @param len Set to the length of the text, may be NULL.
+ * 
+ * @return Null-terminated text without a newline, NULL on failure.
+ * 
+ * @note Caller must free() the result.
+ * @see LINE_FLAGS
+ */
+char *export_json_line(json_t *node, size_t *len);
+
+/**
+ * @brief Parses a JSON document as a normalized subtree.
+ * 
+ * @param text Text of the document.
+ * @param len Length of the text.
+ * 
+ * @return New normalized object, NULL if the text is not 
+ * 		   a JSON object or array.
+ * 
+ * @note Caller must json_decref() the result.
+ */
+json_t *import_json_subtree(const char *text, size_t len);
+
 /**
  * @brief Replaces the "/" character in the key with SPECIAL_SLASH.
  * 
@@ -218,4 +459,138 @@ char *reverse_replace_slash(const char *key);
  */
 int separate_filepath(const char *path, char **parent_path, char **basename);
 
+/**
+ * @brief Serializes a node to the text used as file content.
+ * 
+ * Unlike json_dumps(), the result is allocated with malloc(),
+ * so it can be realloc()'ed and free()'d regardless of 
+ * the allocation functions given to jansson.
+ * 
+ * @param node Node to serialize.
+ * @param len[out] Length of the text, can be NULL.
+ * 
+ * @return Null-terminated text, NULL on failure.
+ * 
+ * @note Caller must free() the result.
+ * @see DUMP_FLAGS
+ */
+char *dump_json_node(json_t *node, size_t *len);
+
+/**
+ * @brief Writes a string as a JSON string, quoting the characters 
+ * 		  that JSON does not allow as they are.
+ * 
+ * @param out Stream to write to.
+ * @param str Null-terminated UTF-8 string.
+ */
+void print_json_string(FILE *out, const char *str);
+
+/**
+ * @brief Represents a number or a literal as text in the given buffer.
+ * 
+ * The text is the same as dump_json_node() gives, but the heap
+ * and jansson encoder are not used.
+ * 
+ * @param node Node to represent.
+ * @param buffer Buffer for the null-terminated text.
+ * @param size Size of the buffer.
+ * 
+ * @return Length of the text on success, -EINVAL if the node is not
+ * 		   a number or a literal, -ENOBUFS if the buffer is too small.
+ * 
+ * @see REAL_PRECISION
+ */
+int format_json_scalar(json_t *node, char *buffer, size_t size);
+
+/**
+ * @brief Parses a number or a literal without jansson.
+ * 
+ * Accepts the same text as json_loads() with JSON_DECODE_ANY,
+ * including surrounding whitespace.
+ * 
+ * @param text Text to parse.
+ * @param len Length of the text.
+ * @param scalar Structure to fill with the value.
+ * 
+ * @return 0 on success, -EINVAL if the text is not a number or a literal,
+ * 		   -ERANGE if the number does not fit.
+ */
+int parse_json_scalar(const char *text, size_t len, struct json_scalar *scalar);
+
+/**
+ * @brief Gives the size of a node in compact JSON without serializing it.
+ * 
+ * The size is the length of the node in the original document
+ * written without whitespace: arrays are counted as arrays
+ * and SPECIAL_SLASH in keys as "/".
+ * 
+ * @param node Normalized node.
+ * 
+ * @return Size in bytes.
+ * 
+ * @note Used with normalized JSON.
+ */
+size_t measure_json_node(json_t *node);
+
+/**
+ * @brief Gives the type of a node in the original document.
+ * 
+ * @param node Normalized node.
+ * 
+ * @return "object", "array", "string", "number", "boolean" or "null",
+ * 		   NULL on failure.
+ * 
+ * @note Used with normalized JSON.
+ */
+const char *get_json_type_name(json_t *node);
+
+/**
+ * @brief Creates an empty pool of shared values.
+ * 
+ * @return New pool, NULL on failure.
+ * 
+ * @note Caller must destroy_json_pool() the result.
+ */
+struct json_pool *create_json_pool(void);
+
+/**
+ * @brief Gives a shared node equal to the scalar.
+ * 
+ * The first scalar with a given value is copied into the pool,
+ * the following ones get a new reference to that copy.
+ * 
+ * @param value Scalar to intern.
+ * @param pool Pool of shared scalars.
+ * 
+ * @return New reference to the shared node, NULL on failure.
+ * 
+ * @note Caller must json_decref() the result.
+ */
+json_t *intern_json_scalar(json_t *value, struct json_pool *pool);
+
+/**
+ * @brief Gives a shared node equal to a normalized object.
+ * 
+ * The children of the object must be interned already, as normalize_json() 
+ * does bottom-up. The first object with given entries is kept in the pool, 
+ * the following ones are released and get a new reference to it.
+ * 
+ * @param obj Object to intern, the reference is stolen.
+ * @param pool Pool of shared values.
+ * 
+ * @return New reference to the shared node, NULL on failure.
+ * 
+ * @note Caller must json_decref() the result.
+ */
+json_t *intern_json_object(json_t *obj, struct json_pool *pool);
+
+/**
+ * @brief Destroys a pool of shared values.
+ * 
+ * Nodes that are still referenced from the document stay alive.
+ * 
+ * @param pool Pool to destroy, can be NULL.
+ */
+void destroy_json_pool(struct json_pool *pool);
+
 #endif /* JSON_OPERATIONS_H_SENTRY */
@@ -0,0 +1,74 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief JSON Patch (RFC 6902) for the normalized tree.
+ * 
+ * JSON Pointers of the patch refer to the original document, 
+ * so array indexes and keys with "/" are translated to their 
+ * normalized form. A patch is applied as a whole or not at all.
+ */
+
+#ifndef JSON_PATCH_H_SENTRY
+#define JSON_PATCH_H_SENTRY
+
+#include <jansson.h>
+
+/* ================================= */
+/*            Declarations           */
+/* ================================= */
+
+/**
+ * @brief Applies a JSON Patch document to the normalized tree.
+ * 
+ * The operations add, remove, replace, move, copy and test are applied 
+ * in order. If one of them fails, the changes made by the previous ones 
+ * are undone and the tree stays as it was.
+ * 
+ * @param root Root of the normalized tree.
+ * @param text Text of the patch, a JSON array of operations.
+ * @param len Length of the text.
+ * @param report[out] New report with the result of every operation,
+ * 					  may be NULL.
+ * 
+ * @return Number of applied operations on success, 
+ * 		   negative error code on failure.
+ * 
+ * @note Caller must json_decref() the report.
+ */
+int apply_json_patch(json_t *root, const char *text, size_t len, 
+					 json_t **report);
+
+/**
+ * @brief Translates a JSON Pointer to a path in the filesystem.
+ * 
+ * @param root Root of the normalized tree.
+ * @param pointer JSON Pointer to translate.
+ * @param is_array[out] Set to 1 if the parent of the target 
+ * 						is a converted array, may be NULL.
+ * 
+ * @return New path, NULL if the parent of the target does not exist.
+ * 
+ * @note Caller must free() the path.
+ */
+char *json_pointer_to_path(json_t *root, const char *pointer, int *is_array);
+
+#endif /* JSON_PATCH_H_SENTRY */
@@ -26,16 +26,44 @@
  #ifndef JSONFS_H_SENTRY
  #define JSONFS_H_SENTRY
 
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+
+struct ndjson_index;
+
 /* ================================= */
 /*             Structures            */
 /* ================================= */
 
+/**
+ * @struct jsonfs_options
+ * @brief Mount options of jsonfs, given with -o.
+ * 
+ * @see get_fuse_args
+ */
+struct jsonfs_options {
+	int intern;		/**< -o intern: share identical scalars of the document */
+	int no_arena;	/**< -o no_arena: allocate the tree with malloc() instead of the arena */
+	int raw_strings;	/**< -o raw_strings: string leaves are read and written without JSON quoting */
+	int trace;		/**< -o trace: record the spans of the requests from mounting */
+	int persist_hot;	/**< -o persist_hot: keep the hottest paths in <document>.hot between mounts */
+	int no_hot;		/**< -o no_hot: do not count the accesses shown in /.hot */
+	unsigned long hot_sample;	/**< -o hot_sample=N: count one of N requests of a thread, see HOT_SAMPLE */
+	char *record_file;	/**< -o record=FILE: record the requests for jsonfs_replay */
+	int ndjson;		/**< -o ndjson: read the documents as JSON Lines whatever their extension */
+	int reload;		/**< -o reload: apply the changes other programs make to the files */
+	int image;		/**< -o image: mount from <document>.img and write it after saving */
+	char *format;	/**< -o format=NAME: read and save the documents as json, msgpack or cbor */
+};
+
 /**
  * @struct jsonfs_private_data
  * @brief Private filesystem data. 
  * 
- * This structure is allocated in main() and passed to fuse_main(),
- * then made available via fuse_get_context()->private_data in all callbacks.
+ * This structure is allocated in main() for every document and 
+ * added to the jsonfs_mount passed to fuse_main().
  * 
  * @see init_private_data
  * @see destroy_private_data
@@ -48,6 +76,41 @@ struct jsonfs_private_data {
 	uid_t uid;					/**< User ID */
 	gid_t gid; 					/**< Group ID */
 	int is_saved;				/**< Save state: 1=no unsaved changes, 0=has unsaved changes */	
+	struct jsonfs_options opts;	/**< Mount options */
+	json_t *zero;				/**< Shared default value of new files, NULL if not shared */
+	pthread_mutex_t lock;		/**< Taken by the callbacks while they use the tree */
+	char *patch_report;			/**< Report of the last patch written to /.patch */
+	size_t patch_report_len;	/**< Length of patch_report */
+	unsigned long long version;	/**< Version of the last change */
+	char *name;					/**< Top-level directory of the document, NULL if it is the only one */
+	struct ndjson_index *ndjson;	/**< Lines of a JSON Lines document, NULL for JSON */
+	json_t *file_root;			/**< Snapshot of the tree as the file has it, kept with -o reload only */
+	off_t file_size;			/**< Size of the file when it was last loaded or saved */
+	struct timespec file_mtime;	/**< Modification time of the file when it was last loaded or saved */
+	char *reload_report;		/**< Conflicts or the error of the last reload, NULL if none */
+	size_t reload_report_len;	/**< Length of reload_report */
+	int binary_format;			/**< Format of the file, an enum binary_format; BINARY_NONE for JSON */
+};
+
+/**
+ * @struct jsonfs_mount
+ * @brief Documents served by the filesystem.
+ * 
+ * This structure is allocated in main() and passed to fuse_main(),
+ * then made available via fuse_get_context()->private_data in all callbacks.
+ * A single document is the root of the mount, several documents 
+ * are top-level directories named after their files. The documents
+ * share the threads of FUSE, the arena and the metrics, each one
+ * has its own lock.
+ * 
+ * @see add_document
+ * @see find_document
+ */
+struct jsonfs_mount {
+	struct jsonfs_private_data **docs;	/**< Documents in the order of adding */
+	size_t count;						/**< Number of the documents */
+	int is_multi;						/**< 1 if the documents are top-level directories */
+	char *hot_file;						/**< Path the hot paths are saved beside, see save_hot_paths() */
 };
 
 /**
@@ -74,15 +137,27 @@ struct fuse_operations get_fuse_op(void);
 /**
  * @brief  Prepares arguments for fuse_main().
  * 
+ * The jsonfs options are removed from the arguments and stored in opts.
+ * 
  * @param argc Argument count from main().
  * @param argv Argument vector from main().
+ * @param count_documents Number of the arguments after argv[0] 
+ * 		  that name the documents, they are skipped.
  * @param args[out] A struct with adjusted argc/argv.
+ * @param opts[out] Parsed jsonfs options.
  * 
  * @return 0 on success, -1 on failure.
  * 
- * @note Caller must free args.fuse_argv.
+ * @note Caller must free args with free_fuse_args().
+ */
+int get_fuse_args(int argc, char **argv, int count_documents,
+				  struct private_args *args, struct jsonfs_options *opts);
+
+/**
+ * @brief Frees the arguments prepared by get_fuse_args().
+ * @param args Arguments to free.
  */
-int get_fuse_args(int argc, char **argv, struct private_args *args);
+void free_fuse_args(struct private_args *args);
 
 /**
  * @brief Creates and initializes a jsonfs_private_data structure.
@@ -102,4 +177,55 @@ struct jsonfs_private_data *init_private_data(json_t *json_root, const char *pat
  */
 void destroy_private_data(struct jsonfs_private_data *pd);
 
+/**
+ * @brief Remembers the file of a document as it is in sync with the tree.
+ * 
+ * With -o reload the tree is also kept as the snapshot of the file.
+ * The snapshot is a shallow copy of the root, so it shares the nodes 
+ * with the tree until they are changed (copy-on-write).
+ * 
+ * @param pd Document.
+ * @param st Attributes of the file after it was loaded or saved.
+ * 
+ * @return 0 on success, -1 on failure.
+ * 
+ * @see jsonfs_private_data
+ * @see merge_json_document
+ */
+int set_file_state(struct jsonfs_private_data *pd, const struct stat *st);
+
+/**
+ * @brief Adds a document to a mount.
+ * 
+ * In a mount of several documents the document is named after 
+ * its file without the .json, .ndjson, .jsonl, .msgpack, .mpk 
+ * or .cbor extension.
+ * 
+ * @param mount Mount of the documents.
+ * @param pd Document, owned by the mount on success.
+ * 
+ * @return 0 on success, -1 on failure or if the name is taken.
+ */
+int add_document(struct jsonfs_mount *mount, struct jsonfs_private_data *pd);
+
+/**
+ * @brief Finds the document of a path.
+ * 
+ * @param mount Mount of the documents.
+ * @param path Path in the mount.
+ * @param doc_path[out] Path inside the document.
+ * 
+ * @return The document, NULL if the path is the root of several 
+ * 		   documents or does not belong to any of them.
+ */
+struct jsonfs_private_data *find_document(const struct jsonfs_mount *mount,
+										  const char *path, 
+										  const char **doc_path);
+
+/**
+ * @brief Destroys a mount and its documents.
+ * @param mount Mount to destroy, may be NULL.
+ */
+void destroy_mount(struct jsonfs_mount *mount);
+
 #endif /* JSONFS_H_SENTRY */
@@ -0,0 +1,140 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief JSON Lines documents: one JSON value per line.
+ *
+ * The document is mounted as an array, the element SPECIAL_PREFIX<N> 
+ * is the N-th non-empty line. The lines are parsed by several threads.
+ * The offsets of the lines are kept in an index, so saving writes 
+ * only the changed lines: new elements are appended to the file, 
+ * changed lines of the same length are overwritten in place, 
+ * otherwise the unchanged lines are copied to the new file as they are.
+ */
+
+#ifndef NDJSON_H_SENTRY
+#define NDJSON_H_SENTRY
+
+#include <jansson.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "json_operations.h"
+
+/**
+ * @def NDJSON_MIN_LINES
+ * @brief Minimal number of lines parsed by one thread.
+ */
+#define NDJSON_MIN_LINES	4096
+
+/**
+ * @def NDJSON_MAX_THREADS
+ * @brief Maximal number of threads parsing the lines.
+ */
+#define NDJSON_MAX_THREADS	64
+
+/* ================================= */
+/*               Types               */
+/* ================================= */
+
+struct jsonfs_private_data;
+
+/**
+ * @struct ndjson_line
+ * @brief Line of an element in the file.
+ */
+struct ndjson_line {
+	size_t key;			/**< Index of the element, the number after SPECIAL_PREFIX */
+	off_t offset;		/**< Offset of the line in the file */
+	size_t len;			/**< Length of the line without the newline */
+};
+
+/**
+ * @struct ndjson_index
+ * @brief Lines of the elements as they were at the last loading or saving.
+ * 
+ * @see load_ndjson_file
+ * @see save_ndjson_file
+ */
+struct ndjson_index {
+	struct ndjson_line *lines;		/**< Lines sorted by key */
+	size_t count;					/**< Number of the lines in the index */
+	size_t count_file_lines;		/**< Number of the non-empty lines in the file */
+	off_t file_size;				/**< Size of the file */
+	struct timespec file_mtime;		/**< Modification time of the file */
+	int has_final_newline;			/**< 1 if the file is empty or ends with a newline */
+	unsigned long long version;		/**< Version of the document the file has */
+};
+
+/* ================================= */
+/*            Declarations           */
+/* ================================= */
+
+/**
+ * @brief Checks if a file is a JSON Lines document by its extension,
+ * 		  .ndjson or .jsonl.
+ * 
+ * @return 1 if it is, 0 otherwise.
+ */
+int is_ndjson_file(const char *path);
+
+/**
+ * @brief Loads a JSON Lines document.
+ * 
+ * Every non-empty line must be a JSON value. Without a pool the lines 
+ * are parsed and normalized by up to NDJSON_MAX_THREADS threads. 
+ * With a pool they are parsed in parallel, but normalized 
+ * by the calling thread, since the pool is not shared.
+ * 
+ * @param path Path to the file.
+ * @param pool Pool of shared scalars, may be NULL.
+ * @param index[out] Index of the lines.
+ * @param error[out] Description of an error, the line is counted from 1.
+ * 
+ * @return Normalized root on success, NULL on failure.
+ * 
+ * @note The index must be freed with destroy_ndjson_index().
+ */
+json_t *load_ndjson_file(const char *path, struct json_pool *pool,
+						 struct ndjson_index **index, json_error_t *error);
+
+/**
+ * @brief Saves a JSON Lines document.
+ * 
+ * An element is unchanged if its path has not got a new version 
+ * since the index was made. The index is used only if the file 
+ * has the size and the modification time it had, otherwise 
+ * all the lines are written. A root that is not an array 
+ * is written as a single line.
+ * 
+ * @param pd Private data of the document, pd->ndjson is updated.
+ * 
+ * @return 0 on success, -1 on failure.
+ */
+int save_ndjson_file(struct jsonfs_private_data *pd);
+
+/**
+ * @brief Frees an index of lines.
+ * @param index Index to free, may be NULL.
+ */
+void destroy_ndjson_index(struct ndjson_index *index);
+
+#endif /* NDJSON_H_SENTRY */
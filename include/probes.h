@@ -0,0 +1,126 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief USDT probes for bpftrace and other dynamic tracers.
+ *
+ * The probes are compiled in if <sys/sdt.h> is available 
+ * (HAVE_SYS_SDT_H), otherwise they expand to nothing. A compiled 
+ * probe is a single nop until a tracer attaches to it. The arguments 
+ * are evaluated only while a tracer is attached, which is known from
+ * the semaphores of the probes.
+ *
+ * Probes of the provider jsonfs:
+ * - handler__entry(name, path, size, offset, depth)
+ * - handler__return(name, path, result, depth)
+ * - save__start(path), save__done(path, result)
+ * - load__start(path), load__done(path, result)
+ * - normalize__start(path), normalize__done(path, result)
+ *
+ * @see tools/jsonfs_lat.bt
+ */
+
+#ifndef PROBES_H_SENTRY
+#define PROBES_H_SENTRY
+
+#ifdef HAVE_SYS_SDT_H
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+/* Are defined in probes.c, a tracer increments them while attached */
+extern unsigned short jsonfs_handler__entry_semaphore;
+extern unsigned short jsonfs_handler__return_semaphore;
+extern unsigned short jsonfs_save__start_semaphore;
+extern unsigned short jsonfs_save__done_semaphore;
+extern unsigned short jsonfs_load__start_semaphore;
+extern unsigned short jsonfs_load__done_semaphore;
+extern unsigned short jsonfs_normalize__start_semaphore;
+extern unsigned short jsonfs_normalize__done_semaphore;
+
+/**
+ * @brief Counts the components of a path, the depth of its node.
+ */
+static inline int get_path_depth(const char *path)
+{
+	int depth = 0;
+
+	if (!path) { return 0; }
+
+	for (const char *c = path; *c; c++) {
+		if (*c != '/' && (c == path || c[-1] == '/')) { depth++; }
+	}
+
+	return depth;
+}
+
+#define PROBE_IS_ENABLED(probe) \
+	__builtin_expect(jsonfs_##probe##_semaphore, 0)
+
+/**
+ * @def PROBE_HANDLER_ENTRY
+ * @brief Fires before a handler is called.
+ */
+#define PROBE_HANDLER_ENTRY(handler, path, size, offset) \
+	do { \
+		if (PROBE_IS_ENABLED(handler__entry)) { \
+			DTRACE_PROBE5(jsonfs, handler__entry, #handler, (path), \
+						  (long long) (size), (long long) (offset), \
+						  get_path_depth(path)); \
+		} \
+	} while (0)
+
+/**
+ * @def PROBE_HANDLER_RETURN
+ * @brief Fires after a handler returned.
+ */
+#define PROBE_HANDLER_RETURN(handler, path, result) \
+	do { \
+		if (PROBE_IS_ENABLED(handler__return)) { \
+			DTRACE_PROBE4(jsonfs, handler__return, #handler, (path), \
+						  (long long) (result), get_path_depth(path)); \
+		} \
+	} while (0)
+
+#define PROBE1(probe, arg1) \
+	do { \
+		if (PROBE_IS_ENABLED(probe)) { \
+			DTRACE_PROBE1(jsonfs, probe, arg1); \
+		} \
+	} while (0)
+
+#define PROBE2(probe, arg1, arg2) \
+	do { \
+		if (PROBE_IS_ENABLED(probe)) { \
+			DTRACE_PROBE2(jsonfs, probe, arg1, arg2); \
+		} \
+	} while (0)
+
+#else
+
+#define PROBE_HANDLER_ENTRY(handler, path, size, offset)	do { } while (0)
+#define PROBE_HANDLER_RETURN(handler, path, result)		do { } while (0)
+#define PROBE1(probe, arg1)								do { } while (0)
+#define PROBE2(probe, arg1, arg2)						do { } while (0)
+
+#endif /* HAVE_SYS_SDT_H */
+
+#endif /* PROBES_H_SENTRY */
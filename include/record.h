@@ -0,0 +1,129 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Recording of the FUSE requests for replaying them later.
+ *
+ * With -o record=FILE every request is appended to FILE in a compact
+ * binary format: a magic header, then one record per request with 
+ * the operation, the variable-length (LEB128) start time delta, 
+ * duration, result, size, offset, flags, file handle and the paths.
+ * The written data is not recorded, so a replay uses synthetic data
+ * of the recorded size.
+ *
+ * @see bench/replay.c
+ */
+
+#ifndef RECORD_H_SENTRY
+#define RECORD_H_SENTRY
+
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "stats.h"
+
+/**
+ * @def RECORD_MAGIC
+ * @brief First bytes of a record file, the last one is the format version.
+ */
+#define RECORD_MAGIC		"JFSREC\0\1"
+#define RECORD_MAGIC_LEN	8
+
+/* ================================= */
+/*               Types               */
+/* ================================= */
+
+/**
+ * @struct record_args
+ * @brief Arguments of a request besides its path.
+ */
+struct record_args {
+	const char *path2;	/**< New path of rename, name of getxattr, may be NULL */
+	uint64_t size;		/**< Size of read, write, truncate and xattr requests */
+	int64_t offset;		/**< Offset of read, write and readdir */
+	uint64_t flags;		/**< Flags of open, mode of mknod and mkdir */
+	uint64_t fh;		/**< File handle, 0 if there is none */
+};
+
+/**
+ * @struct record_entry
+ * @brief Request read from a record file.
+ */
+struct record_entry {
+	enum stats_op op;
+	uint64_t start;			/**< Start in nanoseconds since the recording began */
+	uint64_t duration;		/**< Duration in nanoseconds */
+	int64_t result;			/**< Result returned to the kernel */
+	struct record_args args;
+	char path[PATH_MAX];
+	char path2[PATH_MAX];	/**< args.path2 points here if it was recorded */
+};
+
+/* ================================= */
+/*            Declarations           */
+/* ================================= */
+
+/**
+ * @brief Starts recording the requests to a file.
+ * 
+ * @param file Path to the record file, it is truncated.
+ * 
+ * @return 0 on success, -1 on failure.
+ */
+int start_recording(const char *file);
+
+/**
+ * @brief Writes the remaining records and closes the file.
+ */
+void stop_recording(void);
+
+/**
+ * @brief Records a finished request, does nothing if recording is off.
+ * 
+ * @param op Operation of the request.
+ * @param start Time of the beginning from get_stats_time().
+ * @param path Path of the request, may be NULL.
+ * @param args Other arguments, may be NULL.
+ * @param result Result of the request.
+ */
+void write_record(enum stats_op op, uint64_t start, const char *path,
+				  const struct record_args *args, int result);
+
+/**
+ * @brief Opens a record file for reading.
+ * @return The file positioned at the first record, NULL on failure.
+ */
+FILE *open_record_file(const char *file);
+
+/**
+ * @brief Reads the next record.
+ * 
+ * @param in File from open_record_file().
+ * @param last_start[in,out] Start of the previous record, 0 before the first.
+ * @param entry[out] Read record.
+ * 
+ * @return 1 if a record was read, 0 at the end of the file, 
+ * 		   -1 if the file is corrupted.
+ */
+int read_record(FILE *in, uint64_t *last_start, struct record_entry *entry);
+
+#endif /* RECORD_H_SENTRY */
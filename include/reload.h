@@ -0,0 +1,93 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Reloading of the documents changed by other programs.
+ *
+ * With -o reload a thread watches the directories of the documents
+ * with inotify. When a file is written or replaced by another program,
+ * it is parsed in the background and merged into the tree: only the
+ * changed nodes are replaced and their kernel cache is invalidated.
+ * The saves of jsonfs itself are recognized by the size and the
+ * modification time of the file and are not reloaded.
+ *
+ * @see merge_json_document
+ */
+
+#ifndef RELOAD_H_SENTRY
+#define RELOAD_H_SENTRY
+
+#include "jsonfs.h"
+
+/**
+ * @def RELOAD_MAX_CONFLICTS
+ * @brief Number of the conflicting paths listed in /.status.
+ */
+#define RELOAD_MAX_CONFLICTS	16
+
+struct fuse;
+
+/* ================================= */
+/*            Declarations           */
+/* ================================= */
+
+/**
+ * @brief Starts watching the files of the documents.
+ * 
+ * @param mount Documents, they must live until stop_reload_watcher().
+ * @param fuse Filesystem whose kernel cache is invalidated.
+ * 
+ * @return 0 on success, -1 on failure.
+ */
+int start_reload_watcher(struct jsonfs_mount *mount, struct fuse *fuse);
+
+/**
+ * @brief Stops watching and waits for a running reload to finish.
+ * 
+ * Does nothing if the watcher was not started.
+ */
+void stop_reload_watcher(void);
+
+/**
+ * @brief Reloads a document if its file was changed since 
+ * it was last loaded or saved.
+ * 
+ * The result is reported through /.status: the conflicts with 
+ * the unsaved changes or the error of parsing.
+ * 
+ * @param pd Document, its lock must not be taken.
+ * @param changed_paths[out] Paths of the document whose kernel cache 
+ * 		  must be invalidated, NULL-terminated, may be NULL.
+ * 
+ * @return Number of the applied changes, 0 if the file was not
+ * 		   changed, negative error code on failure.
+ * 
+ * @note The paths must be freed with free_changed_paths().
+ */
+int reload_document(struct jsonfs_private_data *pd, char ***changed_paths);
+
+/**
+ * @brief Frees the paths given by reload_document().
+ * @param paths Paths to free, may be NULL.
+ */
+void free_changed_paths(char **paths);
+
+#endif /* RELOAD_H_SENTRY */
@@ -0,0 +1,153 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Operation metrics of the filesystem.
+ *
+ * Every thread counts into its own shard, so the callbacks do not
+ * share cache lines or take locks. The shards are summed up only
+ * when the metrics are read through /.stats or /.stats.prom.
+ * Latencies are kept in log-linear histograms: 8 buckets for each
+ * power of two, which bounds the error of a percentile by 12.5%.
+ */
+
+#ifndef STATS_H_SENTRY
+#define STATS_H_SENTRY
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ================================= */
+/*               Types               */
+/* ================================= */
+
+/**
+ * @enum stats_op
+ * @brief Timed operations, the FUSE callbacks and saving.
+ */
+enum stats_op {
+	STATS_GETATTR,
+	STATS_MKNOD,
+	STATS_MKDIR,
+	STATS_UNLINK,
+	STATS_RMDIR,
+	STATS_RENAME,
+	STATS_TRUNCATE,
+	STATS_OPEN,
+	STATS_READ,
+	STATS_WRITE,
+	STATS_READ_BUF,
+	STATS_WRITE_BUF,
+	STATS_FLUSH,
+	STATS_RELEASE,
+	STATS_OPENDIR,
+	STATS_READDIR,
+	STATS_RELEASEDIR,
+	STATS_UTIMENS,
+	STATS_GETXATTR,
+	STATS_LISTXATTR,
+	STATS_SAVE,
+	STATS_COUNT_OPS
+};
+
+/**
+ * @enum stats_event
+ * @brief Counted events.
+ */
+enum stats_event {
+	STATS_DUMPS,			/**< Serializations of JSON to text */
+	STATS_LOADS,			/**< Parsings of JSON text */
+	STATS_COUNT_EVENTS
+};
+
+/* ================================= */
+/*            Declarations           */
+/* ================================= */
+
+/**
+ * @brief Gives the current time for measuring an operation.
+ * @return Monotonic time in nanoseconds.
+ */
+uint64_t get_stats_time(void);
+
+/**
+ * @brief Counts an operation and its latency.
+ *
+ * @param op Operation.
+ * @param start Time of the beginning from get_stats_time().
+ */
+void count_stats_op(enum stats_op op, uint64_t start);
+
+/**
+ * @brief Gives the name of an operation.
+ * @return The name, "unknown" for an invalid operation.
+ */
+const char *get_stats_op_name(enum stats_op op);
+
+/**
+ * @brief Counts an event.
+ * @param event Event.
+ */
+void count_stats_event(enum stats_event event);
+
+/**
+ * @brief Counts a lookup of a node by path.
+ * @param depth Number of the path components walked.
+ */
+void count_stats_lookup(int depth);
+
+/**
+ * @brief Remembers the time spent on mounting.
+ *
+ * @param load_ns Time of parsing the JSON file in nanoseconds.
+ * @param normalize_ns Time of normalizing the tree in nanoseconds.
+ */
+void set_stats_load_time(uint64_t load_ns, uint64_t normalize_ns);
+
+/**
+ * @brief Renders the metrics as a JSON object.
+ *
+ * @param len[out] Length of the text, may be NULL.
+ *
+ * @return The text on success, NULL on failure.
+ *
+ * @note The returned text must be freed with free().
+ */
+char *format_stats_json(size_t *len);
+
+/**
+ * @brief Renders the metrics in the Prometheus text format.
+ *
+ * @param len[out] Length of the text, may be NULL.
+ *
+ * @return The text on success, NULL on failure.
+ *
+ * @note The returned text must be freed with free().
+ */
+char *format_stats_prometheus(size_t *len);
+
+/**
+ * @brief Releases the shards of all threads.
+ * @warning No callback may run during and after the call.
+ */
+void release_stats(void);
+
+#endif /* STATS_H_SENTRY */
@@ -0,0 +1,110 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Tracing of the requests in the Chrome trace-event format.
+ *
+ * When tracing is on, every FUSE request and the expensive stages 
+ * inside it (lookups, parsing, serialization, saving) are recorded 
+ * as spans into a ring buffer of the thread. The last spans of all 
+ * threads are read from /.trace and can be opened in chrome://tracing 
+ * or Perfetto. When tracing is off, a span costs one load of a flag.
+ */
+
+#ifndef TRACE_H_SENTRY
+#define TRACE_H_SENTRY
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @def TRACE_FUSE
+ * @brief Category of the spans of FUSE requests.
+ */
+#define TRACE_FUSE	"fuse"
+
+/**
+ * @def TRACE_JSON
+ * @brief Category of the spans of the stages inside the requests.
+ */
+#define TRACE_JSON	"json"
+
+/* ================================= */
+/*            Declarations           */
+/* ================================= */
+
+/**
+ * @brief Turns tracing on or off.
+ * 
+ * The recorded spans are kept, so they can be read after turning off.
+ * 
+ * @param is_enabled 1 to turn on, 0 to turn off.
+ */
+void set_trace_enabled(int is_enabled);
+
+/**
+ * @brief Checks if tracing is on.
+ * @return 1 if tracing is on, 0 otherwise.
+ */
+int trace_is_enabled(void);
+
+/**
+ * @brief Begins a span.
+ * @return Start time of the span, 0 if tracing is off.
+ */
+uint64_t begin_trace_span(void);
+
+/**
+ * @brief Ends a span and records it.
+ * 
+ * Does nothing if tracing is off or the span was begun while it was off.
+ * 
+ * @param name Name of the span, must stay valid until unmounting.
+ * @param cat Category of the span, must stay valid until unmounting.
+ * @param start Start time from begin_trace_span() or get_stats_time().
+ * @param arg Path or another argument shown with the span, may be NULL.
+ */
+void end_trace_span(const char *name, const char *cat, uint64_t start,
+					const char *arg);
+
+/**
+ * @brief Drops the recorded spans of all threads.
+ */
+void clear_trace(void);
+
+/**
+ * @brief Renders the recorded spans as a Chrome trace-event JSON document.
+ * 
+ * @param len[out] Length of the text, may be NULL.
+ * 
+ * @return The text on success, NULL on failure.
+ * 
+ * @note The returned text must be freed with free().
+ */
+char *format_trace_json(size_t *len);
+
+/**
+ * @brief Releases the ring buffers of all threads.
+ * @warning No callback may run during and after the call.
+ */
+void release_trace(void);
+
+#endif /* TRACE_H_SENTRY */
@@ -0,0 +1,464 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file 
+ * @brief Contains definition of the pool allocator for the JSON tree.
+ * 
+ * Function declarations, types and specifications can be found in arena.h.
+ */
+
+#include <jansson.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "arena.h"
+
+/**
+ * @def CHUNK_SIZE
+ * @brief Size of a chunk from which small blocks are cut.
+ */
+#define CHUNK_SIZE		(64 * 1024)
+
+/**
+ * @def CACHE_BATCH
+ * @brief Number of blocks moved between a cache and the shared lists at once.
+ */
+#define CACHE_BATCH		256
+
+/**
+ * @def LARGE_CLASS
+ * @brief Size class of the blocks allocated directly with malloc().
+ */
+#define LARGE_CLASS		((size_t) -1)
+
+/**
+ * @brief Payload sizes of the size classes.
+ * 
+ * Cover the scalar nodes, objects, hashtable entries and short strings.
+ */
+static const size_t class_sizes[] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512
+};
+
+#define COUNT_CLASSES	(sizeof(class_sizes) / sizeof(class_sizes[0]))
+
+/**
+ * @struct block_header
+ * @brief Header before the payload of every block.
+ */
+struct block_header {
+	size_t class;	/**< Index in class_sizes or LARGE_CLASS */
+};
+
+/**
+ * @struct large_header
+ * @brief Header of a large block, links it into the list of large blocks.
+ */
+struct large_header {
+	struct large_header *prev;	/**< Previous large block */
+	struct large_header *next;	/**< Next large block */
+	size_t size;				/**< Size of the whole block */
+	struct block_header hdr;	/**< Common header, right before the payload */
+};
+
+/**
+ * @struct free_block
+ * @brief Released small block, stored in its own payload.
+ * 
+ * The smallest payload holds two pointers, so the first block 
+ * of a batch also links the batches of the shared free lists.
+ */
+struct free_block {
+	struct free_block *next;		/**< Next released block of the same class */
+	struct free_block *next_batch;	/**< First block of the next batch, shared lists only */
+};
+
+/**
+ * @struct chunk
+ * @brief Memory from which small blocks are cut.
+ */
+struct chunk {
+	struct chunk *next;	/**< Previously allocated chunk */
+	size_t used;		/**< Bytes of data already cut */
+	char data[];		/**< Blocks */
+};
+
+/**
+ * @struct arena_cache
+ * @brief Blocks of a thread, used without the lock.
+ * 
+ * A thread allocates from its free lists and its own chunk. Blocks 
+ * released by the thread go to its free lists, whichever thread
+ * allocated them. Only batches of CACHE_BATCH blocks are moved 
+ * between the cache and the shared free lists under the lock, 
+ * so parsing threads and FUSE threads do not wait for each other.
+ * The cache of a finished thread is taken over by the next new thread.
+ */
+struct arena_cache {
+	struct free_block *free_lists[COUNT_CLASSES];
+	size_t count_free_blocks[COUNT_CLASSES];	/**< Lengths of free_lists */
+	struct chunk *chunk;		/**< Chunk to cut new blocks from, NULL if none */
+	size_t count_alloc;			/**< Allocations by the thread */
+	size_t count_free;			/**< Releases by the thread */
+	size_t bytes_in_use;		/**< Allocated minus released bytes, may wrap around */
+	int is_orphaned;			/**< 1 if the thread has finished */
+	struct arena_cache *next;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	int is_used;
+	unsigned long generation;		/**< Changed by release_json_arena() */
+	pthread_key_t cache_key;		/**< Marks the cache orphaned when its thread ends */
+	struct free_block *free_batches[COUNT_CLASSES];
+	struct arena_cache *caches;
+	struct chunk *chunks;
+	struct large_header *large;
+	struct arena_stats stats;		/**< Chunks and large blocks, the caches count the rest */
+} arena = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static __thread struct arena_cache *local_cache = NULL;
+static __thread unsigned long local_generation = 0;
+
+/**
+ * @brief Finds the size class for the payload size.
+ * @return Index in class_sizes or LARGE_CLASS.
+ */
+static size_t find_class(size_t size)
+{
+	for (size_t i = 0; i < COUNT_CLASSES; i++) {
+		if (size <= class_sizes[i]) { return i; }
+	}
+	return LARGE_CLASS;
+}
+
+/**
+ * @brief Destructor of the thread-specific cache key.
+ * 
+ * The cache of the finished thread keeps its blocks 
+ * for the next thread that takes it over.
+ */
+static void orphan_cache(void *cache)
+{
+	pthread_mutex_lock(&arena.lock);
+	if (local_generation == arena.generation) {
+		((struct arena_cache *) cache)->is_orphaned = 1;
+	}
+	pthread_mutex_unlock(&arena.lock);
+}
+
+static void create_cache_key(void)
+{
+	pthread_key_create(&arena.cache_key, orphan_cache);
+}
+
+/**
+ * @brief Gives the cache of the calling thread, taking over 
+ * an orphaned one or creating it on first use.
+ * 
+ * @return The cache or NULL on failure.
+ */
+static struct arena_cache *get_local_cache(void)
+{
+	struct arena_cache *cache = NULL;
+
+	if (local_cache && local_generation == arena.generation) { 
+		return local_cache; 
+	}
+
+	pthread_mutex_lock(&arena.lock);
+
+	for (cache = arena.caches; cache && !cache->is_orphaned; cache = cache->next);
+
+	if (cache) { cache->is_orphaned = 0; }
+	else {
+		cache = calloc(1, sizeof(struct arena_cache));
+		if (cache) {
+			cache->next = arena.caches;
+			arena.caches = cache;
+		}
+	}
+
+	local_generation = arena.generation;
+	pthread_mutex_unlock(&arena.lock);
+
+	CHECK_POINTER(cache, NULL);
+	pthread_setspecific(arena.cache_key, cache);
+	local_cache = cache;
+	return cache;
+}
+
+/**
+ * @brief Allocates a large block directly.
+ * @return Payload of the block, NULL on failure.
+ */
+static void *alloc_large(size_t size)
+{
+	struct large_header *large = NULL;
+
+	large = malloc(sizeof(struct large_header) + size);
+	CHECK_POINTER(large, NULL);
+
+	large->size = sizeof(struct large_header) + size;
+	large->hdr.class = LARGE_CLASS;
+	large->prev = NULL;
+
+	pthread_mutex_lock(&arena.lock);
+	large->next = arena.large;
+	if (arena.large) { arena.large->prev = large; }
+	arena.large = large;
+
+	arena.stats.count_alloc++;
+	arena.stats.count_large++;
+	arena.stats.bytes_in_use += large->size;
+	arena.stats.bytes_reserved += large->size;
+	pthread_mutex_unlock(&arena.lock);
+
+	return &large->hdr + 1;
+}
+
+/**
+ * @brief Cuts a new block from the chunk of the cache.
+ * @return The block, NULL on failure.
+ */
+static struct block_header *cut_block(struct arena_cache *cache, size_t block_size)
+{
+	struct block_header *hdr = NULL;
+	struct chunk *chunk = cache->chunk;
+
+	if (!chunk || chunk->used + block_size > CHUNK_SIZE) {
+		chunk = malloc(sizeof(struct chunk) + CHUNK_SIZE);
+		CHECK_POINTER(chunk, NULL);
+		chunk->used = 0;
+
+		pthread_mutex_lock(&arena.lock);
+		chunk->next = arena.chunks;
+		arena.chunks = chunk;
+		arena.stats.count_chunks++;
+		arena.stats.bytes_reserved += sizeof(struct chunk) + CHUNK_SIZE;
+		pthread_mutex_unlock(&arena.lock);
+
+		cache->chunk = chunk;
+	}
+
+	hdr = (struct block_header *) (chunk->data + chunk->used);
+	chunk->used += block_size;
+	return hdr;
+}
+
+/**
+ * @brief Allocation function for jansson.
+ * @see json_set_alloc_funcs
+ */
+static void *arena_malloc(size_t size)
+{
+	size_t class;
+	size_t block_size;
+	struct block_header *hdr = NULL;
+	struct arena_cache *cache = NULL;
+	struct free_block *batch = NULL;
+
+	class = find_class(size);
+	if (class == LARGE_CLASS) { return alloc_large(size); }
+
+	block_size = sizeof(struct block_header) + class_sizes[class];
+
+	cache = get_local_cache();
+	CHECK_POINTER(cache, NULL);
+
+	/* Blocks released by other threads are taken back in a batch,
+	 * the shared list is peeked at without the lock and checked again */
+	if (!cache->free_lists[class]
+		&& __atomic_load_n(&arena.free_batches[class], __ATOMIC_RELAXED)) {
+		pthread_mutex_lock(&arena.lock);
+		batch = arena.free_batches[class];
+		if (batch) {
+			__atomic_store_n(&arena.free_batches[class], batch->next_batch,
+							 __ATOMIC_RELAXED);
+		}
+		pthread_mutex_unlock(&arena.lock);
+
+		if (batch) {
+			cache->free_lists[class] = batch;
+			cache->count_free_blocks[class] = CACHE_BATCH;
+		}
+	}
+
+	if (cache->free_lists[class]) {
+		hdr = (struct block_header *) cache->free_lists[class] - 1;
+		cache->free_lists[class] = cache->free_lists[class]->next;
+		cache->count_free_blocks[class]--;
+	}
+	else {
+		hdr = cut_block(cache, block_size);
+		CHECK_POINTER(hdr, NULL);
+	}
+
+	hdr->class = class;
+	cache->count_alloc++;
+	cache->bytes_in_use += block_size;
+
+	return hdr + 1;
+}
+
+/**
+ * @brief Gives a batch of released blocks to the shared free lists,
+ * when the cache keeps too many of them.
+ */
+static void give_batch(struct arena_cache *cache, size_t class)
+{
+	struct free_block *batch = cache->free_lists[class];
+	struct free_block *last = batch;
+
+	for (size_t i = 1; i < CACHE_BATCH; i++) { last = last->next; }
+
+	cache->free_lists[class] = last->next;
+	cache->count_free_blocks[class] -= CACHE_BATCH;
+	last->next = NULL;
+
+	pthread_mutex_lock(&arena.lock);
+	batch->next_batch = arena.free_batches[class];
+	__atomic_store_n(&arena.free_batches[class], batch, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&arena.lock);
+}
+
+/**
+ * @brief Release function for jansson.
+ * @see json_set_alloc_funcs
+ */
+static void arena_free(void *ptr)
+{
+	struct block_header *hdr = NULL;
+	struct large_header *large = NULL;
+	struct free_block *block = NULL;
+	struct arena_cache *cache = NULL;
+
+	if (!ptr) { return; }
+
+	hdr = (struct block_header *) ptr - 1;
+
+	if (hdr->class == LARGE_CLASS) {
+		large = (struct large_header *) ((char *) ptr - sizeof(struct large_header));
+
+		pthread_mutex_lock(&arena.lock);
+		if (large->prev) { large->prev->next = large->next; }
+		else { arena.large = large->next; }
+		if (large->next) { large->next->prev = large->prev; }
+
+		arena.stats.count_free++;
+		arena.stats.count_large--;
+		arena.stats.bytes_in_use -= large->size;
+		arena.stats.bytes_reserved -= large->size;
+		pthread_mutex_unlock(&arena.lock);
+
+		free(large);
+		return;
+	}
+
+	/* Without a cache the block stays unused until the arena is released */
+	cache = get_local_cache();
+	if (!cache) { return; }
+
+	block = ptr;
+	block->next = cache->free_lists[hdr->class];
+	cache->free_lists[hdr->class] = block;
+	cache->count_free_blocks[hdr->class]++;
+	cache->count_free++;
+	cache->bytes_in_use -= sizeof(struct block_header) + class_sizes[hdr->class];
+
+	if (cache->count_free_blocks[hdr->class] >= 2 * CACHE_BATCH) {
+		give_batch(cache, hdr->class);
+	}
+}
+
+int init_json_arena(void)
+{
+	pthread_once(&key_once, create_cache_key);
+
+	pthread_mutex_lock(&arena.lock);
+	json_set_alloc_funcs(arena_malloc, arena_free);
+	arena.is_used = 1;
+	pthread_mutex_unlock(&arena.lock);
+
+	return 0;
+}
+
+int json_arena_is_used(void)
+{
+	return arena.is_used;
+}
+
+void release_json_arena(void)
+{
+	struct chunk *chunk = NULL;
+	struct large_header *large = NULL;
+	struct arena_cache *cache = NULL;
+	void *next = NULL;
+
+	pthread_mutex_lock(&arena.lock);
+
+	/* The caches of the live threads are dropped by the new generation */
+	for (cache = arena.caches; cache; cache = next) {
+		next = cache->next;
+		free(cache);
+	}
+
+	for (chunk = arena.chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+
+	for (large = arena.large; large; large = next) {
+		next = large->next;
+		free(large);
+	}
+
+	arena.caches = NULL;
+	arena.chunks = NULL;
+	arena.large = NULL;
+	arena.generation++;
+	memset(arena.free_batches, 0, sizeof(arena.free_batches));
+	memset(&arena.stats, 0, sizeof(arena.stats));
+
+	json_set_alloc_funcs(malloc, free);
+	arena.is_used = 0;
+
+	pthread_mutex_unlock(&arena.lock);
+}
+
+void get_arena_stats(struct arena_stats *stats)
+{
+	if (!stats) { return; }
+
+	pthread_mutex_lock(&arena.lock);
+	*stats = arena.stats;
+
+	/* The counters of the other threads may be a little behind */
+	for (struct arena_cache *cache = arena.caches; cache; cache = cache->next) {
+		stats->count_alloc += cache->count_alloc;
+		stats->count_free += cache->count_free;
+		stats->bytes_in_use += cache->bytes_in_use;
+	}
+	pthread_mutex_unlock(&arena.lock);
+}
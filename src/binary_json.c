@@ -0,0 +1,823 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file 
+ * @brief Contains definition of the MessagePack and CBOR documents.
+ * 
+ * Function declarations and specifications can be found in binary_json.h.
+ */
+
+#include <jansson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "binary_json.h"
+
+/**
+ * @def WRITE_BUFFER
+ * @brief Size of the stdio buffer of a saved file.
+ */
+#define WRITE_BUFFER	(256 * 1024)
+
+/**
+ * @def CBOR_BREAK
+ * @brief Byte ending the items of an indefinite-length CBOR value.
+ */
+#define CBOR_BREAK		0xFF
+
+/**
+ * @def CBOR_INDEFINITE
+ * @brief Additional information of an indefinite-length CBOR value.
+ */
+#define CBOR_INDEFINITE	31
+
+/**
+ * @struct binary_reader
+ * @brief Position in the mapped file while it is decoded.
+ */
+struct binary_reader {
+	const unsigned char *data;
+	size_t size;
+	size_t pos;				/**< Offset of the next byte */
+	const char *error;		/**< First error, NULL if there is none */
+	size_t error_pos;		/**< Offset of the value with the error */
+};
+
+enum binary_format get_binary_format(const char *path)
+{
+	const char *ext = NULL;
+
+	CHECK_POINTER(path, BINARY_NONE);
+
+	ext = strrchr(path, '.');
+	if (!ext || strchr(ext, '/')) { return BINARY_NONE; }
+
+	if (strcmp(ext, ".msgpack") == 0 || strcmp(ext, ".mpk") == 0) { 
+		return BINARY_MSGPACK; 
+	}
+	if (strcmp(ext, ".cbor") == 0) { return BINARY_CBOR; }
+
+	return BINARY_NONE;
+}
+
+int parse_binary_format(const char *name, enum binary_format *format)
+{
+	CHECK_POINTER(name, -1);
+	CHECK_POINTER(format, -1);
+
+	if (strcmp(name, "json") == 0) { *format = BINARY_NONE; }
+	else if (strcmp(name, "msgpack") == 0) { *format = BINARY_MSGPACK; }
+	else if (strcmp(name, "cbor") == 0) { *format = BINARY_CBOR; }
+	else { return -1; }
+
+	return 0;
+}
+
+/* ================================= */
+/*              Decoding             */
+/* ================================= */
+
+/**
+ * @brief Remembers the first error.
+ * @return NULL, so it can be returned as a value.
+ */
+static json_t *set_error(struct binary_reader *r, size_t pos, const char *error)
+{
+	if (!r->error) {
+		r->error = error;
+		r->error_pos = pos;
+	}
+
+	return NULL;
+}
+
+static int read_bytes(struct binary_reader *r, size_t len, 
+					  const unsigned char **bytes)
+{
+	if (len > r->size - r->pos) {
+		set_error(r, r->pos, "unexpected end of file");
+		return -1;
+	}
+
+	*bytes = r->data + r->pos;
+	r->pos += len;
+	return 0;
+}
+
+/**
+ * @brief Reads a big-endian unsigned integer of len bytes.
+ */
+static int read_uint(struct binary_reader *r, size_t len, uint64_t *value)
+{
+	const unsigned char *bytes = NULL;
+
+	if (read_bytes(r, len, &bytes) < 0) { return -1; }
+
+	*value = 0;
+	for (size_t i = 0; i < len; i++) { *value = (*value << 8) | bytes[i]; }
+
+	return 0;
+}
+
+/**
+ * @brief Checks that a container of count items fits in the rest 
+ * of the file, every item takes at least min_size bytes.
+ * 
+ * This keeps a corrupted count from allocating a huge container.
+ */
+static int check_count(struct binary_reader *r, size_t pos, uint64_t count,
+					   size_t min_size)
+{
+	if (count > (r->size - r->pos) / min_size) {
+		set_error(r, pos, "unexpected end of file");
+		return -1;
+	}
+
+	return 0;
+}
+
+static json_t *read_string(struct binary_reader *r, size_t pos, uint64_t len)
+{
+	const unsigned char *bytes = NULL;
+	json_t *string = NULL;
+
+	if (read_bytes(r, len, &bytes) < 0) { return NULL; }
+
+	string = json_stringn((const char *) bytes, len);
+	if (!string) { return set_error(r, pos, "invalid UTF-8 string"); }
+
+	return string;
+}
+
+static json_t *read_real(struct binary_reader *r, size_t pos, double value)
+{
+	json_t *real = json_real(value);
+
+	if (!real) { return set_error(r, pos, "NaN or infinity"); }
+	return real;
+}
+
+static json_t *read_integer(struct binary_reader *r, size_t pos, 
+							uint64_t value, int is_negative)
+{
+	if (value > INT64_MAX) { return set_error(r, pos, "too big integer"); }
+
+	/* CBOR stores -1 - n */
+	return json_integer(is_negative ? -1 - (json_int_t) value 
+									: (json_int_t) value);
+}
+
+/**
+ * @brief Adds a member read as a key and a value to an object.
+ * 
+ * The references of the key and the value are stolen.
+ */
+static int set_member(struct binary_reader *r, size_t pos, json_t *object,
+					  json_t *key, json_t *value)
+{
+	int ret = -1;
+
+	if (!key || !value) { goto handle_error; }
+
+	if (!json_is_string(key)) {
+		set_error(r, pos, "key is not a string");
+		goto handle_error;
+	}
+	if (strlen(json_string_value(key)) != json_string_length(key)) {
+		set_error(r, pos, "null character in a key");
+		goto handle_error;
+	}
+
+	ret = json_object_set(object, json_string_value(key), value);
+	if (ret) { set_error(r, pos, "out of memory"); }
+
+	handle_error:
+		json_decref(key);
+		json_decref(value);
+		return ret;
+}
+
+static json_t *read_msgpack(struct binary_reader *r, int depth);
+
+static json_t *read_msgpack_array(struct binary_reader *r, size_t pos,
+								  uint64_t count, int depth)
+{
+	json_t *array = NULL;
+
+	if (check_count(r, pos, count, 1) < 0) { return NULL; }
+
+	array = json_array();
+	if (!array) { return set_error(r, pos, "out of memory"); }
+
+	for (uint64_t i = 0; i < count; i++) {
+		if (json_array_append_new(array, read_msgpack(r, depth + 1))) {
+			json_decref(array);
+			return set_error(r, pos, "out of memory");
+		}
+	}
+
+	return array;
+}
+
+static json_t *read_msgpack_map(struct binary_reader *r, size_t pos,
+								uint64_t count, int depth)
+{
+	json_t *object = NULL;
+	json_t *key = NULL;
+	size_t key_pos;
+
+	if (check_count(r, pos, count, 2) < 0) { return NULL; }
+
+	object = json_object();
+	if (!object) { return set_error(r, pos, "out of memory"); }
+
+	for (uint64_t i = 0; i < count; i++) {
+		key_pos = r->pos;
+		key = read_msgpack(r, depth + 1);
+		if (set_member(r, key_pos, object, key, 
+					   key ? read_msgpack(r, depth + 1) : NULL) < 0) {
+			json_decref(object);
+			return set_error(r, pos, "out of memory");
+		}
+	}
+
+	return object;
+}
+
+/**
+ * @brief Decodes a MessagePack value.
+ * @return The value, NULL on failure.
+ */
+static json_t *read_msgpack(struct binary_reader *r, int depth)
+{
+	const unsigned char *bytes = NULL;
+	size_t pos = r->pos;
+	uint64_t value;
+	uint32_t bits32;
+	float real32;
+	double real64;
+	unsigned char b;
+
+	if (depth > BINARY_MAX_DEPTH) { return set_error(r, pos, "too deep nesting"); }
+	if (read_bytes(r, 1, &bytes) < 0) { return NULL; }
+	b = bytes[0];
+
+	/* Values with the length or the value in the first byte */
+	if (b <= 0x7F) { return json_integer(b); }
+	if (b >= 0xE0) { return json_integer((int8_t) b); }
+	if ((b & 0xE0) == 0xA0) { return read_string(r, pos, b & 0x1F); }
+	if ((b & 0xF0) == 0x90) { return read_msgpack_array(r, pos, b & 0x0F, depth); }
+	if ((b & 0xF0) == 0x80) { return read_msgpack_map(r, pos, b & 0x0F, depth); }
+
+	switch (b) {
+		case 0xC0:
+			return json_null();
+		case 0xC2:
+			return json_false();
+		case 0xC3:
+			return json_true();
+		case 0xCC: case 0xCD: case 0xCE: case 0xCF:
+			if (read_uint(r, 1 << (b - 0xCC), &value) < 0) { return NULL; }
+			return read_integer(r, pos, value, 0);
+		case 0xD0: case 0xD1: case 0xD2: case 0xD3:
+			if (read_uint(r, 1 << (b - 0xD0), &value) < 0) { return NULL; }
+
+			/* Sign extension from the width of the value */
+			if (b != 0xD3) {
+				value ^= (uint64_t) 1 << (8 * (1 << (b - 0xD0)) - 1);
+				value -= (uint64_t) 1 << (8 * (1 << (b - 0xD0)) - 1);
+			}
+			return json_integer((json_int_t) (int64_t) value);
+		case 0xCA:
+			if (read_uint(r, 4, &value) < 0) { return NULL; }
+			bits32 = (uint32_t) value;
+			memcpy(&real32, &bits32, sizeof(real32));
+			return read_real(r, pos, real32);
+		case 0xCB:
+			if (read_uint(r, 8, &value) < 0) { return NULL; }
+			memcpy(&real64, &value, sizeof(real64));
+			return read_real(r, pos, real64);
+		case 0xD9: case 0xDA: case 0xDB:
+			if (read_uint(r, 1 << (b - 0xD9), &value) < 0) { return NULL; }
+			return read_string(r, pos, value);
+		case 0xDC: case 0xDD:
+			if (read_uint(r, 2 << (b - 0xDC), &value) < 0) { return NULL; }
+			return read_msgpack_array(r, pos, value, depth);
+		case 0xDE: case 0xDF:
+			if (read_uint(r, 2 << (b - 0xDE), &value) < 0) { return NULL; }
+			return read_msgpack_map(r, pos, value, depth);
+		case 0xC4: case 0xC5: case 0xC6:
+			return set_error(r, pos, "binary data is not supported");
+		default:
+			return set_error(r, pos, "extension types are not supported");
+	}
+}
+
+/**
+ * @brief Reads the first byte of a CBOR item and its argument.
+ * 
+ * @param major[out] Major type.
+ * @param info[out] Additional information, CBOR_INDEFINITE for 
+ * 		  an indefinite length.
+ * @param arg[out] Value or length given by the additional information.
+ * 
+ * @return 0 on success, -1 on failure.
+ */
+static int read_cbor_head(struct binary_reader *r, int *major, int *info,
+						  uint64_t *arg)
+{
+	const unsigned char *bytes = NULL;
+	size_t pos = r->pos;
+
+	if (read_bytes(r, 1, &bytes) < 0) { return -1; }
+
+	*major = bytes[0] >> 5;
+	*info = bytes[0] & 0x1F;
+	*arg = *info;
+
+	if (*info >= 24 && *info <= 27) {
+		return read_uint(r, (size_t) 1 << (*info - 24), arg);
+	}
+	if (*info >= 28 && *info <= 30) {
+		set_error(r, pos, "malformed CBOR item");
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Checks for the break ending an indefinite-length item 
+ * and skips it.
+ * 
+ * @return 1 if it was the break, 0 if not, -1 at the end of the file.
+ */
+static int is_cbor_break(struct binary_reader *r)
+{
+	if (r->pos >= r->size) {
+		set_error(r, r->pos, "unexpected end of file");
+		return -1;
+	}
+	if (r->data[r->pos] != CBOR_BREAK) { return 0; }
+
+	r->pos++;
+	return 1;
+}
+
+/**
+ * @brief Reads a text string given in chunks.
+ */
+static json_t *read_cbor_chunks(struct binary_reader *r, size_t pos)
+{
+	const unsigned char *bytes = NULL;
+	char *text = NULL;
+	char *res_realloc = NULL;
+	json_t *string = NULL;
+	size_t len = 0;
+	uint64_t arg;
+	int major, info;
+	int res_break;
+
+	while ((res_break = is_cbor_break(r)) == 0) {
+		if (read_cbor_head(r, &major, &info, &arg) < 0) { goto handle_error; }
+		if (major != 3 || info == CBOR_INDEFINITE) {
+			set_error(r, pos, "malformed CBOR string");
+			goto handle_error;
+		}
+		if (read_bytes(r, arg, &bytes) < 0) { goto handle_error; }
+
+		res_realloc = realloc(text, len + arg + 1);
+		if (!res_realloc) {
+			set_error(r, pos, "out of memory");
+			goto handle_error;
+		}
+		text = res_realloc;
+		memcpy(text + len, bytes, arg);
+		len += arg;
+	}
+	if (res_break < 0) { goto handle_error; }
+
+	string = json_stringn(text ? text : "", len);
+	if (!string) { set_error(r, pos, "invalid UTF-8 string"); }
+
+	handle_error:
+		free(text);
+		return string;
+}
+
+/**
+ * @brief Decodes a half-precision float.
+ */
+static double get_half_float(uint16_t half)
+{
+	int exponent = (half >> 10) & 0x1F;
+	int mantissa = half & 0x3FF;
+	double value;
+
+	/* The value is mantissa * 2^-24 for subnormal numbers */
+	if (exponent == 31) { value = mantissa ? NAN : INFINITY; }
+	else if (exponent == 0) { value = mantissa / (double) (1 << 24); }
+	else if (exponent >= 25) { value = (mantissa + 1024) * (double) (1 << (exponent - 25)); }
+	else { value = (mantissa + 1024) / (double) (1 << (25 - exponent)); }
+
+	return (half & 0x8000) ? -value : value;
+}
+
+static json_t *read_cbor(struct binary_reader *r, int depth);
+
+/**
+ * @brief Reads the items of a CBOR array or map.
+ * 
+ * @param count Number of the items, ignored if is_indefinite is set.
+ */
+static json_t *read_cbor_container(struct binary_reader *r, size_t pos, 
+								   int is_map, int is_indefinite,
+								   uint64_t count, int depth)
+{
+	json_t *container = NULL;
+	json_t *key = NULL;
+	size_t key_pos;
+	int res_break = 0;
+
+	if (!is_indefinite && check_count(r, pos, count, is_map ? 2 : 1) < 0) { 
+		return NULL; 
+	}
+
+	container = is_map ? json_object() : json_array();
+	if (!container) { return set_error(r, pos, "out of memory"); }
+
+	for (uint64_t i = 0; is_indefinite || i < count; i++) {
+		if (is_indefinite && (res_break = is_cbor_break(r)) != 0) { break; }
+
+		if (is_map) {
+			key_pos = r->pos;
+			key = read_cbor(r, depth + 1);
+			if (set_member(r, key_pos, container, key, 
+						   key ? read_cbor(r, depth + 1) : NULL) < 0) {
+				goto handle_error;
+			}
+		}
+		else if (json_array_append_new(container, read_cbor(r, depth + 1))) {
+			goto handle_error;
+		}
+	}
+	if (res_break < 0) { goto handle_error; }
+
+	return container;
+
+	handle_error:
+		json_decref(container);
+		return set_error(r, pos, "out of memory");
+}
+
+/**
+ * @brief Decodes a CBOR item.
+ * @return The value, NULL on failure.
+ */
+static json_t *read_cbor(struct binary_reader *r, int depth)
+{
+	size_t pos = r->pos;
+	uint64_t arg;
+	float real32;
+	double real64;
+	uint32_t bits32;
+	int major, info;
+
+	if (depth > BINARY_MAX_DEPTH) { return set_error(r, pos, "too deep nesting"); }
+	if (read_cbor_head(r, &major, &info, &arg) < 0) { return NULL; }
+
+	if (info == CBOR_INDEFINITE && (major < 2 || major == 6)) {
+		return set_error(r, pos, "malformed CBOR item");
+	}
+
+	switch (major) {
+		case 0:
+		case 1:
+			return read_integer(r, pos, arg, major == 1);
+		case 2:
+			return set_error(r, pos, "binary data is not supported");
+		case 3:
+			if (info == CBOR_INDEFINITE) { return read_cbor_chunks(r, pos); }
+			return read_string(r, pos, arg);
+		case 4:
+		case 5:
+			return read_cbor_container(r, pos, major == 5, 
+									   info == CBOR_INDEFINITE, arg, depth);
+		case 6:
+			/* The meaning of a tag is not kept, only the tagged value */
+			return read_cbor(r, depth + 1);
+		default:
+			break;
+	}
+
+	switch (info) {
+		case 20:
+			return json_false();
+		case 21:
+			return json_true();
+		case 22:
+		case 23:
+			return json_null();
+		case 25:
+			return read_real(r, pos, get_half_float((uint16_t) arg));
+		case 26:
+			bits32 = (uint32_t) arg;
+			memcpy(&real32, &bits32, sizeof(real32));
+			return read_real(r, pos, real32);
+		case 27:
+			memcpy(&real64, &arg, sizeof(real64));
+			return read_real(r, pos, real64);
+		case CBOR_INDEFINITE:
+			return set_error(r, pos, "unexpected break");
+		default:
+			return set_error(r, pos, "simple values are not supported");
+	}
+}
+
+json_t *load_binary_file(const char *path, enum binary_format format,
+						 json_error_t *error)
+{
+	struct binary_reader r;
+	json_t *root = NULL;
+	struct stat st;
+	int fd;
+
+	CHECK_POINTER(path, NULL);
+	CHECK_POINTER(error, NULL);
+
+	memset(error, 0, sizeof(json_error_t));
+	memset(&r, 0, sizeof(r));
+	snprintf(error->source, sizeof(error->source), "%s", path);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		snprintf(error->text, sizeof(error->text), "%s", strerror(errno));
+		if (fd >= 0) { close(fd); }
+		return NULL;
+	}
+
+	if (st.st_size) {
+		r.data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (r.data == MAP_FAILED) {
+			snprintf(error->text, sizeof(error->text), "%s", strerror(errno));
+			close(fd);
+			return NULL;
+		}
+		madvise((void *) r.data, st.st_size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+	r.size = st.st_size;
+
+	root = format == BINARY_CBOR ? read_cbor(&r, 0) : read_msgpack(&r, 0);
+	if (root && r.pos != r.size) {
+		json_decref(root);
+		root = set_error(&r, r.pos, "extra data after the value");
+	}
+
+	if (!root) {
+		snprintf(error->text, sizeof(error->text), "offset %zu: %s", 
+				 r.error_pos, r.error ? r.error : "out of memory");
+		error->position = (int) r.error_pos;
+	}
+
+	if (r.data) { munmap((void *) r.data, st.st_size); }
+	return root;
+}
+
+/* ================================= */
+/*              Encoding             */
+/* ================================= */
+
+/**
+ * @brief Writes an unsigned integer of len bytes in big-endian.
+ */
+static void put_uint(FILE *out, uint64_t value, size_t len)
+{
+	for (size_t i = len; i > 0; i--) {
+		fputc((int) ((value >> (8 * (i - 1))) & 0xFF), out);
+	}
+}
+
+/**
+ * @brief Writes the smallest of the four forms of a length or 
+ * an integer, each one begins with its own first byte.
+ * 
+ * @param first First bytes of the 1, 2, 4 and 8 byte forms.
+ */
+static void put_sized(FILE *out, uint64_t value, const unsigned char first[4])
+{
+	if (value <= UINT8_MAX) { fputc(first[0], out); put_uint(out, value, 1); }
+	else if (value <= UINT16_MAX) { fputc(first[1], out); put_uint(out, value, 2); }
+	else if (value <= UINT32_MAX) { fputc(first[2], out); put_uint(out, value, 4); }
+	else { fputc(first[3], out); put_uint(out, value, 8); }
+}
+
+static void put_real(FILE *out, unsigned char first, double value)
+{
+	uint64_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	fputc(first, out);
+	put_uint(out, bits, 8);
+}
+
+/**
+ * @brief Writes a length of MessagePack, the fixed form holds 
+ * lengths up to fix_max in the first byte.
+ * 
+ * @param first First bytes of the fixed, 1, 2 and 4 byte forms, 
+ * 		  0 if there is no such form.
+ * 
+ * @return 0 on success, -1 if the length does not fit.
+ */
+static int put_msgpack_len(FILE *out, uint64_t len, uint64_t fix_max,
+						   const unsigned char first[4])
+{
+	if (len <= fix_max) { fputc(first[0] | (int) len, out); }
+	else if (first[1] && len <= UINT8_MAX) { fputc(first[1], out); put_uint(out, len, 1); }
+	else if (len <= UINT16_MAX) { fputc(first[2], out); put_uint(out, len, 2); }
+	else if (len <= UINT32_MAX) { fputc(first[3], out); put_uint(out, len, 4); }
+	else { return -1; }
+
+	return 0;
+}
+
+static int write_msgpack(FILE *out, json_t *value)
+{
+	static const unsigned char str_first[4] = { 0xA0, 0xD9, 0xDA, 0xDB };
+	static const unsigned char array_first[4] = { 0x90, 0, 0xDC, 0xDD };
+	static const unsigned char map_first[4] = { 0x80, 0, 0xDE, 0xDF };
+	static const unsigned char uint_first[4] = { 0xCC, 0xCD, 0xCE, 0xCF };
+	const char *key = NULL;
+	json_t *member = NULL;
+	json_int_t integer;
+	size_t index;
+	size_t len;
+
+	switch (json_typeof(value)) {
+		case JSON_OBJECT:
+			if (put_msgpack_len(out, json_object_size(value), 15, map_first) < 0) {
+				return -1;
+			}
+			json_object_foreach(value, key, member) {
+				len = strlen(key);
+				if (put_msgpack_len(out, len, 31, str_first) < 0) { return -1; }
+				fwrite(key, 1, len, out);
+				if (write_msgpack(out, member) < 0) { return -1; }
+			}
+			break;
+		case JSON_ARRAY:
+			if (put_msgpack_len(out, json_array_size(value), 15, array_first) < 0) {
+				return -1;
+			}
+			json_array_foreach(value, index, member) {
+				if (write_msgpack(out, member) < 0) { return -1; }
+			}
+			break;
+		case JSON_STRING:
+			len = json_string_length(value);
+			if (put_msgpack_len(out, len, 31, str_first) < 0) { return -1; }
+			fwrite(json_string_value(value), 1, len, out);
+			break;
+		case JSON_INTEGER:
+			integer = json_integer_value(value);
+			if (integer >= 0 && integer <= 0x7F) { fputc((int) integer, out); }
+			else if (integer >= 0) { put_sized(out, integer, uint_first); }
+			else if (integer >= -32) { fputc((int) (integer & 0xFF), out); }
+			else if (integer >= INT8_MIN) { fputc(0xD0, out); put_uint(out, integer, 1); }
+			else if (integer >= INT16_MIN) { fputc(0xD1, out); put_uint(out, integer, 2); }
+			else if (integer >= INT32_MIN) { fputc(0xD2, out); put_uint(out, integer, 4); }
+			else { fputc(0xD3, out); put_uint(out, integer, 8); }
+			break;
+		case JSON_REAL:
+			put_real(out, 0xCB, json_real_value(value));
+			break;
+		case JSON_TRUE:
+			fputc(0xC3, out);
+			break;
+		case JSON_FALSE:
+			fputc(0xC2, out);
+			break;
+		case JSON_NULL:
+			fputc(0xC0, out);
+			break;
+		default:
+			return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Writes the first byte of a CBOR item with its argument.
+ */
+static void put_cbor_head(FILE *out, int major, uint64_t arg)
+{
+	const unsigned char first[4] = {
+		(major << 5) | 24, (major << 5) | 25, (major << 5) | 26, (major << 5) | 27
+	};
+
+	if (arg < 24) { fputc((major << 5) | (int) arg, out); }
+	else { put_sized(out, arg, first); }
+}
+
+static int write_cbor(FILE *out, json_t *value)
+{
+	const char *key = NULL;
+	json_t *member = NULL;
+	json_int_t integer;
+	size_t index;
+	size_t len;
+
+	switch (json_typeof(value)) {
+		case JSON_OBJECT:
+			put_cbor_head(out, 5, json_object_size(value));
+			json_object_foreach(value, key, member) {
+				len = strlen(key);
+				put_cbor_head(out, 3, len);
+				fwrite(key, 1, len, out);
+				if (write_cbor(out, member) < 0) { return -1; }
+			}
+			break;
+		case JSON_ARRAY:
+			put_cbor_head(out, 4, json_array_size(value));
+			json_array_foreach(value, index, member) {
+				if (write_cbor(out, member) < 0) { return -1; }
+			}
+			break;
+		case JSON_STRING:
+			len = json_string_length(value);
+			put_cbor_head(out, 3, len);
+			fwrite(json_string_value(value), 1, len, out);
+			break;
+		case JSON_INTEGER:
+			integer = json_integer_value(value);
+			if (integer >= 0) { put_cbor_head(out, 0, (uint64_t) integer); }
+			else { put_cbor_head(out, 1, (uint64_t) -(integer + 1)); }
+			break;
+		case JSON_REAL:
+			put_real(out, 0xFB, json_real_value(value));
+			break;
+		case JSON_TRUE:
+			fputc(0xF5, out);
+			break;
+		case JSON_FALSE:
+			fputc(0xF4, out);
+			break;
+		case JSON_NULL:
+			fputc(0xF6, out);
+			break;
+		default:
+			return -1;
+	}
+
+	return 0;
+}
+
+int dump_binary_file(json_t *root, const char *path, enum binary_format format)
+{
+	FILE *out = NULL;
+	int res_write;
+
+	CHECK_POINTER(root, -1);
+	CHECK_POINTER(path, -1);
+
+	out = fopen(path, "wb");
+	CHECK_POINTER(out, -1);
+	setvbuf(out, NULL, _IOFBF, WRITE_BUFFER);
+
+	res_write = format == BINARY_CBOR ? write_cbor(out, root) 
+									  : write_msgpack(out, root);
+
+	if (ferror(out)) { res_write = -1; }
+	if (fclose(out) != 0) { res_write = -1; }
+
+	return res_write;
+}
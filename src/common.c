@@ -0,0 +1,60 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file 
+ * @brief Contains definition of the helpers shared by the modules.
+ * 
+ * Function declarations and specifications can be found in common.h.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "common.h"
+
+uint64_t hash_fnv1a(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = data;
+
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= FNV1A_PRIME;
+	}
+
+	return hash;
+}
+
+int write_all(int fd, const void *data, size_t len)
+{
+	const char *pos = data;
+	ssize_t res_write;
+
+	while (len) {
+		res_write = write(fd, pos, len);
+		if (res_write < 0 && errno == EINTR) { continue; }
+		if (res_write <= 0) { return -1; }
+
+		pos += res_write;
+		len -= res_write;
+	}
+
+	return 0;
+}
@@ -32,32 +32,159 @@
 #include "common.h"
 #include "file_time.h"
 
-struct file_time *add_node_to_list_ft(const char* path, struct file_time *root, 
-									  enum set_time flags)
+/**
+ * @def INDEX_MIN_BUCKETS
+ * @brief Number of the buckets of a new index, always a power of two.
+ */
+#define INDEX_MIN_BUCKETS	64
+
+/**
+ * @struct file_time_index
+ * @brief Hash index of a file_time list by path, kept by its head.
+ * 
+ * Besides the buckets of the nodes, it counts the nodes below every 
+ * path by the bucket of the path. The paths of a bucket share 
+ * the counter, so a zero means that no node is below the path and 
+ * a replaced subtree is cleaned without walking the list.
+ */
+struct file_time_index {
+	struct file_time **buckets;
+	size_t *below;				/**< Nodes below the paths of each bucket */
+	size_t count_buckets;		/**< Power of two */
+	size_t count_nodes;
+	struct file_time *last;		/**< Last node of the list */
+};
+
+/* ================================= */
+/*               Index               */
+/* ================================= */
+
+static struct file_time_index *create_index(void)
 {
-	time_t now;
-	char *path_dup = NULL;
-	struct file_time *new_node = NULL;
-	struct file_time *last = NULL;
+	struct file_time_index *index = NULL;
 
-	CHECK_POINTER(path, NULL);
+	index = calloc(1, sizeof(struct file_time_index));
+	CHECK_POINTER(index, NULL);
 
-	last = root;
-	while(last) {
-		if (strcmp(path, last->path) == 0) {
-			return NULL;
+	index->buckets = calloc(INDEX_MIN_BUCKETS, sizeof(struct file_time *));
+	index->below = calloc(INDEX_MIN_BUCKETS, sizeof(size_t));
+	if (!index->buckets || !index->below) {
+		free(index->buckets);
+		free(index->below);
+		free(index);
+		return NULL;
+	}
+	index->count_buckets = INDEX_MIN_BUCKETS;
+
+	return index;
+}
+
+/**
+ * @brief Adds a number to the counters of the root and 
+ * of every parent of a path.
+ */
+static void count_below(struct file_time_index *index, const char *path, 
+						long delta)
+{
+	size_t mask = index->count_buckets - 1;
+	const char *slash = path;
+	uint64_t hash = FNV1A_BASIS;
+	size_t len = 0;
+	size_t end;
+
+	index->below[hash_fnv1a(FNV1A_BASIS, "/", 1) & mask] += delta;
+	while ((slash = strchr(slash + 1, '/'))) {
+		end = (size_t) (slash - path);
+		hash = hash_fnv1a(hash, path + len, end - len);
+		len = end;
+		index->below[hash & mask] += delta;
+	}
+}
+
+/**
+ * @brief Doubles the buckets of the index, the nodes stay 
+ * in the old buckets if there is no memory.
+ */
+static void grow_index(struct file_time *root)
+{
+	struct file_time_index *index = root->index;
+	struct file_time **buckets = NULL;
+	size_t *below = NULL;
+	size_t count_buckets = index->count_buckets * 2;
+	size_t bucket;
+
+	buckets = calloc(count_buckets, sizeof(struct file_time *));
+	below = calloc(count_buckets, sizeof(size_t));
+	if (!buckets || !below) { 
+		free(buckets);
+		free(below);
+		return; 
+	}
+
+	free(index->buckets);
+	free(index->below);
+	index->buckets = buckets;
+	index->below = below;
+	index->count_buckets = count_buckets;
+
+	for (struct file_time *node = root; node; node = node->next_node) {
+		bucket = node->hash & (count_buckets - 1);
+		node->next_hash = buckets[bucket];
+		buckets[bucket] = node;
+		if (node != root) { count_below(index, node->path, 1); }
+	}
+}
+
+/**
+ * @brief Finds the node of the first len bytes of a path.
+ * 
+ * @param hash Hash of these bytes, see hash_fnv1a().
+ */
+static struct file_time *find_in_index(const struct file_time *root, 
+									   const char *path, size_t len, 
+									   uint64_t hash)
+{
+	const struct file_time_index *index = root->index;
+	struct file_time *node = NULL;
+
+	node = index->buckets[hash & (index->count_buckets - 1)];
+	for (; node; node = node->next_hash) {
+		if (node->hash == hash && strncmp(node->path, path, len) == 0 
+			&& node->path[len] == '\0') {
+			return node;
 		}
-		last = last->next_node;
 	}
 
-	path_dup = strdup(path);
-	CHECK_POINTER(path_dup, NULL);
+	return NULL;
+}
+
+/**
+ * @brief Creates a node and adds it to the end of the list and to the index.
+ * 
+ * @param root Head of the list, NULL to create the head.
+ * 
+ * @return The node, NULL on failure.
+ */
+static struct file_time *add_node(struct file_time *root, const char *path, 
+								  size_t len, uint64_t hash, 
+								  enum set_time flags)
+{
+	struct file_time_index *index = NULL;
+	struct file_time *new_node = NULL;
+	size_t bucket;
+	time_t now;
 
 	new_node = calloc(1, sizeof(struct file_time));
 	CHECK_POINTER(new_node, NULL);
-	
+
+	new_node->path = strndup(path, len);
+	if (!new_node->path) {
+		free(new_node);
+		return NULL;
+	}
+	new_node->hash = hash;
+
 	now = time(NULL);
-	new_node->path = path_dup;
 
 	if (flags & SET_ATIME || !root) { new_node->atime = now; }
 	else { new_node->atime = root->atime; }
@@ -68,72 +195,230 @@ struct file_time *add_node_to_list_ft(const char* path, struct file_time *root,
 	if (flags & SET_CTIME || !root) { new_node->ctime = now; }
 	else { new_node->ctime = root->ctime; }
 
-	new_node->next_node = NULL;
+	if (!root) {
+		new_node->index = create_index();
+		if (!new_node->index) {
+			free_file_time(new_node);
+			return NULL;
+		}
+		root = new_node;
+	}
+	else {
+		root->index->last->next_node = new_node;
+		new_node->prev_node = root->index->last;
+	}
 
-	if(!root) { return new_node; }
+	index = root->index;
+	index->last = new_node;
+	index->count_nodes++;
 
-	last = root;
-	while(last->next_node) {
-		last = last->next_node;
-	}
+	bucket = hash & (index->count_buckets - 1);
+	new_node->next_hash = index->buckets[bucket];
+	index->buckets[bucket] = new_node;
+	if (new_node != root) { count_below(index, new_node->path, 1); }
 
-	last->next_node = new_node;
+	if (index->count_nodes > index->count_buckets) { grow_index(root); }
 
 	return new_node;
 }
 
+/**
+ * @brief Removes a node other than the head from the list and the index,
+ * and frees it.
+ */
+static void remove_node(struct file_time *root, struct file_time *node)
+{
+	struct file_time_index *index = root->index;
+	struct file_time **link = NULL;
+
+	link = &index->buckets[node->hash & (index->count_buckets - 1)];
+	while (*link != node) { link = &(*link)->next_hash; }
+	*link = node->next_hash;
+
+	node->prev_node->next_node = node->next_node;
+	if (node->next_node) { node->next_node->prev_node = node->prev_node; }
+	else { index->last = node->prev_node; }
+	index->count_nodes--;
+	count_below(index, node->path, -1);
+
+	free_file_time(node);
+}
+
+/* ================================= */
+/*               List                */
+/* ================================= */
+
+struct file_time *add_node_to_list_ft(const char* path, struct file_time *root, 
+									  enum set_time flags)
+{
+	uint64_t hash;
+	size_t len;
+
+	CHECK_POINTER(path, NULL);
+
+	len = strlen(path);
+	hash = hash_fnv1a(FNV1A_BASIS, path, len);
+	if (root && find_in_index(root, path, len, hash)) { return NULL; }
+
+	return add_node(root, path, len, hash, flags);
+}
+
 int remove_node_to_list_ft(const char* path, struct file_time *root)
 {
 	struct file_time *node = NULL;
-	struct file_time *parent = NULL;
-	char *parent_path = NULL;
-	size_t path_size;
 
 	CHECK_POINTER(path, -1);
 	CHECK_POINTER(root, -1);
 
+	/* The head belongs to the root and is never removed */
 	node = find_node_file_time(path, root);
-	CHECK_POINTER(node, -1);
+	if (!node || node == root) { return -1; }
 
-	parent_path = strdup(path);
-	path_size = strlen(path);
+	remove_node(root, node);
+	return 0;
+}
 
-	for (int i = path_size - 1; i >= 0 && path[i] != '/'; i--) {
-		parent_path[i] = '\0';
+/**
+ * @brief Removes the nodes of the paths below a path.
+ * 
+ * @param is_self 1 if the node of the path itself is removed too.
+ * 
+ * @return Number of removed nodes.
+ */
+static int remove_below(const char* path, struct file_time *root, int is_self)
+{
+	struct file_time_index *index = root->index;
+	struct file_time *node = NULL;
+	struct file_time *next = NULL;
+	size_t path_len;
+	uint64_t hash;
+	int count = 0;
+
+	path_len = strlen(path);
+	while (path_len > 0 && path[path_len - 1] == '/') { path_len--; }
+
+	/* Usually nothing is below, then the list is not walked */
+	hash = hash_fnv1a(FNV1A_BASIS, path, path_len);
+	if (path_len && !index->below[hash & (index->count_buckets - 1)]) {
+		node = is_self ? find_in_index(root, path, path_len, hash) : NULL;
+		if (!node || node == root) { return 0; }
+
+		remove_node(root, node);
+		return 1;
 	}
 
-	parent = find_node_file_time(parent_path, root);
-	CHECK_POINTER(parent, -1);
-	parent->next_node = node->next_node;
+	for (node = root->next_node; node; node = next) {
+		next = node->next_node;
+		if (strncmp(path, node->path, path_len) == 0 &&
+			((is_self && node->path[path_len] == '\0') || 
+			 (node->path[path_len] == '/' && node->path[path_len + 1]))) {
+			remove_node(root, node);
+			count++;
+		}
+	}
 
-	free(parent_path);
-	free_file_time(node);
+	return count;
+}
+
+int remove_subtree_to_list_ft(const char* path, struct file_time *root)
+{
+	CHECK_POINTER(path, -1);
+	CHECK_POINTER(root, -1);
+
+	return remove_below(path, root, 1);
+}
+
+int set_version_ft(const char *path, struct file_time *root,
+				   unsigned long long version, int is_reset)
+{
+	struct file_time *node = NULL;
+	const char *slash = NULL;
+	uint64_t hash = FNV1A_BASIS;
+	size_t len = 0;
+	size_t end;
+
+	CHECK_POINTER(path, -1);
+	CHECK_POINTER(root, -1);
+
+	/* The root first, then every parent, then the path itself; 
+	 * the hash of a prefix is carried on to the next one */
+	root->version = version;
+	node = root;
+	slash = path;
+	while (slash) {
+		slash = strchr(slash + 1, '/');
+		end = slash ? (size_t) (slash - path) : strlen(path);
+		hash = hash_fnv1a(hash, path + len, end - len);
+		len = end;
+
+		if (len > 1 || !slash) {
+			node = find_in_index(root, path, len, hash);
+			if (!node) { node = add_node(root, path, len, hash, 0); }
+			CHECK_POINTER(node, -1);
+			node->version = version;
+		}
+	}
+
+	if (is_reset) {
+		remove_below(path, root, 0);
+		node->reset_version = version;
+	}
 
 	return 0;
 }
 
-struct file_time *find_node_file_time(const char *path, struct file_time *root)
+unsigned long long get_version_ft(const char *path, struct file_time *root)
 {
-	struct file_time *res = NULL;
-	struct file_time *curr = NULL;
+	struct file_time *node = NULL;
+	unsigned long long version;
+	const char *slash = NULL;
+	uint64_t hash = FNV1A_BASIS;
+	size_t len = 0;
+	size_t end;
 
-	CHECK_POINTER(path, NULL);
-	CHECK_POINTER(root, NULL);
+	CHECK_POINTER(path, 0);
+	CHECK_POINTER(root, 0);
 
-	curr = root;
-	while(curr) {
-		if (strcmp(path, curr->path) == 0) {
-			res = curr;
-			break;
+	/* A node may be added later by a read, so the parents are checked too */
+	version = root->reset_version;
+	slash = path;
+	while ((slash = strchr(slash + 1, '/'))) {
+		end = (size_t) (slash - path);
+		hash = hash_fnv1a(hash, path + len, end - len);
+		len = end;
+
+		node = find_in_index(root, path, len, hash);
+		if (node && node->reset_version > version) { 
+			version = node->reset_version; 
 		}
-		curr = curr->next_node;
 	}
 
-	return res;
+	end = strlen(path);
+	hash = hash_fnv1a(hash, path + len, end - len);
+	node = find_in_index(root, path, end, hash);
+	if (node && node->version > version) { version = node->version; }
+
+	return version;
+}
+
+struct file_time *find_node_file_time(const char *path, struct file_time *root)
+{
+	size_t len;
+
+	CHECK_POINTER(path, NULL);
+	CHECK_POINTER(root, NULL);
+
+	len = strlen(path);
+	return find_in_index(root, path, len, hash_fnv1a(FNV1A_BASIS, path, len));
 }
 
 void free_file_time(struct file_time *ft)
 {
+	if (ft->index) {
+		free(ft->index->buckets);
+		free(ft->index->below);
+		free(ft->index);
+	}
 	free(ft->path);
 	free(ft);
 	return;
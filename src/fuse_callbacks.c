@@ -24,7 +24,9 @@
  *
  * Implements callback functions for FUSE filesystem operations,
  * including: getattr, mknode, mkdir, unlink, rmdir, rename, truncate,
- * 			  open, read, write, readdir, destroy, utimens. 
+ * 			  open, read, write, read_buf, write_buf, flush, release, 
+ * 			  opendir, readdir, releasedir, init, destroy, utimens,
+ * 			  getxattr, listxattr. 
  */
 
 #define FUSE_USE_VERSION 35
@@ -34,229 +36,858 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
 
 #include "common.h"
 #include "handlers.h"
 #include "file_time.h"
 #include "json_operations.h"
+#include "arena.h"
+#include "stats.h"
+#include "trace.h"
+#include "probes.h"
+#include "record.h"
+#include "hot.h"
+#include "reload.h"
 
-int jsonfs_getattr(const char *path, struct stat *st,
+/**
+ * @brief Gives the kind of the access to a path made by a request.
+ * @return The kind, -1 if the request is not counted in /.hot.
+ */
+static int get_hot_kind(enum stats_op op)
+{
+	switch (op) {
+		case STATS_GETATTR:
+		case STATS_OPEN:
+		case STATS_OPENDIR:
+		case STATS_GETXATTR:
+		case STATS_LISTXATTR:
+			return HOT_LOOKUPS;
+		case STATS_READ:
+		case STATS_READ_BUF:
+		case STATS_READDIR:
+			return HOT_READS;
+		case STATS_MKNOD:
+		case STATS_MKDIR:
+		case STATS_UNLINK:
+		case STATS_RMDIR:
+		case STATS_RENAME:
+		case STATS_TRUNCATE:
+		case STATS_WRITE:
+		case STATS_WRITE_BUF:
+		case STATS_UTIMENS:
+			return HOT_WRITES;
+		default:
+			return -1;
+	}
+}
+
+/**
+ * @brief Counts a request in the metrics and in /.hot, records its span 
+ * and the request itself if -o record is given.
+ * 
+ * @param op Operation of the request.
+ * @param start Time of the beginning from get_stats_time().
+ * @param mount_path Path of the request in the mount.
+ * @param path Path inside the document, see get_document().
+ * @param args Other arguments of the request, may be NULL.
+ * @param result Result of the request.
+ */
+static void finish_request(enum stats_op op, uint64_t start, 
+						   const char *mount_path, const char *path,
+						   const struct record_args *args, int result)
+{
+	count_stats_op(op, start);
+	end_trace_span(get_stats_op_name(op), TRACE_FUSE, start, mount_path);
+	write_record(op, start, mount_path, args, result);
+
+	/* Failed lookups would fill /.hot with paths that do not exist */
+	if (result >= 0 && path && get_hot_kind(op) >= 0 
+		&& !is_special_file(path)) {
+		count_hot_access(mount_path, get_hot_kind(op));
+	}
+}
+
+/**
+ * @brief Finds the document of a request.
+ * 
+ * @param path[in,out] Path of the request, set to the path inside 
+ * 		  the document.
+ * 
+ * @return The document, NULL if the path is the root of several 
+ * 		   documents or does not belong to any of them.
+ */
+static struct jsonfs_private_data *get_document(const char **path)
+{
+	struct fuse_context *ctx = fuse_get_context();
+
+	return find_document(ctx->private_data, *path, path);
+}
+
+/**
+ * @brief Tells whether a path is the root of a mount of several documents.
+ */
+static int is_mount_root(const char *path)
+{
+	struct fuse_context *ctx = fuse_get_context();
+	struct jsonfs_mount *mount = ctx->private_data;
+
+	return mount && mount->is_multi && strcmp(path, "/") == 0;
+}
+
+/**
+ * @brief Sets attributes of the root of a mount of several documents.
+ * @return 0 on success, -ENOENT if the path is not the root.
+ */
+static int getattr_mount_root(const char *path, struct stat *st)
+{
+	struct fuse_context *ctx = fuse_get_context();
+	struct jsonfs_mount *mount = ctx->private_data;
+
+	if (!is_mount_root(path)) { return -ENOENT; }
+
+	st->st_mode = S_IFDIR | 0775;
+	st->st_nlink = 2 + mount->count;
+	st->st_uid = mount->docs[0]->uid;
+	st->st_gid = mount->docs[0]->gid;
+	st->st_atime = mount->docs[0]->mount_time;
+	st->st_mtime = mount->docs[0]->mount_time;
+	st->st_ctime = mount->docs[0]->mount_time;
+
+	return 0;
+}
+
+/**
+ * @brief Lists the documents in the root of a mount of several documents.
+ * @return 0 on success, -ENOENT if the path is not the root.
+ */
+static int read_mount_root(const char *path, void *buffer, 
+						   fuse_fill_dir_t filler)
+{
+	struct fuse_context *ctx = fuse_get_context();
+	struct jsonfs_mount *mount = ctx->private_data;
+
+	if (!is_mount_root(path)) { return -ENOENT; }
+
+	filler(buffer, ".", NULL, 0, 0);
+	filler(buffer, "..", NULL, 0, 0);
+	for (size_t i = 0; i < mount->count; i++) {
+		if (filler(buffer, mount->docs[i]->name, NULL, 0, 0)) { break; }
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Checks if the file was opened by open_raw_file().
+ */
+static int is_raw_handle(struct fuse_file_info *fi)
+{
+	return fi && fi->fh && ((struct file_buffer *) (uintptr_t) fi->fh)->is_raw;
+}
+
+int jsonfs_getattr(const char *mount_path, struct stat *st,
 				   struct fuse_file_info *fi)
 {
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
 	int res_getattr;
 	(void) fi;
 
-	struct fuse_context *ctx = fuse_get_context();
-	struct jsonfs_private_data *pd = ctx->private_data;
-	CHECK_POINTER(pd, -ENOMEM);
+	struct jsonfs_private_data *pd = get_document(&path);
 
 	memset(st, 0, sizeof(struct stat));
 
+	if (!pd) {
+		res_getattr = getattr_mount_root(mount_path, st);
+		finish_request(STATS_GETATTR, start, mount_path, path, NULL, res_getattr);
+		return res_getattr;
+	}
+
+	pthread_mutex_lock(&pd->lock);
 	if (is_special_file(path)) {
+		PROBE_HANDLER_ENTRY(getattr_special_file, path, 0, 0);
 		res_getattr = getattr_special_file(path, st, pd);
+		PROBE_HANDLER_RETURN(getattr_special_file, path, res_getattr);
+	}
+	else if (find_subtree_dir(path, pd->root)) {
+		PROBE_HANDLER_ENTRY(getattr_subtree_file, path, 0, 0);
+		res_getattr = getattr_subtree_file(path, st, pd);
+		PROBE_HANDLER_RETURN(getattr_subtree_file, path, res_getattr);
 	}
 	else {
+		PROBE_HANDLER_ENTRY(getattr_json_file, path, 0, 0);
 		res_getattr = getattr_json_file(path, st, pd);
+		PROBE_HANDLER_RETURN(getattr_json_file, path, res_getattr);
 	}
+	pthread_mutex_unlock(&pd->lock);
 
+	finish_request(STATS_GETATTR, start, mount_path, path, NULL, res_getattr);
 	return res_getattr;
 }
 
-int jsonfs_mknod(const char *path, mode_t mode, dev_t dev)
+int jsonfs_mknod(const char *mount_path, mode_t mode, dev_t dev)
 {
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
+	struct record_args args = { .flags = mode };
 	int res_mk;
 
 	if (strstr(path, ".sw")) { return -EPERM; }
 
-	struct fuse_context *ctx = fuse_get_context();
-	struct jsonfs_private_data *pd = ctx->private_data;
-	CHECK_POINTER(pd, -ENOMEM);
+	struct jsonfs_private_data *pd = get_document(&path);
+	CHECK_POINTER(pd, -ENOENT);
 	
+	pthread_mutex_lock(&pd->lock);
+	PROBE_HANDLER_ENTRY(make_file, path, 0, 0);
 	res_mk = make_file(path, mode, pd);
+	PROBE_HANDLER_RETURN(make_file, path, res_mk);
 	if (!res_mk) { pd->is_saved = 0; }
+	pthread_mutex_unlock(&pd->lock);
 
+	finish_request(STATS_MKNOD, start, mount_path, path, &args, res_mk);
 	return res_mk;
 }
 
-int jsonfs_mkdir(const char *path, mode_t mode)
+int jsonfs_mkdir(const char *mount_path, mode_t mode)
 {
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
+	struct record_args args = { .flags = mode };
 	int res_mk;
 
-	struct fuse_context *ctx = fuse_get_context();
-	struct jsonfs_private_data *pd = ctx->private_data;
-	CHECK_POINTER(pd, -ENOMEM);
+	struct jsonfs_private_data *pd = get_document(&path);
+	CHECK_POINTER(pd, -ENOENT);
 	
+	pthread_mutex_lock(&pd->lock);
+	PROBE_HANDLER_ENTRY(make_file, path, 0, 0);
 	res_mk = make_file(path, mode, pd);
+	PROBE_HANDLER_RETURN(make_file, path, res_mk);
 	if (!res_mk) { pd->is_saved = 0; }
+	pthread_mutex_unlock(&pd->lock);
 
+	finish_request(STATS_MKDIR, start, mount_path, path, &args, res_mk);
 	return res_mk;
 }
 
-int jsonfs_unlink(const char *path)
+int jsonfs_unlink(const char *mount_path)
 {
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
 	int res_rm;
 
-	struct fuse_context *ctx = fuse_get_context();
-	struct jsonfs_private_data *pd = ctx->private_data;
-	CHECK_POINTER(pd, -ENOMEM);
+	struct jsonfs_private_data *pd = get_document(&path);
+	CHECK_POINTER(pd, -ENOENT);
 
+	pthread_mutex_lock(&pd->lock);
+	PROBE_HANDLER_ENTRY(rm_file, path, 0, 0);
 	res_rm = rm_file(path, S_IFREG, pd);
+	PROBE_HANDLER_RETURN(rm_file, path, res_rm);
 	if (!res_rm) { pd->is_saved = 0; }
+	pthread_mutex_unlock(&pd->lock);
 	
+	finish_request(STATS_UNLINK, start, mount_path, path, NULL, res_rm);
 	return res_rm;
 }
 
-int jsonfs_rmdir(const char *path)
+int jsonfs_rmdir(const char *mount_path)
 {
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
 	int res_rm;
 
-	struct fuse_context *ctx = fuse_get_context();
-	struct jsonfs_private_data *pd = ctx->private_data;
-	CHECK_POINTER(pd, -ENOMEM);
+	struct jsonfs_private_data *pd = get_document(&path);
+	CHECK_POINTER(pd, -ENOENT);
 
+	pthread_mutex_lock(&pd->lock);
+	PROBE_HANDLER_ENTRY(rm_file, path, 0, 0);
 	res_rm = rm_file(path, S_IFDIR, pd);
+	PROBE_HANDLER_RETURN(rm_file, path, res_rm);
 	if (!res_rm) { pd->is_saved = 0; }
+	pthread_mutex_unlock(&pd->lock);
 	
+	finish_request(STATS_RMDIR, start, mount_path, path, NULL, res_rm);
 	return res_rm;
 }
 
-int jsonfs_rename(const char *old_path, const char *new_path, unsigned int flags)
+int jsonfs_rename(const char *mount_old_path, const char *mount_new_path, 
+				  unsigned int flags)
 {
+	uint64_t start = get_stats_time();
+	const char *old_path = mount_old_path;
+	const char *new_path = mount_new_path;
+	struct record_args args = { .path2 = mount_new_path, .flags = flags };
 	int res_rename;
 	(void) flags;
 
-	struct fuse_context *ctx = fuse_get_context();
-	struct jsonfs_private_data *pd = ctx->private_data;
-	CHECK_POINTER(pd, -ENOMEM);
+	struct jsonfs_private_data *pd = get_document(&old_path);
+	CHECK_POINTER(pd, -ENOENT);
 
-	res_rename = rename_file(old_path, new_path, pd);
-	if (!res_rename) { pd->is_saved = 0; }
+	/* Every document has its own tree, a node cannot move between them */
+	if (get_document(&new_path) != pd) {
+		res_rename = -EXDEV;
+	}
+	else {
+		pthread_mutex_lock(&pd->lock);
+		PROBE_HANDLER_ENTRY(rename_file, old_path, 0, 0);
+		res_rename = rename_file(old_path, new_path, pd);
+		PROBE_HANDLER_RETURN(rename_file, old_path, res_rename);
+		if (!res_rename) { pd->is_saved = 0; }
+		pthread_mutex_unlock(&pd->lock);
+	}
 
+	finish_request(STATS_RENAME, start, mount_old_path, old_path, &args, res_rename);
 	return res_rename;
 }
 
-int jsonfs_truncate(const char *path, off_t len, struct fuse_file_info *fi)
+int jsonfs_truncate(const char *mount_path, off_t len, struct fuse_file_info *fi)
 {
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
+	struct record_args args = { .size = len, .fh = fi ? fi->fh : 0 };
 	int res_trunc;
-	(void) fi;
 
-	struct fuse_context *ctx = fuse_get_context();
-	struct jsonfs_private_data *pd = ctx->private_data;
-	CHECK_POINTER(pd, -ENOMEM);
+	struct jsonfs_private_data *pd = get_document(&path);
+	CHECK_POINTER(pd, -ENOENT);
 
-	res_trunc = trunc_json_file(path, len, pd);
+	pthread_mutex_lock(&pd->lock);
+	if (is_raw_handle(fi)) {
+		PROBE_HANDLER_ENTRY(trunc_raw_file, path, len, 0);
+		res_trunc = trunc_raw_file(path, (struct file_buffer *) (uintptr_t) fi->fh,
+								   len, pd);
+		PROBE_HANDLER_RETURN(trunc_raw_file, path, res_trunc);
+		if (!res_trunc) { pd->is_saved = 0; }
+	}
+	else if (fi && fi->fh) {
+		PROBE_HANDLER_ENTRY(trunc_file_buffer, path, len, 0);
+		res_trunc = trunc_file_buffer((struct file_buffer *) (uintptr_t) fi->fh,
+									  len);
+		PROBE_HANDLER_RETURN(trunc_file_buffer, path, res_trunc);
+	}
+	else {
+		PROBE_HANDLER_ENTRY(trunc_json_file, path, len, 0);
+		res_trunc = trunc_json_file(path, len, pd);
+		PROBE_HANDLER_RETURN(trunc_json_file, path, res_trunc);
+	}
+	pthread_mutex_unlock(&pd->lock);
 
+	finish_request(STATS_TRUNCATE, start, mount_path, path, &args, res_trunc);
 	return res_trunc;
 }
 
-int jsonfs_open(const char *path, struct fuse_file_info *fi)
+int jsonfs_open(const char *mount_path, struct fuse_file_info *fi)
 {
-	if ((fi->flags & O_TRUNC) == O_TRUNC) {
-		struct fuse_context *ctx = fuse_get_context();
-		struct jsonfs_private_data *pd = ctx->private_data;
-		CHECK_POINTER(pd, -ENOMEM);
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
+	struct record_args args = { .flags = fi->flags };
+	int res_open;
+	struct file_buffer *fb = NULL;
+
+	struct jsonfs_private_data *pd = get_document(&path);
+	CHECK_POINTER(pd, -ENOENT);
+
+	pthread_mutex_lock(&pd->lock);
+
+	/* The size of these files is not known, so the page cache is not used */
+	if (strcmp("/.patch", path) == 0) {
+		PROBE_HANDLER_ENTRY(open_patch_file, path, 0, 0);
+		res_open = open_patch_file(fi->flags, &fb, pd);
+		PROBE_HANDLER_RETURN(open_patch_file, path, res_open);
+	}
+	else if (strcmp("/.ctl", path) == 0 && (fi->flags & O_ACCMODE) != O_RDONLY) {
+		/* A command may be split between writes */
+		PROBE_HANDLER_ENTRY(open_ctl_file, path, 0, 0);
+		res_open = open_ctl_file(&fb);
+		PROBE_HANDLER_RETURN(open_ctl_file, path, res_open);
+	}
+	else if (strcmp("/.stats", path) == 0 
+			 || strcmp("/.stats.prom", path) == 0
+			 || strcmp("/.trace", path) == 0
+			 || strcmp("/.hot", path) == 0) {
+		PROBE_HANDLER_ENTRY(open_snapshot_file, path, 0, 0);
+		res_open = open_snapshot_file(path, fi->flags, &fb, pd);
+		PROBE_HANDLER_RETURN(open_snapshot_file, path, res_open);
+	}
+	else if (find_subtree_dir(path, pd->root)) {
+		PROBE_HANDLER_ENTRY(open_subtree_file, path, 0, 0);
+		res_open = open_subtree_file(path, fi->flags, &fb, pd);
+		PROBE_HANDLER_RETURN(open_subtree_file, path, res_open);
+	}
+	else if (pd->opts.raw_strings && (fi->flags & O_ACCMODE) != O_RDONLY
+			 && json_is_string(find_json_node(path, pd->root))) {
+		/* UTF-8 is checked at flush, a write may split a character */
+		PROBE_HANDLER_ENTRY(open_raw_file, path, 0, 0);
+		res_open = open_raw_file(path, fi->flags, &fb, pd);
+		PROBE_HANDLER_RETURN(open_raw_file, path, res_open);
+	}
+	else {
+		if ((fi->flags & O_TRUNC) == O_TRUNC) {
+			trunc_json_file(path, 0, pd);
+		}
+		res_open = 0;
+	}
 
-		trunc_json_file(path, 0, pd);
+	pthread_mutex_unlock(&pd->lock);
+
+	if (!res_open && fb) {
+		fi->fh = (uint64_t) (uintptr_t) fb;
+		fi->direct_io = 1;
 	}
+	args.fh = fi->fh;
 
-	return 0;
+	finish_request(STATS_OPEN, start, mount_path, path, &args, res_open);
+	return res_open;
 }
 
-int jsonfs_read(const char *path, char *buffer, size_t size,
-				off_t offset, struct fuse_file_info *fi)
+/**
+ * @brief Reads a file, the lock must be held by the caller.
+ * @see jsonfs_read
+ */
+static int read_locked(const char *path, char *buffer, size_t size,
+					   off_t offset, struct fuse_file_info *fi,
+					   struct jsonfs_private_data *pd)
 {
 	int res_read;
-	(void) fi;
 
-	struct fuse_context *ctx = fuse_get_context();
-	struct jsonfs_private_data *pd = ctx->private_data;
-	CHECK_POINTER(pd, -ENOMEM);
-
-	if (is_special_file(path)) {
+	if (fi && fi->fh && !is_raw_handle(fi)) {
+		PROBE_HANDLER_ENTRY(read_file_buffer, path, size, offset);
+		res_read = read_file_buffer((struct file_buffer *) (uintptr_t) fi->fh,
+									buffer, size, offset);
+		PROBE_HANDLER_RETURN(read_file_buffer, path, res_read);
+	}
+	else if (is_special_file(path)) {
+		PROBE_HANDLER_ENTRY(read_special_file, path, size, offset);
 		res_read = read_special_file(path, buffer, size, offset, pd);
+		PROBE_HANDLER_RETURN(read_special_file, path, res_read);
 	}
 	else {
+		PROBE_HANDLER_ENTRY(read_json_file, path, size, offset);
 		res_read = read_json_file(path, buffer, size, offset, pd);
+		PROBE_HANDLER_RETURN(read_json_file, path, res_read);
 	}
 
 	return res_read;
 }
 
-int jsonfs_write(const char *path, const char *buffer, size_t size,
-				 off_t offset, struct fuse_file_info *fi)
+/**
+ * @brief Writes a file, the lock must be held by the caller.
+ * @see jsonfs_write
+ */
+static int write_locked(const char *path, const char *buffer, size_t size,
+						off_t offset, struct fuse_file_info *fi,
+						struct jsonfs_private_data *pd)
 {
+	struct fuse_bufvec src = FUSE_BUFVEC_INIT(size);
+	int is_changed = 0;
 	int res_write; 
-	(void) fi;
-
-	struct fuse_context *ctx = fuse_get_context();
-	struct jsonfs_private_data *pd = ctx->private_data;
-	CHECK_POINTER(pd, -ENOMEM);
 
-	if (is_special_file(path)) {
+	if (fi && fi->fh && strcmp("/.ctl", path) == 0) {
+		/* The commands before a failed one are applied */
+		PROBE_HANDLER_ENTRY(write_ctl_file, path, size, offset);
+		res_write = write_ctl_file((struct file_buffer *) (uintptr_t) fi->fh,
+								   buffer, size, offset, &is_changed, pd);
+		PROBE_HANDLER_RETURN(write_ctl_file, path, res_write);
+		if (is_changed) { pd->is_saved = 0; }
+	}
+	else if (is_raw_handle(fi)) {
+		src.buf[0].mem = (void *) buffer;
+		PROBE_HANDLER_ENTRY(write_raw_file, path, size, offset);
+		res_write = write_raw_file(path, (struct file_buffer *) (uintptr_t) fi->fh,
+								   &src, offset, pd);
+		PROBE_HANDLER_RETURN(write_raw_file, path, res_write);
+		if (res_write >= 0) { pd->is_saved = 0; }
+	}
+	else if (fi && fi->fh) {
+		PROBE_HANDLER_ENTRY(write_file_buffer, path, size, offset);
+		res_write = write_file_buffer((struct file_buffer *) (uintptr_t) fi->fh,
+									  buffer, size, offset);
+		PROBE_HANDLER_RETURN(write_file_buffer, path, res_write);
+	}
+	else if (strcmp("/.ctl", path) == 0) {
+		PROBE_HANDLER_ENTRY(write_ctl_commands, path, size, offset);
+		res_write = write_ctl_commands(buffer, size, &is_changed, pd);
+		PROBE_HANDLER_RETURN(write_ctl_commands, path, res_write);
+		if (is_changed) { pd->is_saved = 0; }
+	}
+	else if (is_special_file(path)) {
+		PROBE_HANDLER_ENTRY(write_special_file, path, size, offset);
 		res_write = write_special_file(path, buffer, size, offset, pd);
+		PROBE_HANDLER_RETURN(write_special_file, path, res_write);
 		if (res_write >= 0) { pd->is_saved = 1; }
 	}
 	else {
+		PROBE_HANDLER_ENTRY(write_json_file, path, size, offset);
 		res_write = write_json_file(path, buffer, size, offset, pd);
+		PROBE_HANDLER_RETURN(write_json_file, path, res_write);
 		if (res_write >= 0) { pd->is_saved = 0; }
 	}
 
 	return res_write;
 }
 
-int jsonfs_readdir(const char *path, void *buffer, fuse_fill_dir_t filler,
-				   off_t offset, struct fuse_file_info *fi,
-				   enum fuse_readdir_flags flags)
+int jsonfs_read(const char *mount_path, char *buffer, size_t size,
+				off_t offset, struct fuse_file_info *fi)
 {
-	json_t *node = NULL;
-	const char *key = NULL;
-	json_t *value = NULL;
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
+	struct record_args args = { .size = size, .offset = offset, 
+								.fh = fi ? fi->fh : 0 };
+	int res_read;
 
-	(void) offset;
-	(void) fi;
+	struct jsonfs_private_data *pd = get_document(&path);
+	CHECK_POINTER(pd, -ENOENT);
 
-	struct fuse_context *ctx = fuse_get_context();
-	struct jsonfs_private_data *pd = ctx->private_data;
-	CHECK_POINTER(pd, -ENOMEM);
+	pthread_mutex_lock(&pd->lock);
+	res_read = read_locked(path, buffer, size, offset, fi, pd);
+	pthread_mutex_unlock(&pd->lock);
+
+	finish_request(STATS_READ, start, mount_path, path, &args, res_read);
+	return res_read;
+}
+
+int jsonfs_write(const char *mount_path, const char *buffer, size_t size,
+				 off_t offset, struct fuse_file_info *fi)
+{
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
+	struct record_args args = { .size = size, .offset = offset, 
+								.fh = fi ? fi->fh : 0 };
+	int res_write; 
 
-	FILL_OR_RETURN(buffer, ".");
-	FILL_OR_RETURN(buffer, "..");
-	if (strcmp("/", path) == 0) {
-		FILL_OR_RETURN(buffer, ".status");
-		FILL_OR_RETURN(buffer, ".save");
+	struct jsonfs_private_data *pd = get_document(&path);
+	CHECK_POINTER(pd, -ENOENT);
+
+	pthread_mutex_lock(&pd->lock);
+	res_write = write_locked(path, buffer, size, offset, fi, pd);
+	pthread_mutex_unlock(&pd->lock);
+
+	finish_request(STATS_WRITE, start, mount_path, path, &args, res_write);
+	return res_write;
+}
+
+int jsonfs_read_buf(const char *mount_path, struct fuse_bufvec **bufp, 
+					size_t size, off_t offset, struct fuse_file_info *fi)
+{
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
+	struct record_args args = { .size = size, .offset = offset, 
+								.fh = fi->fh };
+	int res_read;
+	char *buffer = NULL;
+	struct fuse_bufvec *bufv = NULL;
+
+	struct jsonfs_private_data *pd = get_document(&path);
+	CHECK_POINTER(pd, -ENOENT);
+
+	if (!is_special_file(path) && (!fi->fh || is_raw_handle(fi))) {
+		pthread_mutex_lock(&pd->lock);
+		PROBE_HANDLER_ENTRY(read_json_buf, path, size, offset);
+		res_read = read_json_buf(path, bufp, size, offset, pd);
+		PROBE_HANDLER_RETURN(read_json_buf, path, res_read);
+		pthread_mutex_unlock(&pd->lock);
+		finish_request(STATS_READ_BUF, start, mount_path, path, &args, res_read);
+		return res_read;
 	}
 
-	node = find_json_node(path, pd->root);
-	CHECK_POINTER(node, -ENOENT);
+	bufv = malloc(sizeof(struct fuse_bufvec));
+	CHECK_POINTER(bufv, -ENOMEM);
 
-	if (!json_is_object(node)) {
-		return -ENOTDIR;
+	buffer = malloc(size ? size : 1);
+	if (!buffer) {
+		free(bufv);
+		finish_request(STATS_READ_BUF, start, mount_path, path, &args, -ENOMEM);
+		return -ENOMEM;
 	}
 
-	json_object_foreach(node, key, value) {
-		FILL_OR_RETURN(buffer, key);
+	pthread_mutex_lock(&pd->lock);
+	res_read = read_locked(path, buffer, size, offset, fi, pd);
+	pthread_mutex_unlock(&pd->lock);
+	if (res_read < 0) {
+		free(buffer);
+		free(bufv);
+		finish_request(STATS_READ_BUF, start, mount_path, path, &args, res_read);
+		return res_read;
 	}
 
+	*bufv = FUSE_BUFVEC_INIT(res_read);
+	bufv->buf[0].mem = buffer;
+	*bufp = bufv;
+
+	finish_request(STATS_READ_BUF, start, mount_path, path, &args, res_read);
+	return 0;
+}
+
+int jsonfs_write_buf(const char *mount_path, struct fuse_bufvec *buf, 
+					 off_t offset, struct fuse_file_info *fi)
+{
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
+	struct record_args args = { .size = fuse_buf_size(buf), 
+								.offset = offset, .fh = fi->fh };
+	int res_write;
+	size_t size;
+	struct fuse_bufvec mem_buf;
+
+	struct jsonfs_private_data *pd = get_document(&path);
+	CHECK_POINTER(pd, -ENOENT);
+
+	if (!is_special_file(path) && !fi->fh) {
+		pthread_mutex_lock(&pd->lock);
+		PROBE_HANDLER_ENTRY(write_json_buf, path, fuse_buf_size(buf), offset);
+		res_write = write_json_buf(path, buf, offset, pd);
+		PROBE_HANDLER_RETURN(write_json_buf, path, res_write);
+		if (res_write >= 0) { pd->is_saved = 0; }
+		pthread_mutex_unlock(&pd->lock);
+		finish_request(STATS_WRITE_BUF, start, mount_path, path, &args, res_write);
+		return res_write;
+	}
+
+	if (is_raw_handle(fi)) {
+		pthread_mutex_lock(&pd->lock);
+		PROBE_HANDLER_ENTRY(write_raw_file, path, fuse_buf_size(buf), offset);
+		res_write = write_raw_file(path, (struct file_buffer *) (uintptr_t) fi->fh,
+								   buf, offset, pd);
+		PROBE_HANDLER_RETURN(write_raw_file, path, res_write);
+		if (res_write >= 0) { pd->is_saved = 0; }
+		pthread_mutex_unlock(&pd->lock);
+		finish_request(STATS_WRITE_BUF, start, mount_path, path, &args, res_write);
+		return res_write;
+	}
+
+	/* Special and virtual files always take their data from memory */
+	size = fuse_buf_size(buf);
+	mem_buf = FUSE_BUFVEC_INIT(size);
+	mem_buf.buf[0].mem = malloc(size ? size : 1);
+	CHECK_POINTER(mem_buf.buf[0].mem, -ENOMEM);
+
+	res_write = (int) fuse_buf_copy(&mem_buf, buf, 0);
+	if (res_write >= 0) {
+		pthread_mutex_lock(&pd->lock);
+		res_write = write_locked(path, mem_buf.buf[0].mem, res_write, 
+								 offset, fi, pd);
+		pthread_mutex_unlock(&pd->lock);
+	}
+
+	free(mem_buf.buf[0].mem);
+	finish_request(STATS_WRITE_BUF, start, mount_path, path, &args, res_write);
+	return res_write;
+}
+
+int jsonfs_flush(const char *mount_path, struct fuse_file_info *fi)
+{
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
+	struct record_args args = { .fh = fi->fh };
+	int res_flush;
+	struct file_buffer *fb = NULL;
+
+	struct jsonfs_private_data *pd = get_document(&path);
+	CHECK_POINTER(pd, -ENOENT);
+
+	if (!fi->fh) { 
+		finish_request(STATS_FLUSH, start, mount_path, path, &args, 0);
+		return 0; 
+	}
+
+	fb = (struct file_buffer *) (uintptr_t) fi->fh;
+
+	/* The error of flush() is returned by close(), unlike release() */
+	pthread_mutex_lock(&pd->lock);
+	if (strcmp("/.patch", path) == 0) {
+		PROBE_HANDLER_ENTRY(flush_patch_file, path, 0, 0);
+		res_flush = flush_patch_file(fb, pd);
+		PROBE_HANDLER_RETURN(flush_patch_file, path, res_flush);
+	}
+	else if (strcmp("/.ctl", path) == 0) {
+		PROBE_HANDLER_ENTRY(flush_ctl_file, path, 0, 0);
+		res_flush = flush_ctl_file(fb, pd);
+		PROBE_HANDLER_RETURN(flush_ctl_file, path, res_flush);
+	}
+	else if (is_special_file(path) || find_subtree_dir(path, pd->root)) {
+		PROBE_HANDLER_ENTRY(flush_subtree_file, path, 0, 0);
+		res_flush = flush_subtree_file(path, fb, pd);
+		PROBE_HANDLER_RETURN(flush_subtree_file, path, res_flush);
+	}
+	else {
+		PROBE_HANDLER_ENTRY(flush_raw_file, path, 0, 0);
+		res_flush = flush_raw_file(path, fb, pd);
+		PROBE_HANDLER_RETURN(flush_raw_file, path, res_flush);
+	}
+	if (res_flush > 0) { pd->is_saved = 0; }
+	pthread_mutex_unlock(&pd->lock);
+
+	finish_request(STATS_FLUSH, start, mount_path, path, &args, res_flush);
+	return res_flush < 0 ? res_flush : 0;
+}
+
+int jsonfs_release(const char *path, struct fuse_file_info *fi)
+{
+	uint64_t start = get_stats_time();
+	struct record_args args = { .fh = fi->fh };
+
+	release_file_buffer((struct file_buffer *) (uintptr_t) fi->fh);
+	fi->fh = 0;
+
+	finish_request(STATS_RELEASE, start, path, path, &args, 0);
 	return 0;
 }
 
+int jsonfs_opendir(const char *mount_path, struct fuse_file_info *fi)
+{
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
+	struct record_args args = { 0 };
+	int res_open;
+	struct dir_cursor *cursor = NULL;
+
+	struct jsonfs_private_data *pd = get_document(&path);
+
+	/* The root of several documents is listed without a cursor */
+	if (!pd) {
+		res_open = is_mount_root(mount_path) ? 0 : -ENOENT;
+		fi->fh = 0;
+		finish_request(STATS_OPENDIR, start, mount_path, path, &args, res_open);
+		return res_open;
+	}
+
+	pthread_mutex_lock(&pd->lock);
+	PROBE_HANDLER_ENTRY(open_json_dir, path, 0, 0);
+	res_open = open_json_dir(path, &cursor, pd);
+	PROBE_HANDLER_RETURN(open_json_dir, path, res_open);
+	pthread_mutex_unlock(&pd->lock);
+	if (!res_open) { fi->fh = (uint64_t) (uintptr_t) cursor; }
+	args.fh = fi->fh;
+
+	finish_request(STATS_OPENDIR, start, mount_path, path, &args, res_open);
+	return res_open;
+}
+
+int jsonfs_readdir(const char *mount_path, void *buffer, 
+				   fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi,
+				   enum fuse_readdir_flags flags)
+{
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
+	struct record_args args = { .offset = offset, .flags = flags, 
+								.fh = fi ? fi->fh : 0 };
+	int res_read;
+	struct dir_cursor *cursor = NULL;
+	int plus = (flags & FUSE_READDIR_PLUS) ? 1 : 0;
+
+	struct jsonfs_private_data *pd = get_document(&path);
+
+	if (!pd) {
+		res_read = read_mount_root(mount_path, buffer, filler);
+		finish_request(STATS_READDIR, start, mount_path, path, &args, res_read);
+		return res_read;
+	}
+
+	if (fi) { cursor = (struct dir_cursor *) (uintptr_t) fi->fh; }
+
+	pthread_mutex_lock(&pd->lock);
+	PROBE_HANDLER_ENTRY(read_json_dir, path, 0, offset);
+	res_read = read_json_dir(path, buffer, filler, offset, plus, cursor, pd);
+	PROBE_HANDLER_RETURN(read_json_dir, path, res_read);
+	pthread_mutex_unlock(&pd->lock);
+
+	finish_request(STATS_READDIR, start, mount_path, path, &args, res_read);
+	return res_read;
+}
+
+int jsonfs_releasedir(const char *path, struct fuse_file_info *fi)
+{
+	uint64_t start = get_stats_time();
+	struct record_args args = { .fh = fi->fh };
+
+	release_json_dir((struct dir_cursor *) (uintptr_t) fi->fh);
+	fi->fh = 0;
+
+	finish_request(STATS_RELEASEDIR, start, path, path, &args, 0);
+	return 0;
+}
+
+void *jsonfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg)
+{
+	(void) cfg;
+
+	struct fuse_context *ctx = fuse_get_context();
+	struct jsonfs_mount *mount = NULL;
+
+	/* Data of big files is moved through a pipe instead of being copied */
+	if (conn->capable & FUSE_CAP_SPLICE_READ) {
+		conn->want |= FUSE_CAP_SPLICE_READ;
+	}
+	if (conn->capable & FUSE_CAP_SPLICE_WRITE) {
+		conn->want |= FUSE_CAP_SPLICE_WRITE;
+	}
+	if (conn->capable & FUSE_CAP_SPLICE_MOVE) {
+		conn->want |= FUSE_CAP_SPLICE_MOVE;
+	}
+
+	/* libfuse and the kernel lower them to the largest supported values */
+	conn->max_write = UINT_MAX;
+	conn->max_readahead = UINT_MAX;
+
+	mount = ctx->private_data;
+	if (mount && mount->count && mount->docs[0]->opts.reload &&
+		start_reload_watcher(mount, ctx->fuse) < 0) 
+	{
+		fputs("jsonfs: failed to watch the files for reloading\n", stderr);
+	}
+
+	return ctx->private_data;
+}
+
 void jsonfs_destroy(void *userdata)
 {
 	if (!userdata) { return; }
 
-	struct jsonfs_private_data *pd = (struct jsonfs_private_data *)userdata;
-	destroy_private_data(pd);
+	struct jsonfs_mount *mount = (struct jsonfs_mount *)userdata;
+
+	/* No reload may change the trees while they are released */
+	stop_reload_watcher();
+
+	if (mount->count && mount->docs[0]->opts.persist_hot 
+		&& save_hot_paths(mount->hot_file) < 0) {
+		fputs("jsonfs: failed to save the hot paths\n", stderr);
+	}
+
+	/* The trees are released at once with the arena */
+	if (json_arena_is_used()) {
+		for (size_t i = 0; i < mount->count; i++) {
+			mount->docs[i]->root = NULL;
+			mount->docs[i]->zero = NULL;
+			mount->docs[i]->file_root = NULL;
+		}
+		destroy_mount(mount);
+		release_json_arena();
+		release_stats();
+		release_trace();
+		stop_recording();
+		release_hot();
+		return;
+	}
+
+	destroy_mount(mount);
+	release_stats();
+	release_trace();
+	stop_recording();
+	release_hot();
 }
 
-int jsonfs_utimens(const char *path, const struct timespec tv[2], struct fuse_file_info *fi)
+int jsonfs_utimens(const char *mount_path, const struct timespec tv[2], struct fuse_file_info *fi)
 {
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
 	struct file_time *ft = NULL;
 	(void) fi;
 
-	struct fuse_context *ctx = fuse_get_context();
-	struct jsonfs_private_data *pd = ctx->private_data;
-	CHECK_POINTER(pd, -ENOMEM);
+	struct jsonfs_private_data *pd = get_document(&path);
+	CHECK_POINTER(pd, -ENOENT);
 
+	pthread_mutex_lock(&pd->lock);
 	ft = find_node_file_time(path, pd->ft);
 	if (ft) {
 		ft->atime = tv[0].tv_sec;
@@ -270,6 +901,49 @@ int jsonfs_utimens(const char *path, const struct timespec tv[2], struct fuse_fi
 		ft->mtime = tv[1].tv_sec;
 		ft->ctime =	tv[1].tv_sec; 
 	}
+	pthread_mutex_unlock(&pd->lock);
 
+	finish_request(STATS_UTIMENS, start, mount_path, path, NULL, 0);
     return 0;
 }
+
+int jsonfs_getxattr(const char *mount_path, const char *name, char *value,
+					size_t size)
+{
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
+	struct record_args args = { .path2 = name, .size = size };
+	int res_get;
+
+	struct jsonfs_private_data *pd = get_document(&path);
+	CHECK_POINTER(pd, -ENOENT);
+
+	pthread_mutex_lock(&pd->lock);
+	PROBE_HANDLER_ENTRY(getxattr_json_file, path, size, 0);
+	res_get = getxattr_json_file(path, name, value, size, pd);
+	PROBE_HANDLER_RETURN(getxattr_json_file, path, res_get);
+	pthread_mutex_unlock(&pd->lock);
+
+	finish_request(STATS_GETXATTR, start, mount_path, path, &args, res_get);
+	return res_get;
+}
+
+int jsonfs_listxattr(const char *mount_path, char *list, size_t size)
+{
+	uint64_t start = get_stats_time();
+	const char *path = mount_path;
+	struct record_args args = { .size = size };
+	int res_list;
+
+	struct jsonfs_private_data *pd = get_document(&path);
+	CHECK_POINTER(pd, -ENOENT);
+
+	pthread_mutex_lock(&pd->lock);
+	PROBE_HANDLER_ENTRY(listxattr_json_file, path, size, 0);
+	res_list = listxattr_json_file(path, list, size, pd);
+	PROBE_HANDLER_RETURN(listxattr_json_file, path, res_list);
+	pthread_mutex_unlock(&pd->lock);
+
+	finish_request(STATS_LISTXATTR, start, mount_path, path, &args, res_list);
+	return res_list;
+}
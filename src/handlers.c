@@ -33,22 +33,356 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
 
 #include "common.h"
 #include "jsonfs.h"
+#include "handlers.h"
 #include "json_operations.h"
 #include "file_time.h"
+#include "json_patch.h"
+#include "stats.h"
+#include "trace.h"
+#include "hot.h"
+#include "probes.h"
+#include "ndjson.h"
+#include "image.h"
+#include "binary_json.h"
 
-int getattr_json_file(const char *path, struct stat *st,
-					  struct jsonfs_private_data *pd)
+/**
+ * @brief Gives the default value for new and truncated files.
+ * 
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return New reference to the shared zero if there is one,
+ * 		   otherwise a new zero integer. NULL on failure.
+ */
+static json_t *new_default_value(struct jsonfs_private_data *pd)
+{
+	if (pd->zero) { return json_incref(pd->zero); }
+	return json_integer(0);
+}
+
+/**
+ * @brief Gives a new version to a changed path.
+ * 
+ * @param is_reset 1 if the whole subtree of the path was replaced.
+ * 
+ * @see set_version_ft
+ */
+static void mark_changed(const char *path, int is_reset,
+						 struct jsonfs_private_data *pd)
+{
+	pd->version++;
+	set_version_ft(path, pd->ft, pd->version, is_reset);
+}
+
+/**
+ * @brief Copies data given by FUSE to memory.
+ * 
+ * The data may be in memory or in a pipe when splice is used.
+ * 
+ * @param dst Memory to copy to.
+ * @param size Number of bytes to copy.
+ * @param src Data given by FUSE.
+ * 
+ * @return 0 on success, negative error code on failure.
+ */
+static int copy_from_bufvec(char *dst, size_t size, struct fuse_bufvec *src)
+{
+	struct fuse_bufvec dst_buf = FUSE_BUFVEC_INIT(size);
+	ssize_t res_copy;
+
+	if (!size) { return 0; }
+
+	dst_buf.buf[0].mem = dst;
+	res_copy = fuse_buf_copy(&dst_buf, src, 0);
+	if (res_copy < 0) { return (int) res_copy; }
+	if ((size_t) res_copy != size) { return -EIO; }
+
+	return 0;
+}
+
+/**
+ * @brief Checks if the node is a string given as raw bytes.
+ * 
+ * @see jsonfs_options
+ */
+static int is_raw_string(json_t *node, struct jsonfs_private_data *pd)
+{
+	return pd->opts.raw_strings && json_is_string(node);
+}
+
+/**
+ * @brief Checks if the bytes are valid UTF-8, as jansson requires of strings.
+ * 
+ * Overlong forms, surrogates and code points above U+10FFFF are rejected.
+ * 
+ * @param str Bytes to check, may contain null bytes.
+ * @param len Number of the bytes.
+ * 
+ * @return 1 if the bytes are valid UTF-8, 0 otherwise.
+ */
+static int is_utf8(const char *str, size_t len)
+{
+	const unsigned char *pos = (const unsigned char *) str;
+	const unsigned char *end = pos + len;
+	unsigned int value;
+	int count;
+
+	while (pos < end) {
+		if (*pos < 0x80) {
+			pos++;
+			continue;
+		}
+
+		if (*pos >= 0xC2 && *pos <= 0xDF) { count = 1; value = *pos & 0x1F; }
+		else if (*pos >= 0xE0 && *pos <= 0xEF) { count = 2; value = *pos & 0x0F; }
+		else if (*pos >= 0xF0 && *pos <= 0xF4) { count = 3; value = *pos & 0x07; }
+		else { return 0; }
+
+		if (end - pos <= count) { return 0; }
+		for (int i = 1; i <= count; i++) {
+			if ((pos[i] & 0xC0) != 0x80) { return 0; }
+			value = (value << 6) | (pos[i] & 0x3F);
+		}
+
+		if ((count == 2 && value < 0x800) || (count == 3 && value < 0x10000)
+			|| (value >= 0xD800 && value <= 0xDFFF) || value > 0x10FFFF)
+		{
+			return 0;
+		}
+		pos += count + 1;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Stores raw bytes as the new value of a string node.
+ * 
+ * @param path The absolute path to the node.
+ * @param node The string node itself.
+ * @param content Bytes of the string, null-terminated.
+ * @param len Length of the string.
+ * @param is_checked 0 to store the bytes without checking UTF-8,
+ * 					 see write_raw_file().
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, -EILSEQ if the bytes are not valid UTF-8,
+ * 		   other negative error code on failure.
+ */
+static int store_raw_string(const char *path, json_t *node, 
+							const char *content, size_t len, int is_checked,
+							struct jsonfs_private_data *pd)
+{
+	json_t *new_node = NULL;
+
+	if (node->refcount == 1) {
+		if (!is_checked) { return json_string_setn_nocheck(node, content, len); }
+		return json_string_setn(node, content, len) ? -EILSEQ : 0;
+	}
+
+	/* A shared string is replaced only at this path */
+	new_node = is_checked ? json_stringn(content, len) 
+						  : json_stringn_nocheck(content, len);
+	CHECK_POINTER(new_node, -EILSEQ);
+
+	if (replace_json_node_at(path, new_node, pd->root)) {
+		json_decref(new_node);
+		return -ENOENT;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Changes a string given as raw bytes.
+ * 
+ * The string keeps its type, the new bytes are placed at the offset 
+ * and the string gets the given length. The requests that come without 
+ * an open handle check that the whole result is valid UTF-8, the writes 
+ * to an open file are checked when it is flushed.
+ * 
+ * @param path The absolute path to the node.
+ * @param node The string node itself.
+ * @param src Bytes to place, may be NULL.
+ * @param offset Position of the bytes in the string.
+ * @param new_len Length of the string after the change.
+ * @param is_checked 0 to skip the check of UTF-8.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, negative error code on failure.
+ * 
+ * @see store_raw_string
+ */
+static int set_raw_string(const char *path, json_t *node, 
+						  struct fuse_bufvec *src, off_t offset, size_t new_len,
+						  int is_checked, struct jsonfs_private_data *pd)
+{
+	const char *old_value = json_string_value(node);
+	size_t old_len = json_string_length(node);
+	char *content = NULL;
+	int ret = 0;
+
+	content = malloc(new_len + 1);
+	CHECK_POINTER(content, -ENOMEM);
+
+	memcpy(content, old_value, old_len < new_len ? old_len : new_len);
+	if (old_len < new_len) {
+		memset(content + old_len, 0, new_len - old_len);
+	}
+	if (src) {
+		ret = copy_from_bufvec(content + offset, fuse_buf_size(src), src);
+		if (ret < 0) { goto handle_error; }
+	}
+	content[new_len] = '\0';
+
+	ret = store_raw_string(path, node, content, new_len, is_checked, pd);
+
+	handle_error:
+		free(content);
+		return ret;
+}
+
+/**
+ * @brief Marks a file as written: its version and the modification time.
+ */
+static void touch_written_file(const char *path, 
+							   struct jsonfs_private_data *pd)
+{
+	struct file_time *ft = NULL;
+	time_t now = time(NULL);
+
+	mark_changed(path, 0, pd);
+
+	ft = find_node_file_time(path, pd->ft);
+	if (ft) {
+		ft->mtime = now;
+		ft->ctime = now;
+	}
+	else {
+		add_node_to_list_ft(path, pd->ft, SET_MTIME | SET_CTIME);
+	}
+}
+
+/**
+ * @brief Stores the text of a file as the new value of its node.
+ * 
+ * Numbers and literals are parsed without jansson. An integer or 
+ * a real that is not shared with other nodes is changed in place.
+ * 
+ * @param path The absolute path to the node.
+ * @param node The node itself.
+ * @param text Null-terminated text of the file.
+ * @param len Length of the text.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, negative error code on failure.
+ */
+static int store_json_text(const char *path, json_t *node, const char *text,
+						   size_t len, struct jsonfs_private_data *pd)
+{
+	struct json_scalar scalar;
+	json_t *new_node = NULL;
+	uint64_t start;
+	int res_replace;
+
+	if (parse_json_scalar(text, len, &scalar) == 0) {
+		if (json_typeof(node) == scalar.type) {
+			switch (scalar.type) {
+				case JSON_INTEGER:
+					if (node->refcount != 1) { break; }
+					return json_integer_set(node, scalar.integer) ? -EIO : 0;
+				case JSON_REAL:
+					if (node->refcount != 1) { break; }
+					return json_real_set(node, scalar.real) ? -EINVAL : 0;
+				default:
+					/* Literals are unique in jansson */
+					return 0;
+			}
+		}
+
+		switch (scalar.type) {
+			case JSON_INTEGER: new_node = json_integer(scalar.integer); break;
+			case JSON_REAL: new_node = json_real(scalar.real); break;
+			case JSON_TRUE: new_node = json_true(); break;
+			case JSON_FALSE: new_node = json_false(); break;
+			default: new_node = json_null(); break;
+		}
+		CHECK_POINTER(new_node, -ENOMEM);
+	}
+	else {
+		start = begin_trace_span();
+		new_node = json_loads(text, JSON_DECODE_ANY, NULL);
+		end_trace_span("json_loads", TRACE_JSON, start, path);
+		count_stats_event(STATS_LOADS);
+		CHECK_POINTER(new_node, -EINVAL);
+	}
+
+	res_replace = replace_json_node_at(path, new_node, pd->root);
+	if (res_replace) {
+		json_decref(new_node);
+		return -ENOENT;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Gives the content of a JSON file.
+ * 
+ * @param node The node of the file.
+ * @param scalar_buf Buffer for numbers and literals.
+ * @param scalar_size Size of scalar_buf.
+ * @param len Length of the content.
+ * @param is_allocated Set to 1 if the content is a new buffer.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return The string of the node for raw strings, scalar_buf for numbers 
+ * 		   and literals, a new buffer otherwise. NULL on failure.
+ * 
+ * @note Caller must free() the content if is_allocated is set.
+ */
+static char *get_json_content(json_t *node, char *scalar_buf, 
+							  size_t scalar_size, size_t *len, 
+							  int *is_allocated, 
+							  struct jsonfs_private_data *pd)
+{
+	int scalar_len;
+
+	*is_allocated = 0;
+
+	if (is_raw_string(node, pd)) {
+		*len = json_string_length(node);
+		return (char *) json_string_value(node);
+	}
+
+	scalar_len = format_json_scalar(node, scalar_buf, scalar_size);
+	if (scalar_len >= 0) {
+		*len = scalar_len;
+		return scalar_buf;
+	}
+
+	*is_allocated = 1;
+	return dump_json_node(node, len);
+}
+
+/**
+ * @brief Fills file attributes of a JSON node.
+ * 
+ * @param path The absolute path to the node (used to find its times).
+ * @param node The node itself.
+ * @param st Structure to fill with file attributes.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, negative error code on failure.
+ */
+static int fill_json_stat(const char *path, json_t *node, struct stat *st,
+						  struct jsonfs_private_data *pd)
 {
-	json_t *node = NULL;
 	struct file_time *ft = NULL;
 
-	CHECK_POINTER(path, -EFAULT);
-	CHECK_POINTER(st, -EFAULT);
-	CHECK_POINTER(pd, -EFAULT);
-    
 	st->st_uid = pd->uid;
 	st->st_gid = pd->gid;
 
@@ -64,9 +398,6 @@ int getattr_json_file(const char *path, struct stat *st,
 		st->st_ctime = pd->ft->ctime;
 	}
 
-	node = find_json_node(path, pd->root);
-	CHECK_POINTER(node, -ENOENT);
-
 	if (json_is_object(node)) {
 		st->st_mode = S_IFDIR | 0775;
 		st->st_nlink = 2 + count_subdirs(node);
@@ -74,18 +405,69 @@ int getattr_json_file(const char *path, struct stat *st,
 	else {
 		st->st_mode = S_IFREG | 0666;
 		st->st_nlink = 1;
-		char *str = json_dumps(node, JSON_ENCODE_ANY | JSON_REAL_PRECISION(10));
+
+		char scalar_buf[MID_SIZE];
+		size_t str_len;
+		int is_allocated;
+		char *str = get_json_content(node, scalar_buf, sizeof(scalar_buf), 
+									 &str_len, &is_allocated, pd);
 		CHECK_POINTER(str, -ENOMEM);
-		st->st_size = str ? strlen(str) : 0;
-		free(str);
+		st->st_size = str_len;
+		if (is_allocated) { free(str); }
 	}
 	return 0;
 }
 
+int getattr_json_file(const char *path, struct stat *st,
+					  struct jsonfs_private_data *pd)
+{
+	json_t *node = NULL;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(st, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	node = find_json_node(path, pd->root);
+	CHECK_POINTER(node, -ENOENT);
+
+	return fill_json_stat(path, node, st, pd);
+}
+
+/**
+ * @brief Gives the text of /.status: the save state, then the report 
+ * of the last reload on the next lines if there is one.
+ * 
+ * @param len[out] Length of the text.
+ * 
+ * @return The text on success, NULL on failure.
+ * 
+ * @note The returned text must be freed with free().
+ */
+static char *get_status_text(struct jsonfs_private_data *pd, size_t *len)
+{
+	const char *state = pd->is_saved ? "SAVED" : "UNSAVED";
+	size_t state_len = strlen(state);
+	char *text = NULL;
+
+	*len = state_len;
+	if (pd->reload_report) { *len += 1 + pd->reload_report_len; }
+
+	text = malloc(*len + 1);
+	CHECK_POINTER(text, NULL);
+
+	memcpy(text, state, state_len);
+	if (pd->reload_report) {
+		text[state_len] = '\n';
+		memcpy(text + state_len + 1, pd->reload_report, pd->reload_report_len);
+	}
+	text[*len] = '\0';
+
+	return text;
+}
+
 int getattr_special_file(const char *path, struct stat *st,
 						 struct jsonfs_private_data *pd)
 {
-	int is_saved;
 	struct file_time *ft = NULL;
 
 	CHECK_POINTER(path, -EFAULT);
@@ -96,8 +478,6 @@ int getattr_special_file(const char *path, struct stat *st,
         return -EINVAL;
     }
 	
-	is_saved = pd->is_saved;
-
 	st->st_uid = pd->uid;
 	st->st_gid = pd->gid;
 
@@ -116,13 +496,29 @@ int getattr_special_file(const char *path, struct stat *st,
 	if (strcmp("/.status", path) == 0) {
 		st->st_mode = S_IFREG | 0444;
 		st->st_nlink = 1;
-		st->st_size = is_saved ? strlen("SAVED") : strlen("UNSAVED");
+		st->st_size = strlen(pd->is_saved ? "SAVED" : "UNSAVED");
+		if (pd->reload_report) { st->st_size += 1 + pd->reload_report_len; }
 	}
 	else if (strcmp("/.save", path) == 0) {
 		st->st_mode = S_IFREG | 0666;
 		st->st_nlink = 1;
 		st->st_size = 1;
 	}
+	else if (strcmp("/.patch", path) == 0) {
+		st->st_mode = S_IFREG | 0666;
+		st->st_nlink = 1;
+		st->st_size = 0;
+	}
+	else if (strcmp("/.ctl", path) == 0) {
+		st->st_mode = S_IFREG | 0222;
+		st->st_nlink = 1;
+		st->st_size = 0;
+	}
+	else {
+		st->st_mode = S_IFREG | 0444;
+		st->st_nlink = 1;
+		st->st_size = 0;
+	}
 	return 0;
 }
 
@@ -174,7 +570,7 @@ int make_file(const char *path, mode_t mode, struct jsonfs_private_data *pd)
 		return -EINVAL; 
 	}
 
-	parent = find_json_node(parent_path, pd->root);
+	parent = unshare_json_node(parent_path, pd->root);
 	if (!parent) { 
 		free(parent_path); 
 		return -ENOENT; 
@@ -186,7 +582,7 @@ int make_file(const char *path, mode_t mode, struct jsonfs_private_data *pd)
 	}
 
 	if (type == S_IFREG) {
-		new_node = json_integer(0);
+		new_node = new_default_value(pd);
 	}
 	else if (type == S_IFDIR) {
 		new_node = json_object();
@@ -203,6 +599,8 @@ int make_file(const char *path, mode_t mode, struct jsonfs_private_data *pd)
 		return -EIO; 
 	}
 
+	mark_changed(path, 1, pd);
+
 	ft = find_node_file_time(path, pd->ft);
 	if (ft) {
 		ft->mtime = now;
@@ -220,8 +618,9 @@ int rm_file(const char *path, int file_type, struct jsonfs_private_data *pd)
 {
 	json_t *node = NULL;
 	json_t *parent = NULL;
-	const char *node_key = NULL;
-	int res_find;
+	char *parent_path = NULL;
+	char *node_key = NULL;
+	int res_sep;
 	size_t size;
 
 	CHECK_POINTER(path, -EFAULT);
@@ -245,12 +644,22 @@ int rm_file(const char *path, int file_type, struct jsonfs_private_data *pd)
 			break;
 	}
 
-	res_find = find_parent_and_key(pd->root, node, &parent, &node_key);
-	if (res_find < 0) { return res_find; }
+	res_sep = separate_filepath(path, &parent_path, &node_key);
+	if (res_sep < 0) { return -ENOMEM; }
+
+	parent = unshare_json_node(parent_path, pd->root);
+	if (!parent) {
+		free(parent_path);
+		free(node_key);
+		return -ENOENT;
+	}
 
 	json_object_del(parent, node_key);
 	remove_node_to_list_ft(path, pd->ft);
+	mark_changed(parent_path, 0, pd);
 
+	free(parent_path);
+	free(node_key);
 	return 0;
 }
 
@@ -291,7 +700,7 @@ int rename_file(const char *old_path, const char *new_path,
 		old_parent = pd->root;
 	}
 	else {
-		old_parent = find_json_node(old_parent_path, pd->root);
+		old_parent = unshare_json_node(old_parent_path, pd->root);
 		if (!old_parent) {
 			res_rename = -ENOENT;
 			goto handle_error;
@@ -302,7 +711,7 @@ int rename_file(const char *old_path, const char *new_path,
 		new_parent = pd->root;
 	}
 	else {
-		new_parent = find_json_node(new_parent_path, pd->root);
+		new_parent = unshare_json_node(new_parent_path, pd->root);
 		if (!new_parent) {
 			res_rename = -ENOENT;
 			goto handle_error;
@@ -332,7 +741,9 @@ int rename_file(const char *old_path, const char *new_path,
 
 	json_object_del(old_parent, old_name);
 
-	remove_node_to_list_ft(old_path, pd->ft);
+	remove_subtree_to_list_ft(old_path, pd->ft);
+	mark_changed(old_parent == pd->root ? "/" : old_parent_path, 0, pd);
+	mark_changed(new_path, 1, pd);
 
 	handle_error:
 		free(old_parent_path);
@@ -342,94 +753,215 @@ int rename_file(const char *old_path, const char *new_path,
 		return res_rename;
 }
 
-int trunc_json_file(const char *path, off_t offset, 
-					struct jsonfs_private_data *pd)
+int rm_tree(const char *path, struct jsonfs_private_data *pd)
 {
-	size_t content_len;
-	json_t *old_node = NULL;
-	json_t *new_node = NULL;
-	struct file_time *ft = NULL;
-	time_t now = time(NULL);
-	char *res_realloc = NULL;
-	char *content = NULL;
-	int res_replace;
+	json_t *parent = NULL;
+	char *parent_path = NULL;
+	char *node_key = NULL;
 	int ret = 0;
 
-	CHECK_POINTER(path, -EINVAL);
-	CHECK_POINTER(pd, -EINVAL);
-	if (offset < 0) { return -EINVAL; }
-
-	old_node = find_json_node(path, pd->root);
-	CHECK_POINTER(old_node, -ENOENT);
-
-	content = json_dumps(old_node, JSON_ENCODE_ANY | JSON_REAL_PRECISION(10));
-	CHECK_POINTER(content, -ENOMEM);
-
-	content_len = strlen(content);
-
-	if (offset == 0) {
-		new_node = json_integer(0); 
-		res_replace = replace_json_nodes(old_node, new_node, pd->root);
-		if (res_replace) { ret = -ENOENT; goto handle_error; }
-		free(content);
-		return ret;
-	}
-
-	if (content_len != offset) {
-		res_realloc = realloc(content, offset + 1);
-		if (!res_realloc) { ret = -ENOMEM; goto handle_error; }
-		content = res_realloc;
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
 
-		content[offset] = '\0';
+	if (is_special_file(path)) { return -EPERM; }
+	if (!find_json_node(path, pd->root)) { return -ENOENT; }
+	if (strcmp(path, "/") == 0) { return -EBUSY; }
 
-		if (content_len < offset) {
-			memset(content + content_len, 0, offset - content_len);
-		}
+	if (separate_filepath(path, &parent_path, &node_key) < 0) { 
+		return -ENOMEM; 
 	}
 
-	new_node = json_loads(content, JSON_DECODE_ANY, NULL);
-	if (!new_node) { ret = -EINVAL; goto handle_error; }
-
-	res_replace = replace_json_nodes(old_node, new_node, pd->root);
-	if (res_replace) { ret = -ENOENT; goto handle_error; }
-
-	ft = find_node_file_time(path, pd->ft);
-	if (ft) {
-		ft->mtime = now;
-		ft->ctime = now;
-	}
-	else {
-		add_node_to_list_ft(path, pd->ft, SET_MTIME | SET_CTIME);
+	parent = unshare_json_node(parent_path, pd->root);
+	if (!parent) {
+		ret = -ENOENT;
+		goto handle_error;
 	}
 
-	return ret;
+	/* The subtree is freed by jansson, shared parts only lose a reference */
+	json_object_del(parent, node_key);
+	remove_subtree_to_list_ft(path, pd->ft);
+	mark_changed(parent_path, 0, pd);
 
 	handle_error:
-		json_decref(new_node);
-		free(content);
+		free(parent_path);
+		free(node_key);
 		return ret;
 }
 
-int read_json_file(const char *path, char *buffer, size_t size,
-				   off_t offset, struct jsonfs_private_data *pd)
+int clone_tree(const char *src_path, const char *dst_path, 
+			   struct jsonfs_private_data *pd)
 {
 	json_t *node = NULL;
-	char *text = NULL;
-	size_t text_len;
-	size_t final_size = 0;
-	time_t now = time(NULL);
+	json_t *parent = NULL;
+	char *parent_path = NULL;
+	char *name = NULL;
 	struct file_time *ft = NULL;
+	time_t now = time(NULL);
+	size_t src_len;
+	int ret = 0;
 
-	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(src_path, -EFAULT);
+	CHECK_POINTER(dst_path, -EFAULT);
 	CHECK_POINTER(pd, -EFAULT);
 
-	node = find_json_node(path, pd->root);
+	if (is_special_file(src_path) || is_special_file(dst_path)) { 
+		return -EPERM; 
+	}
+
+	node = find_json_node(src_path, pd->root);
+	CHECK_POINTER(node, -ENOENT);
+
+	/* The clone would contain itself */
+	src_len = strlen(src_path);
+	if (node == pd->root || (strncmp(src_path, dst_path, src_len) == 0 && 
+		(dst_path[src_len] == '\0' || dst_path[src_len] == '/'))) {
+		return -EINVAL;
+	}
+
+	if (separate_filepath(dst_path, &parent_path, &name) < 0) { 
+		return -ENOMEM; 
+	}
+
+	if (!*name || strlen(name) >= MID_SIZE) {
+		ret = !*name ? -EINVAL : -ENAMETOOLONG;
+		goto handle_error;
+	}
+
+	parent = unshare_json_node(parent_path, pd->root);
+	if (!parent) {
+		ret = -ENOENT;
+		goto handle_error;
+	}
+	if (!json_is_object(parent)) {
+		ret = -ENOTDIR;
+		goto handle_error;
+	}
+	if (json_object_get(parent, name)) {
+		ret = -EEXIST;
+		goto handle_error;
+	}
+
+	/* Both paths share the subtree until one of them is changed */
+	if (json_object_set(parent, name, node)) {
+		ret = -ENOMEM;
+		goto handle_error;
+	}
+
+	mark_changed(dst_path, 1, pd);
+
+	ft = find_node_file_time(dst_path, pd->ft);
+	if (ft) {
+		ft->mtime = now;
+		ft->ctime = now;
+	}
+
+	handle_error:
+		free(parent_path);
+		free(name);
+		return ret;
+}
+
+int trunc_json_file(const char *path, off_t offset, 
+					struct jsonfs_private_data *pd)
+{
+	char scalar_buf[MID_SIZE];
+	int scalar_len;
+	size_t content_len;
+	json_t *old_node = NULL;
+	json_t *new_node = NULL;
+	char *res_realloc = NULL;
+	char *content = NULL;
+	int res_replace;
+	int ret = 0;
+
+	CHECK_POINTER(path, -EINVAL);
+	CHECK_POINTER(pd, -EINVAL);
+	if (offset < 0) { return -EINVAL; }
+
+	old_node = unshare_json_node(path, pd->root);
+	CHECK_POINTER(old_node, -ENOENT);
+
+	if (offset == 0 && !is_raw_string(old_node, pd)) {
+		if (json_is_integer(old_node) && old_node->refcount == 1) {
+			json_integer_set(old_node, 0);
+			goto update_time;
+		}
+
+		new_node = new_default_value(pd); 
+		CHECK_POINTER(new_node, -ENOMEM);
+
+		res_replace = replace_json_node_at(path, new_node, pd->root);
+		if (res_replace) { 
+			json_decref(new_node);
+			return -ENOENT;
+		}
+		goto update_time;
+	}
+
+	if (is_raw_string(old_node, pd)) {
+		ret = set_raw_string(path, old_node, NULL, 0, offset, 1, pd);
+		if (ret < 0) { return ret; }
+		goto update_time;
+	}
+
+	scalar_len = format_json_scalar(old_node, scalar_buf, sizeof(scalar_buf));
+	if (scalar_len >= 0 && offset < sizeof(scalar_buf)) {
+		content = scalar_buf;
+		content_len = scalar_len;
+	}
+	else {
+		content = dump_json_node(old_node, &content_len);
+		CHECK_POINTER(content, -ENOMEM);
+
+		if (content_len < offset) {
+			res_realloc = realloc(content, offset + 1);
+			if (!res_realloc) { ret = -ENOMEM; goto handle_error; }
+			content = res_realloc;
+		}
+	}
+
+	if (content_len < offset) {
+		memset(content + content_len, 0, offset - content_len);
+	}
+	content[offset] = '\0';
+
+	ret = store_json_text(path, old_node, content, offset, pd);
+	if (ret < 0) { goto handle_error; }
+
+	if (content != scalar_buf) { free(content); }
+
+	update_time:
+		touch_written_file(path, pd);
+
+		return 0;
+
+	handle_error:
+		if (content != scalar_buf) { free(content); }
+		return ret;
+}
+
+int read_json_file(const char *path, char *buffer, size_t size,
+				   off_t offset, struct jsonfs_private_data *pd)
+{
+	char scalar_buf[MID_SIZE];
+	int is_allocated;
+	json_t *node = NULL;
+	char *text = NULL;
+	size_t text_len;
+	size_t final_size = 0;
+	time_t now = time(NULL);
+	struct file_time *ft = NULL;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	node = find_json_node(path, pd->root);
 	CHECK_POINTER(node, -ENOENT);
 	
-	text = json_dumps(node, JSON_ENCODE_ANY | JSON_REAL_PRECISION(10));
+	text = get_json_content(node, scalar_buf, sizeof(scalar_buf), &text_len,
+							&is_allocated, pd);
 	CHECK_POINTER(text, -ENOMEM);
 
-	text_len = strlen(text);
 	if (offset < text_len) {
 		final_size = text_len - offset;
 		if (final_size > size) {
@@ -437,7 +969,7 @@ int read_json_file(const char *path, char *buffer, size_t size,
 		}
 		memcpy(buffer, text + offset, final_size);
 	}
-	free(text);
+	if (is_allocated) { free(text); }
 
 	ft = find_node_file_time(path, pd->ft);
 	if (ft) {
@@ -451,11 +983,81 @@ int read_json_file(const char *path, char *buffer, size_t size,
 	return (int)final_size;
 }
 
+int read_json_buf(const char *path, struct fuse_bufvec **bufp, size_t size,
+				  off_t offset, struct jsonfs_private_data *pd)
+{
+	char scalar_buf[MID_SIZE];
+	int is_allocated;
+	json_t *node = NULL;
+	struct fuse_bufvec *bufv = NULL;
+	char *text = NULL;
+	char *data = NULL;
+	size_t text_len;
+	size_t final_size = 0;
+	time_t now = time(NULL);
+	struct file_time *ft = NULL;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(bufp, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	node = find_json_node(path, pd->root);
+	CHECK_POINTER(node, -ENOENT);
+
+	bufv = malloc(sizeof(struct fuse_bufvec));
+	CHECK_POINTER(bufv, -ENOMEM);
+
+	text = get_json_content(node, scalar_buf, sizeof(scalar_buf), &text_len,
+							&is_allocated, pd);
+	if (!text) {
+		free(bufv);
+		return -ENOMEM;
+	}
+
+	if (offset < text_len) {
+		final_size = text_len - offset;
+		if (final_size > size) {
+			final_size = size;
+		}
+	}
+
+	/* The serialized node itself is given to FUSE, which frees it */
+	if (is_allocated) {
+		data = text;
+		if (offset > 0 && final_size) {
+			memmove(data, text + offset, final_size);
+		}
+	}
+	else {
+		data = malloc(final_size ? final_size : 1);
+		if (!data) {
+			free(bufv);
+			return -ENOMEM;
+		}
+		if (final_size) { memcpy(data, text + offset, final_size); }
+	}
+
+	*bufv = FUSE_BUFVEC_INIT(final_size);
+	bufv->buf[0].mem = data;
+	*bufp = bufv;
+
+	ft = find_node_file_time(path, pd->ft);
+	if (ft) {
+		ft->atime = now;
+		ft->ctime = now;
+	}
+	else {
+		add_node_to_list_ft(path, pd->ft, SET_ATIME | SET_CTIME);
+	}
+
+	return 0;
+}
+
 int read_special_file(const char *path, char *buffer, size_t size,
 					  off_t offset, struct jsonfs_private_data *pd)
 {
-	char *text = NULL;
-	int is_saved;
+	const char *text = NULL;
+	char *status = NULL;
 	size_t text_len;
 	size_t final_size = 0;
 	struct file_time *ft = NULL;
@@ -468,16 +1070,22 @@ int read_special_file(const char *path, char *buffer, size_t size,
         return -EINVAL;
     }
 
-	is_saved = pd->is_saved;
-
 	if (strcmp("/.status", path) == 0) {
-		text = is_saved ? "SAVED\n" : "UNSAVED\n";
+		status = get_status_text(pd, &text_len);
+		CHECK_POINTER(status, -ENOMEM);
+		text = status;
 	}
 	else if (strcmp("/.save", path) == 0) {
-		text = is_saved ? "0" : "1";
+		text = pd->is_saved ? "0" : "1";
+	}
+	else if (strcmp("/.ctl", path) == 0) {
+		return -EACCES;
+	}
+	else {
+		return -EINVAL;
 	}
 	
-	text_len = strlen(text);
+	if (!status) { text_len = strlen(text); }
 	if (offset < text_len) {
 		final_size = text_len - offset;
 		if (final_size > size) {
@@ -485,6 +1093,7 @@ int read_special_file(const char *path, char *buffer, size_t size,
 		}
 		memcpy(buffer, text + offset, final_size);
 	}
+	free(status);
 
 	ft = find_node_file_time(path, pd->ft);
 	if (ft) {
@@ -501,106 +1110,1639 @@ int read_special_file(const char *path, char *buffer, size_t size,
 int write_json_file(const char *path, const char *buffer, size_t size,
 					off_t offset, struct jsonfs_private_data *pd)
 {
+	struct fuse_bufvec src = FUSE_BUFVEC_INIT(size);
+
+	CHECK_POINTER(buffer, -EFAULT);
+
+	src.buf[0].mem = (void *) buffer;
+	return write_json_buf(path, &src, offset, pd);
+}
+
+int write_json_buf(const char *path, struct fuse_bufvec *src, off_t offset,
+				   struct jsonfs_private_data *pd)
+{
+	char scalar_buf[MID_SIZE];
+	int scalar_len;
 	json_t *old_node = NULL;
-	json_t *new_node = NULL;
 	json_t *root = NULL;
 	char *content = NULL;
 	void *res_realloc = NULL;
 	size_t content_len;
-	int res_replace;
-	int ret = (int) size;
-	time_t now = time(NULL);
-	struct file_time *ft = NULL;
+	size_t size;
+	int res_store;
+	int res_copy;
+	int ret;
 
 	CHECK_POINTER(path, -EFAULT);
-	CHECK_POINTER(buffer, -EFAULT);
+	CHECK_POINTER(src, -EFAULT);
 	CHECK_POINTER(pd, -EFAULT);
+	if (offset < 0) { return -EINVAL; }
+
+	size = fuse_buf_size(src);
+	ret = (int) size;
 
 	root = pd->root;
 	CHECK_POINTER(root, -EFAULT);
 
-	old_node = find_json_node(path, root);
+	old_node = unshare_json_node(path, root);
 	CHECK_POINTER(old_node, -ENOENT);
 
-	content = json_dumps(old_node, JSON_ENCODE_ANY | JSON_REAL_PRECISION(10));
-	CHECK_POINTER(content, -ENOMEM);
+	if (is_raw_string(old_node, pd)) {
+		content_len = json_string_length(old_node);
+		if (size + offset > content_len) { content_len = size + offset; }
 
-	content_len = strlen(content);
+		res_store = set_raw_string(path, old_node, src, offset, 
+								   content_len, 1, pd);
+		if (res_store < 0) { return res_store; }
+		goto update_time;
+	}
 
-	if (size + offset > content_len) {
-		res_realloc = realloc(content, size + offset + 1);
-		if (!res_realloc) { ret = -ENOMEM; goto handle_error; }
-		content = res_realloc;
+	/* Small writes to a number or a literal do not use the heap */
+	scalar_len = format_json_scalar(old_node, scalar_buf, sizeof(scalar_buf));
+	if (scalar_len >= 0 && size + offset < sizeof(scalar_buf)) {
+		content = scalar_buf;
+		content_len = scalar_len;
+	}
+	else {
+		content = dump_json_node(old_node, &content_len);
+		CHECK_POINTER(content, -ENOMEM);
+
+		if (size + offset > content_len) {
+			res_realloc = realloc(content, size + offset + 1);
+			if (!res_realloc) { ret = -ENOMEM; goto handle_error; }
+			content = res_realloc;
+		}
+	}
 
+	if (offset > content_len) {
+		memset(content + content_len, 0, offset - content_len);
+	}
+	/* With splice the data is read from the pipe right into the content */
+	res_copy = copy_from_bufvec(content + offset, size, src);
+	if (res_copy < 0) { ret = res_copy; goto handle_error; }
+	if (size + offset > content_len) {
 		content_len = size + offset;
 		content[content_len] = '\0';
 	}
 
-	for(int i = offset, j = 0; i < content_len && j < size; i++, j++) {
-		content[i] = buffer[j];
+	res_store = store_json_text(path, old_node, content, content_len, pd);
+	if (content != scalar_buf) { free(content); }
+	if (res_store < 0) { return res_store; }
+
+	update_time:
+		touch_written_file(path, pd);
+
+		return ret;
+
+	handle_error:
+		if (content != scalar_buf) { free(content); }
+		return ret;
+}
+
+/**
+ * @brief Splits a command of /.ctl into arguments in place.
+ * 
+ * Arguments are separated by spaces or tabs. A backslash escapes 
+ * the next character, so "\ " is a space inside a path.
+ * 
+ * @param line Null-terminated command.
+ * @param args Array for the arguments.
+ * @param max_args Size of args.
+ * @param rest[out] Text after max_args arguments, as is.
+ * 
+ * @return Number of arguments.
+ */
+static int split_ctl_command(char *line, char **args, int max_args, 
+							 char **rest)
+{
+	char *src = line;
+	char *dst = line;
+	int count = 0;
+
+	for (;;) {
+		while (*src == ' ' || *src == '\t') { src++; }
+		if (!*src || count == max_args) { break; }
+
+		args[count++] = dst;
+		while (*src && *src != ' ' && *src != '\t') {
+			if (*src == '\\' && src[1]) { src++; }
+			*dst++ = *src++;
+		}
+		if (*src) { src++; }
+		*dst++ = '\0';
 	}
 
-	new_node = json_loads(content, JSON_DECODE_ANY, NULL);
-	if (!new_node) { ret = -EINVAL; goto handle_error; }
+	*rest = src;
+	return count;
+}
+
+/**
+ * @brief Makes a new object the root of the document.
+ * 
+ * The new root is complete before the old one is released, 
+ * so a failure leaves the document as it was.
+ * 
+ * @param new_root Normalized object, the reference is stolen on success.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, -EINVAL if the new root is not an object.
+ */
+static int replace_json_root(json_t *new_root, struct jsonfs_private_data *pd)
+{
+	if (!json_is_object(new_root)) { return -EINVAL; }
+
+	json_decref(pd->root);
+	pd->root = new_root;
+	return 0;
+}
+
+/**
+ * @brief Replaces the value of a file or a directory with a JSON text.
+ * 
+ * @return 0 on success, negative error code on failure.
+ */
+static int set_json_value(const char *path, const char *text, size_t len,
+						  struct jsonfs_private_data *pd)
+{
+	json_t *value = NULL;
+	json_t *new_node = NULL;
+	struct file_time *ft = NULL;
+	time_t now = time(NULL);
+	uint64_t start;
+	int res_replace;
+	int is_root = strcmp(path, "/") == 0;
+
+	start = begin_trace_span();
+	value = json_loadb(text, len, JSON_DECODE_ANY, NULL);
+	end_trace_span("json_loads", TRACE_JSON, start, path);
+	count_stats_event(STATS_LOADS);
+	CHECK_POINTER(value, -EINVAL);
+
+	new_node = normalize_json(value, is_root, NULL);
+	json_decref(value);
+	CHECK_POINTER(new_node, -ENOMEM);
+
+	if (is_root) {
+		res_replace = replace_json_root(new_node, pd);
+		if (res_replace < 0) {
+			json_decref(new_node);
+			return res_replace;
+		}
+	}
+	else if (replace_json_node_at(path, new_node, pd->root)) {
+		json_decref(new_node);
+		return -ENOENT;
+	}
 
-	res_replace = replace_json_nodes(old_node, new_node, root);
-	if (res_replace) { ret = -ENOENT; goto handle_error; }
+	mark_changed(path, 1, pd);
 
 	ft = find_node_file_time(path, pd->ft);
 	if (ft) {
 		ft->mtime = now;
 		ft->ctime = now;
 	}
-	else {
-		add_node_to_list_ft(path, pd->ft, SET_MTIME | SET_CTIME);
-	}
-
-	free(content);
-	return ret;
 
-	handle_error:
-		json_decref(new_node);
-		free(content);
-		return ret;
+	return 0;
 }
 
-int write_special_file(const char *path, const char *buffer, size_t size,
-					   off_t offset, struct jsonfs_private_data *pd)
+/**
+ * @brief Replaces a value if its version is the expected one.
+ * 
+ * @param path The absolute path to the file/directory.
+ * @param version Text of the expected version.
+ * @param text JSON text of the new value.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, -ECANCELED if the value has another version,
+ * 		   other negative error code on failure.
+ */
+static int cas_json_value(const char *path, const char *version, 
+						  const char *text, struct jsonfs_private_data *pd)
 {
-	int res_save;
-	time_t now = time(NULL);
-	struct file_time *ft = NULL;
-	json_t *saved_json = NULL;
+	unsigned long long expected;
+	char *end = NULL;
 
-	CHECK_POINTER(path, -EFAULT);
-	CHECK_POINTER(buffer, -EFAULT);
-	CHECK_POINTER(pd, -EFAULT);
+	if (!find_json_node(path, pd->root)) { return -ENOENT; }
+	if (is_special_file(path)) { return -EPERM; }
 
-	if (!is_special_file(path)) { 
-		return -EINVAL; 
+	errno = 0;
+	expected = strtoull(version, &end, 10);
+	if (errno || *end || *version < '0' || *version > '9') { return -EINVAL; }
+
+	if (get_version_ft(path, pd->ft) != expected) { return -ECANCELED; }
+
+	return set_json_value(path, text, strlen(text), pd);
+}
+
+/**
+ * @brief Turns tracing on or off, or drops the recorded spans.
+ * 
+ * @param mode "on", "off" or "clear".
+ * 
+ * @return 0 on success, -EINVAL for an unknown mode.
+ */
+static int set_tracing(const char *mode)
+{
+	if (strcmp(mode, "on") == 0) {
+		set_trace_enabled(1);
+	}
+	else if (strcmp(mode, "off") == 0) {
+		set_trace_enabled(0);
+	}
+	else if (strcmp(mode, "clear") == 0) {
+		clear_trace();
+	}
+	else {
+		return -EINVAL;
 	}
 
-	if (strcmp("/.save", path) != 0) {
-		return -EACCES;
+	return 0;
+}
+
+/**
+ * @brief Runs one command of /.ctl.
+ * 
+ * @param line Null-terminated command, it is changed.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 1 if the command changed the tree, 0 if it did not,
+ * 		   negative error code on failure.
+ */
+static int run_ctl_command(char *line, struct jsonfs_private_data *pd)
+{
+	int res_run;
+	char *args[3];
+	char *rest = NULL;
+	size_t len;
+	int count;
+
+	count = split_ctl_command(line, args, 3, &rest);
+	if (count == 0) { return 0; }
+
+	if (strcmp(args[0], "trace") == 0) {
+		return count == 2 && !*rest ? set_tracing(args[1]) : -EINVAL;
 	}
 
-	saved_json = denormalize_json(pd->root); 
-	CHECK_POINTER(saved_json, -EINVAL);
+	/* Paths are the second argument and the third one of clone */
+	for (int i = 1; i < count && (i == 1 || strcmp(args[0], "clone") == 0); i++) {
+		if (args[i][0] != '/') { return -EINVAL; }
 
-	res_save = json_dump_file(saved_json, pd->path_to_json_file,
-							  JSON_INDENT(2) | JSON_ENCODE_ANY | 
-							  JSON_REAL_PRECISION(10));
-	if (res_save < 0) { return -EINVAL; }
-	json_decref(saved_json);
+		len = strlen(args[i]);
+		while (len > 1 && args[i][len - 1] == '/') { args[i][--len] = '\0'; }
+	}
 
-	ft = find_node_file_time(path, pd->ft);
-	if (ft) {
-		ft->mtime = now;
-		ft->ctime = now;
+	if (strcmp(args[0], "rmtree") == 0 && count == 2) {
+		res_run = rm_tree(args[1], pd);
+	}
+	else if (strcmp(args[0], "clone") == 0 && count == 3 && !*rest) {
+		res_run = clone_tree(args[1], args[2], pd);
+	}
+	else if (strcmp(args[0], "cas") == 0 && count == 3 && *rest) {
+		res_run = cas_json_value(args[1], args[2], rest, pd);
 	}
 	else {
-		add_node_to_list_ft(path, pd->ft, SET_MTIME | SET_CTIME);
+		return -EINVAL;
 	}
 
+	return res_run < 0 ? res_run : 1;
+}
+
+/**
+ * @brief Runs the commands written to /.ctl, one per line.
+ * 
+ * @param is_changed[out] Set to 1 if a command changed the tree, 
+ * 		  also when a later one fails.
+ * 
+ * @return 0 on success, error code of the first failed command 
+ * 		   otherwise. The commands before it stay applied.
+ */
+static int run_ctl_commands(const char *buffer, size_t size, int *is_changed,
+							struct jsonfs_private_data *pd)
+{
+	const char *begin = buffer;
+	const char *end = buffer + size;
+	const char *eol = NULL;
+	char *line = NULL;
+	int res_run;
+
+	while (begin < end) {
+		eol = memchr(begin, '\n', end - begin);
+		if (!eol) { eol = end; }
+
+		line = strndup(begin, eol - begin);
+		CHECK_POINTER(line, -ENOMEM);
+
+		res_run = run_ctl_command(line, pd);
+		free(line);
+		if (res_run < 0) { return res_run; }
+		if (res_run > 0) { *is_changed = 1; }
+
+		begin = eol + 1;
+	}
+
+	return 0;
+}
+
+int write_special_file(const char *path, const char *buffer, size_t size,
+					   off_t offset, struct jsonfs_private_data *pd)
+{
+	int res_save;
+	uint64_t start;
+	time_t now = time(NULL);
+	struct file_time *ft = NULL;
+	struct stat file_st;
+	json_t *saved_json = NULL;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(buffer, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	if (!is_special_file(path)) { 
+		return -EINVAL; 
+	}
+
+	if (strcmp("/.save", path) != 0) {
+		return -EACCES;
+	}
+
+	start = get_stats_time();
+	PROBE1(save__start, pd->path_to_json_file);
+
+	/* The lines count their serializations themselves */
+	if (pd->ndjson) {
+		res_save = save_ndjson_file(pd);
+	}
+	else {
+		saved_json = denormalize_json(pd->root); 
+		if (!saved_json) {
+			PROBE2(save__done, pd->path_to_json_file, -EINVAL);
+			return -EINVAL;
+		}
+
+		if (pd->binary_format != BINARY_NONE) {
+			res_save = dump_binary_file(saved_json, pd->path_to_json_file,
+										pd->binary_format);
+		}
+		else {
+			res_save = json_dump_file(saved_json, pd->path_to_json_file, 
+									  SAVE_FLAGS);
+		}
+		json_decref(saved_json);
+		count_stats_event(STATS_DUMPS);
+	}
+	PROBE2(save__done, pd->path_to_json_file, res_save);
+	count_stats_op(STATS_SAVE, start);
+	end_trace_span("save", TRACE_JSON, start, pd->path_to_json_file);
+	if (res_save < 0) { return -EINVAL; }
+
+	/* The saved tree resolves the conflicts of the last reload */
+	if (!stat(pd->path_to_json_file, &file_st)) { 
+		set_file_state(pd, &file_st); 
+
+		/* A failed image is not used at mounting, the file is parsed then */
+		if (pd->opts.image && !pd->ndjson) {
+			save_json_image(pd->root, pd->path_to_json_file, &file_st);
+		}
+	}
+	free(pd->reload_report);
+	pd->reload_report = NULL;
+	pd->reload_report_len = 0;
+
+	ft = find_node_file_time(path, pd->ft);
+	if (ft) {
+		ft->mtime = now;
+		ft->ctime = now;
+	}
+	else {
+		add_node_to_list_ft(path, pd->ft, SET_MTIME | SET_CTIME);
+	}
+
+	return (int) size;
+}
+
+/**
+ * @brief Runs the commands held by the buffer of /.ctl.
+ * 
+ * The commands are dropped from the buffer whether they succeed or not,
+ * so a failed command is not run again by the next write.
+ * 
+ * @param fb Buffer of /.ctl.
+ * @param is_final 1 if the last line is complete without a newline.
+ * @param is_changed[out] Set to 1 if a command changed the tree.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return 0 on success, error code of the first failed command otherwise.
+ */
+static int run_ctl_buffer(struct file_buffer *fb, int is_final, 
+						  int *is_changed, struct jsonfs_private_data *pd)
+{
+	const char *eol = NULL;
+	size_t count_done;
+	int res_run = 0;
+
+	if (!fb->len) { return 0; }
+
+	if (is_final) {
+		count_done = fb->len;
+	}
+	else {
+		/* An unfinished line waits for the next write */
+		eol = fb->data + fb->len;
+		while (eol > fb->data && eol[-1] != '\n') { eol--; }
+		count_done = eol - fb->data;
+	}
+	if (!count_done) { return 0; }
+
+	res_run = run_ctl_commands(fb->data, count_done, is_changed, pd);
+
+	memmove(fb->data, fb->data + count_done, fb->len - count_done);
+	fb->len -= count_done;
+	fb->data[fb->len] = '\0';
+	fb->offset += count_done;
+
+	return res_run < 0 ? res_run : 0;
+}
+
+int write_ctl_commands(const char *buffer, size_t size, int *is_changed,
+					   struct jsonfs_private_data *pd)
+{
+	int res_run;
+
+	CHECK_POINTER(buffer, -EFAULT);
+	CHECK_POINTER(is_changed, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	*is_changed = 0;
+
+	res_run = run_ctl_commands(buffer, size, is_changed, pd);
+	return res_run < 0 ? res_run : (int) size;
+}
+
+int open_ctl_file(struct file_buffer **fb)
+{
+	struct file_buffer *new_fb = NULL;
+
+	CHECK_POINTER(fb, -EFAULT);
+
+	new_fb = calloc(1, sizeof(struct file_buffer));
+	CHECK_POINTER(new_fb, -ENOMEM);
+
+	*fb = new_fb;
+	return 0;
+}
+
+int write_ctl_file(struct file_buffer *fb, const char *buffer, size_t size,
+				   off_t offset, int *is_changed, 
+				   struct jsonfs_private_data *pd)
+{
+	int res_write;
+	int res_run;
+
+	CHECK_POINTER(fb, -EFAULT);
+	CHECK_POINTER(buffer, -EFAULT);
+	CHECK_POINTER(is_changed, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+	if (offset < 0) { return -EINVAL; }
+
+	*is_changed = 0;
+
+	/* The commands start where the first write is, e.g. at the end with O_APPEND */
+	if (!fb->data) { fb->offset = offset; }
+
+	/* The commands that have run cannot be rewritten */
+	if (offset < fb->offset || offset - fb->offset > fb->len) { return -EINVAL; }
+
+	res_write = write_file_buffer(fb, buffer, size, offset - fb->offset);
+	if (res_write < 0) { return res_write; }
+
+	res_run = run_ctl_buffer(fb, 0, is_changed, pd);
+	return res_run < 0 ? res_run : res_write;
+}
+
+int flush_ctl_file(struct file_buffer *fb, struct jsonfs_private_data *pd)
+{
+	int is_changed = 0;
+	int res_run;
+
+	CHECK_POINTER(fb, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	if (!fb->len) { return 0; }
+
+	res_run = run_ctl_buffer(fb, 1, &is_changed, pd);
+	fb->is_changed = 0;
+	return res_run < 0 ? res_run : is_changed;
+}
+
+int getattr_subtree_file(const char *path, struct stat *st,
+						 struct jsonfs_private_data *pd)
+{
+	json_t *dir = NULL;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(st, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	dir = find_subtree_dir(path, pd->root);
+	CHECK_POINTER(dir, -ENOENT);
+
+	st->st_uid = pd->uid;
+	st->st_gid = pd->gid;
+	st->st_atime = pd->mount_time;
+	st->st_mtime = pd->mount_time;
+	st->st_ctime = pd->mount_time;
+	st->st_mode = S_IFREG | 0666;
+	st->st_nlink = 1;
+	st->st_size = 0;
+
+	return 0;
+}
+
+int open_subtree_file(const char *path, int flags, struct file_buffer **fb,
+					  struct jsonfs_private_data *pd)
+{
+	json_t *dir = NULL;
+	struct file_buffer *new_fb = NULL;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(fb, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	dir = find_subtree_dir(path, pd->root);
+	CHECK_POINTER(dir, -ENOENT);
+
+	new_fb = calloc(1, sizeof(struct file_buffer));
+	CHECK_POINTER(new_fb, -ENOMEM);
+
+	if ((flags & O_TRUNC) == O_TRUNC) {
+		new_fb->is_changed = 1;
+	}
+	else {
+		new_fb->data = export_json_subtree(dir, &new_fb->len);
+		if (!new_fb->data) {
+			free(new_fb);
+			return -ENOMEM;
+		}
+		new_fb->cap = new_fb->len + 1;
+	}
+
+	*fb = new_fb;
+	return 0;
+}
+
+int flush_subtree_file(const char *path, struct file_buffer *fb,
+					   struct jsonfs_private_data *pd)
+{
+	json_t *dir = NULL;
+	json_t *subtree = NULL;
+	char *dir_path = NULL;
+	char *name = NULL;
+	struct file_time *ft = NULL;
+	time_t now = time(NULL);
+	int ret = 1;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(fb, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	if (!fb->is_changed) { return 0; }
+
+	dir = find_subtree_dir(path, pd->root);
+	CHECK_POINTER(dir, -ENOENT);
+
+	subtree = import_json_subtree(fb->data ? fb->data : "", fb->len);
+	CHECK_POINTER(subtree, -EINVAL);
+
+	if (separate_filepath(path, &dir_path, &name) < 0) {
+		ret = -ENOMEM;
+		goto handle_error;
+	}
+
+	if (dir == pd->root) {
+		ret = replace_json_root(subtree, pd);
+		if (ret < 0) { goto handle_error; }
+		subtree = NULL;
+		ret = 1;
+		goto handle_error;
+	}
+
+	if (replace_json_node_at(dir_path, subtree, pd->root)) {
+		ret = -ENOENT;
+		goto handle_error;
+	}
+	subtree = NULL;
+
+	handle_error:
+		if (ret > 0) {
+			fb->is_changed = 0;
+			mark_changed(dir_path, 1, pd);
+
+			ft = find_node_file_time(dir_path, pd->ft);
+			if (ft) {
+				ft->mtime = now;
+				ft->ctime = now;
+			}
+			else {
+				add_node_to_list_ft(dir_path, pd->ft, SET_MTIME | SET_CTIME);
+			}
+		}
+
+		json_decref(subtree);
+		free(dir_path);
+		free(name);
+		return ret;
+}
+
+/**
+ * @brief Keeps a copy of the string in the buffer of a raw file.
+ * @return 0 on success, -ENOMEM on failure.
+ * @see flush_raw_file
+ */
+static int keep_raw_content(struct file_buffer *fb, json_t *node)
+{
+	size_t len = json_string_length(node);
+	char *res_realloc = NULL;
+
+	if (len + 1 > fb->cap) {
+		res_realloc = realloc(fb->data, len + 1);
+		CHECK_POINTER(res_realloc, -ENOMEM);
+		fb->data = res_realloc;
+		fb->cap = len + 1;
+	}
+
+	memcpy(fb->data, json_string_value(node), len + 1);
+	fb->len = len;
+	return 0;
+}
+
+int open_raw_file(const char *path, int flags, struct file_buffer **fb,
+				  struct jsonfs_private_data *pd)
+{
+	json_t *node = NULL;
+	struct file_buffer *new_fb = NULL;
+	int res_trunc;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(fb, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	node = find_json_node(path, pd->root);
+	if (!is_raw_string(node, pd)) { return -EINVAL; }
+
+	if ((flags & O_TRUNC) == O_TRUNC) {
+		res_trunc = trunc_json_file(path, 0, pd);
+		if (res_trunc < 0) { return res_trunc; }
+		node = find_json_node(path, pd->root);
+		CHECK_POINTER(node, -ENOENT);
+	}
+
+	new_fb = calloc(1, sizeof(struct file_buffer));
+	CHECK_POINTER(new_fb, -ENOMEM);
+
+	new_fb->is_raw = 1;
+	if (keep_raw_content(new_fb, node) < 0) {
+		free(new_fb);
+		return -ENOMEM;
+	}
+
+	*fb = new_fb;
+	return 0;
+}
+
+int write_raw_file(const char *path, struct file_buffer *fb, 
+				   struct fuse_bufvec *src, off_t offset, 
+				   struct jsonfs_private_data *pd)
+{
+	json_t *node = NULL;
+	size_t size;
+	size_t new_len;
+	int res_store;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(fb, -EFAULT);
+	CHECK_POINTER(src, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+	if (offset < 0) { return -EINVAL; }
+
+	node = unshare_json_node(path, pd->root);
+	CHECK_POINTER(node, -ENOENT);
+
+	/* The node was replaced by another value while the file was open */
+	if (!is_raw_string(node, pd)) { return write_json_buf(path, src, offset, pd); }
+
+	size = fuse_buf_size(src);
+	new_len = json_string_length(node);
+	if (size + offset > new_len) { new_len = size + offset; }
+
+	res_store = set_raw_string(path, node, src, offset, new_len, 0, pd);
+	if (res_store < 0) { return res_store; }
+
+	fb->is_changed = 1;
+	touch_written_file(path, pd);
 	return (int) size;
 }
+
+int trunc_raw_file(const char *path, struct file_buffer *fb, off_t offset,
+				   struct jsonfs_private_data *pd)
+{
+	json_t *node = NULL;
+	int res_store;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(fb, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+	if (offset < 0) { return -EINVAL; }
+
+	node = unshare_json_node(path, pd->root);
+	CHECK_POINTER(node, -ENOENT);
+
+	if (!is_raw_string(node, pd)) { return trunc_json_file(path, offset, pd); }
+
+	res_store = set_raw_string(path, node, NULL, 0, offset, 0, pd);
+	if (res_store < 0) { return res_store; }
+
+	fb->is_changed = 1;
+	touch_written_file(path, pd);
+	return 0;
+}
+
+int flush_raw_file(const char *path, struct file_buffer *fb,
+				   struct jsonfs_private_data *pd)
+{
+	json_t *node = NULL;
+	int res_store;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(fb, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	if (!fb->is_changed) { return 0; }
+	fb->is_changed = 0;
+
+	/* The node was removed or replaced by another value while the file was open */
+	node = find_json_node(path, pd->root);
+	if (!is_raw_string(node, pd)) { return 0; }
+
+	if (is_utf8(json_string_value(node), json_string_length(node))) {
+		return keep_raw_content(fb, node);
+	}
+
+	/* The string gets back its content at the last flush of the file */
+	res_store = store_raw_string(path, node, fb->data, fb->len, 0, pd);
+	if (res_store < 0) { return res_store; }
+
+	touch_written_file(path, pd);
+	return -EILSEQ;
+}
+
+int open_patch_file(int flags, struct file_buffer **fb,
+					struct jsonfs_private_data *pd)
+{
+	struct file_buffer *new_fb = NULL;
+
+	CHECK_POINTER(fb, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	new_fb = calloc(1, sizeof(struct file_buffer));
+	CHECK_POINTER(new_fb, -ENOMEM);
+
+	if ((flags & O_TRUNC) == O_TRUNC) {
+		new_fb->is_changed = 1;
+	}
+	else if (pd->patch_report) {
+		new_fb->data = malloc(pd->patch_report_len + 1);
+		if (!new_fb->data) {
+			free(new_fb);
+			return -ENOMEM;
+		}
+		memcpy(new_fb->data, pd->patch_report, pd->patch_report_len + 1);
+		new_fb->len = pd->patch_report_len;
+		new_fb->cap = new_fb->len + 1;
+	}
+
+	*fb = new_fb;
+	return 0;
+}
+
+int open_snapshot_file(const char *path, int flags, struct file_buffer **fb,
+					struct jsonfs_private_data *pd)
+{
+	struct file_buffer *new_fb = NULL;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(fb, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	if ((flags & O_ACCMODE) != O_RDONLY) { return -EACCES; }
+
+	new_fb = calloc(1, sizeof(struct file_buffer));
+	CHECK_POINTER(new_fb, -ENOMEM);
+
+	if (strcmp("/.stats.prom", path) == 0) {
+		new_fb->data = format_stats_prometheus(&new_fb->len);
+	}
+	else if (strcmp("/.trace", path) == 0) {
+		new_fb->data = format_trace_json(&new_fb->len);
+	}
+	else if (strcmp("/.hot", path) == 0) {
+		new_fb->data = format_hot_json(&new_fb->len);
+	}
+	else {
+		new_fb->data = format_stats_json(&new_fb->len);
+	}
+
+	if (!new_fb->data) {
+		free(new_fb);
+		return -ENOMEM;
+	}
+	new_fb->cap = new_fb->len + 1;
+
+	*fb = new_fb;
+	return 0;
+}
+
+/**
+ * @brief Gives new versions to the paths changed by a patch operation.
+ * 
+ * @param pointer JSON Pointer of the operation.
+ * @param is_removed 1 if the value was removed from the pointer.
+ * @param pd Private filesystem data from FUSE context.
+ */
+static void mark_patched(const char *pointer, int is_removed,
+						 struct jsonfs_private_data *pd)
+{
+	char *path = NULL;
+	char *parent_path = NULL;
+	char *name = NULL;
+	int is_array;
+
+	/* The path is gone if a later operation removed its parent */
+	path = json_pointer_to_path(pd->root, pointer, &is_array);
+	if (!path) { return; }
+
+	if (strcmp(path, "/") == 0 || separate_filepath(path, &parent_path, &name)) {
+		mark_changed("/", 1, pd);
+	}
+	else if (is_array) {
+		/* The following elements were shifted */
+		mark_changed(parent_path, 1, pd);
+	}
+	else if (is_removed) {
+		remove_subtree_to_list_ft(path, pd->ft);
+		mark_changed(parent_path, 0, pd);
+	}
+	else {
+		mark_changed(path, 1, pd);
+	}
+
+	free(path);
+	free(parent_path);
+	free(name);
+}
+
+int flush_patch_file(struct file_buffer *fb, struct jsonfs_private_data *pd)
+{
+	json_t *report = NULL;
+	json_t *result = NULL;
+	const char *op = NULL;
+	const char *path = NULL;
+	const char *from = NULL;
+	char *text = NULL;
+	size_t text_len;
+	size_t index;
+	struct file_time *ft = NULL;
+	time_t now = time(NULL);
+	int res_apply;
+
+	CHECK_POINTER(fb, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	if (!fb->is_changed) { return 0; }
+
+	res_apply = apply_json_patch(pd->root, fb->data ? fb->data : "", fb->len,
+								 &report);
+	fb->is_changed = 0;
+
+	if (res_apply > 0) {
+		json_array_foreach(json_object_get(report, "operations"), index, result) {
+			op = json_string_value(json_object_get(result, "op"));
+			path = json_string_value(json_object_get(result, "path"));
+			from = json_string_value(json_object_get(result, "from"));
+			if (!op || !path || strcmp(op, "test") == 0) { continue; }
+
+			if (from && strcmp(op, "move") == 0) { mark_patched(from, 1, pd); }
+			mark_patched(path, strcmp(op, "remove") == 0, pd);
+		}
+	}
+
+	/* The report replaces the patch, so it can be read back */
+	text = report ? dump_json_document(report, &text_len) : NULL;
+	json_decref(report);
+	if (text) {
+		free(pd->patch_report);
+		pd->patch_report = text;
+		pd->patch_report_len = text_len;
+
+		trunc_file_buffer(fb, 0);
+		write_file_buffer(fb, text, text_len, 0);
+		fb->is_changed = 0;
+	}
+
+	if (res_apply > 0) {
+		ft = find_node_file_time("/", pd->ft);
+		if (ft) {
+			ft->mtime = now;
+			ft->ctime = now;
+		}
+	}
+
+	return res_apply;
+}
+
+int read_file_buffer(struct file_buffer *fb, char *buffer, size_t size,
+					 off_t offset)
+{
+	size_t final_size = 0;
+
+	CHECK_POINTER(fb, -EFAULT);
+	CHECK_POINTER(buffer, -EFAULT);
+	if (offset < 0) { return -EINVAL; }
+
+	if (offset < fb->len) {
+		final_size = fb->len - offset;
+		if (final_size > size) {
+			final_size = size;
+		}
+		memcpy(buffer, fb->data + offset, final_size);
+	}
+
+	return (int) final_size;
+}
+
+/**
+ * @brief Gives the buffer of a virtual file the needed capacity.
+ * 
+ * @param fb Buffer of the file.
+ * @param len Length of the content that must fit.
+ * 
+ * @return 0 on success, -ENOMEM on failure.
+ */
+static int reserve_file_buffer(struct file_buffer *fb, size_t len)
+{
+	char *res_realloc = NULL;
+	size_t new_cap;
+
+	if (len + 1 <= fb->cap) { return 0; }
+
+	new_cap = fb->cap ? fb->cap : BIG_SIZE;
+	while (new_cap < len + 1) { new_cap *= 2; }
+
+	res_realloc = realloc(fb->data, new_cap);
+	CHECK_POINTER(res_realloc, -ENOMEM);
+
+	fb->data = res_realloc;
+	fb->cap = new_cap;
+	return 0;
+}
+
+int write_file_buffer(struct file_buffer *fb, const char *buffer, size_t size,
+					  off_t offset)
+{
+	CHECK_POINTER(fb, -EFAULT);
+	CHECK_POINTER(buffer, -EFAULT);
+	if (offset < 0) { return -EINVAL; }
+
+	if (reserve_file_buffer(fb, offset + size)) { return -ENOMEM; }
+
+	if (offset > fb->len) {
+		memset(fb->data + fb->len, 0, offset - fb->len);
+	}
+	memcpy(fb->data + offset, buffer, size);
+	if (offset + size > fb->len) {
+		fb->len = offset + size;
+		fb->data[fb->len] = '\0';
+	}
+
+	fb->is_changed = 1;
+	return (int) size;
+}
+
+int trunc_file_buffer(struct file_buffer *fb, off_t offset)
+{
+	CHECK_POINTER(fb, -EFAULT);
+	if (offset < 0) { return -EINVAL; }
+
+	if (reserve_file_buffer(fb, offset)) { return -ENOMEM; }
+
+	if (offset > fb->len) {
+		memset(fb->data + fb->len, 0, offset - fb->len);
+	}
+	fb->len = offset;
+	fb->data[fb->len] = '\0';
+
+	fb->is_changed = 1;
+	return 0;
+}
+
+void release_file_buffer(struct file_buffer *fb)
+{
+	if (!fb) { return; }
+
+	free(fb->data);
+	free(fb);
+}
+
+int open_json_dir(const char *path, struct dir_cursor **cursor,
+				  struct jsonfs_private_data *pd)
+{
+	json_t *node = NULL;
+	struct dir_cursor *new_cursor = NULL;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(cursor, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	node = find_json_node(path, pd->root);
+	CHECK_POINTER(node, -ENOENT);
+
+	if (!json_is_object(node)) { return -ENOTDIR; }
+
+	new_cursor = calloc(1, sizeof(struct dir_cursor));
+	CHECK_POINTER(new_cursor, -ENOMEM);
+
+	/* A full check would walk the whole directory on every opendir */
+	new_cursor->is_array = is_array_like(node);
+
+	*cursor = new_cursor;
+	return 0;
+}
+
+/**
+ * @brief Adds a child of the directory to the readdir buffer.
+ * 
+ * @param path The absolute path to the directory.
+ * @param key Key of the child.
+ * @param value The child itself.
+ * @param buffer The buffer passed to the readdir() operation.
+ * @param filler Function to add an entry to the buffer.
+ * @param next Offset of the next entry.
+ * @param plus 1 if attributes should be filled in along with the name.
+ * @param pd Private filesystem data from FUSE context.
+ * 
+ * @return Result of the filler, 1 if the buffer is full.
+ */
+static int fill_child(const char *path, const char *key, json_t *value,
+					  void *buffer, fuse_fill_dir_t filler, off_t next,
+					  int plus, struct jsonfs_private_data *pd)
+{
+	struct stat st;
+	char child_path[PATH_MAX];
+	int count_byte;
+
+	if (!plus) { return filler(buffer, key, NULL, next, 0); }
+
+	count_byte = snprintf(child_path, sizeof(child_path), "%s/%s",
+						  strcmp("/", path) == 0 ? "" : path, key);
+
+	memset(&st, 0, sizeof(st));
+	if (count_byte >= sizeof(child_path) || 
+		fill_json_stat(child_path, value, &st, pd)) {
+		return filler(buffer, key, NULL, next, 0);
+	}
+
+	return filler(buffer, key, &st, next, FUSE_FILL_DIR_PLUS);
+}
+
+/**
+ * @brief Checks if a key is of an element listed by index before
+ * the directory stopped being listed as an array.
+ * 
+ * @param cursor Cursor of the directory, can be NULL.
+ */
+static int is_indexed_key(const char *key, const struct dir_cursor *cursor)
+{
+	size_t prefix_len = strlen(SPECIAL_PREFIX);
+	unsigned long long index;
+	char *end = NULL;
+
+	if (!cursor || !cursor->count_indexed) { return 0; }
+	if (strncmp(key, SPECIAL_PREFIX, prefix_len) != 0) { return 0; }
+
+	/* Only the canonical form, "@01" is not the element 1 */
+	key += prefix_len;
+	if (key[0] < '0' || key[0] > '9' || (key[0] == '0' && key[1])) { return 0; }
+
+	errno = 0;
+	index = strtoull(key, &end, 10);
+	return !errno && *end == '\0' && index < cursor->count_indexed;
+}
+
+int read_json_dir(const char *path, void *buffer, fuse_fill_dir_t filler,
+				  off_t offset, int plus, struct dir_cursor *cursor,
+				  struct jsonfs_private_data *pd)
+{
+	json_t *node = NULL;
+	json_t *value = NULL;
+	void *iter = NULL;
+	const char *key = NULL;
+	const char *special = NULL;
+	char elem_key[SHRT_SIZE];
+	struct stat st;
+	off_t count_special = 0;
+	off_t index;
+	off_t skip;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(filler, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+	if (offset < 0) { return -EINVAL; }
+
+	node = find_json_node(path, pd->root);
+	CHECK_POINTER(node, -ENOENT);
+
+	if (!json_is_object(node)) { return -ENOTDIR; }
+
+	if (strcmp("/", path) == 0) {
+		count_special = count_special_files();
+	}
+
+	/* ".", ".." and the special files */
+	for (index = offset; index < 2 + count_special; index++) {
+		if (index == 0) {
+			memset(&st, 0, sizeof(st));
+			if (!plus || fill_json_stat(path, node, &st, pd)) {
+				if (filler(buffer, ".", NULL, index + 1, 0)) { return 0; }
+			}
+			else if (filler(buffer, ".", &st, index + 1, FUSE_FILL_DIR_PLUS)) {
+				return 0;
+			}
+			continue;
+		}
+
+		if (index == 1) {
+			if (filler(buffer, "..", NULL, index + 1, 0)) { return 0; }
+			continue;
+		}
+
+		special = get_special_file(index - 2);
+		memset(&st, 0, sizeof(st));
+		if (!plus || getattr_special_file(special, &st, pd)) {
+			if (filler(buffer, special + 1, NULL, index + 1, 0)) { return 0; }
+		}
+		else if (filler(buffer, special + 1, &st, index + 1, FUSE_FILL_DIR_PLUS)) {
+			return 0;
+		}
+	}
+
+	skip = index - 2 - count_special;
+
+	/* Elements of a converted array are found by index, 
+	 * the size is taken anew so that added elements are listed */
+	if (cursor && cursor->is_array) {
+		for (; skip < json_object_size(node); skip++, index++) {
+			snprintf(elem_key, sizeof(elem_key), "%s%lld", 
+					 SPECIAL_PREFIX, (long long) skip);
+			value = json_object_get(node, elem_key);
+			if (!value) { break; }
+
+			if (fill_child(path, elem_key, value, buffer, filler,
+						   index + 1, plus, pd)) {
+				cursor->offset = index;
+				return 0;
+			}
+		}
+		cursor->offset = index;
+		if (value || skip == json_object_size(node)) { return 0; }
+
+		cursor->is_array = 0;
+		cursor->count_indexed = skip;
+	}
+
+	if (cursor) { skip -= cursor->count_indexed; }
+
+	/* Keys of an object are continued from the saved one */
+	if (cursor && cursor->next_key && cursor->offset == offset) {
+		iter = json_object_iter_at(node, cursor->next_key);
+	}
+
+	if (!iter) {
+		iter = json_object_iter(node);
+		for (; iter && skip > 0; iter = json_object_iter_next(node, iter)) {
+			if (!is_indexed_key(json_object_iter_key(iter), cursor)) { skip--; }
+		}
+	}
+
+	for (; iter; iter = json_object_iter_next(node, iter)) {
+		key = json_object_iter_key(iter);
+		value = json_object_iter_value(iter);
+		if (is_indexed_key(key, cursor)) { continue; }
+
+		if (fill_child(path, key, value, buffer, filler, index + 1, plus, pd)) {
+			break;
+		}
+		index++;
+	}
+
+	if (cursor) {
+		free(cursor->next_key);
+		cursor->next_key = NULL;
+		cursor->offset = index;
+		if (iter) {
+			cursor->next_key = strdup(json_object_iter_key(iter));
+		}
+	}
+
+	return 0;
+}
+
+void release_json_dir(struct dir_cursor *cursor)
+{
+	if (!cursor) { return; }
+
+	free(cursor->next_key);
+	free(cursor);
+}
+
+/**
+ * @brief Gives the size of a node in compact JSON.
+ * 
+ * The size is kept with the version of the path, so it is measured
+ * again only after the node or its descendants are changed.
+ * 
+ * @see measure_json_node
+ */
+static size_t get_json_size(const char *path, json_t *node,
+							struct jsonfs_private_data *pd)
+{
+	struct file_time *ft = NULL;
+	unsigned long long version;
+	size_t size;
+
+	version = get_version_ft(path, pd->ft);
+	ft = find_node_file_time(path, pd->ft);
+	if (ft && ft->size_version == version) { return ft->json_size; }
+
+	size = measure_json_node(node);
+
+	if (!ft) { ft = add_node_to_list_ft(path, pd->ft, 0); }
+	if (ft) {
+		ft->json_size = size;
+		ft->size_version = version;
+	}
+
+	return size;
+}
+
+/**
+ * @brief Finds the node of a file for its extended attributes.
+ * 
+ * @return The node, the top-level primitive for the root, NULL on failure.
+ */
+static json_t *find_xattr_node(const char *path, json_t *root)
+{
+	json_t *node = NULL;
+	json_t *scalar = NULL;
+
+	if (is_special_file(path) || find_subtree_dir(path, root)) { return NULL; }
+
+	node = find_json_node(path, root);
+	CHECK_POINTER(node, NULL);
+
+	scalar = json_object_get(node, SCALAR_NAME);
+	if (node == root && scalar && json_object_size(root) == 1) { return scalar; }
+
+	return node;
+}
+
+int getxattr_json_file(const char *path, const char *name, char *value,
+					   size_t size, struct jsonfs_private_data *pd)
+{
+	char text[SHRT_SIZE];
+	const char *str = text;
+	json_t *node = NULL;
+	size_t len;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(name, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	node = find_xattr_node(path, pd->root);
+	if (!node) {
+		return is_special_file(path) || find_subtree_dir(path, pd->root) ? 
+			   -ENODATA : -ENOENT;
+	}
+
+	if (strcmp(name, XATTR_TYPE) == 0) {
+		str = get_json_type_name(node);
+	}
+	else if (strcmp(name, XATTR_SIZE) == 0) {
+		snprintf(text, sizeof(text), "%zu", get_json_size(path, node, pd));
+	}
+	else if (strcmp(name, XATTR_CHILDREN) == 0 && json_is_object(node)) {
+		snprintf(text, sizeof(text), "%zu", json_object_size(node));
+	}
+	else if (strcmp(name, XATTR_VERSION) == 0) {
+		snprintf(text, sizeof(text), "%llu", get_version_ft(path, pd->ft));
+	}
+	else {
+		return -ENODATA;
+	}
+
+	len = strlen(str);
+	if (size == 0) { return (int) len; }
+	if (size < len) { return -ERANGE; }
+
+	memcpy(value, str, len);
+	return (int) len;
+}
+
+int listxattr_json_file(const char *path, char *list, size_t size,
+						struct jsonfs_private_data *pd)
+{
+	const char *names[] = { XATTR_TYPE, XATTR_SIZE, XATTR_CHILDREN, 
+							XATTR_VERSION, NULL };
+	json_t *node = NULL;
+	size_t len = 0;
+	size_t name_len;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	node = find_xattr_node(path, pd->root);
+	if (!node) {
+		return is_special_file(path) || find_subtree_dir(path, pd->root) ? 
+			   0 : -ENOENT;
+	}
+
+	for (int i = 0; names[i]; i++) {
+		if (strcmp(names[i], XATTR_CHILDREN) == 0 && !json_is_object(node)) { 
+			continue; 
+		}
+
+		/* Every name ends with '\0' */
+		name_len = strlen(names[i]) + 1;
+		if (size) {
+			if (len + name_len > size) { return -ERANGE; }
+			memcpy(list + len, names[i], name_len);
+		}
+		len += name_len;
+	}
+
+	return (int) len;
+}
+
+int warm_json_file(const char *path, struct jsonfs_private_data *pd)
+{
+	json_t *node = NULL;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+
+	if (is_special_file(path) || find_subtree_dir(path, pd->root)) { 
+		return -EINVAL; 
+	}
+
+	node = find_json_node(path, pd->root);
+	CHECK_POINTER(node, -ENOENT);
+
+	get_json_size(path, node, pd);
+	return 0;
+}
+
+/**
+ * @brief Adds a change to the result of a merge.
+ * 
+ * @return 0 on success, -ENOMEM on failure.
+ */
+static int add_merge_change(struct merge_result *result, const char *path,
+							json_t *value)
+{
+	struct merge_change *res_realloc = NULL;
+	size_t new_cap;
+
+	if (result->count == result->cap) {
+		new_cap = result->cap ? result->cap * 2 : SHRT_SIZE;
+		res_realloc = realloc(result->changes, 
+							  new_cap * sizeof(struct merge_change));
+		CHECK_POINTER(res_realloc, -ENOMEM);
+		result->changes = res_realloc;
+		result->cap = new_cap;
+	}
+
+	result->changes[result->count].path = strdup(path);
+	CHECK_POINTER(result->changes[result->count].path, -ENOMEM);
+	result->changes[result->count].value = value;
+	result->changes[result->count].state = MERGE_APPLIED;
+	result->count++;
+
+	return 0;
+}
+
+/**
+ * @brief Finds the children of two directories that differ.
+ * 
+ * A child present in both directories as a directory is compared
+ * recursively, so a change is found at the deepest differing node.
+ * Equal children of the new directory are replaced by the old ones,
+ * so the documents share them.
+ * 
+ * @param path Buffer of PATH_MAX bytes with the path of the directories.
+ * @param path_len Length of the path, 0 for the root.
+ * @param old_dir Directory of the file before the change.
+ * @param new_dir Directory of the newer document.
+ * @param result Result to add the changes to.
+ * 
+ * @return 0 on success, negative error code on failure.
+ */
+static int diff_json_dirs(char *path, size_t path_len, json_t *old_dir,
+						  json_t *new_dir, struct merge_result *result)
+{
+	const char *key = NULL;
+	json_t *old_value = NULL;
+	json_t *new_value = NULL;
+	size_t key_len;
+	size_t count;
+	int res_diff = 0;
+
+	json_object_foreach(old_dir, key, old_value) {
+		key_len = strlen(key);
+		if (path_len + 1 + key_len >= PATH_MAX) { return -ENAMETOOLONG; }
+
+		path[path_len] = '/';
+		memcpy(path + path_len + 1, key, key_len + 1);
+
+		new_value = json_object_get(new_dir, key);
+		if (old_value == new_value) { continue; }
+
+		count = result->count;
+		if (!new_value) {
+			res_diff = add_merge_change(result, path, NULL);
+		}
+		else if (json_is_object(old_value) && json_is_object(new_value)) {
+			res_diff = diff_json_dirs(path, path_len + 1 + key_len, 
+									  old_value, new_value, result);
+		}
+		else if (json_is_object(old_value) || json_is_object(new_value) ||
+				 !json_equal(old_value, new_value)) 
+		{
+			res_diff = add_merge_change(result, path, new_value);
+		}
+		if (res_diff < 0) { return res_diff; }
+
+		/* Only the keys of the new directory are changed, not their order */
+		if (new_value && result->count == count &&
+			json_object_set(new_dir, key, old_value)) 
+		{
+			return -ENOMEM;
+		}
+	}
+
+	json_object_foreach(new_dir, key, new_value) {
+		if (json_object_get(old_dir, key)) { continue; }
+
+		key_len = strlen(key);
+		if (path_len + 1 + key_len >= PATH_MAX) { return -ENAMETOOLONG; }
+
+		path[path_len] = '/';
+		memcpy(path + path_len + 1, key, key_len + 1);
+
+		res_diff = add_merge_change(result, path, new_value);
+		if (res_diff < 0) { return res_diff; }
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Checks if two nodes are equal, a missing node is NULL.
+ */
+static int is_same_node(json_t *node, json_t *other)
+{
+	if (node == other) { return 1; }
+	if (!node || !other) { return 0; }
+
+	return json_equal(node, other);
+}
+
+/**
+ * @brief Applies a change found by diff_json_dirs() to the tree.
+ * 
+ * @return 0 on success, 1 if the node was changed locally and kept, 
+ * 		   2 if the node already has the new value, 
+ * 		   negative error code on failure.
+ */
+static int apply_merge_change(struct merge_change *change,
+							  struct jsonfs_private_data *pd)
+{
+	json_t *node = NULL;
+	json_t *parent = NULL;
+	char *parent_path = NULL;
+	char *name = NULL;
+	const char *changed_path = NULL;
+	struct file_time *ft = NULL;
+	time_t now = time(NULL);
+	int ret = 0;
+
+	node = find_json_node(change->path, pd->root);
+	if (is_same_node(node, change->value)) { return 2; }
+	if (!is_same_node(node, find_json_node(change->path, pd->file_root))) { 
+		return 1; 
+	}
+
+	if (separate_filepath(change->path, &parent_path, &name) < 0) { 
+		return -ENOMEM; 
+	}
+
+	/* The directory was removed or replaced by a file locally */
+	parent = unshare_json_node(parent_path, pd->root);
+	if (!json_is_object(parent)) {
+		ret = 1;
+		goto handle_error;
+	}
+
+	if (change->value) {
+		if (json_object_set(parent, name, change->value)) {
+			ret = -ENOMEM;
+			goto handle_error;
+		}
+		mark_changed(change->path, 1, pd);
+		changed_path = change->path;
+	}
+	else {
+		json_object_del(parent, name);
+		remove_subtree_to_list_ft(change->path, pd->ft);
+		mark_changed(parent_path, 0, pd);
+		changed_path = parent_path;
+	}
+
+	ft = find_node_file_time(changed_path, pd->ft);
+	if (ft) {
+		ft->mtime = now;
+		ft->ctime = now;
+	}
+	else {
+		add_node_to_list_ft(changed_path, pd->ft, SET_MTIME | SET_CTIME);
+	}
+
+	handle_error:
+		free(parent_path);
+		free(name);
+		return ret;
+}
+
+int merge_json_document(json_t *new_root, struct merge_result *result,
+						struct jsonfs_private_data *pd)
+{
+	char path[PATH_MAX];
+	int res_apply;
+	int count_applied = 0;
+
+	CHECK_POINTER(new_root, -EFAULT);
+	CHECK_POINTER(result, -EFAULT);
+	CHECK_POINTER(pd, -EFAULT);
+	CHECK_POINTER(pd->file_root, -EINVAL);
+
+	memset(result, 0, sizeof(*result));
+	if (!json_is_object(new_root)) { return -EINVAL; }
+
+	/* The changes of the file are found before the tree is touched */
+	path[0] = '\0';
+	res_apply = diff_json_dirs(path, 0, pd->file_root, new_root, result);
+	if (res_apply < 0) { goto handle_error; }
+
+	for (size_t i = 0; i < result->count; i++) {
+		res_apply = apply_merge_change(&result->changes[i], pd);
+		if (res_apply < 0) { goto handle_error; }
+
+		if (res_apply == 1) {
+			result->changes[i].state = MERGE_CONFLICT;
+			result->count_conflicts++;
+		}
+		else if (res_apply == 2) {
+			result->changes[i].state = MERGE_SAME;
+		}
+		else {
+			count_applied++;
+		}
+	}
+
+	json_decref(pd->file_root);
+	pd->file_root = json_incref(new_root);
+
+	return count_applied;
+
+	handle_error:
+		free_merge_result(result);
+		return res_apply;
+}
+
+void free_merge_result(struct merge_result *result)
+{
+	if (!result) { return; }
+
+	for (size_t i = 0; i < result->count; i++) {
+		free(result->changes[i].path);
+	}
+	free(result->changes);
+	memset(result, 0, sizeof(*result));
+}
@@ -0,0 +1,619 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file 
+ * @brief Contains definition of the access counters of the paths.
+ * 
+ * Function declarations and specifications can be found in hot.h.
+ */
+
+#include <jansson.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "hot.h"
+#include "json_operations.h"
+#include "stats.h"
+
+/**
+ * @def SKETCH_DEPTH
+ * @brief Number of the rows of the sketch, each with its own hash.
+ */
+#define SKETCH_DEPTH	4
+
+/**
+ * @def SKETCH_WIDTH
+ * @brief Number of the counters in a row of the sketch.
+ */
+#define SKETCH_WIDTH	2048
+
+/**
+ * @def TOP_PATHS
+ * @brief Number of the hottest paths kept.
+ */
+#define TOP_PATHS		32
+
+/**
+ * @def TOP_SUBTREES
+ * @brief Number of the hottest top-level subtrees kept.
+ */
+#define TOP_SUBTREES	16
+
+/**
+ * @def SUBTREE_SALT
+ * @brief Mixed into the hash of a subtree, so it is counted apart 
+ * from the file of the same path.
+ */
+#define SUBTREE_SALT	0x9E3779B97F4A7C15ULL
+
+/**
+ * @struct hot_entry
+ * @brief Path in a table of the hottest ones.
+ */
+struct hot_entry {
+	char *path;
+	uint64_t hash;
+	uint64_t counts[HOT_COUNT_KINDS];	/**< Estimates, see refresh_table() */
+	uint64_t previous;					/**< Halved total of the last mount */
+	uint64_t key;						/**< Sum of the counts and previous */
+};
+
+/**
+ * @struct hot_table
+ * @brief The hottest paths, in no order.
+ * 
+ * The entries are changed under hot_lock. The hashes and min_key are
+ * also read without it, so a path already in the table or too cold 
+ * to get in is counted without the lock.
+ */
+struct hot_table {
+	struct hot_entry *entries;
+	uint64_t *hashes;		/**< Hashes of the entries, read atomically */
+	size_t count;			/**< Read atomically */
+	size_t cap;
+	uint64_t min_key;		/**< Key of the coldest entry of a full table */
+};
+
+static uint32_t sketch[HOT_COUNT_KINDS][SKETCH_DEPTH][SKETCH_WIDTH];
+static struct hot_entry path_entries[TOP_PATHS];
+static struct hot_entry subtree_entries[TOP_SUBTREES];
+static uint64_t path_hashes[TOP_PATHS];
+static uint64_t subtree_hashes[TOP_SUBTREES];
+static struct hot_table paths = { path_entries, path_hashes, 0, TOP_PATHS, 0 };
+static struct hot_table subtrees = { subtree_entries, subtree_hashes, 0, 
+									 TOP_SUBTREES, 0 };
+static pthread_mutex_t hot_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t hot_start = 0;
+static unsigned long sample_every = HOT_SAMPLE;
+static __thread unsigned long local_requests = 0;
+
+/* ================================= */
+/*              Counting             */
+/* ================================= */
+
+/**
+ * @brief Hashes the first len bytes of a path with FNV-1a.
+ * 
+ * The hash of a subtree is the hash of its path with the salt mixed in, 
+ * so count_hot_access() gets both hashes in one pass.
+ */
+static uint64_t hash_path(const char *path, size_t len, uint64_t salt)
+{
+	return hash_fnv1a(FNV1A_BASIS, path, len) ^ salt;
+}
+
+/**
+ * @brief Gives the counter of a row, the rows use combinations of 
+ * the two halves of the hash.
+ */
+static size_t get_column(uint64_t hash, int row)
+{
+	uint32_t low = (uint32_t) hash;
+	uint32_t high = (uint32_t) (hash >> 32) | 1;
+
+	return (size_t) ((low + (uint32_t) row * high) % SKETCH_WIDTH);
+}
+
+/**
+ * @brief Gives the estimates of all kinds of a hash.
+ * @return Sum of the estimates.
+ */
+static uint64_t get_estimates(uint64_t hash, uint64_t *counts)
+{
+	size_t columns[SKETCH_DEPTH];
+	uint64_t value, min, total = 0;
+
+	for (int row = 0; row < SKETCH_DEPTH; row++) {
+		columns[row] = get_column(hash, row);
+	}
+
+	/* Collisions only add to a counter, so the smallest one is the closest */
+	for (int k = 0; k < HOT_COUNT_KINDS; k++) {
+		min = UINT32_MAX;
+		for (int row = 0; row < SKETCH_DEPTH; row++) {
+			value = __atomic_load_n(&sketch[k][row][columns[row]], 
+									__ATOMIC_RELAXED);
+			if (value < min) { min = value; }
+		}
+		counts[k] = min;
+		total += min;
+	}
+
+	return total;
+}
+
+/**
+ * @brief Counts accesses in the sketch.
+ * 
+ * @param weight Number of the accesses, one sampled access stands 
+ * 		  for sample_every of them.
+ */
+static void add_to_sketch(uint64_t hash, enum hot_kind kind, uint32_t weight)
+{
+	uint32_t *counter = NULL;
+
+	for (int row = 0; row < SKETCH_DEPTH; row++) {
+		counter = &sketch[kind][row][get_column(hash, row)];
+		if (__atomic_load_n(counter, __ATOMIC_RELAXED) <= UINT32_MAX - weight) {
+			__atomic_fetch_add(counter, weight, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/**
+ * @brief Tells whether a hash is in a table, may be called without the lock.
+ */
+static int has_hash(const struct hot_table *table, uint64_t hash)
+{
+	size_t count = __atomic_load_n(&table->count, __ATOMIC_ACQUIRE);
+
+	for (size_t i = 0; i < count; i++) {
+		if (__atomic_load_n(&table->hashes[i], __ATOMIC_RELAXED) == hash) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Finds a path in a table, the lock must be held.
+ * @return Index of the path, -1 if it is not in the table.
+ */
+static long find_entry(const struct hot_table *table, const char *path, 
+					   size_t len, uint64_t hash)
+{
+	const struct hot_entry *entry = NULL;
+
+	for (size_t i = 0; i < table->count; i++) {
+		entry = &table->entries[i];
+		if (entry->hash == hash && strncmp(entry->path, path, len) == 0 
+			&& entry->path[len] == '\0') {
+			return (long) i;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * @brief Updates the counts and keys of the entries from the sketch,
+ * the lock must be held.
+ * 
+ * @return Index of the coldest entry, -1 if the table is empty.
+ */
+static long refresh_table(struct hot_table *table)
+{
+	struct hot_entry *entry = NULL;
+	long coldest = -1;
+
+	for (size_t i = 0; i < table->count; i++) {
+		entry = &table->entries[i];
+		entry->key = get_estimates(entry->hash, entry->counts) + entry->previous;
+		if (coldest < 0 || entry->key < table->entries[coldest].key) {
+			coldest = (long) i;
+		}
+	}
+
+	return coldest;
+}
+
+/**
+ * @brief Puts a path in a table if there is room or it is hotter 
+ * than the coldest entry, the lock must be held.
+ * 
+ * @param copy[in,out] Copy of the path, set to NULL if it is taken.
+ */
+static void add_entry(struct hot_table *table, char **copy, size_t len, 
+					  uint64_t hash, uint64_t total)
+{
+	struct hot_entry *entry = NULL;
+	long index;
+
+	if (find_entry(table, *copy, len, hash) >= 0) { return; }
+
+	index = refresh_table(table);
+	if (table->count < table->cap) {
+		index = (long) table->count;
+	}
+	else if (total <= table->entries[index].key) {
+		__atomic_store_n(&table->min_key, table->entries[index].key, 
+						 __ATOMIC_RELAXED);
+		return;
+	}
+	else {
+		free(table->entries[index].path);
+	}
+
+	entry = &table->entries[index];
+	entry->path = *copy;
+	entry->hash = hash;
+	entry->previous = 0;
+	entry->key = get_estimates(hash, entry->counts);
+	*copy = NULL;
+
+	__atomic_store_n(&table->hashes[index], hash, __ATOMIC_RELAXED);
+	if ((size_t) index == table->count) {
+		__atomic_store_n(&table->count, table->count + 1, __ATOMIC_RELEASE);
+	}
+
+	if (table->count == table->cap) {
+		index = refresh_table(table);
+		__atomic_store_n(&table->min_key, table->entries[index].key, 
+						 __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * @brief Counts an access and takes the lock only if the path 
+ * may get into the table.
+ */
+static void count_entry(struct hot_table *table, const char *path, size_t len,
+						uint64_t hash, enum hot_kind kind, uint32_t weight)
+{
+	uint64_t counts[HOT_COUNT_KINDS];
+	uint64_t total;
+	char *copy = NULL;
+
+	add_to_sketch(hash, kind, weight);
+	if (has_hash(table, hash)) { return; }
+
+	total = get_estimates(hash, counts);
+	if (__atomic_load_n(&table->count, __ATOMIC_RELAXED) == table->cap
+		&& total <= __atomic_load_n(&table->min_key, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	copy = strndup(path, len);
+	if (!copy) { return; }
+
+	pthread_mutex_lock(&hot_lock);
+	add_entry(table, &copy, len, hash, total);
+	pthread_mutex_unlock(&hot_lock);
+
+	free(copy);
+}
+
+void set_hot_sampling(unsigned long every)
+{
+	sample_every = every;
+}
+
+void count_hot_access(const char *path, enum hot_kind kind)
+{
+	const char *end = NULL;
+	uint64_t hash, start = 0;
+	uint32_t weight;
+	size_t len, len_subtree;
+
+	if (!sample_every || !path || path[0] != '/' || kind >= HOT_COUNT_KINDS) { 
+		return; 
+	}
+
+	/* Each thread counts one of every sample_every of its requests */
+	if (++local_requests < sample_every) { return; }
+	local_requests = 0;
+	weight = sample_every < UINT32_MAX ? (uint32_t) sample_every : UINT32_MAX;
+
+	if (!__atomic_load_n(&hot_start, __ATOMIC_RELAXED)) {
+		__atomic_compare_exchange_n(&hot_start, &start, get_stats_time(), 0,
+									__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	}
+
+	/* The subtree is the first component of the path */
+	end = path[1] ? strchr(path + 1, '/') : NULL;
+	len_subtree = end ? (size_t) (end - path) : strlen(path);
+	len = end ? len_subtree + strlen(end) : len_subtree;
+
+	hash = hash_fnv1a(FNV1A_BASIS, path, len_subtree);
+	if (path[1]) {
+		count_entry(&subtrees, path, len_subtree, hash ^ SUBTREE_SALT, kind,
+					weight);
+	}
+
+	hash = hash_fnv1a(hash, path + len_subtree, len - len_subtree);
+	count_entry(&paths, path, len, hash, kind, weight);
+}
+
+static void release_table(struct hot_table *table)
+{
+	for (size_t i = 0; i < table->count; i++) {
+		free(table->entries[i].path);
+	}
+	memset(table->entries, 0, table->cap * sizeof(struct hot_entry));
+	memset(table->hashes, 0, table->cap * sizeof(uint64_t));
+	table->count = 0;
+	table->min_key = 0;
+}
+
+void release_hot(void)
+{
+	pthread_mutex_lock(&hot_lock);
+	release_table(&paths);
+	release_table(&subtrees);
+	memset(sketch, 0, sizeof(sketch));
+	hot_start = 0;
+	pthread_mutex_unlock(&hot_lock);
+}
+
+/* ================================= */
+/*             Rendering             */
+/* ================================= */
+
+static int compare_entries(const void *a, const void *b)
+{
+	uint64_t x = ((const struct hot_entry *) a)->key;
+	uint64_t y = ((const struct hot_entry *) b)->key;
+
+	return (x < y) - (x > y);
+}
+
+/**
+ * @brief Copies the entries of a table with their current counts, 
+ * the hottest first.
+ * @note The paths are not copied, the lock must be held while they are used.
+ */
+static struct hot_entry *sort_table(struct hot_table *table)
+{
+	struct hot_entry *sorted = NULL;
+
+	sorted = malloc((table->count + 1) * sizeof(struct hot_entry));
+	CHECK_POINTER(sorted, NULL);
+
+	refresh_table(table);
+	memcpy(sorted, table->entries, table->count * sizeof(struct hot_entry));
+	qsort(sorted, table->count, sizeof(struct hot_entry), compare_entries);
+
+	return sorted;
+}
+
+/**
+ * @brief Writes the entries of a table as a JSON array.
+ * @return 0 on success, -1 on failure.
+ */
+static int print_table(FILE *out, const char *name, 
+					   struct hot_table *table, double seconds)
+{
+	struct hot_entry *sorted = NULL;
+	struct hot_entry *entry = NULL;
+	uint64_t current;
+
+	sorted = sort_table(table);
+	CHECK_POINTER(sorted, -1);
+
+	fprintf(out, "\"%s\":[", name);
+	for (size_t i = 0; i < table->count; i++) {
+		entry = &sorted[i];
+		current = entry->key - entry->previous;
+
+		fprintf(out, "%s\n{\"path\":", i ? "," : "");
+		print_json_string(out, entry->path);
+		fprintf(out, ",\"lookups\":%llu,\"reads\":%llu,\"writes\":%llu,"
+				"\"previous\":%llu,\"total\":%llu,\"rate\":%.3f}",
+				(unsigned long long) entry->counts[HOT_LOOKUPS],
+				(unsigned long long) entry->counts[HOT_READS],
+				(unsigned long long) entry->counts[HOT_WRITES],
+				(unsigned long long) entry->previous,
+				(unsigned long long) entry->key,
+				seconds > 0 ? current / seconds : 0.0);
+	}
+	fputs("\n]", out);
+
+	free(sorted);
+	return 0;
+}
+
+char *format_hot_json(size_t *len)
+{
+	char *text = NULL;
+	size_t text_len = 0;
+	FILE *out = NULL;
+	uint64_t start;
+	double seconds;
+	int res_print;
+
+	out = open_memstream(&text, &text_len);
+	CHECK_POINTER(out, NULL);
+
+	pthread_mutex_lock(&hot_lock);
+	start = __atomic_load_n(&hot_start, __ATOMIC_RELAXED);
+	seconds = start ? (get_stats_time() - start) / 1e9 : 0.0;
+	fprintf(out, "{\"seconds\":%.3f,\n", seconds);
+	res_print = print_table(out, "paths", &paths, seconds);
+	fputs(",\n", out);
+	if (!res_print) { res_print = print_table(out, "subtrees", &subtrees, 
+											 seconds); }
+	pthread_mutex_unlock(&hot_lock);
+
+	fputs("}\n", out);
+
+	if (fclose(out) != 0 || !text || res_print < 0) {
+		free(text);
+		return NULL;
+	}
+
+	if (len) { *len = text_len; }
+	return text;
+}
+
+char **get_hot_paths(size_t *count)
+{
+	struct hot_entry *sorted = NULL;
+	char **hot_paths = NULL;
+	size_t filled = 0;
+
+	CHECK_POINTER(count, NULL);
+	*count = 0;
+
+	pthread_mutex_lock(&hot_lock);
+	if (!paths.count) { goto handle_error; }
+
+	sorted = sort_table(&paths);
+	hot_paths = calloc(paths.count, sizeof(char *));
+	if (!sorted || !hot_paths) { goto handle_error; }
+
+	for (filled = 0; filled < paths.count; filled++) {
+		hot_paths[filled] = strdup(sorted[filled].path);
+		if (!hot_paths[filled]) { goto handle_error; }
+	}
+	pthread_mutex_unlock(&hot_lock);
+
+	free(sorted);
+	*count = filled;
+	return hot_paths;
+
+	handle_error:
+		pthread_mutex_unlock(&hot_lock);
+		for (size_t i = 0; i < filled; i++) { free(hot_paths[i]); }
+		free(hot_paths);
+		free(sorted);
+		return NULL;
+}
+
+/* ================================= */
+/*            Persistence            */
+/* ================================= */
+
+/**
+ * @brief Gives the name of the file of the counters of a document.
+ * @return 0 on success, -1 if the name is too long.
+ */
+static int get_hot_file(const char *json_file, char *file, size_t size)
+{
+	int count_byte = snprintf(file, size, "%s%s", json_file, HOT_SUFFIX);
+
+	return count_byte < 0 || (size_t) count_byte >= size ? -1 : 0;
+}
+
+int save_hot_paths(const char *json_file)
+{
+	char file[BIG_SIZE];
+	char *text = NULL;
+	size_t text_len;
+	FILE *out = NULL;
+	int ret = 0;
+
+	CHECK_POINTER(json_file, -1);
+	if (get_hot_file(json_file, file, sizeof(file)) < 0) { return -1; }
+
+	text = format_hot_json(&text_len);
+	CHECK_POINTER(text, -1);
+
+	out = fopen(file, "w");
+	if (!out) {
+		free(text);
+		return -1;
+	}
+
+	if (fwrite(text, 1, text_len, out) != text_len) { ret = -1; }
+	if (fclose(out) != 0) { ret = -1; }
+
+	free(text);
+	return ret;
+}
+
+/**
+ * @brief Adds the saved entries to a table with their halved totals.
+ */
+static void seed_table(struct hot_table *table, json_t *array, uint64_t salt)
+{
+	struct hot_entry *entry = NULL;
+	const char *path = NULL;
+	json_t *item = NULL;
+	json_int_t total;
+	uint64_t hash;
+	size_t index;
+	size_t len;
+	long coldest;
+
+	json_array_foreach(array, index, item) {
+		if (table->count == table->cap) { break; }
+
+		path = json_string_value(json_object_get(item, "path"));
+		total = json_integer_value(json_object_get(item, "total"));
+		if (!path || path[0] != '/' || total / 2 <= 0) { continue; }
+
+		len = strlen(path);
+		hash = hash_path(path, len, salt);
+		if (find_entry(table, path, len, hash) >= 0) { continue; }
+
+		entry = &table->entries[table->count];
+		entry->path = strdup(path);
+		if (!entry->path) { break; }
+
+		entry->hash = hash;
+		memset(entry->counts, 0, sizeof(entry->counts));
+		entry->previous = (uint64_t) total / 2;
+		entry->key = entry->previous;
+		__atomic_store_n(&table->hashes[table->count], hash, __ATOMIC_RELAXED);
+		__atomic_store_n(&table->count, table->count + 1, __ATOMIC_RELEASE);
+	}
+
+	if (table->count == table->cap) {
+		coldest = refresh_table(table);
+		__atomic_store_n(&table->min_key, table->entries[coldest].key, 
+						 __ATOMIC_RELAXED);
+	}
+}
+
+int load_hot_paths(const char *json_file)
+{
+	char file[BIG_SIZE];
+	json_t *root = NULL;
+
+	CHECK_POINTER(json_file, -1);
+	if (get_hot_file(json_file, file, sizeof(file)) < 0) { return -1; }
+
+	root = json_load_file(file, 0, NULL);
+	CHECK_POINTER(root, -1);
+
+	pthread_mutex_lock(&hot_lock);
+	seed_table(&paths, json_object_get(root, "paths"), 0);
+	seed_table(&subtrees, json_object_get(root, "subtrees"), SUBTREE_SALT);
+	pthread_mutex_unlock(&hot_lock);
+
+	json_decref(root);
+	return 0;
+}
@@ -0,0 +1,636 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file 
+ * @brief Contains definition of the binary images of the documents.
+ * 
+ * Function declarations, types and specifications can be found in image.h.
+ */
+
+#include <jansson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "image.h"
+
+/**
+ * @struct image_writer
+ * @brief Parts of an image while the tree is written to memory.
+ * 
+ * The nodes referenced several times are remembered in an open 
+ * addressing table from the node to its index.
+ */
+struct image_writer {
+	struct image_node *nodes;
+	size_t count_nodes;
+	size_t cap_nodes;
+	struct image_entry *entries;
+	size_t count_entries;
+	size_t cap_entries;
+	char *strings;
+	size_t strings_size;
+	size_t cap_strings;
+	json_t **shared;			/**< Nodes of the table, NULL for a free slot */
+	uint64_t *shared_index;		/**< Indexes of the nodes of the table */
+	size_t count_shared;
+	size_t cap_shared;			/**< Size of the table, a power of two */
+};
+
+/**
+ * @struct image_reader
+ * @brief Parts of a mapped image while the tree is built.
+ */
+struct image_reader {
+	const struct image_node *nodes;
+	size_t count_nodes;
+	const struct image_entry *entries;
+	size_t count_entries;
+	const char *strings;
+	size_t strings_size;
+	json_t **shared;			/**< Built shared nodes by index */
+};
+
+/* ================================= */
+/*              Hashing              */
+/* ================================= */
+
+/**
+ * @brief Hashes the content of a file with FNV-1a.
+ * 
+ * @param st[in,out] Expected attributes of the file, filled if 
+ * 		  its size is negative.
+ * 
+ * @return 0 on success, -1 on failure or if the file 
+ * 		   does not have the expected attributes.
+ */
+static int hash_file(const char *path, struct stat *st, uint64_t *hash)
+{
+	struct stat file_st;
+	unsigned char *data = NULL;
+	int fd;
+	int ret = -1;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) { return -1; }
+	if (fstat(fd, &file_st) < 0) { goto handle_error; }
+
+	if (st->st_size < 0) { *st = file_st; }
+	if (file_st.st_size != st->st_size || 
+		file_st.st_mtim.tv_sec != st->st_mtim.tv_sec ||
+		file_st.st_mtim.tv_nsec != st->st_mtim.tv_nsec) 
+	{
+		goto handle_error;
+	}
+
+	*hash = FNV1A_BASIS;
+	if (file_st.st_size) {
+		data = mmap(NULL, file_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) { goto handle_error; }
+		madvise(data, file_st.st_size, MADV_SEQUENTIAL);
+
+		*hash = hash_fnv1a(*hash, data, file_st.st_size);
+		munmap(data, file_st.st_size);
+	}
+
+	/* A file changed in place while it was hashed has a new time */
+	if (fstat(fd, &file_st) < 0 || 
+		file_st.st_mtim.tv_sec != st->st_mtim.tv_sec ||
+		file_st.st_mtim.tv_nsec != st->st_mtim.tv_nsec) 
+	{
+		goto handle_error;
+	}
+	ret = 0;
+
+	handle_error:
+		close(fd);
+		return ret;
+}
+
+/* ================================= */
+/*              Writing              */
+/* ================================= */
+
+/**
+ * @brief Makes room for count more elements of an array.
+ * @return 0 on success, -1 on failure.
+ */
+static int reserve_array(void **data, size_t *cap, size_t len, size_t count,
+						 size_t elem_size)
+{
+	void *res_realloc = NULL;
+	size_t new_cap = *cap ? *cap : SHRT_SIZE;
+
+	if (len + count <= *cap) { return 0; }
+
+	while (new_cap < len + count) { new_cap *= 2; }
+	res_realloc = realloc(*data, new_cap * elem_size);
+	CHECK_POINTER(res_realloc, -1);
+
+	*data = res_realloc;
+	*cap = new_cap;
+	return 0;
+}
+
+static size_t hash_node(const json_t *node, size_t cap)
+{
+	return (size_t) (((uintptr_t) node >> 4) * 0x9E3779B97F4A7C15ULL) & (cap - 1);
+}
+
+/**
+ * @brief Finds the slot of a node in the table of shared nodes.
+ * @return The slot of the node or the free slot for it.
+ */
+static size_t find_shared(const struct image_writer *w, const json_t *node)
+{
+	size_t slot = hash_node(node, w->cap_shared);
+
+	while (w->shared[slot] && w->shared[slot] != node) {
+		slot = (slot + 1) & (w->cap_shared - 1);
+	}
+
+	return slot;
+}
+
+/**
+ * @brief Remembers the index of a node that has several references.
+ * @return 0 on success, -1 on failure.
+ */
+static int add_shared(struct image_writer *w, json_t *node, uint64_t index)
+{
+	json_t **old_shared = w->shared;
+	uint64_t *old_index = w->shared_index;
+	size_t old_cap = w->cap_shared;
+	size_t slot;
+
+	/* The table is kept at most half full */
+	if (2 * (w->count_shared + 1) > w->cap_shared) {
+		w->cap_shared = old_cap ? old_cap * 2 : MID_SIZE;
+		w->shared = calloc(w->cap_shared, sizeof(json_t *));
+		w->shared_index = malloc(w->cap_shared * sizeof(uint64_t));
+		if (!w->shared || !w->shared_index) {
+			free(w->shared);
+			free(w->shared_index);
+			w->shared = old_shared;
+			w->shared_index = old_index;
+			w->cap_shared = old_cap;
+			return -1;
+		}
+
+		for (size_t i = 0; i < old_cap; i++) {
+			if (!old_shared[i]) { continue; }
+			slot = find_shared(w, old_shared[i]);
+			w->shared[slot] = old_shared[i];
+			w->shared_index[slot] = old_index[i];
+		}
+		free(old_shared);
+		free(old_index);
+	}
+
+	slot = find_shared(w, node);
+	w->shared[slot] = node;
+	w->shared_index[slot] = index;
+	w->count_shared++;
+	return 0;
+}
+
+/**
+ * @brief Adds a null-terminated string to the strings.
+ * @return 0 on success, -1 on failure.
+ */
+static int add_string(struct image_writer *w, const char *str, size_t len,
+					  uint64_t *offset)
+{
+	if (reserve_array((void **) &w->strings, &w->cap_strings, w->strings_size, 
+					  len + 1, 1) < 0) 
+	{
+		return -1;
+	}
+
+	memcpy(w->strings + w->strings_size, str, len);
+	w->strings[w->strings_size + len] = '\0';
+	*offset = w->strings_size;
+	w->strings_size += len + 1;
+
+	return 0;
+}
+
+/**
+ * @brief Adds a node and its subtree in preorder.
+ * 
+ * @param index[out] Index of the node.
+ * 
+ * @return 0 on success, -1 on failure.
+ */
+static int add_node(struct image_writer *w, json_t *node, uint64_t *index)
+{
+	const char *key = NULL;
+	json_t *value = NULL;
+	uint64_t child;
+	uint64_t i;
+	size_t entry;
+	double real;
+	size_t slot;
+
+	/* A node referenced from another place was added there */
+	if (node->refcount > 1 && w->cap_shared) {
+		slot = find_shared(w, node);
+		if (w->shared[slot]) {
+			*index = w->shared_index[slot];
+			w->nodes[*index].flags |= IMAGE_SHARED;
+			return 0;
+		}
+	}
+
+	if (reserve_array((void **) &w->nodes, &w->cap_nodes, w->count_nodes, 1,
+					  sizeof(struct image_node)) < 0) 
+	{
+		return -1;
+	}
+
+	i = w->count_nodes++;
+	*index = i;
+	memset(&w->nodes[i], 0, sizeof(struct image_node));
+	if (node->refcount > 1 && add_shared(w, node, i) < 0) { return -1; }
+
+	switch (json_typeof(node)) {
+		case JSON_OBJECT:
+			w->nodes[i].type = IMAGE_OBJECT;
+			w->nodes[i].count = json_object_size(node);
+			if (reserve_array((void **) &w->entries, &w->cap_entries, 
+							  w->count_entries, w->nodes[i].count, 
+							  sizeof(struct image_entry)) < 0) 
+			{
+				return -1;
+			}
+
+			/* The entries of the object are taken before its subtree */
+			entry = w->count_entries;
+			w->nodes[i].value = entry;
+			w->count_entries += w->nodes[i].count;
+
+			json_object_foreach(node, key, value) {
+				if (add_string(w, key, strlen(key), &w->entries[entry].key) < 0 ||
+					add_node(w, value, &child) < 0) 
+				{
+					return -1;
+				}
+				w->entries[entry++].node = child;
+			}
+			break;
+		case JSON_STRING:
+			w->nodes[i].type = IMAGE_STRING;
+			w->nodes[i].count = json_string_length(node);
+			if (add_string(w, json_string_value(node), w->nodes[i].count,
+						   &w->nodes[i].value) < 0) 
+			{
+				return -1;
+			}
+			break;
+		case JSON_INTEGER:
+			w->nodes[i].type = IMAGE_INTEGER;
+			w->nodes[i].value = (uint64_t) (int64_t) json_integer_value(node);
+			break;
+		case JSON_REAL:
+			w->nodes[i].type = IMAGE_REAL;
+			real = json_real_value(node);
+			memcpy(&w->nodes[i].value, &real, sizeof(real));
+			break;
+		case JSON_TRUE:
+			w->nodes[i].type = IMAGE_TRUE;
+			break;
+		case JSON_FALSE:
+			w->nodes[i].type = IMAGE_FALSE;
+			break;
+		case JSON_NULL:
+			w->nodes[i].type = IMAGE_NULL;
+			break;
+		default:
+			/* A normalized tree has no arrays */
+			return -1;
+	}
+
+	return 0;
+}
+
+static void free_image_writer(struct image_writer *w)
+{
+	free(w->nodes);
+	free(w->entries);
+	free(w->strings);
+	free(w->shared);
+	free(w->shared_index);
+}
+
+int save_json_image(json_t *root, const char *json_file, const struct stat *st)
+{
+	struct image_writer w;
+	struct image_header header;
+	struct stat file_st;
+	char image_path[PATH_MAX];
+	char tmp_path[PATH_MAX];
+	uint64_t root_index;
+	int count_byte;
+	int fd = -1;
+	int is_created = 0;
+	int ret = -1;
+
+	CHECK_POINTER(root, -1);
+	CHECK_POINTER(json_file, -1);
+	CHECK_POINTER(st, -1);
+
+	memset(&w, 0, sizeof(w));
+	memset(&header, 0, sizeof(header));
+
+	count_byte = snprintf(image_path, sizeof(image_path), "%s%s", json_file, 
+						  IMAGE_SUFFIX);
+	if (count_byte >= sizeof(image_path)) { return -1; }
+	count_byte = snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", image_path);
+	if (count_byte >= sizeof(tmp_path)) { return -1; }
+
+	file_st = *st;
+	if (hash_file(json_file, &file_st, &header.file_hash) < 0) { return -1; }
+	if (add_node(&w, root, &root_index) < 0) { goto handle_error; }
+
+	memcpy(header.magic, IMAGE_MAGIC, IMAGE_MAGIC_LEN);
+	header.byte_order = IMAGE_BYTE_ORDER;
+	header.file_size = st->st_size;
+	header.file_mtime_sec = st->st_mtim.tv_sec;
+	header.file_mtime_nsec = st->st_mtim.tv_nsec;
+	header.count_nodes = w.count_nodes;
+	header.count_entries = w.count_entries;
+	header.strings_size = w.strings_size;
+
+	header.image_hash = hash_fnv1a(FNV1A_BASIS, w.nodes, 
+								   w.count_nodes * sizeof(struct image_node));
+	header.image_hash = hash_fnv1a(header.image_hash, w.entries,
+								   w.count_entries * sizeof(struct image_entry));
+	header.image_hash = hash_fnv1a(header.image_hash, w.strings,
+								   w.strings_size);
+
+	fd = mkstemp(tmp_path);
+	if (fd < 0) { goto handle_error; }
+	is_created = 1;
+
+	if (write_all(fd, &header, sizeof(header)) < 0 ||
+		write_all(fd, w.nodes, w.count_nodes * sizeof(struct image_node)) < 0 ||
+		write_all(fd, w.entries, w.count_entries * sizeof(struct image_entry)) < 0 ||
+		write_all(fd, w.strings, w.strings_size) < 0) 
+	{
+		goto handle_error;
+	}
+
+	/* The image holds the same data as the file */
+	if (fchmod(fd, st->st_mode & 0777) < 0) { goto handle_error; }
+	if (close(fd) < 0) {
+		fd = -1;
+		goto handle_error;
+	}
+	fd = -1;
+
+	if (rename(tmp_path, image_path) < 0) { goto handle_error; }
+	ret = 0;
+
+	handle_error:
+		if (fd >= 0) { close(fd); }
+		if (ret < 0 && is_created) { unlink(tmp_path); }
+		free_image_writer(&w);
+		return ret;
+}
+
+/* ================================= */
+/*              Reading              */
+/* ================================= */
+
+/**
+ * @brief Gives a null-terminated string of the image.
+ * @return The string, NULL if the offset is out of the strings.
+ */
+static const char *get_string(const struct image_reader *r, uint64_t offset)
+{
+	if (offset >= r->strings_size) { return NULL; }
+	if (!memchr(r->strings + offset, '\0', r->strings_size - offset)) { 
+		return NULL; 
+	}
+
+	return r->strings + offset;
+}
+
+static json_t *build_node(struct image_reader *r, uint64_t index, int depth);
+
+/**
+ * @brief Builds a child of an object.
+ * 
+ * Nodes are numbered in preorder, so a child has a greater index 
+ * than its parent, unless it is a shared node built before. 
+ * This also keeps a corrupted image from making a cycle.
+ */
+static json_t *build_child(struct image_reader *r, uint64_t index, 
+						   uint64_t parent, int depth)
+{
+	if (index < r->count_nodes && r->shared[index]) { 
+		return json_incref(r->shared[index]); 
+	}
+	if (index <= parent) { return NULL; }
+
+	return build_node(r, index, depth);
+}
+
+/**
+ * @brief Builds a node and its subtree.
+ * 
+ * @param depth Depth of the node, a path of a deeper one 
+ * 		  would be longer than PATH_MAX.
+ * 
+ * @return New reference to the node, NULL if the image is corrupted.
+ */
+static json_t *build_node(struct image_reader *r, uint64_t index, int depth)
+{
+	const struct image_node *node = NULL;
+	const struct image_entry *entry = NULL;
+	const char *key = NULL;
+	json_t *result = NULL;
+	json_t *child = NULL;
+	double real;
+
+	if (index >= r->count_nodes || depth > PATH_MAX / 2) { return NULL; }
+	node = &r->nodes[index];
+
+	switch (node->type) {
+		case IMAGE_OBJECT:
+			if (node->value > r->count_entries || 
+				node->count > r->count_entries - node->value) 
+			{
+				return NULL;
+			}
+
+			result = json_object();
+			CHECK_POINTER(result, NULL);
+
+			for (uint64_t i = 0; i < node->count; i++) {
+				entry = &r->entries[node->value + i];
+				key = get_string(r, entry->key);
+				child = key ? build_child(r, entry->node, index, depth + 1) : NULL;
+				if (!child || json_object_set_new(result, key, child)) {
+					json_decref(result);
+					return NULL;
+				}
+			}
+			break;
+		case IMAGE_STRING:
+			if (node->value > r->strings_size || 
+				node->count > r->strings_size - node->value) 
+			{
+				return NULL;
+			}
+			result = json_stringn(r->strings + node->value, node->count);
+			break;
+		case IMAGE_INTEGER:
+			result = json_integer((json_int_t) (int64_t) node->value);
+			break;
+		case IMAGE_REAL:
+			memcpy(&real, &node->value, sizeof(real));
+			result = json_real(real);
+			break;
+		case IMAGE_TRUE:
+			result = json_true();
+			break;
+		case IMAGE_FALSE:
+			result = json_false();
+			break;
+		case IMAGE_NULL:
+			result = json_null();
+			break;
+		default:
+			return NULL;
+	}
+	CHECK_POINTER(result, NULL);
+
+	if (node->flags & IMAGE_SHARED) { r->shared[index] = json_incref(result); }
+	return result;
+}
+
+/**
+ * @brief Checks the header of an image against its size and the JSON file.
+ * @return 0 if the image can be used, -1 otherwise.
+ */
+static int check_image_header(const struct image_header *header, 
+							  size_t image_size, const char *json_file)
+{
+	struct stat st;
+	uint64_t hash;
+	size_t size = image_size - sizeof(struct image_header);
+
+	if (memcmp(header->magic, IMAGE_MAGIC, IMAGE_MAGIC_LEN) != 0 ||
+		header->byte_order != IMAGE_BYTE_ORDER) 
+	{
+		return -1;
+	}
+
+	/* The parts must fill the image exactly */
+	if (header->count_nodes > size / sizeof(struct image_node)) { return -1; }
+	size -= header->count_nodes * sizeof(struct image_node);
+	if (header->count_entries > size / sizeof(struct image_entry)) { return -1; }
+	size -= header->count_entries * sizeof(struct image_entry);
+	if (header->strings_size != size || !header->count_nodes) { return -1; }
+
+	/* A byte changed inside the parts is not seen by the checks above */
+	if (hash_fnv1a(FNV1A_BASIS, header + 1, 
+				   image_size - sizeof(struct image_header)) != header->image_hash) {
+		return -1;
+	}
+
+	memset(&st, 0, sizeof(st));
+	st.st_size = header->file_size;
+	st.st_mtim.tv_sec = header->file_mtime_sec;
+	st.st_mtim.tv_nsec = header->file_mtime_nsec;
+	if (st.st_size < 0 || hash_file(json_file, &st, &hash) < 0) { return -1; }
+
+	return hash == header->file_hash ? 0 : -1;
+}
+
+json_t *load_json_image(const char *json_file)
+{
+	struct image_reader r;
+	const struct image_header *header = NULL;
+	char image_path[PATH_MAX];
+	char *data = NULL;
+	json_t *root = NULL;
+	struct stat st;
+	int count_byte;
+	int fd;
+
+	CHECK_POINTER(json_file, NULL);
+
+	memset(&r, 0, sizeof(r));
+
+	count_byte = snprintf(image_path, sizeof(image_path), "%s%s", json_file, 
+						  IMAGE_SUFFIX);
+	if (count_byte >= sizeof(image_path)) { return NULL; }
+
+	fd = open(image_path, O_RDONLY);
+	if (fd < 0) { return NULL; }
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(struct image_header)) {
+		close(fd);
+		return NULL;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) { return NULL; }
+
+	header = (const struct image_header *) data;
+	if (check_image_header(header, st.st_size, json_file) < 0) { goto handle_error; }
+
+	/* The nodes are built in the order they are stored */
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	r.nodes = (const struct image_node *) (header + 1);
+	r.count_nodes = header->count_nodes;
+	r.entries = (const struct image_entry *) (r.nodes + r.count_nodes);
+	r.count_entries = header->count_entries;
+	r.strings = (const char *) (r.entries + r.count_entries);
+	r.strings_size = header->strings_size;
+
+	r.shared = calloc(r.count_nodes, sizeof(json_t *));
+	if (!r.shared) { goto handle_error; }
+
+	root = build_node(&r, 0, 0);
+	if (root && !json_is_object(root)) {
+		json_decref(root);
+		root = NULL;
+	}
+
+	handle_error:
+		if (r.shared) {
+			for (size_t i = 0; i < r.count_nodes; i++) { json_decref(r.shared[i]); }
+		}
+		free(r.shared);
+		munmap(data, st.st_size);
+		return root;
+}
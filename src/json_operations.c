@@ -30,11 +30,15 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <stdio.h>
+#include <limits.h>
+#include <math.h>
 
 #include "common.h"
 #include "json_operations.h"
+#include "stats.h"
+#include "trace.h"
 
-json_t *normalize_json(json_t *root, int is_root)
+json_t *normalize_json(json_t *root, int is_root, struct json_pool *pool)
 {
 	json_t *obj = NULL;
 	json_t *value = NULL;
@@ -50,7 +54,7 @@ json_t *normalize_json(json_t *root, int is_root)
 
 	if (json_is_object(root)) {
         json_object_foreach(root, key, value) {
-            converted_val = normalize_json(value, 0);
+            converted_val = normalize_json(value, 0, pool);
 			if (!converted_val) { goto handle_error; }
 			if (strchr(key, '/')) {
 				transform_key = replace_slash(key);
@@ -69,7 +73,7 @@ json_t *normalize_json(json_t *root, int is_root)
             char key[SHRT_SIZE];
             snprintf(key, sizeof(key), "%s%zu", SPECIAL_PREFIX, i);
 
-            converted_val = normalize_json(value, 0);
+            converted_val = normalize_json(value, 0, pool);
 			if (!converted_val) { goto handle_error; }
             json_object_set_new(obj, key, converted_val);
         }
@@ -82,131 +86,237 @@ json_t *normalize_json(json_t *root, int is_root)
 		}
 		else {
 			json_decref(obj);
-			obj = json_copy(root);
+			obj = pool ? intern_json_scalar(root, pool) : json_copy(root);
 			CHECK_POINTER(obj, NULL);
+			return obj;
 		}
     }
 
+	/* The root is changed in place, it is never shared */
+	if (pool && !is_root) { return intern_json_object(obj, pool); }
+
 	return obj;
 	handle_error:
 		json_decref(obj);
 		return NULL;
 }
 
-json_t *denormalize_json(json_t *root)
+/**
+ * @brief Checks if a normalized object represents an array.
+ * 
+ * @param obj Normalized object.
+ * 
+ * @return 1 if a key of the object has SPECIAL_PREFIX, 0 otherwise.
+ */
+static int is_array_object(json_t *obj)
 {
-	json_t *root_dup = NULL;
-    json_t *scal_value = NULL;
-	json_t *node_with_slash[MID_SIZE];
-	json_t *node_array[MID_SIZE];
-	json_t *new_array = NULL;
-	json_t *parent = NULL;
-	json_t *node_dup = NULL;
+	const char *key = NULL;
+	json_t *value = NULL;
+
+	json_object_foreach(obj, key, value) {
+		if (strncmp(key, SPECIAL_PREFIX, strlen(SPECIAL_PREFIX)) == 0 &&
+			!strstr(key, SPECIAL_SLASH)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Converts a normalized node and its descendants back.
+ * 
+ * Unlike the copies, scalars are shared with the normalized tree.
+ * 
+ * @param node Normalized node.
+ * 
+ * @return New reference to the converted node, NULL on failure.
+ */
+static json_t *denormalize_node(json_t *node)
+{
+	char elem_key[SHRT_SIZE];
+	json_t *result = NULL;
+	json_t *child = NULL;
 	json_t *value = NULL;
 	const char *key = NULL;
-	char *transform_key = NULL;
-	int res;
-	int prefix_found;
-	int count;
+	char *new_key = NULL;
+	size_t size;
+	int res_set;
+
+	if (!json_is_object(node)) { return json_incref(node); }
+
+	if (is_array_object(node)) {
+		result = json_array();
+		CHECK_POINTER(result, NULL);
+
+		/* Elements go by their indexes while there are no gaps */
+		if (is_normal_array(node)) {
+			size = json_object_size(node);
+			for (size_t i = 0; i < size; i++) {
+				snprintf(elem_key, sizeof(elem_key), "%s%zu", SPECIAL_PREFIX, i);
+				child = denormalize_node(json_object_get(node, elem_key));
+				if (!child) { goto handle_error; }
+				if (json_array_append_new(result, child)) { goto handle_error; }
+			}
+			return result;
+		}
 
-	if (!json_is_object(root)) { return NULL; }
+		json_object_foreach(node, key, value) {
+			child = denormalize_node(value);
+			if (!child) { goto handle_error; }
+			if (json_array_append_new(result, child)) { goto handle_error; }
+		}
+		return result;
+	}
+
+	result = json_object();
+	CHECK_POINTER(result, NULL);
+
+	json_object_foreach(node, key, value) {
+		child = denormalize_node(value);
+		if (!child) { goto handle_error; }
+
+		if (strstr(key, SPECIAL_SLASH)) {
+			new_key = reverse_replace_slash(key);
+			if (!new_key) {
+				json_decref(child);
+				goto handle_error;
+			}
+			res_set = json_object_set_new(result, new_key, child);
+			free(new_key);
+		}
+		else {
+			res_set = json_object_set_new_nocheck(result, key, child);
+		}
+		if (res_set) { goto handle_error; }
+	}
 
-	root_dup = json_deep_copy(root);
-	if (!root_dup) { return NULL; }
+	return result;
 
-	prefix_found = spec_prefix_is_present(root_dup);
-	if (!prefix_found) { return root_dup; }
+	handle_error:
+		json_decref(result);
+		return NULL;
+}
 
-	scal_value = json_object_get(root_dup, SCALAR_NAME);
-    if (scal_value) { return scal_value; }
+json_t *denormalize_json(json_t *root)
+{
+	json_t *scal_value = NULL;
 
-	count = find_keys_with_spec_slash(root_dup, node_with_slash, MID_SIZE, 0);
-	for (int i = count - 1; i >=  0; i--) {
-		res = find_parent_and_key(root_dup, node_with_slash[i], &parent, &key);
-		if (res) { goto handle_error; }
+	if (!json_is_object(root)) { return NULL; }
 
-		transform_key = reverse_replace_slash(key);
-		node_dup = json_deep_copy(node_with_slash[i]);
-		
-		json_object_set_new(parent, transform_key, node_dup);
-		json_object_del(parent, key);
-		free(transform_key);
+	scal_value = json_object_get(root, SCALAR_NAME);
+	if (scal_value && json_object_size(root) == 1) { 
+		return json_incref(scal_value); 
 	}
 
-	count = find_array_in_normal_root(root_dup, node_array, MID_SIZE, 0);
-	for (int i = count - 1; i >= 0; i--) {
-		new_array = json_array();
-		json_object_foreach(node_array[i], key, value) {
-			node_dup = json_deep_copy(value);
-			json_array_append_new(new_array, node_dup);
-		}
+	return denormalize_node(root);
+}
 
-		res = find_parent_and_key(root_dup, node_array[i], &parent, &key);
-		if (res == -EINVAL) {
-			json_decref(root_dup);
-			return new_array;
-		}
-		else if (res) {
-			goto handle_error;
+/**
+ * @brief Walks a path from the root.
+ * 
+ * @param len Length of the path, the rest of the string is not looked at.
+ * @param is_unshare If set, every object on the path that is shared
+ * 					 with other nodes is replaced by its shallow copy.
+ * 
+ * @see find_json_node
+ * @see unshare_json_node
+ */
+static json_t *walk_json_path(const char *path, size_t len, json_t *root, 
+							  int is_unshare)
+{
+	char key[NAME_MAX + 1];
+	const char *begin = NULL;
+	const char *end = NULL;
+	const char *limit = path + len;
+	json_t *curr_obj = NULL;
+	json_t *child = NULL;
+	json_t *copy = NULL;
+	size_t key_len;
+	int depth = 0;
+
+	if (len == 1 && path[0] == '/') { 
+		count_stats_lookup(0);
+		return root; 
+	}
+
+	/* The path is walked in place, without copying it to the heap */
+	curr_obj = root;
+	begin = path;
+	while (begin < limit) {
+		if (*begin == '/') {
+			begin++;
+			continue;
 		}
-		else {
-			res = json_object_set_new(parent, key, new_array);
-			if (res < 0) { goto handle_error; }
+
+		end = memchr(begin, '/', (size_t) (limit - begin));
+		key_len = end ? (size_t) (end - begin) : (size_t) (limit - begin);
+		if (key_len > NAME_MAX) { return NULL; }
+
+		if (!json_is_object(curr_obj)) { return NULL; }
+
+		memcpy(key, begin, key_len);
+		key[key_len] = '\0';
+
+		child = json_object_get(curr_obj, key);
+		CHECK_POINTER(child, NULL);
+
+		/* The copy shares the children, so they are copied deeper on the path */
+		if (is_unshare && json_is_object(child) && child->refcount > 1) {
+			copy = json_copy(child);
+			CHECK_POINTER(copy, NULL);
+			if (json_object_set_new(curr_obj, key, copy)) { return NULL; }
+			child = copy;
 		}
+		curr_obj = child;
+
+		begin += key_len;
+		depth++;
 	}
 
-    return root_dup;
-	handle_error:
-		free(transform_key);
-		json_decref(root_dup);
-		return NULL;
+	count_stats_lookup(depth);
+	return depth ? curr_obj : NULL;
 }
 
 json_t *find_json_node(const char *path, json_t *root)
 {
-	char *path_dup = NULL;
-	char *saveptr = NULL;
+	json_t *node = NULL;
+	uint64_t start;
 
 	CHECK_POINTER(path, NULL);
 	CHECK_POINTER(root, NULL);
 
-	if (strcmp(path, "/") == 0) { return root; }
-
-	path_dup = strdup(path);
-	CHECK_POINTER(path_dup, NULL);
+	start = begin_trace_span();
+	node = walk_json_path(path, strlen(path), root, 0);
+	end_trace_span("find_json_node", TRACE_JSON, start, path);
 
-	char *key = strtok_r(path_dup, "/", &saveptr);
-	if (!key) { goto handle_error; }
+	return node;
+}
 
-	json_t *curr_obj = root;
+json_t *unshare_json_node(const char *path, json_t *root)
+{
+	json_t *node = NULL;
+	uint64_t start;
 
-	while(key) {
-		if (!json_is_object(curr_obj)) { goto handle_error; }
-		curr_obj = json_object_get(curr_obj, key);
-		if (!curr_obj) { goto handle_error; }
-		key = strtok_r(NULL, "/", &saveptr);
-	}
+	CHECK_POINTER(path, NULL);
+	CHECK_POINTER(root, NULL);
 
-	free(path_dup);
-	return curr_obj;
+	start = begin_trace_span();
+	node = walk_json_path(path, strlen(path), root, 1);
+	end_trace_span("unshare_json_node", TRACE_JSON, start, path);
 
-	handle_error:
-		free(path_dup);
-		return NULL;
+	return node;
 }
 
-int find_parent_and_key(json_t *root, json_t *node, json_t **parent, 
-					    const char **key)
+/**
+ * @brief Searches the parent of a node, see find_parent_and_key().
+ */
+static int search_parent(json_t *root, json_t *node, json_t **parent, 
+						 const char **key)
 {
 	json_t *v = NULL;
 	const char *k = NULL;
 	int res_find;
 
-	CHECK_POINTER(root, -EFAULT);
-    CHECK_POINTER(node, -EFAULT);
-    CHECK_POINTER(parent, -EFAULT);
-    CHECK_POINTER(key, -EFAULT);
-
 	if (json_equal(root, node)) { return -EINVAL; }
 
 	if (json_is_object(root)) {
@@ -217,7 +327,7 @@ int find_parent_and_key(json_t *root, json_t *node, json_t **parent,
 				return 0;
 			}
 
-			res_find = find_parent_and_key(v, node, parent, key);
+			res_find = search_parent(v, node, parent, key);
 			if (!res_find) { return 0; }
 		}
 	}
@@ -225,6 +335,24 @@ int find_parent_and_key(json_t *root, json_t *node, json_t **parent,
 	return -ENOENT;
 }
 
+int find_parent_and_key(json_t *root, json_t *node, json_t **parent, 
+					    const char **key)
+{
+	int res_find;
+	uint64_t start;
+
+	CHECK_POINTER(root, -EFAULT);
+    CHECK_POINTER(node, -EFAULT);
+    CHECK_POINTER(parent, -EFAULT);
+    CHECK_POINTER(key, -EFAULT);
+
+	start = begin_trace_span();
+	res_find = search_parent(root, node, parent, key);
+	end_trace_span("find_parent_and_key", TRACE_JSON, start, NULL);
+
+	return res_find;
+}
+
 int spec_prefix_is_present(json_t *root)
 {
 	const char *key = NULL;
@@ -313,6 +441,39 @@ int replace_json_nodes(json_t *old_node, json_t *new_node, json_t *root)
 	return 0;
 }
 
+int replace_json_node_at(const char *path, json_t *new_node, json_t *root)
+{
+	json_t *parent = NULL;
+	char *parent_path = NULL;
+	char *key = NULL;
+	int res_sep;
+	int ret = 0;
+
+	CHECK_POINTER(path, -EFAULT);
+	CHECK_POINTER(new_node, -EFAULT);
+	CHECK_POINTER(root, -EFAULT);
+
+	res_sep = separate_filepath(path, &parent_path, &key);
+	if (res_sep < 0) { return -ENOMEM; }
+
+	parent = unshare_json_node(parent_path, root);
+	if (!json_is_object(parent) || !json_object_get(parent, key)) {
+		ret = -ENOENT;
+		goto handle_error;
+	}
+
+	if (json_object_set(parent, key, new_node)) {
+		ret = -EINVAL;
+		goto handle_error;
+	}
+	json_decref(new_node);
+
+	handle_error:
+		free(parent_path);
+		free(key);
+		return ret;
+}
+
 int count_subdirs(json_t *obj)
 {
 	int count = 0;
@@ -332,64 +493,134 @@ int count_subdirs(json_t *obj)
 	return count;
 }
 
+/**
+ * @brief Absolute paths of the special files, NULL-terminated.
+ * @see is_special_file
+ */
+static const char *special_files[] = {
+	"/.status",
+	"/.save",
+	"/.patch",
+	"/.ctl",
+	"/.stats",
+	"/.stats.prom",
+	"/.trace",
+	"/.hot",
+	NULL
+};
+
 int is_special_file(const char *path)
 {
-	if (strcmp("/.status", path) == 0 ||
-		strcmp("/.save", path) == 0) {
+	for (int i = 0; special_files[i]; i++) {
+		if (strcmp(special_files[i], path) == 0) {
 			return 1;
+		}
 	}
 	return 0;
 }
 
+const char *get_special_file(int index)
+{
+	if (index < 0 || index >= count_special_files()) {
+		return NULL;
+	}
+	return special_files[index];
+}
+
+int count_special_files(void)
+{
+	return sizeof(special_files) / sizeof(special_files[0]) - 1;
+}
+
+int is_normal_array(json_t *obj)
+{
+	char key[SHRT_SIZE];
+	size_t size;
+
+	if (!json_is_object(obj)) { return 0; }
+
+	size = json_object_size(obj);
+	for (size_t i = 0; i < size; i++) {
+		snprintf(key, sizeof(key), "%s%zu", SPECIAL_PREFIX, i);
+		if (!json_object_get(obj, key)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+int is_array_like(json_t *obj)
+{
+	char key[SHRT_SIZE];
+	size_t size;
+
+	if (!json_is_object(obj)) { return 0; }
+
+	size = json_object_size(obj);
+	if (!size) { return 0; }
+
+	snprintf(key, sizeof(key), "%s%zu", SPECIAL_PREFIX, size - 1);
+	return json_object_get(obj, SPECIAL_PREFIX"0") && json_object_get(obj, key);
+}
+
+json_t *find_subtree_dir(const char *path, json_t *root)
+{
+	json_t *dir = NULL;
+	const char *name = NULL;
+	uint64_t start;
+
+	CHECK_POINTER(path, NULL);
+	CHECK_POINTER(root, NULL);
+
+	/* Most paths are not subtree files, they are told by the name alone */
+	name = strrchr(path, '/');
+	if (!name || strcmp(name + 1, SUBTREE_NAME) != 0) { return NULL; }
+
+	/* The parent is the path before the name, walked in place */
+	if (name == path) { 
+		dir = root; 
+	}
+	else {
+		start = begin_trace_span();
+		dir = walk_json_path(path, (size_t) (name - path), root, 0);
+		end_trace_span("find_json_node", TRACE_JSON, start, path);
+	}
+
+	if (!json_is_object(dir) || json_object_get(dir, name + 1)) { return NULL; }
+	return dir;
+}
+
 char *replace_slash(const char *key)
 {
-	char *key_dup = NULL;
 	char *new_key = NULL;
-	char *part_of_key = NULL;
-	char *saveptr = NULL;
-	size_t offset = 0;
+	char *pos = NULL;
+	size_t slash_len = strlen(SPECIAL_SLASH);
 	int count_slash = 0;
-	int is_first_part = 1;
 
 	CHECK_POINTER(key, NULL);
 
-	key_dup = strdup(key);
-	if (!key_dup) { goto handle_error; }
-
-	for (int i = 0; i < strlen(key_dup); i++) {
-		if (key_dup[i] == '/') { count_slash++; }
+	for (const char *c = key; *c; c++) {
+		if (*c == '/') { count_slash++; }
 	}
 
-	new_key = calloc(1, strlen(key) + strlen(SPECIAL_SLASH) * count_slash);
-	if (!new_key) { goto handle_error; }
-
-	part_of_key = strtok_r(key_dup, "/", &saveptr);
-	while (part_of_key) {
-		if (!is_first_part) {
-            snprintf(new_key + offset, 
-                     strlen(SPECIAL_SLASH) + 1,
-                     "%s",
-                     SPECIAL_SLASH);
-            offset += strlen(SPECIAL_SLASH);
-        }
-        is_first_part = 0;
-
-        snprintf(new_key + offset, 
-                 strlen(part_of_key) + 1,
-                 "%s",
-                 part_of_key);
-        offset += strlen(part_of_key);
+	new_key = malloc(strlen(key) + (slash_len - 1) * count_slash + 1);
+	CHECK_POINTER(new_key, NULL);
 
-        part_of_key = strtok_r(NULL, "/", &saveptr);
+	/* Every slash is replaced, so that the key can be restored exactly */
+	pos = new_key;
+	for (const char *c = key; *c; c++) {
+		if (*c == '/') {
+			memcpy(pos, SPECIAL_SLASH, slash_len);
+			pos += slash_len;
+		}
+		else {
+			*pos++ = *c;
+		}
 	}
+	*pos = '\0';
 
-	free(key_dup);
 	return new_key;
-
-	handle_error:
-		free(key_dup);
-		free(new_key);
-		return NULL;
 }
 
 char *reverse_replace_slash(const char *key)
@@ -467,3 +698,541 @@ int separate_filepath(const char *path, char **parent_path, char **basename)
 		free(*basename);
 		return -1;
 }
+
+/**
+ * @struct dump_buffer
+ * @brief Growing buffer for dump_json_node().
+ */
+struct dump_buffer {
+	char *data;		/**< Serialized text */
+	size_t len;		/**< Length of the text */
+	size_t cap;		/**< Size of data */
+};
+
+/**
+ * @brief Appends a piece of serialized text to struct dump_buffer.
+ * @see json_dump_callback
+ */
+static int append_to_dump(const char *buffer, size_t size, void *data)
+{
+	struct dump_buffer *dump = data;
+	char *res_realloc = NULL;
+	size_t new_cap;
+
+	if (dump->len + size + 1 > dump->cap) {
+		new_cap = dump->cap ? dump->cap : SHRT_SIZE;
+		while (dump->len + size + 1 > new_cap) { new_cap *= 2; }
+
+		res_realloc = realloc(dump->data, new_cap);
+		if (!res_realloc) { return -1; }
+		dump->data = res_realloc;
+		dump->cap = new_cap;
+	}
+
+	memcpy(dump->data + dump->len, buffer, size);
+	dump->len += size;
+	dump->data[dump->len] = '\0';
+
+	return 0;
+}
+
+/**
+ * @brief Serializes a node with the given flags of jansson.
+ * 
+ * @see dump_json_node
+ */
+static char *dump_json_text(json_t *node, size_t *len, size_t flags)
+{
+	struct dump_buffer dump = { NULL, 0, 0 };
+	uint64_t start;
+	int res_dump;
+
+	CHECK_POINTER(node, NULL);
+
+	start = begin_trace_span();
+	res_dump = json_dump_callback(node, append_to_dump, &dump, flags);
+	end_trace_span("json_dumps", TRACE_JSON, start, NULL);
+	count_stats_event(STATS_DUMPS);
+	if (res_dump < 0 || !dump.data) {
+		free(dump.data);
+		return NULL;
+	}
+
+	if (len) { *len = dump.len; }
+	return dump.data;
+}
+
+char *dump_json_node(json_t *node, size_t *len)
+{
+	return dump_json_text(node, len, DUMP_FLAGS);
+}
+
+char *dump_json_document(json_t *node, size_t *len)
+{
+	return dump_json_text(node, len, SAVE_FLAGS);
+}
+
+void print_json_string(FILE *out, const char *str)
+{
+	fputc('"', out);
+	for (const unsigned char *c = (const unsigned char *) str; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			fputc('\\', out);
+			fputc(*c, out);
+		}
+		else if (*c < 0x20) {
+			fprintf(out, "\\u%04x", *c);
+		}
+		else {
+			fputc(*c, out);
+		}
+	}
+	fputc('"', out);
+}
+
+char *export_json_subtree(json_t *node, size_t *len)
+{
+	json_t *denorm = NULL;
+	char *text = NULL;
+
+	CHECK_POINTER(node, NULL);
+
+	denorm = denormalize_json(node);
+	CHECK_POINTER(denorm, NULL);
+
+	text = dump_json_document(denorm, len);
+	json_decref(denorm);
+	return text;
+}
+
+char *export_json_line(json_t *node, size_t *len)
+{
+	json_t *denorm = NULL;
+	char *text = NULL;
+
+	CHECK_POINTER(node, NULL);
+
+	/* Elements may be scalars, which are the same in both trees */
+	denorm = json_is_object(node) ? denormalize_json(node) : json_incref(node);
+	CHECK_POINTER(denorm, NULL);
+
+	text = dump_json_text(denorm, len, LINE_FLAGS);
+	json_decref(denorm);
+	return text;
+}
+
+json_t *import_json_subtree(const char *text, size_t len)
+{
+	json_t *value = NULL;
+	json_t *subtree = NULL;
+	uint64_t start;
+
+	CHECK_POINTER(text, NULL);
+
+	start = begin_trace_span();
+	value = json_loadb(text, len, 0, NULL);
+	end_trace_span("json_loads", TRACE_JSON, start, NULL);
+	count_stats_event(STATS_LOADS);
+	CHECK_POINTER(value, NULL);
+
+	subtree = normalize_json(value, 0, NULL);
+	json_decref(value);
+	return subtree;
+}
+
+/**
+ * @brief Represents a real as jansson does with REAL_PRECISION.
+ * 
+ * @param value Real to represent.
+ * @param buffer Buffer for the null-terminated text.
+ * @param size Size of the buffer.
+ * 
+ * @return Length of the text on success, -ENOBUFS if the buffer is too small.
+ */
+static int format_json_real(double value, char *buffer, size_t size)
+{
+	char *start = NULL;
+	char *end = NULL;
+	int len;
+
+	len = snprintf(buffer, size, "%.*g", REAL_PRECISION, value);
+	if (len < 0 || (size_t) len >= size) { return -ENOBUFS; }
+
+	/* A real must stay a real when it is read back */
+	if (!strpbrk(buffer, ".e")) {
+		if ((size_t) len + 2 >= size) { return -ENOBUFS; }
+		memcpy(buffer + len, ".0", 3);
+		len += 2;
+	}
+
+	/* Drop the "+" sign and leading zeros of the exponent */
+	start = strchr(buffer, 'e');
+	if (start) {
+		start++;
+		end = start + 1;
+		if (*start == '-') { start++; }
+		while (*end == '0') { end++; }
+		if (end != start) {
+			memmove(start, end, len - (end - buffer) + 1);
+			len -= end - start;
+		}
+	}
+
+	return len;
+}
+
+int format_json_scalar(json_t *node, char *buffer, size_t size)
+{
+	int len;
+
+	CHECK_POINTER(node, -EFAULT);
+	CHECK_POINTER(buffer, -EFAULT);
+
+	switch (json_typeof(node)) {
+		case JSON_INTEGER:
+			len = snprintf(buffer, size, "%" JSON_INTEGER_FORMAT,
+						   json_integer_value(node));
+			break;
+		case JSON_REAL:
+			return format_json_real(json_real_value(node), buffer, size);
+		case JSON_TRUE:
+			len = snprintf(buffer, size, "true");
+			break;
+		case JSON_FALSE:
+			len = snprintf(buffer, size, "false");
+			break;
+		case JSON_NULL:
+			len = snprintf(buffer, size, "null");
+			break;
+		default:
+			return -EINVAL;
+	}
+
+	if (len < 0 || (size_t) len >= size) { return -ENOBUFS; }
+	return len;
+}
+
+/**
+ * @brief Checks if the character is whitespace in JSON.
+ */
+static int is_json_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/**
+ * @brief Skips decimal digits.
+ * 
+ * @return Pointer to the first character after the digits.
+ */
+static const char *skip_digits(const char *pos, const char *end)
+{
+	while (pos < end && *pos >= '0' && *pos <= '9') { pos++; }
+	return pos;
+}
+
+int parse_json_scalar(const char *text, size_t len, struct json_scalar *scalar)
+{
+	char number[MID_SIZE];
+	const char *begin = NULL;
+	const char *end = NULL;
+	const char *pos = NULL;
+	int is_real = 0;
+
+	CHECK_POINTER(text, -EFAULT);
+	CHECK_POINTER(scalar, -EFAULT);
+
+	begin = text;
+	end = text + len;
+	while (begin < end && is_json_space(*begin)) { begin++; }
+	while (end > begin && is_json_space(end[-1])) { end--; }
+	len = end - begin;
+
+	if (len == 4 && memcmp(begin, "true", 4) == 0) {
+		scalar->type = JSON_TRUE;
+		return 0;
+	}
+	if (len == 5 && memcmp(begin, "false", 5) == 0) {
+		scalar->type = JSON_FALSE;
+		return 0;
+	}
+	if (len == 4 && memcmp(begin, "null", 4) == 0) {
+		scalar->type = JSON_NULL;
+		return 0;
+	}
+
+	/* -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)? */
+	pos = begin;
+	if (pos < end && *pos == '-') { pos++; }
+	if (pos == end || *pos < '0' || *pos > '9') { return -EINVAL; }
+	pos = (*pos == '0') ? pos + 1 : skip_digits(pos, end);
+
+	if (pos < end && *pos == '.') {
+		is_real = 1;
+		if (skip_digits(pos + 1, end) == pos + 1) { return -EINVAL; }
+		pos = skip_digits(pos + 1, end);
+	}
+
+	if (pos < end && (*pos == 'e' || *pos == 'E')) {
+		is_real = 1;
+		pos++;
+		if (pos < end && (*pos == '+' || *pos == '-')) { pos++; }
+		if (skip_digits(pos, end) == pos) { return -EINVAL; }
+		pos = skip_digits(pos, end);
+	}
+
+	if (pos != end) { return -EINVAL; }
+	if (len >= sizeof(number)) { return -ERANGE; }
+
+	memcpy(number, begin, len);
+	number[len] = '\0';
+
+	errno = 0;
+	if (is_real) {
+		scalar->type = JSON_REAL;
+		scalar->real = strtod(number, NULL);
+		if (errno == ERANGE && 
+			(scalar->real == HUGE_VAL || scalar->real == -HUGE_VAL)) { 
+			return -ERANGE; 
+		}
+	}
+	else {
+		scalar->type = JSON_INTEGER;
+		scalar->integer = strtoll(number, NULL, 10);
+		if (errno == ERANGE) { return -ERANGE; }
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Gives the length of a string in JSON, with quotes and escapes.
+ * 
+ * @param is_key 1 if SPECIAL_SLASH is counted as "/".
+ */
+static size_t measure_json_string(const char *str, size_t len, int is_key)
+{
+	size_t slash_len = strlen(SPECIAL_SLASH);
+	size_t size = 2;
+	unsigned char c;
+
+	for (size_t i = 0; i < len; i++) {
+		c = (unsigned char) str[i];
+
+		if (is_key && strncmp(str + i, SPECIAL_SLASH, slash_len) == 0) {
+			i += slash_len - 1;
+			size++;
+		}
+		else if (c == '"' || c == '\\' || c == '\b' || c == '\f' || 
+				 c == '\n' || c == '\r' || c == '\t') {
+			size += 2;
+		}
+		else if (c < 0x20) {
+			/* Written as a code point */
+			size += 6;
+		}
+		else {
+			size++;
+		}
+	}
+
+	return size;
+}
+
+size_t measure_json_node(json_t *node)
+{
+	char scalar_buf[MID_SIZE];
+	const char *key = NULL;
+	json_t *value = NULL;
+	size_t size;
+	int is_array;
+	int len;
+
+	switch (json_typeof(node)) {
+		case JSON_OBJECT:
+			is_array = is_array_object(node);
+			size = 2 + (json_object_size(node) ? json_object_size(node) - 1 : 0);
+			json_object_foreach(node, key, value) {
+				if (!is_array) { size += measure_json_string(key, strlen(key), 1) + 1; }
+				size += measure_json_node(value);
+			}
+			return size;
+		case JSON_STRING:
+			return measure_json_string(json_string_value(node), 
+									   json_string_length(node), 0);
+		default:
+			len = format_json_scalar(node, scalar_buf, sizeof(scalar_buf));
+			return len > 0 ? (size_t) len : 0;
+	}
+}
+
+const char *get_json_type_name(json_t *node)
+{
+	CHECK_POINTER(node, NULL);
+
+	switch (json_typeof(node)) {
+		case JSON_OBJECT: return is_array_object(node) ? "array" : "object";
+		case JSON_STRING: return "string";
+		case JSON_INTEGER:
+		case JSON_REAL: return "number";
+		case JSON_TRUE:
+		case JSON_FALSE: return "boolean";
+		default: return "null";
+	}
+}
+
+struct json_pool *create_json_pool(void)
+{
+	struct json_pool *pool = calloc(1, sizeof(struct json_pool));
+	CHECK_POINTER(pool, NULL);
+
+	pool->strings = json_object();
+	pool->integers = json_object();
+	pool->reals = json_object();
+	pool->objects = json_object();
+	if (!pool->strings || !pool->integers || !pool->reals || !pool->objects) {
+		destroy_json_pool(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+json_t *intern_json_scalar(json_t *value, struct json_pool *pool)
+{
+	char num_key[SHRT_SIZE];
+	const char *key = NULL;
+	json_t *table = NULL;
+	json_t *shared = NULL;
+	size_t payload = 0;
+
+	CHECK_POINTER(value, NULL);
+	CHECK_POINTER(pool, NULL);
+
+	switch (json_typeof(value)) {
+		case JSON_STRING:
+			key = json_string_value(value);
+			payload = json_string_length(value) + 1;
+			/* Strings with '\0' inside cannot be a key */
+			if (strlen(key) + 1 != payload) { return json_copy(value); }
+			table = pool->strings;
+			break;
+		case JSON_INTEGER:
+			snprintf(num_key, sizeof(num_key), "%" JSON_INTEGER_FORMAT,
+					 json_integer_value(value));
+			key = num_key;
+			table = pool->integers;
+			break;
+		case JSON_REAL:
+			snprintf(num_key, sizeof(num_key), "%.17g", json_real_value(value));
+			key = num_key;
+			table = pool->reals;
+			break;
+		default:
+			/* true, false and null are shared by jansson itself */
+			return json_copy(value);
+	}
+
+	pool->count_scalars++;
+
+	shared = json_object_get(table, key);
+	if (shared) {
+		pool->count_shared++;
+		pool->saved_bytes += SCALAR_NODE_SIZE + payload;
+		return json_incref(shared);
+	}
+
+	shared = json_copy(value);
+	CHECK_POINTER(shared, NULL);
+	json_object_set(table, key, shared);
+
+	return shared;
+}
+
+/**
+ * @brief Hashes the entries of an object, whatever their order.
+ * 
+ * The children are hashed by their address: equal children are 
+ * the same node once they are interned.
+ */
+static uint64_t hash_json_object(json_t *obj)
+{
+	const char *key = NULL;
+	json_t *value = NULL;
+	uint64_t hash = json_object_size(obj);
+	uint64_t entry;
+
+	json_object_foreach(obj, key, value) {
+		entry = hash_fnv1a(FNV1A_BASIS, key, strlen(key));
+		entry = hash_fnv1a(entry, &value, sizeof(value));
+		hash += entry;
+	}
+
+	return hash;
+}
+
+/**
+ * @brief Checks if two objects have the same keys with the same nodes.
+ */
+static int has_same_entries(json_t *obj, json_t *other)
+{
+	const char *key = NULL;
+	json_t *value = NULL;
+
+	if (json_object_size(obj) != json_object_size(other)) { return 0; }
+
+	json_object_foreach(obj, key, value) {
+		if (json_object_get(other, key) != value) { return 0; }
+	}
+
+	return 1;
+}
+
+json_t *intern_json_object(json_t *obj, struct json_pool *pool)
+{
+	char hash_key[SHRT_SIZE];
+	json_t *candidates = NULL;
+	json_t *shared = NULL;
+	size_t i;
+
+	CHECK_POINTER(obj, NULL);
+	if (!pool) { 
+		json_decref(obj);
+		return NULL;
+	}
+
+	snprintf(hash_key, sizeof(hash_key), "%016llx", 
+			 (unsigned long long) hash_json_object(obj));
+
+	candidates = json_object_get(pool->objects, hash_key);
+	json_array_foreach(candidates, i, shared) {
+		if (has_same_entries(obj, shared)) {
+			pool->count_objects++;
+			json_decref(obj);
+			return json_incref(shared);
+		}
+	}
+
+	if (!candidates) {
+		candidates = json_array();
+		if (!candidates || json_object_set_new(pool->objects, hash_key, 
+											   candidates)) {
+			/* The object is kept, only not shared */
+			return obj;
+		}
+	}
+	json_array_append(candidates, obj);
+
+	return obj;
+}
+
+void destroy_json_pool(struct json_pool *pool)
+{
+	if (!pool) { return; }
+
+	json_decref(pool->strings);
+	json_decref(pool->integers);
+	json_decref(pool->reals);
+	json_decref(pool->objects);
+	free(pool);
+}
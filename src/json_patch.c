@@ -0,0 +1,685 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file 
+ * @brief Contains the application of JSON Patch to the normalized tree.
+ * 
+ * Function declarations and specifications can be found in json_patch.h.
+ */
+
+#include <jansson.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "common.h"
+#include "json_operations.h"
+#include "json_patch.h"
+#include "stats.h"
+#include "trace.h"
+
+/**
+ * @struct journal_entry
+ * @brief Change of one key, enough to undo it.
+ */
+struct journal_entry {
+	json_t *parent;		/**< Object whose key was changed */
+	char *key;			/**< The changed key */
+	json_t *old_value;	/**< Previous value, NULL if there was no key */
+};
+
+/**
+ * @struct patch_journal
+ * @brief Undo journal of a patch.
+ * 
+ * Every change of the tree made by a patch is recorded, 
+ * so that a failed patch can be undone in reverse order.
+ */
+struct patch_journal {
+	struct journal_entry *entries;	/**< Recorded changes */
+	size_t count;					/**< Number of recorded changes */
+	size_t cap;						/**< Size of the entries array */
+};
+
+/**
+ * @struct patch_target
+ * @brief Location of a JSON Pointer in the normalized tree.
+ */
+struct patch_target {
+	json_t *parent;		/**< Object holding the target, NULL for the root */
+	json_t *node;		/**< The target itself, NULL if it does not exist */
+	char *key;			/**< Normalized key of the target in the parent */
+	int is_array;		/**< 1 if the parent is a converted array */
+	size_t index;		/**< Index of the target if is_array */
+};
+
+/**
+ * @brief Records the current value of a key before it is changed.
+ * 
+ * @return 0 on success, -ENOMEM on failure.
+ */
+static int record_journal(struct patch_journal *journal, json_t *parent,
+						  const char *key)
+{
+	struct journal_entry *entry = NULL;
+	struct journal_entry *res_realloc = NULL;
+	size_t new_cap;
+
+	if (journal->count == journal->cap) {
+		new_cap = journal->cap ? journal->cap * 2 : SHRT_SIZE;
+		res_realloc = realloc(journal->entries, 
+							  new_cap * sizeof(struct journal_entry));
+		CHECK_POINTER(res_realloc, -ENOMEM);
+
+		journal->entries = res_realloc;
+		journal->cap = new_cap;
+	}
+
+	entry = &journal->entries[journal->count];
+	entry->key = strdup(key);
+	CHECK_POINTER(entry->key, -ENOMEM);
+
+	/* The parent stays alive: it is either in the tree or in a later entry */
+	entry->parent = parent;
+	entry->old_value = json_incref(json_object_get(parent, key));
+	journal->count++;
+
+	return 0;
+}
+
+/**
+ * @brief Sets a key and records its previous value.
+ * 
+ * @param value New value, the reference is stolen.
+ * 
+ * @return 0 on success, negative error code on failure.
+ */
+static int journal_set(struct patch_journal *journal, json_t *parent,
+					   const char *key, json_t *value)
+{
+	CHECK_POINTER(value, -ENOMEM);
+
+	if (record_journal(journal, parent, key)) {
+		json_decref(value);
+		return -ENOMEM;
+	}
+
+	if (json_object_set_new(parent, key, value)) { return -ENOMEM; }
+	return 0;
+}
+
+/**
+ * @brief Deletes a key and records its previous value.
+ * 
+ * @return 0 on success, negative error code on failure.
+ */
+static int journal_del(struct patch_journal *journal, json_t *parent,
+					   const char *key)
+{
+	if (record_journal(journal, parent, key)) { return -ENOMEM; }
+
+	if (json_object_del(parent, key)) { return -ENOENT; }
+	return 0;
+}
+
+/**
+ * @brief Undoes the recorded changes in reverse order.
+ */
+static void undo_journal(struct patch_journal *journal)
+{
+	struct journal_entry *entry = NULL;
+
+	for (size_t i = journal->count; i > 0; i--) {
+		entry = &journal->entries[i - 1];
+		if (entry->old_value) {
+			json_object_set(entry->parent, entry->key, entry->old_value);
+		}
+		else {
+			json_object_del(entry->parent, entry->key);
+		}
+	}
+}
+
+/**
+ * @brief Frees the journal without undoing the changes.
+ */
+static void free_journal(struct patch_journal *journal)
+{
+	for (size_t i = 0; i < journal->count; i++) {
+		json_decref(journal->entries[i].old_value);
+		free(journal->entries[i].key);
+	}
+	free(journal->entries);
+}
+
+/**
+ * @brief Gives the normalized key of an array element.
+ * 
+ * @return New key, NULL on failure.
+ */
+static char *index_key(size_t index)
+{
+	char key[SHRT_SIZE];
+
+	snprintf(key, sizeof(key), "%s%zu", SPECIAL_PREFIX, index);
+	return strdup(key);
+}
+
+/**
+ * @brief Parses an array index of a JSON Pointer.
+ * 
+ * @return 0 on success, -EINVAL if the token is not an index.
+ */
+static int parse_index(const char *token, size_t *index)
+{
+	size_t value = 0;
+
+	if (!*token || (token[0] == '0' && token[1])) { return -EINVAL; }
+
+	for (const char *c = token; *c; c++) {
+		if (*c < '0' || *c > '9') { return -EINVAL; }
+		if (value > (SIZE_MAX - (*c - '0')) / 10) { return -EINVAL; }
+		value = value * 10 + (*c - '0');
+	}
+
+	*index = value;
+	return 0;
+}
+
+/**
+ * @brief Decodes a reference token of a JSON Pointer ("~1" is "/", "~0" is "~").
+ * 
+ * @return New token, NULL on failure.
+ */
+static char *decode_token(const char *begin, size_t len)
+{
+	char *token = NULL;
+	char *pos = NULL;
+
+	token = malloc(len + 1);
+	CHECK_POINTER(token, NULL);
+
+	pos = token;
+	for (size_t i = 0; i < len; i++) {
+		if (begin[i] != '~') {
+			*pos++ = begin[i];
+			continue;
+		}
+
+		if (i + 1 < len && (begin[i + 1] == '0' || begin[i + 1] == '1')) {
+			*pos++ = begin[i + 1] == '0' ? '~' : '/';
+			i++;
+		}
+		else {
+			free(token);
+			return NULL;
+		}
+	}
+	*pos = '\0';
+
+	return token;
+}
+
+/**
+ * @brief Appends a key to a path in the filesystem.
+ * 
+ * @return 0 on success, -ENOMEM on failure.
+ */
+static int append_path(char **path, size_t *len, const char *key)
+{
+	size_t key_len = strlen(key);
+	char *res_realloc = NULL;
+
+	res_realloc = realloc(*path, *len + key_len + 2);
+	CHECK_POINTER(res_realloc, -ENOMEM);
+
+	res_realloc[*len] = '/';
+	memcpy(res_realloc + *len + 1, key, key_len + 1);
+	*path = res_realloc;
+	*len += key_len + 1;
+
+	return 0;
+}
+
+/**
+ * @brief Finds the location of a JSON Pointer in the normalized tree.
+ * 
+ * The last token may refer to a missing key, and "-" refers 
+ * to the position after the last element of an array.
+ * Shared objects on the way are copied, the copies are recorded 
+ * in the journal.
+ * 
+ * @param journal Journal of the patch, NULL if the tree is not changed.
+ * @param path[out] New path of the target in the filesystem, may be NULL.
+ * 
+ * @return 0 on success, -EINVAL for a malformed pointer, 
+ * 		   -ENOENT if a token before the last one does not exist.
+ * 
+ * @note Caller must free() target->key and the path.
+ */
+static int resolve_pointer(struct patch_journal *journal, json_t *root,
+						   const char *pointer, struct patch_target *target,
+						   char **path)
+{
+	const char *begin = NULL;
+	const char *end = NULL;
+	char *token = NULL;
+	json_t *node = root;
+	size_t path_len = 0;
+	size_t len;
+
+	memset(target, 0, sizeof(struct patch_target));
+	target->node = root;
+
+	if (path) { *path = NULL; }
+	if (pointer[0] == '\0') { return 0; }
+	if (pointer[0] != '/') { return -EINVAL; }
+
+	begin = pointer + 1;
+	for (;;) {
+		end = strchr(begin, '/');
+		len = end ? (size_t) (end - begin) : strlen(begin);
+
+		if (!json_is_object(node)) { return -ENOENT; }
+
+		token = decode_token(begin, len);
+		CHECK_POINTER(token, -EINVAL);
+
+		free(target->key);
+		target->parent = node;
+		target->is_array = is_array_like(node) || 
+						   (!json_object_size(node) && strcmp(token, "-") == 0);
+
+		if (target->is_array) {
+			if (strcmp(token, "-") == 0) {
+				target->index = json_object_size(node);
+			}
+			else if (parse_index(token, &target->index)) {
+				free(token);
+				target->key = NULL;
+				return -EINVAL;
+			}
+			target->key = index_key(target->index);
+		}
+		else {
+			target->key = strchr(token, '/') ? replace_slash(token) : strdup(token);
+		}
+		free(token);
+		CHECK_POINTER(target->key, -ENOMEM);
+
+		if (path && append_path(path, &path_len, target->key)) { 
+			return -ENOMEM; 
+		}
+
+		node = json_object_get(node, target->key);
+		target->node = node;
+
+		if (!end) { return 0; }
+		if (!node) { return -ENOENT; }
+
+		/* A shared object is copied before it is changed (copy-on-write) */
+		if (journal && json_is_object(node) && node->refcount > 1) {
+			node = json_copy(node);
+			if (journal_set(journal, target->parent, target->key, node)) {
+				return -ENOMEM;
+			}
+		}
+		begin = end + 1;
+	}
+}
+
+/**
+ * @brief Replaces the content of the root with the keys of a new object.
+ * 
+ * @param value New object, the reference is stolen.
+ */
+static int replace_root(struct patch_journal *journal, json_t *root,
+						json_t *value)
+{
+	const char *key = NULL;
+	json_t *child = NULL;
+	void *tmp = NULL;
+	int res = 0;
+
+	if (!json_is_object(value)) { 
+		json_decref(value);
+		return -EINVAL; 
+	}
+
+	json_object_foreach_safe(root, tmp, key, child) {
+		res = journal_del(journal, root, key);
+		if (res) { goto handle_error; }
+	}
+
+	json_object_foreach(value, key, child) {
+		res = journal_set(journal, root, key, json_incref(child));
+		if (res) { goto handle_error; }
+	}
+
+	handle_error:
+		json_decref(value);
+		return res;
+}
+
+/**
+ * @brief Adds a value at the target, shifting the following array elements.
+ * 
+ * @param value Normalized value, the reference is stolen.
+ */
+static int patch_add(struct patch_journal *journal, json_t *root,
+					 struct patch_target *target, json_t *value)
+{
+	char dst_key[SHRT_SIZE];
+	char src_key[SHRT_SIZE];
+	size_t size;
+	int res;
+
+	if (!target->parent) { return replace_root(journal, root, value); }
+
+	if (target->is_array) {
+		size = json_object_size(target->parent);
+		if (target->index > size) {
+			json_decref(value);
+			return -ENOENT;
+		}
+
+		for (size_t i = size; i > target->index; i--) {
+			snprintf(dst_key, sizeof(dst_key), "%s%zu", SPECIAL_PREFIX, i);
+			snprintf(src_key, sizeof(src_key), "%s%zu", SPECIAL_PREFIX, i - 1);
+			res = journal_set(journal, target->parent, dst_key,
+							  json_incref(json_object_get(target->parent, src_key)));
+			if (res) {
+				json_decref(value);
+				return res;
+			}
+		}
+	}
+
+	return journal_set(journal, target->parent, target->key, value);
+}
+
+/**
+ * @brief Removes the target, shifting the following array elements.
+ */
+static int patch_remove(struct patch_journal *journal,
+						struct patch_target *target)
+{
+	char dst_key[SHRT_SIZE];
+	char src_key[SHRT_SIZE];
+	size_t size;
+	int res;
+
+	if (!target->parent) { return -EINVAL; }
+	if (!target->node) { return -ENOENT; }
+
+	if (!target->is_array) {
+		return journal_del(journal, target->parent, target->key);
+	}
+
+	size = json_object_size(target->parent);
+	for (size_t i = target->index; i + 1 < size; i++) {
+		snprintf(dst_key, sizeof(dst_key), "%s%zu", SPECIAL_PREFIX, i);
+		snprintf(src_key, sizeof(src_key), "%s%zu", SPECIAL_PREFIX, i + 1);
+		res = journal_set(journal, target->parent, dst_key,
+						  json_incref(json_object_get(target->parent, src_key)));
+		if (res) { return res; }
+	}
+
+	snprintf(dst_key, sizeof(dst_key), "%s%zu", SPECIAL_PREFIX, size - 1);
+	return journal_del(journal, target->parent, dst_key);
+}
+
+/**
+ * @brief Applies one operation of a patch.
+ * 
+ * @param message[out] Description of the error.
+ * 
+ * @return 0 on success, negative error code on failure.
+ */
+static int apply_operation(struct patch_journal *journal, json_t *root,
+						   json_t *operation, const char **message)
+{
+	struct patch_target target = { 0 };
+	struct patch_target from_target = { 0 };
+	const char *op = NULL;
+	const char *path = NULL;
+	const char *from = NULL;
+	json_t *value = NULL;
+	json_t *new_value = NULL;
+	int res = 0;
+
+	op = json_string_value(json_object_get(operation, "op"));
+	path = json_string_value(json_object_get(operation, "path"));
+	from = json_string_value(json_object_get(operation, "from"));
+	value = json_object_get(operation, "value");
+
+	if (!json_is_object(operation) || !op || !path) {
+		*message = "operation must have \"op\" and \"path\"";
+		return -EINVAL;
+	}
+
+	if (strcmp(op, "add") == 0 || strcmp(op, "replace") == 0 || 
+		strcmp(op, "test") == 0) {
+		if (!value) {
+			*message = "operation must have \"value\"";
+			return -EINVAL;
+		}
+		new_value = normalize_json(value, 0, NULL);
+		if (!new_value) {
+			*message = "out of memory";
+			return -ENOMEM;
+		}
+	}
+	else if (strcmp(op, "move") == 0 || strcmp(op, "copy") == 0) {
+		if (!from) {
+			*message = "operation must have \"from\"";
+			return -EINVAL;
+		}
+
+		res = resolve_pointer(journal, root, from, &from_target, NULL);
+		if (!res && !from_target.node) { res = -ENOENT; }
+		if (res) {
+			*message = "\"from\" does not exist";
+			goto handle_error;
+		}
+
+		if (strcmp(op, "copy") == 0) {
+			/* The copy is shared until one of the values is changed */
+			new_value = json_incref(from_target.node);
+		}
+		else {
+			size_t from_len = strlen(from);
+
+			/* A value cannot be moved into itself */
+			if (strcmp(from, path) == 0) { goto handle_error; }
+			if (strncmp(from, path, from_len) == 0 && path[from_len] == '/') {
+				*message = "\"path\" is inside \"from\"";
+				res = -EINVAL;
+				goto handle_error;
+			}
+
+			new_value = json_incref(from_target.node);
+			res = patch_remove(journal, &from_target);
+			if (res) {
+				*message = "cannot remove \"from\"";
+				goto handle_error;
+			}
+		}
+	}
+	else if (strcmp(op, "remove") != 0) {
+		*message = "unknown operation";
+		return -EINVAL;
+	}
+
+	res = resolve_pointer(journal, root, path, &target, NULL);
+	if (res) {
+		*message = res == -EINVAL ? "invalid \"path\"" : "\"path\" does not exist";
+		goto handle_error;
+	}
+
+	if (strcmp(op, "remove") == 0) {
+		res = patch_remove(journal, &target);
+		if (res) { *message = "cannot remove \"path\""; }
+	}
+	else if (strcmp(op, "replace") == 0) {
+		if (!target.node) {
+			*message = "\"path\" does not exist";
+			res = -ENOENT;
+			goto handle_error;
+		}
+		res = target.parent ? 
+			  journal_set(journal, target.parent, target.key, new_value) :
+			  replace_root(journal, root, new_value);
+		new_value = NULL;
+		if (res) { *message = "cannot replace \"path\""; }
+	}
+	else if (strcmp(op, "test") == 0) {
+		if (!target.node || !json_equal(target.node, new_value)) {
+			*message = "test failed";
+			res = -ECANCELED;
+		}
+	}
+	else {
+		res = patch_add(journal, root, &target, new_value);
+		new_value = NULL;
+		if (res) { *message = "cannot add to \"path\""; }
+	}
+
+	handle_error:
+		json_decref(new_value);
+		free(target.key);
+		free(from_target.key);
+		return res;
+}
+
+/**
+ * @brief Adds the result of an operation to the report.
+ */
+static void add_result(json_t *results, json_t *operation, const char *status,
+					   const char *message)
+{
+	json_t *result = json_object();
+	if (!result) { return; }
+
+	json_object_set(result, "op", json_object_get(operation, "op"));
+	json_object_set(result, "path", json_object_get(operation, "path"));
+	if (json_object_get(operation, "from")) {
+		json_object_set(result, "from", json_object_get(operation, "from"));
+	}
+	json_object_set_new(result, "status", json_string(status));
+	if (message) {
+		json_object_set_new(result, "error", json_string(message));
+	}
+
+	json_array_append_new(results, result);
+}
+
+int apply_json_patch(json_t *root, const char *text, size_t len,
+					 json_t **report)
+{
+	struct patch_journal journal = { NULL, 0, 0 };
+	json_error_t error;
+	json_t *patch = NULL;
+	json_t *results = NULL;
+	json_t *operation = NULL;
+	const char *message = NULL;
+	size_t index;
+	uint64_t start;
+	int res_apply;
+	int ret = 0;
+
+	CHECK_POINTER(root, -EFAULT);
+	CHECK_POINTER(text, -EFAULT);
+
+	results = json_array();
+	CHECK_POINTER(results, -ENOMEM);
+
+	start = begin_trace_span();
+	patch = json_loadb(text, len, 0, &error);
+	end_trace_span("json_loads", TRACE_JSON, start, "/.patch");
+	count_stats_event(STATS_LOADS);
+	if (!json_is_array(patch)) {
+		message = patch ? "patch must be an array" : error.text;
+		ret = -EINVAL;
+		goto handle_error;
+	}
+
+	json_array_foreach(patch, index, operation) {
+		if (ret < 0) {
+			add_result(results, operation, "skipped", NULL);
+			continue;
+		}
+
+		message = NULL;
+		res_apply = apply_operation(&journal, root, operation, &message);
+		if (res_apply < 0) {
+			add_result(results, operation, "failed", message);
+			ret = res_apply;
+			continue;
+		}
+
+		add_result(results, operation, "ok", NULL);
+		ret++;
+	}
+	message = NULL;
+
+	/* A patch is applied as a whole or not at all */
+	if (ret < 0) { undo_journal(&journal); }
+
+	handle_error:
+		free_journal(&journal);
+		json_decref(patch);
+
+		if (report) {
+			*report = json_object();
+			if (*report) {
+				json_object_set_new(*report, "applied", json_boolean(ret >= 0));
+				if (message) {
+					json_object_set_new(*report, "error", json_string(message));
+				}
+				json_object_set(*report, "operations", results);
+			}
+		}
+		json_decref(results);
+		return ret;
+}
+
+char *json_pointer_to_path(json_t *root, const char *pointer, int *is_array)
+{
+	struct patch_target target;
+	char *path = NULL;
+	int res;
+
+	CHECK_POINTER(root, NULL);
+	CHECK_POINTER(pointer, NULL);
+
+	res = resolve_pointer(NULL, root, pointer, &target, &path);
+	free(target.key);
+	if (res) {
+		free(path);
+		return NULL;
+	}
+
+	if (is_array) { *is_array = target.is_array; }
+	return path ? path : strdup("/");
+}
@@ -29,10 +29,13 @@
 #include <fuse.h>
 #include <unistd.h>
 #include <string.h>
+#include <stddef.h>
 
 #include "common.h"
 #include "file_time.h"
 #include "jsonfs.h"
+#include "ndjson.h"
+#include "binary_json.h"
 
 extern int jsonfs_getattr(const char *path, struct stat *st,
 				          struct fuse_file_info *fi);
@@ -48,12 +51,24 @@ extern int jsonfs_read(const char *path, char *buffer, size_t size,
 				       off_t offset, struct fuse_file_info *fi);
 extern int jsonfs_write(const char *path, const char *buffer, size_t size,
 				        off_t offset, struct fuse_file_info *fi);
+extern int jsonfs_read_buf(const char *path, struct fuse_bufvec **bufp, 
+						   size_t size, off_t offset, struct fuse_file_info *fi);
+extern int jsonfs_write_buf(const char *path, struct fuse_bufvec *buf, 
+							off_t offset, struct fuse_file_info *fi);
+extern int jsonfs_flush(const char *path, struct fuse_file_info *fi);
+extern int jsonfs_release(const char *path, struct fuse_file_info *fi);
+extern int jsonfs_opendir(const char *path, struct fuse_file_info *fi);
 extern int jsonfs_readdir(const char *path, void *buffer, fuse_fill_dir_t filler,
 				          off_t offset, struct fuse_file_info *fi,
 				          enum fuse_readdir_flags flags);
+extern int jsonfs_releasedir(const char *path, struct fuse_file_info *fi);
+extern void *jsonfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg);
 extern void jsonfs_destroy(void *userdata);
 extern int jsonfs_utimens(const char *path, const struct timespec tv[2], 
                           struct fuse_file_info *fi);
+extern int jsonfs_getxattr(const char *path, const char *name, char *value,
+						   size_t size);
+extern int jsonfs_listxattr(const char *path, char *list, size_t size);
 
 struct fuse_operations get_fuse_op(void)
 {
@@ -68,33 +83,97 @@ struct fuse_operations get_fuse_op(void)
 		.open	 = jsonfs_open,
 		.read	 = jsonfs_read,
 		.write	 = jsonfs_write,
+		.read_buf = jsonfs_read_buf,
+		.write_buf = jsonfs_write_buf,
+		.flush	 = jsonfs_flush,
+		.release = jsonfs_release,
+		.opendir = jsonfs_opendir,
 		.readdir = jsonfs_readdir,
+		.releasedir = jsonfs_releasedir,
+		.init	 = jsonfs_init,
 		.destroy = jsonfs_destroy,
-		.utimens = jsonfs_utimens
+		.utimens = jsonfs_utimens,
+		.getxattr = jsonfs_getxattr,
+		.listxattr = jsonfs_listxattr
 	};
 
 	return op;
 }
 
-int get_fuse_args(int argc, char **argv, struct private_args *args)
+/**
+ * @def JSONFS_OPT
+ * @brief Describes an option that sets a field of struct jsonfs_options.
+ */
+#define JSONFS_OPT(TEMPL, FIELD, VALUE) \
+	{ TEMPL, offsetof(struct jsonfs_options, FIELD), VALUE }
+
+static const struct fuse_opt jsonfs_opts[] = {
+	JSONFS_OPT("intern", intern, 1),
+	JSONFS_OPT("no_arena", no_arena, 1),
+	JSONFS_OPT("raw_strings", raw_strings, 1),
+	JSONFS_OPT("trace", trace, 1),
+	JSONFS_OPT("persist_hot", persist_hot, 1),
+	JSONFS_OPT("no_hot", no_hot, 1),
+	JSONFS_OPT("hot_sample=%lu", hot_sample, 0),
+	JSONFS_OPT("record=%s", record_file, 0),
+	JSONFS_OPT("ndjson", ndjson, 1),
+	JSONFS_OPT("reload", reload, 1),
+	JSONFS_OPT("image", image, 1),
+	JSONFS_OPT("format=%s", format, 0),
+	FUSE_OPT_END
+};
+
+int get_fuse_args(int argc, char **argv, int count_documents,
+				  struct private_args *args, struct jsonfs_options *opts)
 {
+	struct fuse_args fuse_args;
+	char **fuse_argv = NULL;
+
 	CHECK_POINTER(argv, -1);
 	CHECK_POINTER(args, -1);
+	CHECK_POINTER(opts, -1);
+	if (count_documents < 1 || count_documents >= argc) { return -1; }
 
-	args->fuse_argc = argc - 1;
-	args->fuse_argv = calloc(args->fuse_argc, sizeof(char *));
-	if (!args->fuse_argv) {
+	fuse_argv = calloc(argc - count_documents, sizeof(char *));
+	if (!fuse_argv) {
 		return -1;
 	}
 
-	args->fuse_argv[0] = argv[0];
-	for (int i = 2; i < argc; i++) {
-		args->fuse_argv[i - 1] = argv[i];
+	fuse_argv[0] = argv[0];
+	for (int i = 1 + count_documents; i < argc; i++) {
+		fuse_argv[i - count_documents] = argv[i];
 	}
 
+	/* On success fuse_opt_parse() always gives a new allocated copy */
+	fuse_args = (struct fuse_args) FUSE_ARGS_INIT(argc - count_documents, 
+												  fuse_argv);
+	memset(opts, 0, sizeof(struct jsonfs_options));
+	if (fuse_opt_parse(&fuse_args, opts, jsonfs_opts, NULL) == -1) {
+		free(fuse_argv);
+		return -1;
+	}
+	free(fuse_argv);
+
+	args->fuse_argc = fuse_args.argc;
+	args->fuse_argv = fuse_args.argv;
+
 	return 0;
 }
 
+void free_fuse_args(struct private_args *args)
+{
+	struct fuse_args fuse_args;
+
+	if (!args || !args->fuse_argv) { return; }
+
+	fuse_args = (struct fuse_args) FUSE_ARGS_INIT(args->fuse_argc, args->fuse_argv);
+	fuse_args.allocated = 1;
+	fuse_opt_free_args(&fuse_args);
+
+	args->fuse_argv = NULL;
+	args->fuse_argc = 0;
+}
+
 struct jsonfs_private_data *init_private_data(json_t *json_root, const char *path)
 {
 	int count_byte;
@@ -128,15 +207,23 @@ struct jsonfs_private_data *init_private_data(json_t *json_root, const char *pat
 	if (!pd->ft) { goto handle_error; }
 
 	pd->mount_time = now;
+
+	/* Versions start from the mount time, so they also grow between mounts */
+	pd->version = (unsigned long long) now * 1000000;
+	pd->ft->version = pd->version;
+	pd->ft->reset_version = pd->version;
 	pd->uid = getuid();
 	pd->gid = getgid();
 	pd->is_saved = 1;
 
+	if (pthread_mutex_init(&pd->lock, NULL)) { goto handle_error; }
+
 	return pd;
 	
 	handle_error:
 		json_decref(pd->root);
 		free(pd->path_to_json_file);
+		if (pd->ft) { free_file_time(pd->ft); }
 		free(pd);
 		return NULL;
 }
@@ -152,7 +239,15 @@ void destroy_private_data(struct jsonfs_private_data *pd)
 		json_decref(pd->root);
 	}
 
+	json_decref(pd->zero);
+	json_decref(pd->file_root);
+
 	free(pd->path_to_json_file);
+	free(pd->patch_report);
+	free(pd->reload_report);
+	free(pd->name);
+	destroy_ndjson_index(pd->ndjson);
+	pthread_mutex_destroy(&pd->lock);
 
 	curr = pd->ft;
 	while(curr) {
@@ -163,3 +258,131 @@ void destroy_private_data(struct jsonfs_private_data *pd)
 
 	free(pd);
 }
+
+int set_file_state(struct jsonfs_private_data *pd, const struct stat *st)
+{
+	json_t *snapshot = NULL;
+
+	CHECK_POINTER(pd, -1);
+	CHECK_POINTER(st, -1);
+
+	pd->file_size = st->st_size;
+	pd->file_mtime = st->st_mtim;
+	if (!pd->opts.reload) { return 0; }
+
+	snapshot = json_copy(pd->root);
+	CHECK_POINTER(snapshot, -1);
+
+	json_decref(pd->file_root);
+	pd->file_root = snapshot;
+	return 0;
+}
+
+/**
+ * @brief Makes the name of a document from its file: the base name
+ * without the .json, .ndjson, .jsonl, .msgpack, .mpk or .cbor extension.
+ * 
+ * @return The name on success, NULL on failure.
+ * 
+ * @note The returned name must be freed with free().
+ */
+static char *get_document_name(const char *path)
+{
+	const char *base = strrchr(path, '/');
+	const char *ext = NULL;
+	size_t len;
+
+	base = base ? base + 1 : path;
+	len = strlen(base);
+
+	ext = strrchr(base, '.');
+	if (ext && (strcmp(ext, ".json") == 0 || is_ndjson_file(base) ||
+				get_binary_format(base) != BINARY_NONE)) { 
+		len = ext - base; 
+	}
+
+	/* A name of a special file or "." would hide it */
+	if (!len || base[0] == '.') { return NULL; }
+
+	return strndup(base, len);
+}
+
+int add_document(struct jsonfs_mount *mount, struct jsonfs_private_data *pd)
+{
+	struct jsonfs_private_data **res_realloc = NULL;
+	char *name = NULL;
+
+	CHECK_POINTER(mount, -1);
+	CHECK_POINTER(pd, -1);
+
+	if (mount->is_multi) {
+		name = get_document_name(pd->path_to_json_file);
+		CHECK_POINTER(name, -1);
+
+		for (size_t i = 0; i < mount->count; i++) {
+			if (strcmp(mount->docs[i]->name, name) == 0) { goto handle_error; }
+		}
+	}
+	else if (mount->count) {
+		return -1;
+	}
+
+	res_realloc = realloc(mount->docs, (mount->count + 1) * 
+						  sizeof(struct jsonfs_private_data *));
+	if (!res_realloc) { goto handle_error; }
+
+	mount->docs = res_realloc;
+	mount->docs[mount->count++] = pd;
+	pd->name = name;
+
+	return 0;
+
+	handle_error:
+		free(name);
+		return -1;
+}
+
+struct jsonfs_private_data *find_document(const struct jsonfs_mount *mount,
+										  const char *path, 
+										  const char **doc_path)
+{
+	const char *rest = NULL;
+	size_t len;
+
+	CHECK_POINTER(mount, NULL);
+	CHECK_POINTER(path, NULL);
+	CHECK_POINTER(doc_path, NULL);
+
+	*doc_path = path;
+	if (!mount->count) { return NULL; }
+	if (!mount->is_multi) { return mount->docs[0]; }
+
+	if (path[0] != '/' || !path[1]) { return NULL; }
+
+	rest = strchr(path + 1, '/');
+	len = rest ? (size_t) (rest - path - 1) : strlen(path + 1);
+
+	for (size_t i = 0; i < mount->count; i++) {
+		if (strncmp(mount->docs[i]->name, path + 1, len) == 0 
+			&& mount->docs[i]->name[len] == '\0') {
+			*doc_path = rest ? rest : "/";
+			return mount->docs[i];
+		}
+	}
+
+	return NULL;
+}
+
+void destroy_mount(struct jsonfs_mount *mount)
+{
+	if (!mount) { return; }
+
+	for (size_t i = 0; i < mount->count; i++) {
+		destroy_private_data(mount->docs[i]);
+	}
+
+	free(mount->docs);
+	free(mount->hot_file);
+	free(mount);
+}
+
@@ -23,6 +23,13 @@
  * @brief Entry point of the JSONFS.
  *
  * Processes command line parameters and calls fuse_main().
+ * The documents are given before the mount point: a JSON file,
+ * several JSON files or a directory, whose *.json files are served.
+ * Files named *.ndjson or *.jsonl are read as JSON Lines, 
+ * *.msgpack or *.mpk as MessagePack and *.cbor as CBOR, 
+ * unless -o format gives the format of all of them.
+ * With -o image a document is built from its binary image 
+ * when the image is current.
  */
 
 #define FUSE_USE_VERSION 	35
@@ -31,51 +38,430 @@
 #include <fuse.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 #include "common.h"
 #include "jsonfs.h"
 #include "json_operations.h"
+#include "handlers.h"
+#include "arena.h"
+#include "stats.h"
+#include "trace.h"
+#include "probes.h"
+#include "record.h"
+#include "hot.h"
+#include "ndjson.h"
+#include "image.h"
+#include "binary_json.h"
 
-int main(int argc, char **argv)
+static int is_directory(const char *path)
+{
+	struct stat st;
+
+	return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/**
+ * @brief Counts the arguments that name the documents.
+ * 
+ * The documents are the regular files before the mount point,
+ * at least the first argument is taken.
+ * 
+ * @return Number of the arguments after argv[0].
+ */
+static int count_document_args(int argc, char **argv)
+{
+	struct stat st;
+	int count = 1;
+
+	/* The last one is at least the mount point */
+	while (count + 1 < argc - 1 && stat(argv[count + 1], &st) == 0 
+		   && S_ISREG(st.st_mode)) {
+		count++;
+	}
+
+	return count;
+}
+
+static void free_file_list(char **files, size_t count)
+{
+	if (!files) { return; }
+
+	for (size_t i = 0; i < count; i++) { free(files[i]); }
+	free(files);
+}
+
+static int select_json_file(const struct dirent *entry)
+{
+	size_t len = strlen(entry->d_name);
+
+	if (entry->d_name[0] == '.') { return 0; }
+
+	return (len > 5 && strcmp(entry->d_name + len - 5, ".json") == 0) 
+		   || is_ndjson_file(entry->d_name) 
+		   || get_binary_format(entry->d_name) != BINARY_NONE;
+}
+
+/**
+ * @brief Lists the JSON, JSON Lines, MessagePack and CBOR files 
+ * of a directory in alphabetical order.
+ * 
+ * @param dir Path to the directory.
+ * @param count[out] Number of the files.
+ * 
+ * @return Array of the paths, NULL on failure or if there are none.
+ * 
+ * @note The result must be freed with free_file_list().
+ */
+static char **list_json_files(const char *dir, size_t *count)
+{
+	struct dirent **entries = NULL;
+	char **files = NULL;
+	char path[PATH_MAX];
+	int count_entries;
+	int count_byte;
+	int i;
+
+	*count = 0;
+
+	count_entries = scandir(dir, &entries, select_json_file, alphasort);
+	if (count_entries <= 0) { 
+		free(entries);
+		return NULL; 
+	}
+
+	files = calloc(count_entries, sizeof(char *));
+	if (!files) { goto handle_error; }
+
+	for (i = 0; i < count_entries; i++) {
+		count_byte = snprintf(path, sizeof(path), "%s/%s", dir, 
+							  entries[i]->d_name);
+		if (count_byte >= sizeof(path)) { goto handle_error; }
+
+		files[i] = strdup(path);
+		if (!files[i]) { goto handle_error; }
+		*count = i + 1;
+	}
+
+	for (i = 0; i < count_entries; i++) { free(entries[i]); }
+	free(entries);
+	return files;
+
+	handle_error:
+		for (i = 0; i < count_entries; i++) { free(entries[i]); }
+		free(entries);
+		free_file_list(files, *count);
+		*count = 0;
+		return NULL;
+}
+
+/**
+ * @brief Loads and normalizes a document.
+ * 
+ * @param json_file Path to the document.
+ * @param format Format of the file.
+ * @param pool Pool of shared scalars, may be NULL.
+ * @param load_ns[in,out] Time of parsing, the time of this document is added.
+ * @param normalize_ns[in,out] Time of normalizing, the time 
+ * 		  of this document is added.
+ * 
+ * @return The document on success, NULL on failure.
+ */
+static struct jsonfs_private_data *load_document(const char *json_file,
+												  enum binary_format format,
+												  struct json_pool *pool,
+												  uint64_t *load_ns,
+												  uint64_t *normalize_ns)
 {
 	json_t *root = NULL;
 	json_t *norm_root = NULL;
 	struct jsonfs_private_data *pd = NULL;
 	json_error_t json_error;
+	uint64_t load_start, normalize_start;
+
+	memset(&json_error, 0, sizeof(json_error));
+
+	load_start = get_stats_time();
+	PROBE1(load__start, json_file);
+	if (format != BINARY_NONE) {
+		root = load_binary_file(json_file, format, &json_error);
+	}
+	else {
+		root = json_load_file(json_file, JSON_DECODE_ANY, &json_error);
+	}
+	PROBE2(load__done, json_file, root ? 0 : -1);
+	end_trace_span("json_loads", TRACE_JSON, load_start, json_file);
+	count_stats_event(STATS_LOADS);
+	if (!root) {
+		fprintf(stderr, "jsonfs: %s: %s\n", json_file, json_error.text);
+		return NULL;
+	}
+
+	normalize_start = get_stats_time();
+	PROBE1(normalize__start, json_file);
+	norm_root = normalize_json(root, 1, pool);
+	PROBE2(normalize__done, json_file, norm_root ? 0 : -1);
+	end_trace_span("normalize_json", TRACE_JSON, normalize_start, json_file);
+	json_decref(root);
+	CHECK_POINTER(norm_root, NULL);
+
+	*load_ns += normalize_start - load_start;
+	*normalize_ns += get_stats_time() - normalize_start;
+
+	pd = init_private_data(norm_root, json_file);
+	if (!pd) { json_decref(norm_root); }
+
+	return pd;
+}
+
+/**
+ * @brief Loads a document from its image, without parsing.
+ * 
+ * The image keeps the sharing of the nodes of the tree it was 
+ * written from, so the pool is not used.
+ * 
+ * @return The document, NULL if there is no current image.
+ * 
+ * @see load_document
+ */
+static struct jsonfs_private_data *load_image_document(const char *json_file,
+														uint64_t *load_ns)
+{
+	json_t *norm_root = NULL;
+	struct jsonfs_private_data *pd = NULL;
+	uint64_t load_start;
+
+	load_start = get_stats_time();
+	norm_root = load_json_image(json_file);
+	end_trace_span("image_loads", TRACE_JSON, load_start, json_file);
+	CHECK_POINTER(norm_root, NULL);
+
+	*load_ns += get_stats_time() - load_start;
+
+	pd = init_private_data(norm_root, json_file);
+	if (!pd) { json_decref(norm_root); }
+
+	return pd;
+}
+
+/**
+ * @brief Loads a JSON Lines document.
+ * 
+ * The lines are parsed and normalized together, 
+ * so all the time is counted as parsing.
+ * 
+ * @see load_document
+ */
+static struct jsonfs_private_data *load_ndjson_document(const char *json_file,
+														 struct json_pool *pool,
+														 uint64_t *load_ns)
+{
+	json_t *norm_root = NULL;
+	struct ndjson_index *index = NULL;
+	struct jsonfs_private_data *pd = NULL;
+	json_error_t json_error;
+	uint64_t load_start;
+
+	load_start = get_stats_time();
+	PROBE1(load__start, json_file);
+	norm_root = load_ndjson_file(json_file, pool, &index, &json_error);
+	PROBE2(load__done, json_file, norm_root ? 0 : -1);
+	end_trace_span("ndjson_loads", TRACE_JSON, load_start, json_file);
+	count_stats_event(STATS_LOADS);
+	if (!norm_root) {
+		fprintf(stderr, "jsonfs: %s: %s\n", json_file, json_error.text);
+		return NULL;
+	}
+
+	*load_ns += get_stats_time() - load_start;
+
+	pd = init_private_data(norm_root, json_file);
+	if (!pd) { 
+		json_decref(norm_root);
+		destroy_ndjson_index(index);
+		return NULL;
+	}
+
+	pd->ndjson = index;
+	index->version = pd->version;
+
+	return pd;
+}
+
+/**
+ * @brief Looks up and measures the paths that were hot at the last unmounting.
+ */
+static void warm_hot_paths(const struct jsonfs_mount *mount)
+{
+	struct jsonfs_private_data *pd = NULL;
+	const char *doc_path = NULL;
+	char **hot_paths = NULL;
+	size_t count_hot = 0;
+
+	/* A missing file is not an error, it is written at unmounting */
+	if (load_hot_paths(mount->hot_file) < 0) { return; }
+
+	hot_paths = get_hot_paths(&count_hot);
+	for (size_t i = 0; i < count_hot; i++) {
+		pd = find_document(mount, hot_paths[i], &doc_path);
+		if (pd) { warm_json_file(doc_path, pd); }
+		free(hot_paths[i]);
+	}
+	free(hot_paths);
+}
+
+int main(int argc, char **argv)
+{
+	json_t *zero = NULL;
+	struct jsonfs_private_data *pd = NULL;
+	struct jsonfs_mount *mount = NULL;
+	struct json_pool *pool = NULL;
 	struct private_args args;
-	const char *json_file = NULL;
-	int ret, res_get_args;
+	struct jsonfs_options opts;
+	struct stat file_st;
+	char **files = NULL;
+	size_t count_files = 0;
+	uint64_t load_ns = 0, normalize_ns = 0;
+	enum binary_format default_format = BINARY_NONE, format;
+	int ret, res_get_args, count_args;
 
 	if (argc < 3) { return EXIT_FAILURE; }
 
-	memset(&json_error, 0, sizeof(json_error));
 	memset(&args, 0, sizeof(args));
+	memset(&opts, 0, sizeof(opts));
 
-	json_file = argv[1];
+	count_args = count_document_args(argc, argv);
 
-	root = json_load_file(json_file, JSON_DECODE_ANY, &json_error);
-	if (!root) { goto handle_error; }
+	res_get_args = get_fuse_args(argc, argv, count_args, &args, &opts);
+	if (res_get_args == -1) { goto handle_error; }
 
-	norm_root = normalize_json(root, 1);
-	if (!norm_root) { goto handle_error; }
-	json_decref(root);
+	if (opts.format && parse_binary_format(opts.format, &default_format) < 0) {
+		fprintf(stderr, "jsonfs: unknown format %s\n", opts.format);
+		goto handle_error;
+	}
 
-	pd = init_private_data(norm_root, json_file);
-	if (!pd) { goto handle_error; }
+	mount = calloc(1, sizeof(struct jsonfs_mount));
+	if (!mount) { goto handle_error; }
 
-	struct fuse_operations op = get_fuse_op();
+	if (is_directory(argv[1])) {
+		files = list_json_files(argv[1], &count_files);
+		if (!files) {
+			fprintf(stderr, "jsonfs: no JSON files in %s\n", argv[1]);
+			goto handle_error;
+		}
+		mount->is_multi = 1;
+		mount->hot_file = realpath(argv[1], NULL);
+		if (!mount->hot_file) { goto handle_error; }
+	}
+	else {
+		files = calloc(count_args, sizeof(char *));
+		if (!files) { goto handle_error; }
+		for (count_files = 0; count_files < count_args; count_files++) {
+			files[count_files] = strdup(argv[count_files + 1]);
+			if (!files[count_files]) { goto handle_error; }
+		}
+		mount->is_multi = count_args > 1;
+	}
 
-	res_get_args = get_fuse_args(argc, argv, &args);
-	if (res_get_args == -1) { goto handle_error; }
+	if (!opts.no_arena && init_json_arena() < 0) { goto handle_error; }
+
+	set_trace_enabled(opts.trace);
+	if (opts.no_hot) { set_hot_sampling(0); }
+	else if (opts.hot_sample) { set_hot_sampling(opts.hot_sample); }
+
+	/* The documents share one pool, so a value is stored once in all of them */
+	if (opts.intern) {
+		pool = create_json_pool();
+		if (!pool) { goto handle_error; }
+	}
+
+	for (size_t i = 0; i < count_files; i++) {
+		/* The attributes are taken before parsing, so a later change is seen */
+		if (stat(files[i], &file_st) < 0) {
+			fprintf(stderr, "jsonfs: %s: %s\n", files[i], strerror(errno));
+			goto handle_error;
+		}
+
+		format = opts.format ? default_format : get_binary_format(files[i]);
+
+		if (format == BINARY_NONE && (opts.ndjson || is_ndjson_file(files[i]))) {
+			pd = load_ndjson_document(files[i], pool, &load_ns);
+		}
+		else {
+			if (opts.image) { pd = load_image_document(files[i], &load_ns); }
+			if (!pd) {
+				pd = load_document(files[i], format, pool, &load_ns, 
+								   &normalize_ns);
+
+				/* The next mount starts from the image */
+				if (pd && opts.image) { 
+					save_json_image(pd->root, files[i], &file_st); 
+				}
+			}
+		}
+		if (!pd) { goto handle_error; }
+
+		pd->opts = opts;
+		pd->binary_format = format;
+		if (set_file_state(pd, &file_st) < 0 || add_document(mount, pd) < 0) {
+			fprintf(stderr, "jsonfs: %s: the name is taken or invalid\n", 
+					files[i]);
+			goto handle_error;
+		}
+		pd = NULL;
+	}
+	free_file_list(files, count_files);
+	files = NULL;
+
+	set_stats_load_time(load_ns, normalize_ns);
+
+	if (!mount->hot_file) {
+		mount->hot_file = strdup(mount->docs[0]->path_to_json_file);
+		if (!mount->hot_file) { goto handle_error; }
+	}
+
+	if (pool) {
+		fprintf(stderr, "jsonfs: intern: %zu of %zu scalars and %zu objects "
+				"shared, ~%zu bytes saved by the scalars\n", pool->count_shared, 
+				pool->count_scalars, pool->count_objects, pool->saved_bytes);
+
+		zero = json_integer(0);
+		for (size_t i = 0; zero && i < mount->count; i++) {
+			mount->docs[i]->zero = intern_json_scalar(zero, pool);
+		}
+		json_decref(zero);
+
+		destroy_json_pool(pool);
+		pool = NULL;
+	}
+
+	if (opts.persist_hot) { warm_hot_paths(mount); }
+
+	if (opts.record_file && start_recording(opts.record_file) < 0) {
+		fprintf(stderr, "jsonfs: failed to open %s for recording\n", 
+				opts.record_file);
+		goto handle_error;
+	}
+
+	struct fuse_operations op = get_fuse_op();
 
-	ret = fuse_main(args.fuse_argc, args.fuse_argv, &op, pd);
-	free(args.fuse_argv);
+	ret = fuse_main(args.fuse_argc, args.fuse_argv, &op, mount);
+	free_fuse_args(&args);
+	free(opts.record_file);
+	free(opts.format);
 	return ret;
 
 	handle_error:
 		if (pd) destroy_private_data(pd);
-		if (root) json_decref(root);
-		if (norm_root) json_decref(norm_root);
+		destroy_mount(mount);
+		destroy_json_pool(pool);
+		free_file_list(files, count_files);
+		free_fuse_args(&args);
+		free(opts.record_file);
+		free(opts.format);
 		fputs("jsonfs: failed to initialize filesystem\n", stderr);
 		return EXIT_FAILURE;
 }
@@ -0,0 +1,1013 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file 
+ * @brief Contains definition of loading and saving JSON Lines documents.
+ * 
+ * Function declarations, types and specifications can be found in ndjson.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <jansson.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "jsonfs.h"
+#include "file_time.h"
+#include "json_operations.h"
+#include "ndjson.h"
+
+/**
+ * @def WRITER_BUFFER
+ * @brief Size of the buffer of struct line_writer.
+ */
+#define WRITER_BUFFER	(64 * 1024)
+
+/**
+ * @struct parse_task
+ * @brief Lines parsed by one thread.
+ */
+struct parse_task {
+	const char *data;					/**< Text of the file */
+	const struct ndjson_line *lines;	/**< Lines of the file */
+	json_t **values;					/**< Parsed values, by line */
+	size_t begin;						/**< First line of the task */
+	size_t end;							/**< Line after the last one */
+	int is_normalize;					/**< 1 if the values are normalized too */
+	size_t error_line;					/**< Line that failed, SIZE_MAX if none */
+	json_error_t error;					/**< Error of error_line */
+};
+
+/**
+ * @struct ndjson_entry
+ * @brief Element of the document as it is written.
+ */
+struct ndjson_entry {
+	size_t key;							/**< Index of the element, SIZE_MAX if it has none */
+	json_t *node;						/**< Normalized element */
+	const struct ndjson_line *line;		/**< Line of the element in the file, NULL if none */
+	int is_changed;						/**< 1 if the element got a new version */
+	char *text;							/**< New line, NULL if not made yet */
+	size_t len;							/**< Length of the new line */
+	off_t new_offset;					/**< Offset of the line after saving */
+	size_t new_len;						/**< Length of the line after saving */
+};
+
+/**
+ * @struct line_writer
+ * @brief Buffered writing of lines to a file.
+ */
+struct line_writer {
+	int fd;						/**< File to write */
+	off_t offset;				/**< Offset of the next byte */
+	size_t len;					/**< Bytes in the buffer */
+	char buf[WRITER_BUFFER];	/**< Bytes not written yet */
+};
+
+int is_ndjson_file(const char *path)
+{
+	const char *ext = NULL;
+
+	CHECK_POINTER(path, 0);
+
+	ext = strrchr(path, '.');
+	if (!ext || strchr(ext, '/')) { return 0; }
+
+	return strcmp(ext, ".ndjson") == 0 || strcmp(ext, ".jsonl") == 0;
+}
+
+/* ================================= */
+/*              Loading              */
+/* ================================= */
+
+static int is_blank_line(const char *line, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		if (line[i] != ' ' && line[i] != '\t' && line[i] != '\r') { return 0; }
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Finds the non-empty lines of a text.
+ * 
+ * @param count[out] Number of the lines.
+ * 
+ * @return Lines keyed by their order on success, NULL on failure.
+ */
+static struct ndjson_line *find_lines(const char *data, size_t size, 
+									  size_t *count)
+{
+	struct ndjson_line *lines = NULL;
+	struct ndjson_line *res_realloc = NULL;
+	const char *begin = data;
+	const char *end = data + size;
+	const char *eol = NULL;
+	size_t cap = 0;
+	size_t len;
+
+	*count = 0;
+
+	while (begin < end) {
+		eol = memchr(begin, '\n', end - begin);
+		len = eol ? (size_t) (eol - begin) : (size_t) (end - begin);
+
+		if (!is_blank_line(begin, len)) {
+			if (*count == cap) {
+				cap = cap ? cap * 2 : SHRT_SIZE;
+				res_realloc = realloc(lines, cap * sizeof(struct ndjson_line));
+				if (!res_realloc) {
+					free(lines);
+					return NULL;
+				}
+				lines = res_realloc;
+			}
+
+			lines[*count].key = *count;
+			lines[*count].offset = begin - data;
+			lines[*count].len = len;
+			(*count)++;
+		}
+
+		begin += len + 1;
+	}
+
+	/* An empty file has no lines, but it is not an error */
+	if (!lines) { lines = malloc(sizeof(struct ndjson_line)); }
+
+	return lines;
+}
+
+static void *parse_lines(void *arg)
+{
+	struct parse_task *task = arg;
+	const struct ndjson_line *line = NULL;
+	json_t *value = NULL;
+	json_t *norm_value = NULL;
+	size_t i;
+
+	for (i = task->begin; i < task->end; i++) {
+		line = &task->lines[i];
+
+		value = json_loadb(task->data + line->offset, line->len, 
+						   JSON_DECODE_ANY, &task->error);
+		if (!value) { goto handle_error; }
+
+		/* Scalars of elements are the same in both trees */
+		if (task->is_normalize && (json_is_object(value) || json_is_array(value))) {
+			norm_value = normalize_json(value, 0, NULL);
+			json_decref(value);
+			value = norm_value;
+			if (!value) {
+				snprintf(task->error.text, sizeof(task->error.text), 
+						 "out of memory");
+				goto handle_error;
+			}
+		}
+
+		task->values[i] = value;
+	}
+
+	return NULL;
+
+	handle_error:
+		task->error_line = i;
+		return NULL;
+}
+
+/**
+ * @brief Gives the number of threads for parsing the lines.
+ */
+static size_t count_parse_threads(size_t count_lines)
+{
+	long count_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t count_threads = count_lines / NDJSON_MIN_LINES;
+
+	if (count_cpus > 0 && count_threads > (size_t) count_cpus) { 
+		count_threads = count_cpus; 
+	}
+	if (count_threads > NDJSON_MAX_THREADS) { 
+		count_threads = NDJSON_MAX_THREADS; 
+	}
+
+	return count_threads ? count_threads : 1;
+}
+
+/**
+ * @brief Parses the lines, by several threads if there are many of them.
+ * 
+ * @param error[out] Error of the first line that failed.
+ * 
+ * @return Index of the first line that failed, SIZE_MAX on success.
+ */
+static size_t parse_all_lines(const char *data, const struct ndjson_line *lines, 
+							  size_t count, json_t **values, int is_normalize,
+							  json_error_t *error)
+{
+	struct parse_task tasks[NDJSON_MAX_THREADS];
+	pthread_t threads[NDJSON_MAX_THREADS];
+	int is_started[NDJSON_MAX_THREADS];
+	size_t count_threads = count_parse_threads(count);
+	size_t error_line = SIZE_MAX;
+	size_t i;
+
+	for (i = 0; i < count_threads; i++) {
+		tasks[i] = (struct parse_task) { 
+			.data = data, .lines = lines, .values = values,
+			.begin = count * i / count_threads,
+			.end = count * (i + 1) / count_threads,
+			.is_normalize = is_normalize, .error_line = SIZE_MAX 
+		};
+	}
+
+	/* The first part is parsed by this thread, as is a part without a thread */
+	for (i = 1; i < count_threads; i++) {
+		is_started[i] = !pthread_create(&threads[i], NULL, 
+										parse_lines, &tasks[i]);
+	}
+	parse_lines(&tasks[0]);
+
+	for (i = 1; i < count_threads; i++) {
+		if (is_started[i]) { pthread_join(threads[i], NULL); } 
+		else { parse_lines(&tasks[i]); }
+	}
+
+	for (i = 0; i < count_threads; i++) {
+		if (tasks[i].error_line != SIZE_MAX) {
+			error_line = tasks[i].error_line;
+			*error = tasks[i].error;
+			break;
+		}
+	}
+
+	return error_line;
+}
+
+/**
+ * @brief Puts the line of the file before an error of jansson.
+ */
+static void set_line_error(json_error_t *error, const char *data, off_t offset)
+{
+	char message[sizeof(error->text)];
+	size_t line = 1;
+	int count_byte;
+
+	for (const char *pos = data; pos < data + offset; pos++) {
+		if (*pos == '\n') { line++; }
+	}
+
+	count_byte = snprintf(message, sizeof(message), "line %zu: ", line);
+	snprintf(message + count_byte, sizeof(message) - count_byte, "%s", 
+			 error->text);
+	memcpy(error->text, message, sizeof(message));
+	error->line = (int) line;
+	error->position = (int) offset;
+}
+
+/**
+ * @brief Builds the normalized root of the parsed lines.
+ * 
+ * The values are taken by the root or released.
+ */
+static json_t *make_ndjson_root(json_t **values, size_t count, 
+								struct json_pool *pool)
+{
+	json_t *root = NULL;
+	json_t *value = NULL;
+	char key[SHRT_SIZE];
+	size_t i;
+
+	root = json_object();
+	if (!root) { goto handle_error; }
+
+	for (i = 0; i < count; i++) {
+		value = values[i];
+		if (pool) {
+			value = normalize_json(values[i], 0, pool);
+			json_decref(values[i]);
+		}
+		values[i] = NULL;
+		if (!value) { goto handle_error; }
+
+		snprintf(key, sizeof(key), "%s%zu", SPECIAL_PREFIX, i);
+		if (json_object_set_new_nocheck(root, key, value)) { goto handle_error; }
+	}
+
+	return root;
+
+	handle_error:
+		for (; i < count; i++) { json_decref(values[i]); }
+		json_decref(root);
+		return NULL;
+}
+
+json_t *load_ndjson_file(const char *path, struct json_pool *pool,
+						 struct ndjson_index **index, json_error_t *error)
+{
+	struct ndjson_index *new_index = NULL;
+	struct ndjson_line *lines = NULL;
+	json_t **values = NULL;
+	json_t *root = NULL;
+	char *data = NULL;
+	struct stat st;
+	size_t count = 0;
+	size_t error_line;
+	int fd = -1;
+
+	CHECK_POINTER(path, NULL);
+	CHECK_POINTER(index, NULL);
+	CHECK_POINTER(error, NULL);
+
+	memset(error, 0, sizeof(json_error_t));
+	snprintf(error->source, sizeof(error->source), "%s", path);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) { goto handle_os_error; }
+
+	if (st.st_size) {
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			data = NULL;
+			goto handle_os_error;
+		}
+		madvise(data, st.st_size, MADV_SEQUENTIAL);
+	}
+
+	lines = find_lines(data, st.st_size, &count);
+	if (!lines) { goto handle_os_error; }
+
+	values = calloc(count ? count : 1, sizeof(json_t *));
+	if (!values) { goto handle_os_error; }
+
+	error_line = parse_all_lines(data, lines, count, values, !pool, error);
+	if (error_line != SIZE_MAX) {
+		set_line_error(error, data, lines[error_line].offset);
+		goto handle_error;
+	}
+
+	root = make_ndjson_root(values, count, pool);
+	if (!root) { goto handle_os_error; }
+
+	new_index = calloc(1, sizeof(struct ndjson_index));
+	if (!new_index) { goto handle_os_error; }
+
+	new_index->lines = lines;
+	new_index->count = count;
+	new_index->count_file_lines = count;
+	new_index->file_size = st.st_size;
+	new_index->file_mtime = st.st_mtim;
+	new_index->has_final_newline = !st.st_size || data[st.st_size - 1] == '\n';
+	*index = new_index;
+
+	free(values);
+	if (data) { munmap(data, st.st_size); }
+	close(fd);
+	return root;
+
+	handle_os_error:
+		snprintf(error->text, sizeof(error->text), "%s", 
+				 errno ? strerror(errno) : "out of memory");
+	handle_error:
+		if (values) {
+			for (size_t i = 0; i < count; i++) { json_decref(values[i]); }
+		}
+		free(values);
+		free(lines);
+		json_decref(root);
+		if (data) { munmap(data, st.st_size); }
+		if (fd >= 0) { close(fd); }
+		return NULL;
+}
+
+/* ================================= */
+/*               Saving              */
+/* ================================= */
+
+static int compare_lines(const void *a, const void *b)
+{
+	const struct ndjson_line *line_a = a;
+	const struct ndjson_line *line_b = b;
+
+	return (line_a->key > line_b->key) - (line_a->key < line_b->key);
+}
+
+static int compare_keys(const void *a, const void *b)
+{
+	size_t key_a = *(const size_t *) a;
+	size_t key_b = *(const size_t *) b;
+
+	return (key_a > key_b) - (key_a < key_b);
+}
+
+/**
+ * @brief Gives the index of an element by its key.
+ * 
+ * @param key Key of the element, may be followed by a slash and a path.
+ * @param index[out] Index of the element.
+ * 
+ * @return 0 on success, -1 if the key is not an index of an element.
+ */
+static int get_element_key(const char *key, size_t *index)
+{
+	size_t prefix_len = strlen(SPECIAL_PREFIX);
+	unsigned long long value;
+	char *end = NULL;
+
+	if (strncmp(key, SPECIAL_PREFIX, prefix_len) != 0) { return -1; }
+	key += prefix_len;
+
+	/* Only the keys given by normalize_json(), "@01" is another key */
+	if (*key < '0' || *key > '9' || (key[0] == '0' && key[1] >= '0' 
+		&& key[1] <= '9')) {
+		return -1;
+	}
+
+	errno = 0;
+	value = strtoull(key, &end, 10);
+	if (errno || (*end && *end != '/') || value >= SIZE_MAX) { return -1; }
+
+	*index = (size_t) value;
+	return 0;
+}
+
+static const struct ndjson_line *find_line(const struct ndjson_index *index,
+										   size_t key)
+{
+	struct ndjson_line wanted = { .key = key };
+
+	return bsearch(&wanted, index->lines, index->count, 
+				   sizeof(struct ndjson_line), compare_lines);
+}
+
+/**
+ * @brief Gives the elements changed after a version.
+ * 
+ * The list of file times is walked once, an element is changed 
+ * if a path in it has got a newer version.
+ * 
+ * @param count[out] Number of the keys.
+ * 
+ * @return Sorted keys on success, NULL on failure.
+ */
+static size_t *get_changed_keys(struct file_time *ft, 
+								unsigned long long version, size_t *count)
+{
+	size_t *keys = NULL;
+	size_t *res_realloc = NULL;
+	size_t cap = 0;
+	size_t key;
+
+	*count = 0;
+
+	for (; ft; ft = ft->next_node) {
+		if (ft->version <= version || ft->path[0] != '/' 
+			|| get_element_key(ft->path + 1, &key) < 0) {
+			continue;
+		}
+
+		if (*count == cap) {
+			cap = cap ? cap * 2 : SHRT_SIZE;
+			res_realloc = realloc(keys, cap * sizeof(size_t));
+			if (!res_realloc) {
+				free(keys);
+				return NULL;
+			}
+			keys = res_realloc;
+		}
+		keys[(*count)++] = key;
+	}
+
+	if (!keys) { return malloc(sizeof(size_t)); }
+
+	qsort(keys, *count, sizeof(size_t), compare_keys);
+	return keys;
+}
+
+/**
+ * @brief Checks if the root is written as lines, as an array is.
+ * 
+ * @see denormalize_json
+ */
+static int is_lines_root(json_t *root)
+{
+	const char *key = NULL;
+	json_t *value = NULL;
+
+	if (json_object_get(root, SCALAR_NAME) && json_object_size(root) == 1) {
+		return 0;
+	}
+
+	json_object_foreach(root, key, value) {
+		if (strncmp(key, SPECIAL_PREFIX, strlen(SPECIAL_PREFIX)) == 0 
+			&& !strstr(key, SPECIAL_SLASH)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Lists the elements in the order denormalize_json() gives them.
+ * 
+ * A root that is not an array is the only entry.
+ * 
+ * @param count[out] Number of the entries.
+ * 
+ * @return The entries on success, NULL on failure.
+ */
+static struct ndjson_entry *get_entries(json_t *root, size_t *count)
+{
+	struct ndjson_entry *entries = NULL;
+	const char *key = NULL;
+	json_t *value = NULL;
+	char elem_key[SHRT_SIZE];
+	size_t size = json_object_size(root);
+	size_t i = 0;
+
+	*count = 0;
+
+	entries = calloc(size ? size : 1, sizeof(struct ndjson_entry));
+	CHECK_POINTER(entries, NULL);
+
+	if (!size) { return entries; }
+
+	if (!is_lines_root(root)) {
+		entries[0].key = SIZE_MAX;
+		entries[0].node = root;
+		*count = 1;
+		return entries;
+	}
+
+	if (is_normal_array(root)) {
+		for (i = 0; i < size; i++) {
+			snprintf(elem_key, sizeof(elem_key), "%s%zu", SPECIAL_PREFIX, i);
+			entries[i].key = i;
+			entries[i].node = json_object_get(root, elem_key);
+		}
+	}
+	else {
+		json_object_foreach(root, key, value) {
+			if (get_element_key(key, &entries[i].key) < 0) { 
+				entries[i].key = SIZE_MAX; 
+			}
+			entries[i].node = value;
+			i++;
+		}
+	}
+
+	*count = size;
+	return entries;
+}
+
+static int make_entry_text(struct ndjson_entry *entry)
+{
+	if (entry->text) { return 0; }
+
+	entry->text = export_json_line(entry->node, &entry->len);
+	return entry->text ? 0 : -1;
+}
+
+static int flush_writer(struct line_writer *w)
+{
+	if (write_all(w->fd, w->buf, w->len) < 0) { return -1; }
+
+	w->len = 0;
+	return 0;
+}
+
+static int put_bytes(struct line_writer *w, const char *data, size_t len)
+{
+	if (w->len + len > sizeof(w->buf) && flush_writer(w) < 0) { return -1; }
+
+	if (len > sizeof(w->buf)) {
+		if (write_all(w->fd, data, len) < 0) { return -1; }
+	}
+	else {
+		memcpy(w->buf + w->len, data, len);
+		w->len += len;
+	}
+
+	w->offset += len;
+	return 0;
+}
+
+static int put_line(struct line_writer *w, struct ndjson_entry *entry)
+{
+	if (make_entry_text(entry) < 0) { return -1; }
+
+	entry->new_offset = w->offset;
+	entry->new_len = entry->len;
+
+	if (put_bytes(w, entry->text, entry->len) < 0) { return -1; }
+	if (put_bytes(w, "\n", 1) < 0) { return -1; }
+
+	free(entry->text);
+	entry->text = NULL;
+	return 0;
+}
+
+/**
+ * @brief Copies bytes of the old file, by the kernel if it can.
+ */
+static int copy_bytes(struct line_writer *w, int src_fd, off_t offset, 
+					  size_t len)
+{
+	ssize_t res_copy;
+	ssize_t res_read;
+	int is_kernel = 1;
+
+	if (flush_writer(w) < 0) { return -1; }
+
+	while (len) {
+		if (is_kernel) {
+			res_copy = copy_file_range(src_fd, &offset, w->fd, NULL, len, 0);
+			if (res_copy > 0) {
+				len -= res_copy;
+				w->offset += res_copy;
+				continue;
+			}
+			if (res_copy < 0 && errno == EINTR) { continue; }
+
+			/* Another filesystem or an old kernel, the rest is copied here */
+			is_kernel = 0;
+		}
+
+		res_read = pread(src_fd, w->buf, len < sizeof(w->buf) ? len : 
+						 sizeof(w->buf), offset);
+		if (res_read < 0 && errno == EINTR) { continue; }
+		if (res_read <= 0) { return -1; }
+
+		if (write_all(w->fd, w->buf, res_read) < 0) { return -1; }
+		offset += res_read;
+		len -= res_read;
+		w->offset += res_read;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Checks if the file keeps its lines and only gets new ones.
+ * @return 1 if it does, 0 otherwise.
+ */
+static int is_append_only(const struct ndjson_index *index, 
+						  const struct ndjson_entry *entries, size_t count)
+{
+	if (count < index->count_file_lines) { return 0; }
+
+	for (size_t i = 0; i < index->count_file_lines; i++) {
+		if (!entries[i].line || entries[i].is_changed) { return 0; }
+		if (i && entries[i].line->offset <= entries[i - 1].line->offset) { 
+			return 0; 
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Checks if the changed lines can be overwritten in place.
+ * 
+ * The file must keep its lines in their order, 
+ * and the changed lines must keep their lengths.
+ * 
+ * @return 1 if they can, 0 if not, -1 on failure.
+ */
+static int is_overwrite(const struct ndjson_index *index, 
+						struct ndjson_entry *entries, size_t count)
+{
+	if (count != index->count_file_lines) { return 0; }
+
+	for (size_t i = 0; i < count; i++) {
+		if (!entries[i].line) { return 0; }
+		if (i && entries[i].line->offset <= entries[i - 1].line->offset) { 
+			return 0; 
+		}
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		if (!entries[i].is_changed) { continue; }
+
+		if (make_entry_text(&entries[i]) < 0) { return -1; }
+		if (entries[i].len != entries[i].line->len) { return 0; }
+	}
+
+	return 1;
+}
+
+static void keep_old_lines(struct ndjson_entry *entries, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		entries[i].new_offset = entries[i].line->offset;
+		entries[i].new_len = entries[i].line->len;
+	}
+}
+
+static int append_lines(const char *path, const struct ndjson_index *index,
+						struct ndjson_entry *entries, size_t count)
+{
+	struct line_writer *w = NULL;
+	size_t i = index->count_file_lines;
+	int res_append = -1;
+
+	keep_old_lines(entries, i);
+	if (i == count) { return 0; }
+
+	w = malloc(sizeof(struct line_writer));
+	CHECK_POINTER(w, -1);
+
+	w->fd = open(path, O_WRONLY | O_APPEND);
+	w->offset = index->file_size;
+	w->len = 0;
+	if (w->fd < 0) { goto handle_error; }
+
+	if (!index->has_final_newline && put_bytes(w, "\n", 1) < 0) { 
+		goto handle_error; 
+	}
+
+	for (; i < count; i++) {
+		if (put_line(w, &entries[i]) < 0) { goto handle_error; }
+	}
+	res_append = flush_writer(w);
+
+	handle_error:
+		if (w->fd >= 0 && close(w->fd) < 0) { res_append = -1; }
+		free(w);
+		return res_append;
+}
+
+static int overwrite_lines(const char *path, struct ndjson_entry *entries, 
+						   size_t count)
+{
+	struct ndjson_entry *entry = NULL;
+	ssize_t res_write;
+	size_t done;
+	int fd;
+
+	keep_old_lines(entries, count);
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0) { return -1; }
+
+	for (size_t i = 0; i < count; i++) {
+		entry = &entries[i];
+		if (!entry->is_changed) { continue; }
+
+		for (done = 0; done < entry->len; done += res_write) {
+			res_write = pwrite(fd, entry->text + done, entry->len - done, 
+							   entry->line->offset + done);
+			if (res_write < 0 && errno == EINTR) { res_write = 0; }
+			else if (res_write <= 0) { 
+				close(fd);
+				return -1; 
+			}
+		}
+	}
+
+	return close(fd);
+}
+
+/**
+ * @brief Writes the document to a new file, which replaces the old one.
+ * 
+ * Runs of unchanged lines that follow each other in the old file
+ * are copied at once.
+ * 
+ * @param is_copy 1 if the unchanged lines are copied from the old file.
+ * @param mode Permissions of the new file.
+ */
+static int rewrite_lines(const char *path, struct ndjson_entry *entries,
+						 size_t count, int is_copy, mode_t mode)
+{
+	struct line_writer *w = NULL;
+	const struct ndjson_line *first = NULL;
+	const struct ndjson_line *last = NULL;
+	char tmp_path[PATH_MAX];
+	off_t new_start;
+	int src_fd = -1;
+	int count_byte;
+	size_t i, j;
+
+	count_byte = snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+	if (count_byte >= sizeof(tmp_path)) { return -1; }
+
+	w = malloc(sizeof(struct line_writer));
+	CHECK_POINTER(w, -1);
+
+	w->offset = 0;
+	w->len = 0;
+	w->fd = mkstemp(tmp_path);
+	if (w->fd < 0) { 
+		free(w);
+		return -1; 
+	}
+
+	if (is_copy) {
+		src_fd = open(path, O_RDONLY);
+		if (src_fd < 0) { goto handle_error; }
+	}
+
+	for (i = 0; i < count; i = j + 1) {
+		j = i;
+		if (!entries[i].line || entries[i].is_changed) {
+			if (put_line(w, &entries[i]) < 0) { goto handle_error; }
+			continue;
+		}
+
+		first = last = entries[i].line;
+		while (j + 1 < count && entries[j + 1].line && !entries[j + 1].is_changed
+			   && entries[j + 1].line->offset == last->offset + 
+			   (off_t) last->len + 1) {
+			last = entries[++j].line;
+		}
+
+		new_start = w->offset;
+		for (size_t k = i; k <= j; k++) {
+			entries[k].new_offset = new_start + 
+									(entries[k].line->offset - first->offset);
+			entries[k].new_len = entries[k].line->len;
+		}
+
+		if (copy_bytes(w, src_fd, first->offset, last->offset + last->len - 
+					   first->offset) < 0) {
+			goto handle_error;
+		}
+		if (put_bytes(w, "\n", 1) < 0) { goto handle_error; }
+	}
+
+	if (flush_writer(w) < 0) { goto handle_error; }
+	if (fchmod(w->fd, mode) < 0) { 
+		goto handle_error; 
+	}
+	if (close(w->fd) < 0) {
+		w->fd = -1;
+		goto handle_error;
+	}
+	w->fd = -1;
+
+	if (rename(tmp_path, path) < 0) { goto handle_error; }
+
+	if (src_fd >= 0) { close(src_fd); }
+	free(w);
+	return 0;
+
+	handle_error:
+		if (w->fd >= 0) { close(w->fd); }
+		if (src_fd >= 0) { close(src_fd); }
+		unlink(tmp_path);
+		free(w);
+		return -1;
+}
+
+/**
+ * @brief Makes the index of the saved file.
+ * 
+ * If it fails, the index is left unusable, so the next saving 
+ * writes all the lines.
+ */
+static void update_index(struct jsonfs_private_data *pd, 
+						 const struct ndjson_entry *entries, size_t count,
+						 int has_final_newline)
+{
+	struct ndjson_index *index = pd->ndjson;
+	struct ndjson_line *lines = NULL;
+	struct stat st;
+	size_t count_lines = 0;
+
+	index->file_size = -1;
+
+	lines = malloc((count ? count : 1) * sizeof(struct ndjson_line));
+	if (!lines) { return; }
+
+	for (size_t i = 0; i < count; i++) {
+		if (entries[i].key == SIZE_MAX) { continue; }
+
+		lines[count_lines].key = entries[i].key;
+		lines[count_lines].offset = entries[i].new_offset;
+		lines[count_lines].len = entries[i].new_len;
+		count_lines++;
+	}
+	qsort(lines, count_lines, sizeof(struct ndjson_line), compare_lines);
+
+	free(index->lines);
+	index->lines = lines;
+	index->count = count_lines;
+	index->count_file_lines = count;
+	index->has_final_newline = has_final_newline;
+	index->version = pd->version;
+
+	if (stat(pd->path_to_json_file, &st) == 0) {
+		index->file_size = st.st_size;
+		index->file_mtime = st.st_mtim;
+	}
+}
+
+int save_ndjson_file(struct jsonfs_private_data *pd)
+{
+	struct ndjson_index *index = NULL;
+	struct ndjson_entry *entries = NULL;
+	size_t *changed_keys = NULL;
+	size_t count = 0, count_changed = 0;
+	const char *path = NULL;
+	struct stat st;
+	int is_valid = 0, is_old_file;
+	int res_save = -1;
+	int res_overwrite;
+
+	CHECK_POINTER(pd, -1);
+	CHECK_POINTER(pd->ndjson, -1);
+
+	index = pd->ndjson;
+	path = pd->path_to_json_file;
+
+	entries = get_entries(pd->root, &count);
+	CHECK_POINTER(entries, -1);
+
+	/* The lines are reused only from the file the index was made of */
+	is_old_file = stat(path, &st) == 0;
+	if (is_old_file && st.st_size == index->file_size 
+		&& st.st_mtim.tv_sec == index->file_mtime.tv_sec 
+		&& st.st_mtim.tv_nsec == index->file_mtime.tv_nsec
+		&& pd->ft->reset_version <= index->version) {
+		changed_keys = get_changed_keys(pd->ft, index->version, &count_changed);
+		is_valid = changed_keys != NULL;
+	}
+
+	for (size_t i = 0; is_valid && i < count; i++) {
+		if (entries[i].key == SIZE_MAX) { continue; }
+
+		entries[i].line = find_line(index, entries[i].key);
+		entries[i].is_changed = bsearch(&entries[i].key, changed_keys, 
+										count_changed, sizeof(size_t), 
+										compare_keys) != NULL;
+	}
+
+	if (is_valid && is_append_only(index, entries, count)) {
+		res_save = append_lines(path, index, entries, count);
+		if (!res_save) { 
+			update_index(pd, entries, count, count > index->count_file_lines 
+						 || index->has_final_newline); 
+		}
+		goto finish;
+	}
+
+	res_overwrite = is_valid ? is_overwrite(index, entries, count) : 0;
+	if (res_overwrite < 0) { goto finish; }
+
+	if (res_overwrite) {
+		res_save = overwrite_lines(path, entries, count);
+		if (!res_save) { 
+			update_index(pd, entries, count, index->has_final_newline); 
+		}
+	}
+	else {
+		res_save = rewrite_lines(path, entries, count, is_valid, 
+								 is_old_file ? st.st_mode & 07777 : 0644);
+		if (!res_save) { update_index(pd, entries, count, 1); }
+	}
+
+	finish:
+		for (size_t i = 0; i < count; i++) { free(entries[i].text); }
+		free(entries);
+		free(changed_keys);
+		return res_save;
+}
+
+void destroy_ndjson_index(struct ndjson_index *index)
+{
+	if (!index) { return; }
+
+	free(index->lines);
+	free(index);
+}
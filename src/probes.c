@@ -0,0 +1,50 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file 
+ * @brief Contains the semaphores of the USDT probes.
+ * 
+ * Probe declarations can be found in probes.h.
+ */
+
+#include "probes.h"
+
+#ifdef HAVE_SYS_SDT_H
+
+#define PROBE_SEMAPHORE(probe) \
+	unsigned short jsonfs_##probe##_semaphore \
+		__attribute__((section(".probes"))) = 0
+
+PROBE_SEMAPHORE(handler__entry);
+PROBE_SEMAPHORE(handler__return);
+PROBE_SEMAPHORE(save__start);
+PROBE_SEMAPHORE(save__done);
+PROBE_SEMAPHORE(load__start);
+PROBE_SEMAPHORE(load__done);
+PROBE_SEMAPHORE(normalize__start);
+PROBE_SEMAPHORE(normalize__done);
+
+#else
+
+/* ISO C does not allow an empty translation unit */
+typedef int probes_are_disabled;
+
+#endif /* HAVE_SYS_SDT_H */
@@ -0,0 +1,248 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file 
+ * @brief Contains definition of the recording of the requests.
+ * 
+ * Function declarations, types and specifications can be found in record.h.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "record.h"
+
+/**
+ * @def RECORD_BUFFER
+ * @brief Size of the stdio buffer of the record file.
+ */
+#define RECORD_BUFFER	(1024 * 1024)
+
+static FILE *record_file = NULL;
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t base_time = 0;
+static uint64_t last_time = 0;
+
+/* ================================= */
+/*              Encoding             */
+/* ================================= */
+
+static void put_varint(FILE *out, uint64_t value)
+{
+	while (value >= 0x80) {
+		fputc((int) (value & 0x7F) | 0x80, out);
+		value >>= 7;
+	}
+	fputc((int) value, out);
+}
+
+/**
+ * @brief Writes a signed value, small magnitudes take few bytes.
+ */
+static void put_signed(FILE *out, int64_t value)
+{
+	put_varint(out, ((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+}
+
+static void put_string(FILE *out, const char *str)
+{
+	size_t len = str ? strlen(str) : 0;
+
+	put_varint(out, len);
+	if (len) { fwrite(str, 1, len, out); }
+}
+
+/**
+ * @return 0 on success, -1 at the end of the file or on a too long value.
+ */
+static int get_varint(FILE *in, uint64_t *value)
+{
+	int c;
+
+	*value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		c = fgetc(in);
+		if (c == EOF) { return -1; }
+
+		*value |= (uint64_t) (c & 0x7F) << shift;
+		if (!(c & 0x80)) { return 0; }
+	}
+
+	return -1;
+}
+
+static int get_signed(FILE *in, int64_t *value)
+{
+	uint64_t raw;
+
+	if (get_varint(in, &raw) < 0) { return -1; }
+
+	*value = (int64_t) (raw >> 1) ^ -(int64_t) (raw & 1);
+	return 0;
+}
+
+static int get_string(FILE *in, char *str, size_t size)
+{
+	uint64_t len;
+
+	if (get_varint(in, &len) < 0 || len >= size) { return -1; }
+	if (len && fread(str, 1, len, in) != len) { return -1; }
+
+	str[len] = '\0';
+	return 0;
+}
+
+/* ================================= */
+/*             Recording             */
+/* ================================= */
+
+int start_recording(const char *file)
+{
+	FILE *out = NULL;
+
+	CHECK_POINTER(file, -1);
+
+	out = fopen(file, "wb");
+	CHECK_POINTER(out, -1);
+
+	setvbuf(out, NULL, _IOFBF, RECORD_BUFFER);
+
+	/* Flushed before fuse_main() forks, so the header is written once */
+	if (fwrite(RECORD_MAGIC, 1, RECORD_MAGIC_LEN, out) != RECORD_MAGIC_LEN
+		|| fflush(out) != 0) {
+		fclose(out);
+		return -1;
+	}
+
+	pthread_mutex_lock(&record_lock);
+	if (record_file) { fclose(record_file); }
+	base_time = get_stats_time();
+	last_time = 0;
+	__atomic_store_n(&record_file, out, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&record_lock);
+
+	return 0;
+}
+
+void stop_recording(void)
+{
+	pthread_mutex_lock(&record_lock);
+	if (record_file) {
+		fclose(record_file);
+		__atomic_store_n(&record_file, NULL, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&record_lock);
+}
+
+void write_record(enum stats_op op, uint64_t start, const char *path,
+				  const struct record_args *args, int result)
+{
+	static const struct record_args no_args = { NULL, 0, 0, 0, 0 };
+	uint64_t now;
+	uint64_t time;
+
+	if (!__atomic_load_n(&record_file, __ATOMIC_RELAXED)) { return; }
+
+	if (!args) { args = &no_args; }
+	now = get_stats_time();
+
+	pthread_mutex_lock(&record_lock);
+	if (!record_file) {
+		pthread_mutex_unlock(&record_lock);
+		return;
+	}
+
+	/* The requests finish out of order, so the delta may be negative */
+	time = start > base_time ? start - base_time : 0;
+	fputc((int) op, record_file);
+	put_signed(record_file, (int64_t) (time - last_time));
+	put_varint(record_file, now > start ? now - start : 0);
+	put_signed(record_file, result);
+	put_varint(record_file, args->size);
+	put_signed(record_file, args->offset);
+	put_varint(record_file, args->flags);
+	put_varint(record_file, args->fh);
+	put_string(record_file, path);
+	put_string(record_file, args->path2);
+	last_time = time;
+	pthread_mutex_unlock(&record_lock);
+}
+
+/* ================================= */
+/*              Reading              */
+/* ================================= */
+
+FILE *open_record_file(const char *file)
+{
+	char magic[RECORD_MAGIC_LEN];
+	FILE *in = NULL;
+
+	CHECK_POINTER(file, NULL);
+
+	in = fopen(file, "rb");
+	CHECK_POINTER(in, NULL);
+
+	if (fread(magic, 1, RECORD_MAGIC_LEN, in) != RECORD_MAGIC_LEN
+		|| memcmp(magic, RECORD_MAGIC, RECORD_MAGIC_LEN) != 0) {
+		fclose(in);
+		return NULL;
+	}
+
+	return in;
+}
+
+int read_record(FILE *in, uint64_t *last_start, struct record_entry *entry)
+{
+	int64_t delta;
+	int op;
+
+	CHECK_POINTER(in, -1);
+	CHECK_POINTER(last_start, -1);
+	CHECK_POINTER(entry, -1);
+
+	op = fgetc(in);
+	if (op == EOF) { return 0; }
+	if (op >= STATS_COUNT_OPS) { return -1; }
+
+	memset(&entry->args, 0, sizeof(struct record_args));
+	entry->op = (enum stats_op) op;
+
+	if (get_signed(in, &delta) < 0
+		|| get_varint(in, &entry->duration) < 0
+		|| get_signed(in, &entry->result) < 0
+		|| get_varint(in, &entry->args.size) < 0
+		|| get_signed(in, &entry->args.offset) < 0
+		|| get_varint(in, &entry->args.flags) < 0
+		|| get_varint(in, &entry->args.fh) < 0
+		|| get_string(in, entry->path, sizeof(entry->path)) < 0
+		|| get_string(in, entry->path2, sizeof(entry->path2)) < 0) {
+		return -1;
+	}
+
+	entry->start = *last_start + (uint64_t) delta;
+	*last_start = entry->start;
+	if (entry->path2[0]) { entry->args.path2 = entry->path2; }
+
+	return 1;
+}
@@ -0,0 +1,456 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file 
+ * @brief Contains definition of the reloading of the documents.
+ * 
+ * Function declarations and specifications can be found in reload.h.
+ */
+
+#define FUSE_USE_VERSION 35
+
+#include <jansson.h>
+#include <fuse.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/inotify.h>
+
+#include "common.h"
+#include "jsonfs.h"
+#include "handlers.h"
+#include "json_operations.h"
+#include "reload.h"
+#include "stats.h"
+#include "trace.h"
+#include "ndjson.h"
+#include "binary_json.h"
+
+/**
+ * @def RELOAD_EVENTS
+ * @brief Events of a file written in place or renamed over the old one.
+ */
+#define RELOAD_EVENTS	(IN_CLOSE_WRITE | IN_MOVED_TO)
+
+/**
+ * @def EVENTS_BUFFER
+ * @brief Size of the buffer the inotify events are read to.
+ */
+#define EVENTS_BUFFER	(16 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+
+static struct jsonfs_mount *reload_mount = NULL;
+static struct fuse *reload_fuse = NULL;
+static pthread_t reload_thread;
+static int is_running = 0;
+static int inotify_fd = -1;
+static int wake_pipe[2] = { -1, -1 };
+static int *watches = NULL;
+
+/* ================================= */
+/*             Reloading             */
+/* ================================= */
+
+/**
+ * @brief Checks if the file differs from the one the document 
+ * was last loaded from or saved to.
+ */
+static int is_file_changed(const struct stat *st, 
+						   const struct jsonfs_private_data *pd)
+{
+	return st->st_size != pd->file_size ||
+		   st->st_mtim.tv_sec != pd->file_mtime.tv_sec ||
+		   st->st_mtim.tv_nsec != pd->file_mtime.tv_nsec;
+}
+
+/**
+ * @brief Parses and normalizes the file of a document.
+ * 
+ * @param index[out] Index of the lines of a JSON Lines document.
+ * @param error[out] Error of parsing.
+ * 
+ * @return Normalized root on success, NULL on failure.
+ */
+static json_t *parse_document(const struct jsonfs_private_data *pd,
+							  struct ndjson_index **index, 
+							  json_error_t *error)
+{
+	json_t *root = NULL;
+	json_t *norm_root = NULL;
+	char message[sizeof(error->text)];
+
+	/* The shared scalars are not interned again, the pool is gone */
+	if (pd->ndjson) { 
+		return load_ndjson_file(pd->path_to_json_file, NULL, index, error); 
+	}
+
+	if (pd->binary_format != BINARY_NONE) {
+		root = load_binary_file(pd->path_to_json_file, pd->binary_format, error);
+	}
+	else {
+		root = json_load_file(pd->path_to_json_file, JSON_DECODE_ANY, error);
+	}
+	if (!root && error->line > 0) {
+		snprintf(message, sizeof(message), "line %d: ", error->line);
+		strncat(message, error->text, sizeof(message) - strlen(message) - 1);
+		memcpy(error->text, message, sizeof(message));
+	}
+	CHECK_POINTER(root, NULL);
+
+	norm_root = normalize_json(root, 1, NULL);
+	json_decref(root);
+	if (!norm_root) { snprintf(error->text, sizeof(error->text), "out of memory"); }
+
+	return norm_root;
+}
+
+/**
+ * @brief Replaces the report of the last reload shown in /.status.
+ * @param report New report, owned by the document.
+ */
+static void set_reload_report(struct jsonfs_private_data *pd, char *report)
+{
+	free(pd->reload_report);
+	pd->reload_report = report;
+	pd->reload_report_len = report ? strlen(report) : 0;
+}
+
+/**
+ * @brief Lists the conflicts of a merge for /.status.
+ * @return The report on success, NULL on failure.
+ */
+static char *format_conflicts(const struct merge_result *result)
+{
+	char *report = NULL;
+	size_t size = MID_SIZE;
+	size_t len;
+	size_t count_listed = 0;
+
+	for (size_t i = 0; i < result->count; i++) {
+		if (result->changes[i].state != MERGE_CONFLICT) { continue; }
+		if (count_listed++ == RELOAD_MAX_CONFLICTS) { break; }
+		size += strlen(result->changes[i].path) + 1;
+	}
+
+	report = malloc(size);
+	CHECK_POINTER(report, NULL);
+
+	len = snprintf(report, size, "reload: conflicts with unsaved changes: %zu\n", 
+				   result->count_conflicts);
+
+	count_listed = 0;
+	for (size_t i = 0; i < result->count; i++) {
+		if (result->changes[i].state != MERGE_CONFLICT) { continue; }
+		if (count_listed++ == RELOAD_MAX_CONFLICTS) { 
+			len += snprintf(report + len, size - len, "...\n");
+			break; 
+		}
+		len += snprintf(report + len, size - len, "%s\n", 
+						result->changes[i].path);
+	}
+
+	return report;
+}
+
+/**
+ * @brief Lists the paths whose kernel cache is invalidated: 
+ * the applied changes and their parent directories.
+ * 
+ * @return The paths on success, NULL on failure.
+ */
+static char **get_changed_paths(const struct merge_result *result)
+{
+	char **paths = NULL;
+	char *parent_path = NULL;
+	char *name = NULL;
+	const char *last_parent = NULL;
+	size_t count = 0;
+
+	paths = calloc(2 * result->count + 1, sizeof(char *));
+	CHECK_POINTER(paths, NULL);
+
+	for (size_t i = 0; i < result->count; i++) {
+		if (result->changes[i].state != MERGE_APPLIED) { continue; }
+
+		paths[count] = strdup(result->changes[i].path);
+		if (!paths[count]) { goto handle_error; }
+		count++;
+
+		if (separate_filepath(result->changes[i].path, &parent_path, &name) < 0) {
+			goto handle_error;
+		}
+		free(name);
+
+		/* The changes of a directory follow each other */
+		if (last_parent && strcmp(last_parent, parent_path) == 0) {
+			free(parent_path);
+			continue;
+		}
+		paths[count++] = parent_path;
+		last_parent = parent_path;
+	}
+
+	return paths;
+
+	handle_error:
+		free_changed_paths(paths);
+		return NULL;
+}
+
+int reload_document(struct jsonfs_private_data *pd, char ***changed_paths)
+{
+	struct stat st;
+	struct merge_result result;
+	struct ndjson_index *index = NULL;
+	json_t *new_root = NULL;
+	json_error_t json_error;
+	char *report = NULL;
+	const char *error_text = NULL;
+	uint64_t start;
+	int is_changed;
+	int res_merge;
+
+	CHECK_POINTER(pd, -EFAULT);
+	if (changed_paths) { *changed_paths = NULL; }
+	memset(&result, 0, sizeof(result));
+
+	/* A removed file is kept in the tree until it is saved again */
+	if (stat(pd->path_to_json_file, &st) < 0) { return -errno; }
+
+	pthread_mutex_lock(&pd->lock);
+	is_changed = is_file_changed(&st, pd);
+	pthread_mutex_unlock(&pd->lock);
+	if (!is_changed) { return 0; }
+
+	/* The tree is not locked while the file is parsed */
+	start = get_stats_time();
+	memset(&json_error, 0, sizeof(json_error));
+	new_root = parse_document(pd, &index, &json_error);
+	count_stats_event(STATS_LOADS);
+
+	pthread_mutex_lock(&pd->lock);
+	if (new_root) {
+		res_merge = merge_json_document(new_root, &result, pd);
+		error_text = res_merge < 0 ? strerror(-res_merge) : NULL;
+	}
+	else {
+		res_merge = -EINVAL;
+		error_text = json_error.text;
+	}
+
+	/* A file that failed is parsed again only when it is changed again */
+	pd->file_size = st.st_size;
+	pd->file_mtime = st.st_mtim;
+
+	if (error_text) {
+		report = malloc(strlen(error_text) + SHRT_SIZE);
+		if (report) { sprintf(report, "reload failed: %s\n", error_text); }
+		set_reload_report(pd, report);
+	}
+	else {
+		if (result.count_conflicts) { set_reload_report(pd, format_conflicts(&result)); }
+
+		/* The lines changed since the last save are still written then */
+		if (pd->ndjson) {
+			index->version = pd->is_saved ? pd->version : pd->ndjson->version;
+			destroy_ndjson_index(pd->ndjson);
+			pd->ndjson = index;
+			index = NULL;
+		}
+	}
+	pthread_mutex_unlock(&pd->lock);
+
+	if (res_merge >= 0 && changed_paths) {
+		*changed_paths = get_changed_paths(&result);
+	}
+
+	end_trace_span("reload", TRACE_JSON, start, pd->path_to_json_file);
+	free_merge_result(&result);
+	destroy_ndjson_index(index);
+	json_decref(new_root);
+	return res_merge;
+}
+
+void free_changed_paths(char **paths)
+{
+	if (!paths) { return; }
+
+	for (size_t i = 0; paths[i]; i++) { free(paths[i]); }
+	free(paths);
+}
+
+/* ================================= */
+/*              Watching             */
+/* ================================= */
+
+/**
+ * @brief Invalidates the kernel cache of the changed paths of a document.
+ */
+static void invalidate_paths(const struct jsonfs_private_data *pd, 
+							 char **paths)
+{
+	char mount_path[PATH_MAX];
+	int count_byte;
+
+	for (size_t i = 0; paths && paths[i]; i++) {
+		if (!pd->name) {
+			fuse_invalidate_path(reload_fuse, paths[i]);
+			continue;
+		}
+
+		count_byte = snprintf(mount_path, sizeof(mount_path), "/%s%s", pd->name,
+							  strcmp(paths[i], "/") == 0 ? "" : paths[i]);
+		if (count_byte < sizeof(mount_path)) {
+			fuse_invalidate_path(reload_fuse, mount_path);
+		}
+	}
+}
+
+/**
+ * @brief Reloads the documents whose file is named by an event.
+ */
+static void handle_event(const struct inotify_event *event)
+{
+	struct jsonfs_private_data *pd = NULL;
+	const char *base = NULL;
+	char **paths = NULL;
+
+	for (size_t i = 0; i < reload_mount->count; i++) {
+		pd = reload_mount->docs[i];
+		if (watches[i] != event->wd) { continue; }
+
+		base = strrchr(pd->path_to_json_file, '/') + 1;
+		if (strcmp(base, event->name) != 0) { continue; }
+
+		if (reload_document(pd, &paths) > 0) { invalidate_paths(pd, paths); }
+		free_changed_paths(paths);
+		paths = NULL;
+	}
+}
+
+static void *watch_documents(void *arg)
+{
+	char buffer[EVENTS_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct pollfd fds[2];
+	const struct inotify_event *event = NULL;
+	ssize_t len;
+
+	(void) arg;
+
+	fds[0].fd = inotify_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = wake_pipe[0];
+	fds[1].events = POLLIN;
+
+	for (;;) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR) { continue; }
+			break;
+		}
+		if (fds[1].revents) { break; }
+
+		len = read(inotify_fd, buffer, sizeof(buffer));
+		if (len < 0 && errno == EINTR) { continue; }
+		if (len <= 0) { break; }
+
+		for (char *pos = buffer; pos < buffer + len; 
+			 pos += sizeof(struct inotify_event) + event->len) 
+		{
+			event = (const struct inotify_event *) pos;
+			if (event->len && (event->mask & RELOAD_EVENTS)) { 
+				handle_event(event); 
+			}
+		}
+	}
+
+	return NULL;
+}
+
+int start_reload_watcher(struct jsonfs_mount *mount, struct fuse *fuse)
+{
+	char dir[PATH_MAX];
+	const char *slash = NULL;
+
+	CHECK_POINTER(mount, -1);
+	if (is_running) { return -1; }
+
+	watches = calloc(mount->count, sizeof(int));
+	CHECK_POINTER(watches, -1);
+
+	if (pipe(wake_pipe) < 0) { goto handle_error; }
+
+	inotify_fd = inotify_init1(IN_CLOEXEC);
+	if (inotify_fd < 0) { goto handle_error; }
+
+	/* The directory is watched, so a file replaced by rename() is seen */
+	for (size_t i = 0; i < mount->count; i++) {
+		slash = strrchr(mount->docs[i]->path_to_json_file, '/');
+		snprintf(dir, sizeof(dir), "%.*s", 
+				 (int) (slash - mount->docs[i]->path_to_json_file), 
+				 mount->docs[i]->path_to_json_file);
+
+		watches[i] = inotify_add_watch(inotify_fd, dir[0] ? dir : "/", 
+									   RELOAD_EVENTS);
+		if (watches[i] < 0) { goto handle_error; }
+	}
+
+	reload_mount = mount;
+	reload_fuse = fuse;
+	if (pthread_create(&reload_thread, NULL, watch_documents, NULL)) { 
+		goto handle_error; 
+	}
+	is_running = 1;
+
+	return 0;
+
+	handle_error:
+		stop_reload_watcher();
+		return -1;
+}
+
+void stop_reload_watcher(void)
+{
+	ssize_t res_write;
+
+	if (is_running) {
+		/* The watcher sleeps in poll() until there are events */
+		res_write = write(wake_pipe[1], "", 1);
+		(void) res_write;
+		pthread_join(reload_thread, NULL);
+		is_running = 0;
+	}
+
+	if (inotify_fd >= 0) { close(inotify_fd); }
+	if (wake_pipe[0] >= 0) { close(wake_pipe[0]); }
+	if (wake_pipe[1] >= 0) { close(wake_pipe[1]); }
+	inotify_fd = -1;
+	wake_pipe[0] = -1;
+	wake_pipe[1] = -1;
+
+	free(watches);
+	watches = NULL;
+	reload_mount = NULL;
+	reload_fuse = NULL;
+}
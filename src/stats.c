@@ -0,0 +1,571 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file 
+ * @brief Contains definition of the operation metrics.
+ * 
+ * Function declarations, types and specifications can be found in stats.h.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "common.h"
+#include "stats.h"
+#include "arena.h"
+
+/**
+ * @def SUB_BITS
+ * @brief Number of the bits below the highest one kept by a bucket.
+ */
+#define SUB_BITS		3
+
+#define SUB_BUCKETS		(1 << SUB_BITS)
+
+/**
+ * @def COUNT_BUCKETS
+ * @brief Number of the histogram buckets, the last one covers ~18 minutes.
+ */
+#define COUNT_BUCKETS	(38 * SUB_BUCKETS)
+
+/**
+ * @struct stats_histogram
+ * @brief Latencies of an operation in nanoseconds.
+ */
+struct stats_histogram {
+	uint64_t buckets[COUNT_BUCKETS];	/**< Number of the values of each bucket */
+	uint64_t count;						/**< Number of the values */
+	uint64_t sum;						/**< Sum of the values */
+	uint64_t max;						/**< Largest value */
+};
+
+/**
+ * @struct stats_shard
+ * @brief Metrics counted by a thread.
+ * 
+ * Only the owner thread writes the shard, 
+ * the readers sum it up with the others.
+ */
+struct stats_shard {
+	struct stats_histogram ops[STATS_COUNT_OPS];
+	uint64_t events[STATS_COUNT_EVENTS];
+	uint64_t count_lookups;					/**< Number of lookups by path */
+	uint64_t sum_depth;						/**< Components walked by lookups */
+	uint64_t max_depth;						/**< Deepest lookup */
+	struct stats_shard *next;
+};
+
+static const char *op_names[STATS_COUNT_OPS] = {
+	"getattr", "mknod", "mkdir", "unlink", "rmdir", "rename", "truncate",
+	"open", "read", "write", "read_buf", "write_buf", "flush", "release",
+	"opendir", "readdir", "releasedir", "utimens", "getxattr", "listxattr",
+	"save"
+};
+
+static const char *event_names[STATS_COUNT_EVENTS] = {
+	"dumps", "loads"
+};
+
+/**
+ * @brief Percentiles given by the histograms.
+ */
+static const struct {
+	const char *name;
+	const char *quantile;
+	double fraction;
+} percentiles[] = {
+	{ "p50_ns", "0.5", 0.5 },
+	{ "p90_ns", "0.9", 0.9 },
+	{ "p99_ns", "0.99", 0.99 },
+	{ "p999_ns", "0.999", 0.999 }
+};
+
+#define COUNT_PERCENTILES	(sizeof(percentiles) / sizeof(percentiles[0]))
+
+static __thread struct stats_shard *local_shard = NULL;
+static struct stats_shard *shards = NULL;
+static pthread_mutex_t shards_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t start_time = 0;
+static uint64_t load_time = 0;
+static uint64_t normalize_time = 0;
+
+/* ================================= */
+/*              Counting             */
+/* ================================= */
+
+/**
+ * @brief Gives the shard of the calling thread, creating it on first use.
+ * @return The shard or NULL on failure.
+ */
+static struct stats_shard *get_local_shard(void)
+{
+	struct stats_shard *shard = NULL;
+
+	if (local_shard) { return local_shard; }
+
+	shard = calloc(1, sizeof(struct stats_shard));
+	CHECK_POINTER(shard, NULL);
+
+	/* The shard outlives its thread, the counts stay in the sums */
+	pthread_mutex_lock(&shards_lock);
+	shard->next = shards;
+	shards = shard;
+	pthread_mutex_unlock(&shards_lock);
+
+	local_shard = shard;
+	return shard;
+}
+
+/**
+ * @brief Adds to a counter of the own shard without a locked instruction.
+ * 
+ * The relaxed atomics only keep a concurrent reader 
+ * from seeing a torn value.
+ */
+static inline void add_counter(uint64_t *counter, uint64_t value)
+{
+	uint64_t old = __atomic_load_n(counter, __ATOMIC_RELAXED);
+	__atomic_store_n(counter, old + value, __ATOMIC_RELAXED);
+}
+
+static inline void max_counter(uint64_t *counter, uint64_t value)
+{
+	if (value > __atomic_load_n(counter, __ATOMIC_RELAXED)) {
+		__atomic_store_n(counter, value, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * @brief Finds the bucket of a value.
+ * 
+ * Values below SUB_BUCKETS have a bucket each, larger ones keep 
+ * the highest bit and SUB_BITS bits below it.
+ */
+static size_t get_bucket(uint64_t value)
+{
+	int shift;
+	size_t bucket;
+
+	if (value < SUB_BUCKETS) { return (size_t) value; }
+
+	shift = 63 - __builtin_clzll(value) - SUB_BITS;
+	bucket = (size_t) (shift + 1) * SUB_BUCKETS 
+			 + ((value >> shift) & (SUB_BUCKETS - 1));
+
+	return bucket < COUNT_BUCKETS ? bucket : COUNT_BUCKETS - 1;
+}
+
+/**
+ * @brief Gives the middle of the range covered by a bucket.
+ */
+static uint64_t get_bucket_value(size_t bucket)
+{
+	int shift;
+	uint64_t lower;
+
+	if (bucket < SUB_BUCKETS) { return bucket; }
+
+	shift = (int) (bucket / SUB_BUCKETS) - 1;
+	lower = (uint64_t) (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+
+	return lower + ((1ULL << shift) >> 1);
+}
+
+uint64_t get_stats_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+void count_stats_op(enum stats_op op, uint64_t start)
+{
+	struct stats_shard *shard = NULL;
+	struct stats_histogram *hist = NULL;
+	uint64_t now = get_stats_time();
+	uint64_t value = now > start ? now - start : 0;
+
+	if ((unsigned) op >= STATS_COUNT_OPS) { return; }
+
+	shard = get_local_shard();
+	if (!shard) { return; }
+
+	hist = &shard->ops[op];
+	add_counter(&hist->buckets[get_bucket(value)], 1);
+	add_counter(&hist->count, 1);
+	add_counter(&hist->sum, value);
+	max_counter(&hist->max, value);
+}
+
+const char *get_stats_op_name(enum stats_op op)
+{
+	if ((unsigned) op >= STATS_COUNT_OPS) { return "unknown"; }
+
+	return op_names[op];
+}
+
+void count_stats_event(enum stats_event event)
+{
+	struct stats_shard *shard = NULL;
+
+	if ((unsigned) event >= STATS_COUNT_EVENTS) { return; }
+
+	shard = get_local_shard();
+	if (!shard) { return; }
+
+	add_counter(&shard->events[event], 1);
+}
+
+void count_stats_lookup(int depth)
+{
+	struct stats_shard *shard = NULL;
+
+	if (depth < 0) { return; }
+
+	shard = get_local_shard();
+	if (!shard) { return; }
+
+	add_counter(&shard->count_lookups, 1);
+	add_counter(&shard->sum_depth, (uint64_t) depth);
+	max_counter(&shard->max_depth, (uint64_t) depth);
+}
+
+void set_stats_load_time(uint64_t load_ns, uint64_t normalize_ns)
+{
+	load_time = load_ns;
+	normalize_time = normalize_ns;
+	start_time = get_stats_time();
+}
+
+void release_stats(void)
+{
+	struct stats_shard *next = NULL;
+
+	pthread_mutex_lock(&shards_lock);
+	while (shards) {
+		next = shards->next;
+		free(shards);
+		shards = next;
+	}
+	pthread_mutex_unlock(&shards_lock);
+
+	local_shard = NULL;
+}
+
+/* ================================= */
+/*             Rendering             */
+/* ================================= */
+
+/**
+ * @brief Sums up the shards of all threads.
+ * @return The sum on success, NULL on failure.
+ * @note The returned shard must be freed with free().
+ */
+static struct stats_shard *sum_shards(void)
+{
+	struct stats_shard *total = NULL;
+	struct stats_shard *shard = NULL;
+	struct stats_histogram *dst = NULL;
+	struct stats_histogram *src = NULL;
+	uint64_t value;
+
+	total = calloc(1, sizeof(struct stats_shard));
+	CHECK_POINTER(total, NULL);
+
+	pthread_mutex_lock(&shards_lock);
+	for (shard = shards; shard; shard = shard->next) {
+		for (int op = 0; op < STATS_COUNT_OPS; op++) {
+			dst = &total->ops[op];
+			src = &shard->ops[op];
+			for (size_t i = 0; i < COUNT_BUCKETS; i++) {
+				dst->buckets[i] += __atomic_load_n(&src->buckets[i], 
+												   __ATOMIC_RELAXED);
+			}
+			dst->count += __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+			dst->sum += __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+			value = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+			if (value > dst->max) { dst->max = value; }
+		}
+		for (int event = 0; event < STATS_COUNT_EVENTS; event++) {
+			total->events[event] += __atomic_load_n(&shard->events[event],
+													__ATOMIC_RELAXED);
+		}
+		total->count_lookups += __atomic_load_n(&shard->count_lookups, 
+												__ATOMIC_RELAXED);
+		total->sum_depth += __atomic_load_n(&shard->sum_depth, 
+											__ATOMIC_RELAXED);
+		value = __atomic_load_n(&shard->max_depth, __ATOMIC_RELAXED);
+		if (value > total->max_depth) { total->max_depth = value; }
+	}
+	pthread_mutex_unlock(&shards_lock);
+
+	return total;
+}
+
+/**
+ * @brief Gives a percentile of a histogram.
+ * 
+ * @param hist Histogram.
+ * @param fraction Fraction of the values that are not larger, 0 to 1.
+ * 
+ * @return Value of the percentile in nanoseconds.
+ */
+static uint64_t get_percentile(const struct stats_histogram *hist,
+							   double fraction)
+{
+	uint64_t rank;
+	uint64_t seen = 0;
+	uint64_t value;
+
+	if (!hist->count) { return 0; }
+
+	rank = (uint64_t) (fraction * (double) hist->count);
+	if (rank < 1) { rank = 1; }
+
+	for (size_t i = 0; i < COUNT_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen >= rank) {
+			value = get_bucket_value(i);
+			return value < hist->max ? value : hist->max;
+		}
+	}
+
+	return hist->max;
+}
+
+/**
+ * @brief Collects the memory figures of the process.
+ * 
+ * @param arena[out] Statistics of the arena, zeroed if it is not used.
+ * @param max_rss[out] Peak resident set size in bytes.
+ */
+static void get_memory(struct arena_stats *arena, uint64_t *max_rss)
+{
+	struct rusage usage;
+
+	memset(arena, 0, sizeof(struct arena_stats));
+	if (json_arena_is_used()) { get_arena_stats(arena); }
+
+	*max_rss = 0;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+		*max_rss = (uint64_t) usage.ru_maxrss * 1024;
+	}
+}
+
+/**
+ * @brief Writes a histogram as the members of a JSON object.
+ */
+static void print_histogram_json(FILE *out, const char *name, 
+								 const struct stats_histogram *hist)
+{
+	fprintf(out, "\"%s\":{\"count\":%llu,\"sum_ns\":%llu,\"max_ns\":%llu",
+			name, (unsigned long long) hist->count, 
+			(unsigned long long) hist->sum, (unsigned long long) hist->max);
+
+	for (size_t i = 0; i < COUNT_PERCENTILES; i++) {
+		fprintf(out, ",\"%s\":%llu", percentiles[i].name,
+				(unsigned long long) get_percentile(hist, 
+													percentiles[i].fraction));
+	}
+
+	fputc('}', out);
+}
+
+/**
+ * @brief Closes a memory stream and gives its text.
+ * @return The text on success, NULL on failure.
+ */
+static char *close_stream(FILE *out, char **text, size_t *text_len, 
+						  size_t *len)
+{
+	int res_close = fclose(out);
+
+	if (res_close != 0 || !*text) {
+		free(*text);
+		return NULL;
+	}
+
+	if (len) { *len = *text_len; }
+	return *text;
+}
+
+char *format_stats_json(size_t *len)
+{
+	struct stats_shard *total = NULL;
+	struct arena_stats arena;
+	uint64_t max_rss;
+	char *text = NULL;
+	size_t text_len = 0;
+	FILE *out = NULL;
+
+	total = sum_shards();
+	CHECK_POINTER(total, NULL);
+
+	get_memory(&arena, &max_rss);
+
+	out = open_memstream(&text, &text_len);
+	if (!out) {
+		free(total);
+		return NULL;
+	}
+
+	fprintf(out, "{\n\"uptime_ns\":%llu,\n\"ops\":{", 
+			(unsigned long long) (get_stats_time() - start_time));
+	for (int op = 0; op < STATS_SAVE; op++) {
+		fputs(op ? ",\n" : "\n", out);
+		print_histogram_json(out, op_names[op], &total->ops[op]);
+	}
+	fputs("\n},\n", out);
+
+	print_histogram_json(out, op_names[STATS_SAVE], &total->ops[STATS_SAVE]);
+
+	fputs(",\n\"json\":{", out);
+	for (int event = 0; event < STATS_COUNT_EVENTS; event++) {
+		fprintf(out, "%s\"%s\":%llu", event ? "," : "", event_names[event],
+				(unsigned long long) total->events[event]);
+	}
+
+	fprintf(out, "},\n\"lookups\":{\"count\":%llu,\"depth_sum\":%llu,"
+			"\"depth_max\":%llu},\n",
+			(unsigned long long) total->count_lookups,
+			(unsigned long long) total->sum_depth,
+			(unsigned long long) total->max_depth);
+
+	fprintf(out, "\"mount\":{\"load_ns\":%llu,\"normalize_ns\":%llu},\n",
+			(unsigned long long) load_time, 
+			(unsigned long long) normalize_time);
+
+	fprintf(out, "\"memory\":{\"arena\":%s,\"bytes_in_use\":%zu,"
+			"\"bytes_reserved\":%zu,\"allocs\":%zu,\"frees\":%zu,"
+			"\"max_rss_bytes\":%llu}\n}\n",
+			json_arena_is_used() ? "true" : "false", arena.bytes_in_use,
+			arena.bytes_reserved, arena.count_alloc, arena.count_free,
+			(unsigned long long) max_rss);
+
+	free(total);
+	return close_stream(out, &text, &text_len, len);
+}
+
+/**
+ * @brief Writes a histogram as a Prometheus summary.
+ * 
+ * @param label Labels of the samples without braces, may be empty.
+ */
+static void print_summary_prometheus(FILE *out, const char *name, 
+									 const char *label,
+									 const struct stats_histogram *hist)
+{
+	const char *sep = *label ? "," : "";
+
+	/* Quantiles of an empty summary are NaN by the convention */
+	for (size_t i = 0; i < COUNT_PERCENTILES; i++) {
+		fprintf(out, "%s{%s%squantile=\"%s\"} ", name, label, sep,
+				percentiles[i].quantile);
+		if (hist->count) {
+			fprintf(out, "%.9f\n", 
+					get_percentile(hist, percentiles[i].fraction) / 1e9);
+		}
+		else {
+			fputs("NaN\n", out);
+		}
+	}
+
+	fprintf(out, "%s_sum%s%s%s %.9f\n", name, *label ? "{" : "", label,
+			*label ? "}" : "", hist->sum / 1e9);
+	fprintf(out, "%s_count%s%s%s %llu\n", name, *label ? "{" : "", label,
+			*label ? "}" : "", (unsigned long long) hist->count);
+}
+
+char *format_stats_prometheus(size_t *len)
+{
+	struct stats_shard *total = NULL;
+	struct arena_stats arena;
+	uint64_t max_rss;
+	char label[MID_SIZE];
+	char *text = NULL;
+	size_t text_len = 0;
+	FILE *out = NULL;
+
+	total = sum_shards();
+	CHECK_POINTER(total, NULL);
+
+	get_memory(&arena, &max_rss);
+
+	out = open_memstream(&text, &text_len);
+	if (!out) {
+		free(total);
+		return NULL;
+	}
+
+	fputs("# HELP jsonfs_op_duration_seconds Latency of the FUSE callbacks.\n"
+		  "# TYPE jsonfs_op_duration_seconds summary\n", out);
+	for (int op = 0; op < STATS_SAVE; op++) {
+		snprintf(label, sizeof(label), "op=\"%s\"", op_names[op]);
+		print_summary_prometheus(out, "jsonfs_op_duration_seconds", label,
+								 &total->ops[op]);
+	}
+
+	fputs("# HELP jsonfs_save_duration_seconds Time of writing the file.\n"
+		  "# TYPE jsonfs_save_duration_seconds summary\n", out);
+	print_summary_prometheus(out, "jsonfs_save_duration_seconds", "",
+							 &total->ops[STATS_SAVE]);
+
+	for (int event = 0; event < STATS_COUNT_EVENTS; event++) {
+		fprintf(out, "# TYPE jsonfs_json_%s_total counter\n"
+				"jsonfs_json_%s_total %llu\n", event_names[event],
+				event_names[event], 
+				(unsigned long long) total->events[event]);
+	}
+
+	fprintf(out, "# TYPE jsonfs_lookups_total counter\n"
+			"jsonfs_lookups_total %llu\n"
+			"# TYPE jsonfs_lookup_depth_total counter\n"
+			"jsonfs_lookup_depth_total %llu\n"
+			"# TYPE jsonfs_lookup_depth_max gauge\n"
+			"jsonfs_lookup_depth_max %llu\n",
+			(unsigned long long) total->count_lookups,
+			(unsigned long long) total->sum_depth,
+			(unsigned long long) total->max_depth);
+
+	fprintf(out, "# TYPE jsonfs_load_seconds gauge\n"
+			"jsonfs_load_seconds %.9f\n"
+			"# TYPE jsonfs_normalize_seconds gauge\n"
+			"jsonfs_normalize_seconds %.9f\n",
+			load_time / 1e9, normalize_time / 1e9);
+
+	fprintf(out, "# TYPE jsonfs_arena_bytes_in_use gauge\n"
+			"jsonfs_arena_bytes_in_use %zu\n"
+			"# TYPE jsonfs_arena_bytes_reserved gauge\n"
+			"jsonfs_arena_bytes_reserved %zu\n"
+			"# TYPE jsonfs_max_rss_bytes gauge\n"
+			"jsonfs_max_rss_bytes %llu\n",
+			arena.bytes_in_use, arena.bytes_reserved,
+			(unsigned long long) max_rss);
+
+	free(total);
+	return close_stream(out, &text, &text_len, len);
+}
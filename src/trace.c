@@ -0,0 +1,244 @@
+/* 
+ * This file is part of jsonfs.
+ * jsonfs - File system for working with JSON.
+ *
+ * Copyright (C) 2025 Egorov Konstantin
+ *
+ * jsonfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * jsonfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with jsonfs. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file 
+ * @brief Contains definition of the request tracing.
+ * 
+ * Function declarations and specifications can be found in trace.h.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "common.h"
+#include "trace.h"
+#include "json_operations.h"
+#include "stats.h"
+
+/**
+ * @def RING_SIZE
+ * @brief Number of the last spans kept for each thread.
+ */
+#define RING_SIZE	4096
+
+/**
+ * @struct trace_span
+ * @brief Recorded span.
+ */
+struct trace_span {
+	const char *name;		/**< Name of the span */
+	const char *cat;		/**< Category of the span */
+	uint64_t start;			/**< Start time in nanoseconds */
+	uint64_t duration;		/**< Duration in nanoseconds */
+	char arg[MID_SIZE];		/**< Argument, truncated if it is longer */
+};
+
+/**
+ * @struct trace_ring
+ * @brief Last spans of a thread.
+ * 
+ * The lock is taken by the owner thread for every span and by 
+ * the readers, so it is almost never contended.
+ */
+struct trace_ring {
+	struct trace_span spans[RING_SIZE];
+	size_t head;				/**< Index of the next span to write */
+	size_t count;				/**< Number of the recorded spans */
+	long tid;					/**< Id of the thread */
+	pthread_mutex_t lock;
+	struct trace_ring *next;
+};
+
+static __thread struct trace_ring *local_ring = NULL;
+static struct trace_ring *rings = NULL;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static int trace_enabled = 0;
+
+/**
+ * @brief Gives the ring of the calling thread, creating it on first use.
+ * @return The ring or NULL on failure.
+ */
+static struct trace_ring *get_local_ring(void)
+{
+	struct trace_ring *ring = NULL;
+
+	if (local_ring) { return local_ring; }
+
+	ring = calloc(1, sizeof(struct trace_ring));
+	CHECK_POINTER(ring, NULL);
+
+	pthread_mutex_init(&ring->lock, NULL);
+	ring->tid = syscall(SYS_gettid);
+
+	pthread_mutex_lock(&rings_lock);
+	ring->next = rings;
+	rings = ring;
+	pthread_mutex_unlock(&rings_lock);
+
+	local_ring = ring;
+	return ring;
+}
+
+void set_trace_enabled(int is_enabled)
+{
+	__atomic_store_n(&trace_enabled, is_enabled ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+int trace_is_enabled(void)
+{
+	return __atomic_load_n(&trace_enabled, __ATOMIC_RELAXED);
+}
+
+uint64_t begin_trace_span(void)
+{
+	return trace_is_enabled() ? get_stats_time() : 0;
+}
+
+void end_trace_span(const char *name, const char *cat, uint64_t start,
+					const char *arg)
+{
+	struct trace_ring *ring = NULL;
+	struct trace_span *span = NULL;
+	uint64_t now;
+
+	if (!start || !trace_is_enabled()) { return; }
+
+	now = get_stats_time();
+
+	ring = get_local_ring();
+	if (!ring) { return; }
+
+	pthread_mutex_lock(&ring->lock);
+	span = &ring->spans[ring->head];
+	span->name = name;
+	span->cat = cat;
+	span->start = start;
+	span->duration = now > start ? now - start : 0;
+	snprintf(span->arg, sizeof(span->arg), "%s", arg ? arg : "");
+
+	ring->head = (ring->head + 1) % RING_SIZE;
+	if (ring->count < RING_SIZE) { ring->count++; }
+	pthread_mutex_unlock(&ring->lock);
+}
+
+void clear_trace(void)
+{
+	struct trace_ring *ring = NULL;
+
+	pthread_mutex_lock(&rings_lock);
+	for (ring = rings; ring; ring = ring->next) {
+		pthread_mutex_lock(&ring->lock);
+		ring->head = 0;
+		ring->count = 0;
+		pthread_mutex_unlock(&ring->lock);
+	}
+	pthread_mutex_unlock(&rings_lock);
+}
+
+void release_trace(void)
+{
+	struct trace_ring *next = NULL;
+
+	pthread_mutex_lock(&rings_lock);
+	while (rings) {
+		next = rings->next;
+		pthread_mutex_destroy(&rings->lock);
+		free(rings);
+		rings = next;
+	}
+	pthread_mutex_unlock(&rings_lock);
+
+	local_ring = NULL;
+}
+
+/**
+ * @brief Writes the spans of a ring from the oldest to the newest.
+ * 
+ * @param is_first[in,out] 1 if no event was written yet.
+ */
+static void print_ring(FILE *out, struct trace_ring *ring, long pid, 
+					   int *is_first)
+{
+	struct trace_span *span = NULL;
+	size_t index;
+
+	pthread_mutex_lock(&ring->lock);
+
+	if (ring->count) {
+		fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,"
+				"\"tid\":%ld,\"args\":{\"name\":\"jsonfs-%ld\"}}", 
+				*is_first ? "" : ",", pid, ring->tid, ring->tid);
+		*is_first = 0;
+	}
+
+	index = (ring->head + RING_SIZE - ring->count) % RING_SIZE;
+	for (size_t i = 0; i < ring->count; i++) {
+		span = &ring->spans[index];
+		fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+				"\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%ld", 
+				span->name, span->cat, span->start / 1e3, 
+				span->duration / 1e3, pid, ring->tid);
+		if (span->arg[0]) {
+			fputs(",\"args\":{\"path\":", out);
+			print_json_string(out, span->arg);
+			fputc('}', out);
+		}
+		fputc('}', out);
+		index = (index + 1) % RING_SIZE;
+	}
+
+	pthread_mutex_unlock(&ring->lock);
+}
+
+char *format_trace_json(size_t *len)
+{
+	struct trace_ring *ring = NULL;
+	char *text = NULL;
+	size_t text_len = 0;
+	FILE *out = NULL;
+	long pid = (long) getpid();
+	int is_first = 1;
+
+	out = open_memstream(&text, &text_len);
+	CHECK_POINTER(out, NULL);
+
+	fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", out);
+
+	pthread_mutex_lock(&rings_lock);
+	for (ring = rings; ring; ring = ring->next) {
+		print_ring(out, ring, pid, &is_first);
+	}
+	pthread_mutex_unlock(&rings_lock);
+
+	fputs("\n]}\n", out);
+
+	if (fclose(out) != 0 || !text) {
+		free(text);
+		return NULL;
+	}
+
+	if (len) { *len = text_len; }
+	return text;
+}
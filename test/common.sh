@@ -0,0 +1,56 @@
+#!/bin/bash
+
+# Functions shared by the test scripts of jsonfs, sourced by them.
+# Sets test_dir, exec_file and mount_point, creates the mount point
+# and removes it with the files of temp_files when the script exits.
+
+test_dir="$(cd $(dirname $BASH_SOURCE[0]) && pwd)"
+exec_file="$test_dir/../bin/jsonfs"
+mount_point="$test_dir/mnt"
+is_mounted=0
+
+# Files removed when the script exits
+temp_files=()
+
+if [ ! -f "$exec_file" ] ; then
+    echo "Error: not found $exec_file" >&2
+    exit 1
+fi
+
+# Mounts the document given with its options and enters the mount
+mount_file() {
+    if ! "$exec_file" "$1" "$mount_point" "${@:2}" ; then
+        echo "Error: mount failure" >&2
+        exit 1
+    fi
+    is_mounted=1
+    cd "$mount_point"
+}
+
+unmount_file() {
+    cd "$test_dir"
+    sync
+    fusermount3 -u "$mount_point"
+    is_mounted=0
+}
+
+# Checks the content of a file in the mount
+check_value() {
+    if [ "$(cat "$1")" != "$2" ] ; then
+        echo "Error: $1 is $(cat "$1"), expected $2" >&2
+        exit 1
+    fi
+}
+
+cleanup() {
+    cd "$test_dir"
+    if [ $is_mounted = 1 ] ; then
+        sync
+        fusermount3 -u "$mount_point"
+    fi
+    rmdir "$mount_point"
+    rm -f "${temp_files[@]}"
+}
+
+mkdir -p "$mount_point"
+trap cleanup EXIT
@@ -0,0 +1,130 @@
+#!/bin/bash
+
+# This script is designed for testing jsonfs.
+# Mounts the MessagePack and CBOR examples, checks their values,
+# changes them, saves and mounts the saved files again.
+# The examples with binary data, extension types and NaN must not mount.
+
+set -e
+
+source "$(dirname $BASH_SOURCE[0])/common.sh"
+
+log_file="$test_dir/log.txt"
+temp_files+=("$test_dir/types.msgpack" "$test_dir/types.cbor" "$log_file")
+
+# Checks the elements of an array in the mount
+check_array() {
+    local dir=$1
+    local i=0
+    shift
+    for value in "$@" ; do
+        check_value "$dir/@$i" "$value"
+        i=$((i + 1))
+    done
+    if [ "$(ls "$dir" | wc -l)" != "$#" ] ; then
+        echo "Error: $dir has $(ls "$dir" | wc -l) elements, expected $#" >&2
+        exit 1
+    fi
+}
+
+# Prints every file and directory with its content
+dump_tree() {
+    find . -mindepth 1 -not -name '.*' | sort | while read -r name ; do
+        echo "$name"
+        if [ -f "$name" ] ; then
+            cat "$name"
+            echo
+        fi
+    done
+}
+
+# Changes the document, saves it and checks the saved file
+check_round_trip() {
+    echo -n -70000 > neg/@0
+    echo -n 2.5 > real/@0
+    echo -n '"added"' > added
+    before="$(dump_tree)"
+    echo 1 > .save
+    unmount_file
+
+    mount_file "$1"
+    if [ "$before" != "$(dump_tree)" ] ; then
+        echo "Error: the saved $1 differs from the mount" >&2
+        diff <(echo "$before") <(dump_tree) >&2 || true
+        exit 1
+    fi
+    unmount_file
+}
+
+# The mount must fail with the message
+check_rejected() {
+    if "$exec_file" "$test_dir/$1" "$mount_point" 2> "$log_file" ; then
+        is_mounted=1
+        echo "Error: $1 is mounted" >&2
+        exit 1
+    fi
+    if ! grep -q "$2" "$log_file" ; then
+        echo "Error: $1: unexpected error:" >&2
+        cat "$log_file" >&2
+        exit 1
+    fi
+    echo "msg: $1 is rejected: $(cat "$log_file")"
+}
+
+cp "$test_dir/ex_types.msgpack" "$test_dir/types.msgpack"
+cp "$test_dir/ex_types.cbor" "$test_dir/types.cbor"
+
+########## TEST 1 ##########
+
+mount_file "$test_dir/types.msgpack"
+
+# Negative integers of every width, the fixint ones first
+check_array neg -1 -32 -33 -128 -129 -32768 -32769 -2147483648 -2147483649 \
+    -9223372036854775808
+check_array pos 127 128 65535 4294967295 9223372036854775807
+check_array real 1.5 16777216.0 0.375
+check_value str '"héllo"'
+check_value t true
+check_value n null
+check_value obj/k '"v"'
+echo "msg: the values of MessagePack are read"
+
+check_round_trip "$test_dir/types.msgpack"
+echo "msg: MessagePack is saved and read back"
+
+########## TEST 2 ##########
+
+mount_file "$test_dir/types.cbor"
+
+check_array neg -1 -24 -25 -256 -257 -65536 -65537 -4294967296 -4294967297 \
+    -9223372036854775808
+check_array pos 23 24 255 256 65535 65536 4294967295 4294967296 \
+    9223372036854775807
+
+# Half floats with the largest and the smallest subnormal one, float32, float64
+check_array real 1.5 65504.0 5.960464478e-08 16777216.0 0.375
+check_value str '"héllo"'
+check_value t true
+check_value n null
+check_value obj/k '"v"'
+
+# An indefinite map holding an indefinite array and a string in chunks
+check_array indef/arr 1 2
+check_value indef/txt '"abc"'
+
+# The tag is dropped, its value is kept
+check_value tag 1700000000
+echo "msg: the values of CBOR are read"
+
+check_round_trip "$test_dir/types.cbor"
+echo "msg: CBOR is saved and read back"
+
+########## TEST 3 ##########
+
+check_rejected ex_bin.msgpack "binary data is not supported"
+check_rejected ex_ext.msgpack "extension types are not supported"
+check_rejected ex_nan.msgpack "NaN or infinity"
+check_rejected ex_bin.cbor "binary data is not supported"
+check_rejected ex_nan.cbor "NaN or infinity"
+
+exit 0
@@ -0,0 +1,102 @@
+#!/bin/bash
+
+# This script is designed for testing jsonfs.
+# Checks that -o image mounts from the image only while it is current
+# and intact, and parses the JSON file otherwise.
+
+set -e
+
+source "$(dirname $BASH_SOURCE[0])/common.sh"
+
+json_file="$test_dir/image.json"
+image_file="$json_file.img"
+temp_files+=("$json_file" "$image_file")
+
+if [ ! -f "$test_dir/ex_obj.json" ] ; then
+    echo "Error: JSON file not found" >&2
+    exit 1
+fi
+
+# Mounts the file and checks whether it was parsed: 1 if it was, 0 if not
+mount_image() {
+    mount_file "$json_file" -o image
+
+    loads=$(grep -o '"loads":[0-9]*' .stats | cut -d : -f 2)
+    if [ "$loads" != "$1" ] ; then
+        echo "Error: $2: the file was parsed $loads times, expected $1" >&2
+        exit 1
+    fi
+    echo "msg: $2"
+}
+
+# Checks the values of the mounted document
+check_values() {
+    check_value int "$1"
+    check_value obj/key '"value"'
+    check_value arr/@1 '"x"'
+}
+
+cp "$test_dir/ex_obj.json" "$json_file"
+rm -f "$image_file"
+
+########## TEST 1 ##########
+
+mount_image 1 "without an image the file is parsed"
+check_values 42
+unmount_file
+
+if [ ! -f "$image_file" ] ; then
+    echo "Error: the image is not written" >&2
+    exit 1
+fi
+image_sum=$(md5sum < "$image_file")
+
+########## TEST 2 ##########
+
+mount_image 0 "a current image is used"
+check_values 42
+unmount_file
+
+if [ "$(md5sum < "$image_file")" != "$image_sum" ] ; then
+    echo "Error: a current image was written anew" >&2
+    exit 1
+fi
+
+########## TEST 3 ##########
+
+# The same size, only the content and the time tell the change
+sed -i 's/"int": 42/"int": 43/' "$json_file"
+
+mount_image 1 "the image is not used after the file is changed"
+check_values 43
+unmount_file
+
+mount_image 0 "the image is written anew for the changed file"
+check_values 43
+unmount_file
+
+########## TEST 4 ##########
+
+truncate -s -1 "$image_file"
+
+mount_image 1 "a truncated image is not used"
+check_values 43
+unmount_file
+
+########## TEST 5 ##########
+
+# One bit is flipped in the middle of the image
+offset=$(( $(stat -c %s "$image_file") / 2 ))
+byte=$(dd if="$image_file" bs=1 skip=$offset count=1 2>/dev/null | od -An -tu1)
+printf "\\$(printf %o $(( byte ^ 1 )))" \
+    | dd of="$image_file" bs=1 seek=$offset conv=notrunc 2>/dev/null
+
+mount_image 1 "a corrupted image is not used"
+check_values 43
+unmount_file
+
+mount_image 0 "the corrupted image is replaced"
+check_values 43
+unmount_file
+
+exit 0
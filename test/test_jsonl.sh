@@ -0,0 +1,97 @@
+#!/bin/bash
+
+# This script is designed for testing jsonfs.
+# Checks that saving a JSON Lines document writes only what has changed:
+# a line of the same length is overwritten in place, new lines are
+# appended, and the unchanged lines are copied byte for byte otherwise.
+
+set -e
+
+source "$(dirname $BASH_SOURCE[0])/common.sh"
+
+json_file="$test_dir/lines.jsonl"
+temp_files+=("$json_file")
+
+# Compares the file and its size with the expected content
+check_file() {
+    if [ "$(stat -c %s "$json_file")" != "$(printf '%s' "$1" | wc -c)" ] ; then
+        echo "Error: $2: wrong size of the file" >&2
+        exit 1
+    fi
+    if ! cmp -s "$json_file" <(printf '%s' "$1") ; then
+        echo "Error: $2" >&2
+        echo "=== Expected ===" >&2
+        printf '%s' "$1" >&2
+        echo "=== Got ===" >&2
+        cat "$json_file" >&2
+        exit 1
+    fi
+    echo "msg: $2"
+}
+
+# Checks that the file was changed in place, not replaced
+check_inode() {
+    if [ "$(stat -c %i "$json_file")" != "$1" ] ; then
+        echo "Error: the file was written anew" >&2
+        exit 1
+    fi
+}
+
+########## TEST 1 ##########
+
+# The line that is changed is compact, the others are not
+printf '%s\n' '{"id":1,"tag":"a"}' '{"id": 2, "tag": "b"}' '[3,   "c"]' \
+    > "$json_file"
+inode=$(stat -c %i "$json_file")
+
+mount_file "$json_file"
+echo -n 7 > @0/id
+echo 1 > .save
+
+check_file $'{"id":7,"tag":"a"}\n{"id": 2, "tag": "b"}\n[3,   "c"]\n' \
+    "a line of the same length is overwritten in place"
+check_inode "$inode"
+
+########## TEST 2 ##########
+
+echo -n '"d"' > @3
+echo 1 > .save
+
+check_file $'{"id":7,"tag":"a"}\n{"id": 2, "tag": "b"}\n[3,   "c"]\n"d"\n' \
+    "a new line is appended"
+check_inode "$inode"
+
+########## TEST 3 ##########
+
+# The second line is dropped, the rest are copied from the old file
+rm -r @1
+echo 1 > .save
+
+check_file $'{"id":7,"tag":"a"}\n[3,   "c"]\n"d"\n' \
+    "the unchanged lines are copied when the file is written anew"
+
+unmount_file
+
+########## TEST 4 ##########
+
+printf '%s\n%s' '{"id":1}' '{"id":2}' > "$json_file"
+inode=$(stat -c %i "$json_file")
+
+mount_file "$json_file"
+echo -n 5 > @1/id
+echo 1 > .save
+
+check_file $'{"id":1}\n{"id":5}' \
+    "the last line without a newline is overwritten in place"
+check_inode "$inode"
+
+echo -n true > @2
+echo 1 > .save
+
+check_file $'{"id":1}\n{"id":5}\ntrue\n' \
+    "a line is appended after the last line without a newline"
+check_inode "$inode"
+
+unmount_file
+
+exit 0
@@ -0,0 +1,96 @@
+#!/bin/bash
+
+# This script is designed for testing jsonfs.
+# Checks that a patch whose last operation fails changes nothing:
+# neither the values nor their user.json.version attributes.
+
+set -e
+
+source "$(dirname $BASH_SOURCE[0])/common.sh"
+
+json_file="$test_dir/patch.json"
+temp_files+=("$json_file")
+
+if [ ! -f "$test_dir/ex_obj.json" ] ; then
+    echo "Error: JSON file not found" >&2
+    exit 1
+fi
+
+# Prints every file and directory with its version and content
+dump_tree() {
+    echo ". $(getfattr --only-values -n user.json.version .)"
+    find . -mindepth 1 -not -name '.*' | sort | while read -r name ; do
+        echo "$name $(getfattr --only-values -n user.json.version "$name")"
+        if [ -f "$name" ] ; then
+            cat "$name"
+            echo
+        fi
+    done
+}
+
+########## Mounting ##########
+
+cp "$test_dir/ex_obj.json" "$json_file"
+mount_file "$json_file"
+
+########## TEST 1 ##########
+
+before="$(dump_tree)"
+
+# Every operation but the last one succeeds on its own
+if echo '[{"op": "replace", "path": "/int", "value": 7},
+          {"op": "add", "path": "/arr/-", "value": "y"},
+          {"op": "remove", "path": "/obj/key"},
+          {"op": "move", "from": "/float", "path": "/obj/float"},
+          {"op": "test", "path": "/bool", "value": false}]' > .patch
+then
+    echo "Error: the failed patch was applied" >&2
+    exit 1
+fi
+
+echo "msg: report of the patch:"
+cat .patch
+echo
+
+if ! grep -q '"applied": *false' .patch ; then
+    echo "Error: the report does not say the patch failed" >&2
+    exit 1
+fi
+
+after="$(dump_tree)"
+
+if [ "$before" != "$after" ] ; then
+    echo "Error: the failed patch changed the tree" >&2
+    diff <(echo "$before") <(echo "$after") >&2 || true
+    exit 1
+fi
+
+if [ "$(head -n 1 .status)" != "SAVED" ] ; then
+    echo "Error: the failed patch made the document unsaved" >&2
+    exit 1
+fi
+
+echo "msg: the tree and the versions are unchanged"
+
+########## TEST 2 ##########
+
+# The same patch without the failing test is applied
+echo '[{"op": "replace", "path": "/int", "value": 7},
+      {"op": "add", "path": "/arr/-", "value": "y"},
+      {"op": "remove", "path": "/obj/key"},
+      {"op": "move", "from": "/float", "path": "/obj/float"}]' > .patch
+
+if [ "$(cat int)" != "7" ] || [ -e obj/key ] || [ ! -e obj/float ] ; then
+    echo "Error: the patch was not applied" >&2
+    exit 1
+fi
+
+if [ "$(getfattr --only-values -n user.json.version .)" \
+     = "$(echo "$before" | head -n 1 | cut -d ' ' -f 2)" ] ; then
+    echo "Error: the version of the root did not change" >&2
+    exit 1
+fi
+
+echo "msg: the patch without the failed operation is applied"
+
+exit 0
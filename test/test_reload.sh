@@ -0,0 +1,78 @@
+#!/bin/bash
+
+# This script is designed for testing jsonfs.
+# Checks that -o reload merges the changes another program makes
+# to the file with the unsaved changes of the mount.
+
+set -e
+
+source "$(dirname $BASH_SOURCE[0])/common.sh"
+
+json_file="$test_dir/reload.json"
+temp_files+=("$json_file" "$json_file.tmp")
+
+########## Mounting ##########
+
+echo '{"a": 1, "b": "x", "c": true, "d": null, "obj": {"k": "v"}}' > "$json_file"
+mount_file "$json_file" -o reload
+
+########## TEST 1 ##########
+
+# Changed only in the mount, in both to the same value, in both differently
+echo -n 100 > a
+echo -n 5 > d
+echo -n '"mine"' > obj/k
+
+# Changed only in the file, in both, and a new key
+echo '{"a": 1, "b": "y", "c": true, "d": 5, "obj": {"k": "theirs"},
+      "e": [1, 2]}' > "$json_file.tmp"
+mv "$json_file.tmp" "$json_file"
+
+# The file is parsed in the background
+for i in $(seq 50) ; do
+    [ "$(cat b)" = '"y"' ] && break
+    sleep 0.1
+done
+
+check_value b '"y"'
+check_value e/@1 2
+check_value a 100
+check_value d 5
+check_value c true
+check_value obj/k '"mine"'
+echo "msg: the changes of the file and of the mount are merged"
+
+########## TEST 2 ##########
+
+echo "msg: .status after the reload:"
+cat .status
+
+if [ "$(sed -n 1p .status)" != "UNSAVED" ] \
+   || [ "$(sed -n 2p .status)" != "reload: conflicts with unsaved changes: 1" ] \
+   || [ "$(sed -n 3p .status)" != "/obj/k" ] \
+   || [ "$(wc -l < .status)" != "3" ] ; then
+    echo "Error: wrong conflicts of the reload" >&2
+    exit 1
+fi
+
+########## TEST 3 ##########
+
+# The saved file has the merged values, the conflict is resolved by the mount
+echo 1 > .save
+
+if [ "$(cat .status)" != "SAVED" ] ; then
+    echo "Error: the conflicts are still reported after saving" >&2
+    exit 1
+fi
+
+for pattern in '"a": *100' '"b": *"y"' '"d": *5' '"k": *"mine"' '"e": *\[' ; do
+    if ! tr -d '\n' < "$json_file" | grep -q "$pattern" ; then
+        echo "Error: the saved file does not match $pattern" >&2
+        cat "$json_file" >&2
+        exit 1
+    fi
+done
+
+echo "msg: the merged document is saved"
+
+exit 0